@@ -0,0 +1,822 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <sched.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/utsname.h>
+#include <netinet/tcp.h>
+
+#include "utilx9.h"
+
+#define TAG "bench_456"
+
+// ns per op of the core primitives, each sample runs batch ops.
+// the result is one bench per line, so -b can read it back without a json library.
+
+#define MAX_OF_BENCH_SAMPLE 10000
+#define LEN_OF_BENCH_PAYLOAD 64
+
+typedef int (*bench_open_fn)(void);
+typedef void (*bench_run_fn)(int batch);
+typedef void (*bench_close_fn)(void);
+
+typedef struct BenchX_Struct
+{
+	const char *name;
+	int batch; // ops per sample
+	bench_open_fn open_cb; // -1: skipped
+	bench_run_fn run_cb;
+	bench_close_fn close_cb;
+
+	int count; // samples
+	double min;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double base_p50; // 0: not in the baseline
+} BenchX_t;
+
+static int bench_warmup = 10;
+static int bench_repetitions = 200;
+static int bench_threshold = 10; // %, p50 over the baseline
+static int bench_port = 18451; // udp, tcp is +1
+static char bench_filter[LEN_OF_NAME64] = "";
+static char bench_outfile[LEN_OF_FULLNAME] = "bench_result.json";
+static char bench_basefile[LEN_OF_FULLNAME] = "";
+
+static volatile unsigned long bench_sink = 0;
+static unsigned char bench_payload[4096];
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ** queuex **
+typedef struct BenchQ_Struct
+{
+	int idx;
+} BenchQ_t;
+
+static QueueX_t *bench_q = NULL;
+static unsigned long bench_q_exec = 0;
+
+static int bench_q_exec_cb(void *arg)
+{
+	__atomic_add_fetch(&bench_q_exec, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int bench_queuex_open(void)
+{
+	bench_q = queuex_thread_init("bench_456", 1024, sizeof(BenchQ_t), bench_q_exec_cb, NULL);
+	if (bench_q == NULL)
+	{
+		return -1;
+	}
+	queuex_debug(bench_q, DBG_LVL_MAX);
+	queuex_isready(bench_q, 5);
+	return 0;
+}
+
+// push -> exec_cb, until the queue is empty
+static void bench_queuex_run(int batch)
+{
+	unsigned long target = __atomic_load_n(&bench_q_exec, __ATOMIC_ACQUIRE) + batch;
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		BenchQ_t data_new = { .idx = idx };
+		queuex_push(bench_q, (void*)&data_new);
+	}
+	while (__atomic_load_n(&bench_q_exec, __ATOMIC_ACQUIRE) < target)
+	{
+		sched_yield();
+	}
+}
+
+static void bench_queuex_close(void)
+{
+	queuex_thread_stop(bench_q);
+	queuex_thread_close(bench_q);
+	bench_q = NULL;
+}
+
+// ** clist **
+typedef struct BenchItem_Struct
+{
+	void *next;
+	int idx;
+} BenchItem_t;
+
+#define MAX_OF_BENCH_ITEM 1024
+static BenchItem_t bench_items[MAX_OF_BENCH_ITEM];
+CLIST(bench_list);
+
+static int bench_clist_open(void)
+{
+	clist_init(bench_list);
+	return 0;
+}
+
+static void bench_clist_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		clist_push(bench_list, &bench_items[idx % MAX_OF_BENCH_ITEM]);
+	}
+	for (idx = 0; idx < batch; idx++)
+	{
+		BenchItem_t *item = (BenchItem_t *)clist_pop(bench_list);
+		bench_sink += (unsigned long)item;
+	}
+}
+
+// ** qbuf **
+static QBUF_t bench_qbuf;
+
+static int bench_qbuf_open(void)
+{
+	qbuf_init(&bench_qbuf, MAX_OF_QBUF_1MB);
+	return 0;
+}
+
+// write 64 bytes, then read them back
+static void bench_qbuf_run(int batch)
+{
+	char obuff[LEN_OF_BENCH_PAYLOAD];
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		qbuf_write(&bench_qbuf, (char *)bench_payload, LEN_OF_BENCH_PAYLOAD);
+	}
+	for (idx = 0; idx < batch; idx++)
+	{
+		bench_sink += qbuf_read(&bench_qbuf, obuff, sizeof(obuff));
+	}
+}
+
+static void bench_qbuf_close(void)
+{
+	qbuf_free(&bench_qbuf);
+}
+
+// ** poolx, 128 objects of 48 ~ 72 bytes are kept, then freed **
+#define MAX_OF_BENCH_ALLOC 128
+
+static void *bench_alloc_ary[MAX_OF_BENCH_ALLOC];
+
+static void bench_poolx_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		bench_alloc_ary[idx % MAX_OF_BENCH_ALLOC] = SAFE_POOLX_CALLOC(1, 48 + (idx & 3) * 8);
+	}
+	for (idx = 0; idx < batch; idx++)
+	{
+		SAFE_POOLX_FREE(bench_alloc_ary[idx % MAX_OF_BENCH_ALLOC]);
+	}
+}
+
+static void bench_calloc_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		bench_alloc_ary[idx % MAX_OF_BENCH_ALLOC] = SAFE_CALLOC(1, 48 + (idx & 3) * 8);
+	}
+	for (idx = 0; idx < batch; idx++)
+	{
+		SAFE_FREE(bench_alloc_ary[idx % MAX_OF_BENCH_ALLOC]);
+	}
+}
+
+// ** crc **
+static void bench_crc16_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		bench_sink += buff_crc16(bench_payload, sizeof(bench_payload), 0);
+	}
+}
+
+static void bench_crc32_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		bench_sink += buff_crc32(bench_payload, sizeof(bench_payload), 0);
+	}
+}
+
+// ** base64 **
+static char *bench_base64_txt = NULL;
+static int bench_base64_len = 0;
+
+static int bench_base64_open(void)
+{
+	bench_base64_txt = sec_base64_enc((char *)bench_payload, 1024, &bench_base64_len);
+	return (bench_base64_txt) ? 0 : -1;
+}
+
+static void bench_base64_enc_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		int enc_len = 0;
+		char *enc = sec_base64_enc((char *)bench_payload, 1024, &enc_len);
+		bench_sink += enc_len;
+		SAFE_FREE(enc);
+	}
+}
+
+static void bench_base64_dec_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		int dec_len = 0;
+		char *dec = sec_base64_dec(bench_base64_txt, bench_base64_len, &dec_len);
+		bench_sink += dec_len;
+		SAFE_FREE(dec);
+	}
+}
+
+static void bench_base64_close(void)
+{
+	SAFE_FREE(bench_base64_txt);
+}
+
+// ** cronx **
+#ifdef UTIL_EX_CRON
+static void bench_cronx_run(int batch)
+{
+	char cron_txt[LEN_OF_VAL64] = "";
+	struct tm kick_tm = { .tm_min = 30, .tm_hour = 9, .tm_mday = 15, .tm_mon = 5, .tm_year = 2024-1900, .tm_wday = 3 };
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		// cronx_validate tokenizes cron_txt
+		SAFE_SPRINTF_EX(cron_txt, "%s", "*/5 8-18 1,15 * 1-5");
+		bench_sink += cronx_validate(cron_txt, &kick_tm);
+	}
+}
+#endif
+
+// ** json **
+#ifdef UTIL_EX_JSON
+static json_t *bench_jroot = NULL;
+
+static int bench_json_open(void)
+{
+	bench_jroot = JSON_LOADS_EASY("{\"system\":{\"network\":{\"lan\":[{\"ip\":\"192.168.0.1\"},{\"ip\":\"192.168.1.1\",\"dns\":{\"primary\":\"8.8.8.8\"}}]}}}");
+	return (bench_jroot) ? 0 : -1;
+}
+
+static void bench_json_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		json_t *jobj = json_object_find_with_keys(bench_jroot, "system/network/lan/1/dns/primary");
+		bench_sink += (unsigned long)jobj;
+	}
+}
+
+static void bench_json_close(void)
+{
+	JSON_FREE(bench_jroot);
+}
+#endif
+
+// ** chainX udp, the server echoes from post_cb **
+static ChainX_t bench_udp_server =
+{
+	.mode = CHAINX_MODE_ID_UDP_SERVER,
+	.sockfd = -1,
+	.status = 0,
+	.isfree = 0,
+
+	.security = 0,
+	.noblock = 1,
+
+	.select_wait = TIMEOUT_OF_SELECT_1,
+};
+static int bench_udp_fd = -1;
+
+static void bench_udp_post_cb(ChainX_t *chainX_req, char *buff, int buff_len)
+{
+	sendto(chainX_fd_get(chainX_req), buff, buff_len, 0, (struct sockaddr*)chainX_addr_from_get(chainX_req), sizeof(struct sockaddr_in));
+}
+
+static int bench_fd_connect(int type, int port)
+{
+	int fd = socket(AF_INET, type, 0);
+	if (fd >= 0)
+	{
+		struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+		struct sockaddr_in addr;
+		SAFE_MEMSET(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		{
+			SAFE_CLOSE(fd);
+		}
+	}
+	return fd;
+}
+
+static int bench_udp_open(void)
+{
+	chainX_ip_set(&bench_udp_server, "127.0.0.1");
+	chainX_port_set(&bench_udp_server, bench_port);
+	chainX_post_register(&bench_udp_server, bench_udp_post_cb);
+	if (chainX_thread_init(&bench_udp_server) != 0)
+	{
+		return -1;
+	}
+
+	bench_udp_fd = bench_fd_connect(SOCK_DGRAM, bench_port);
+	return (bench_udp_fd >= 0) ? 0 : -1;
+}
+
+// round trip of 64 bytes
+static void bench_udp_run(int batch)
+{
+	char rbuff[LEN_OF_BENCH_PAYLOAD];
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		if (send(bench_udp_fd, bench_payload, LEN_OF_BENCH_PAYLOAD, 0) > 0)
+		{
+			bench_sink += recv(bench_udp_fd, rbuff, sizeof(rbuff), 0);
+		}
+	}
+}
+
+static void bench_udp_close(void)
+{
+	SAFE_CLOSE(bench_udp_fd);
+	chainX_thread_stop(&bench_udp_server);
+	chainX_thread_close(&bench_udp_server);
+}
+
+// ** chainX tcp, chainX is the client and reads the echo in pipe_cb **
+static ChainX_t bench_tcp_client =
+{
+	.mode = CHAINX_MODE_ID_TCP_CLIENT,
+	.sockfd = -1,
+	.status = 0,
+	.isfree = 0,
+
+	.security = 0,
+	.noblock = 1,
+
+	.retry_hold = TIMEOUT_OF_RETRY_HOLD,
+	.select_wait = TIMEOUT_OF_SELECT_1,
+};
+static ThreadX_t bench_tcp_tidx;
+static int bench_tcp_listen_fd = -1;
+static unsigned long bench_tcp_rx = 0;
+
+static void bench_tcp_pipe_cb(ChainX_t *chainX_req, char *buff, int buff_len)
+{
+	__atomic_add_fetch(&bench_tcp_rx, buff_len, __ATOMIC_RELEASE);
+}
+
+static void *bench_tcp_echo_handler(void *user)
+{
+	ThreadX_t *tidx_req = (ThreadX_t*)user;
+
+	threadx_detach(tidx_req);
+
+	int fd = accept(bench_tcp_listen_fd, NULL, NULL);
+	if (fd >= 0)
+	{
+		struct timeval tv = { .tv_sec = 0, .tv_usec = 200*1000 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		int flag = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+		char buff[LEN_OF_BUF1024];
+		while (threadx_isquit(tidx_req) == 0)
+		{
+			int nread = read(fd, buff, sizeof(buff));
+			if (nread > 0)
+			{
+				bench_sink += write(fd, buff, nread);
+			}
+			else if ((nread == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+			{
+				break;
+			}
+		}
+		SAFE_CLOSE(fd);
+	}
+
+	threadx_leave(tidx_req);
+	return NULL;
+}
+
+static int bench_tcp_open(void)
+{
+	bench_tcp_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (bench_tcp_listen_fd < 0)
+	{
+		return -1;
+	}
+
+	int flag = 1;
+	setsockopt(bench_tcp_listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+	struct sockaddr_in addr;
+	SAFE_MEMSET(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(bench_port + 1);
+	if ((bind(bench_tcp_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(bench_tcp_listen_fd, 1) != 0))
+	{
+		DBG_ER_LN("bind/listen error !!! (port: %d, errno: %d %s)", bench_port + 1, errno, strerror(errno));
+		SAFE_CLOSE(bench_tcp_listen_fd);
+		return -1;
+	}
+
+	bench_tcp_tidx.thread_cb = bench_tcp_echo_handler;
+	bench_tcp_tidx.data = &bench_tcp_tidx;
+	if (threadx_init(&bench_tcp_tidx, "bench_456 - echo") != 0)
+	{
+		SAFE_CLOSE(bench_tcp_listen_fd);
+		return -1;
+	}
+
+	chainX_ip_set(&bench_tcp_client, "127.0.0.1");
+	chainX_port_set(&bench_tcp_client, bench_port + 1);
+	chainX_pipe_register(&bench_tcp_client, bench_tcp_pipe_cb);
+	if (chainX_thread_init(&bench_tcp_client) != 0)
+	{
+		return -1;
+	}
+
+	int retry = 50;
+	while ((chainX_linked_check(&bench_tcp_client) != 0) && (retry-- > 0))
+	{
+		usleep(100*1000);
+	}
+	return (chainX_linked_check(&bench_tcp_client) == 0) ? 0 : -1;
+}
+
+// round trip of 64 bytes
+static void bench_tcp_run(int batch)
+{
+	int idx = 0;
+	for (idx = 0; idx < batch; idx++)
+	{
+		unsigned long target = __atomic_load_n(&bench_tcp_rx, __ATOMIC_ACQUIRE) + LEN_OF_BENCH_PAYLOAD;
+		if (SOCKETX_WRITE(&bench_tcp_client, bench_payload, LEN_OF_BENCH_PAYLOAD) > 0)
+		{
+			double t_end = bench_now() + 1e9;
+			while ((__atomic_load_n(&bench_tcp_rx, __ATOMIC_ACQUIRE) < target) && (bench_now() < t_end))
+			{
+				sched_yield();
+			}
+		}
+	}
+}
+
+static void bench_tcp_close(void)
+{
+	chainX_thread_stop(&bench_tcp_client);
+	chainX_thread_close(&bench_tcp_client);
+	if (bench_tcp_listen_fd >= 0)
+	{
+		// wakes up accept
+		shutdown(bench_tcp_listen_fd, SHUT_RDWR);
+	}
+	threadx_close(&bench_tcp_tidx);
+	SAFE_CLOSE(bench_tcp_listen_fd);
+}
+
+static BenchX_t bench_ary[] =
+{
+	{ .name = "queuex_push_exec", .batch = 256, .open_cb = bench_queuex_open, .run_cb = bench_queuex_run, .close_cb = bench_queuex_close },
+	{ .name = "clist_push_pop", .batch = 1024, .open_cb = bench_clist_open, .run_cb = bench_clist_run },
+	{ .name = "qbuf_write_read_64", .batch = 256, .open_cb = bench_qbuf_open, .run_cb = bench_qbuf_run, .close_cb = bench_qbuf_close },
+	{ .name = "poolx_calloc_free_64", .batch = MAX_OF_BENCH_ALLOC, .run_cb = bench_poolx_run },
+	{ .name = "calloc_free_64", .batch = MAX_OF_BENCH_ALLOC, .run_cb = bench_calloc_run },
+	{ .name = "crc16_4k", .batch = 16, .run_cb = bench_crc16_run },
+	{ .name = "crc32_4k", .batch = 16, .run_cb = bench_crc32_run },
+	{ .name = "base64_enc_1k", .batch = 64, .open_cb = bench_base64_open, .run_cb = bench_base64_enc_run, .close_cb = bench_base64_close },
+	{ .name = "base64_dec_1k", .batch = 64, .open_cb = bench_base64_open, .run_cb = bench_base64_dec_run, .close_cb = bench_base64_close },
+#ifdef UTIL_EX_CRON
+	{ .name = "cronx_validate", .batch = 256, .run_cb = bench_cronx_run },
+#endif
+#ifdef UTIL_EX_JSON
+	{ .name = "json_object_find_with_keys", .batch = 256, .open_cb = bench_json_open, .run_cb = bench_json_run, .close_cb = bench_json_close },
+#endif
+	{ .name = "chainx_udp_rtt_64", .batch = 1, .open_cb = bench_udp_open, .run_cb = bench_udp_run, .close_cb = bench_udp_close },
+	{ .name = "chainx_tcp_rtt_64", .batch = 1, .open_cb = bench_tcp_open, .run_cb = bench_tcp_run, .close_cb = bench_tcp_close },
+	{ .name = NULL },
+};
+
+static int bench_double_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// nearest rank
+static double bench_percentile(double *sample_ary, int count, int pct)
+{
+	int rank = (count * pct + 99) / 100;
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	return sample_ary[rank - 1];
+}
+
+static void bench_run(BenchX_t *bench)
+{
+	static double sample_ary[MAX_OF_BENCH_SAMPLE];
+
+	if ((bench->open_cb) && (bench->open_cb() != 0))
+	{
+		DBG_ER_LN("open error, skipped !!! (name: %s)", bench->name);
+		if (bench->close_cb)
+		{
+			bench->close_cb();
+		}
+		return;
+	}
+
+	int idx = 0;
+	for (idx = 0; idx < bench_warmup; idx++)
+	{
+		bench->run_cb(bench->batch);
+	}
+
+	double sum = 0;
+	for (idx = 0; idx < bench_repetitions; idx++)
+	{
+		double t_start = bench_now();
+		bench->run_cb(bench->batch);
+		sample_ary[idx] = (bench_now() - t_start) / bench->batch;
+		sum += sample_ary[idx];
+	}
+
+	if (bench->close_cb)
+	{
+		bench->close_cb();
+	}
+
+	qsort(sample_ary, bench_repetitions, sizeof(double), bench_double_cmp);
+	bench->count = bench_repetitions;
+	bench->min = sample_ary[0];
+	bench->mean = sum / bench_repetitions;
+	bench->p50 = bench_percentile(sample_ary, bench_repetitions, 50);
+	bench->p90 = bench_percentile(sample_ary, bench_repetitions, 90);
+	bench->p99 = bench_percentile(sample_ary, bench_repetitions, 99);
+}
+
+// the lines written by bench_save: {"name":"xxx",...,"p50_ns":123.4,...}
+static void bench_baseline_load(char *filename)
+{
+	FILE *fp = SAFE_FOPEN(filename, "r");
+	if (fp == NULL)
+	{
+		DBG_ER_LN("SAFE_FOPEN error !!! (filename: %s)", filename);
+		return;
+	}
+
+	char line[LEN_OF_BUF1024];
+	while (fgets(line, sizeof(line), fp))
+	{
+		char name[LEN_OF_NAME64] = "";
+		char *name_ptr = strstr(line, "\"name\":\"");
+		char *p50_ptr = strstr(line, "\"p50_ns\":");
+		if ((name_ptr) && (p50_ptr) && (sscanf(name_ptr, "\"name\":\"%63[^\"]\"", name) == 1))
+		{
+			BenchX_t *bench = NULL;
+			for (bench = bench_ary; bench->name; bench++)
+			{
+				if (SAFE_STRCMP((char *)bench->name, name) == 0)
+				{
+					bench->base_p50 = strtod(p50_ptr + strlen("\"p50_ns\":"), NULL);
+				}
+			}
+		}
+	}
+	SAFE_FCLOSE(fp);
+}
+
+static void bench_save(char *filename)
+{
+	FILE *fp = SAFE_FOPEN(filename, "w");
+	if (fp == NULL)
+	{
+		DBG_ER_LN("SAFE_FOPEN error !!! (filename: %s)", filename);
+		return;
+	}
+
+	struct utsname uts;
+	SAFE_MEMSET(&uts, 0, sizeof(uts));
+	uname(&uts);
+
+	fprintf(fp, "{\"host\":\"%s %s\",\"warmup\":%d,\"repetitions\":%d,\"benches\":[\n", uts.machine, uts.release, bench_warmup, bench_repetitions);
+	int isfirst = 1;
+	BenchX_t *bench = NULL;
+	for (bench = bench_ary; bench->name; bench++)
+	{
+		if (bench->count == 0)
+		{
+			continue;
+		}
+		fprintf(fp, "%s{\"name\":\"%s\",\"batch\":%d,\"min_ns\":%.1f,\"mean_ns\":%.1f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f}",
+			(isfirst) ? "" : ",\n", bench->name, bench->batch, bench->min, bench->mean, bench->p50, bench->p90, bench->p99);
+		isfirst = 0;
+	}
+	fprintf(fp, "\n]}\n");
+	SAFE_FCLOSE(fp);
+}
+
+// return the number of regressions
+static int bench_report(void)
+{
+	int regression = 0;
+
+	printf("%-28s %8s %12s %12s %12s %12s %12s %10s\n", "name", "batch", "min_ns", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "vs base");
+	BenchX_t *bench = NULL;
+	for (bench = bench_ary; bench->name; bench++)
+	{
+		if (bench->count == 0)
+		{
+			continue;
+		}
+
+		char diff[LEN_OF_NAME32] = "-";
+		const char *flag = "";
+		if (bench->base_p50 > 0)
+		{
+			double pct = (bench->p50 - bench->base_p50) * 100 / bench->base_p50;
+			SAFE_SPRINTF_EX(diff, "%+.1f%%", pct);
+			if (pct > bench_threshold)
+			{
+				flag = " REGRESSION";
+				regression++;
+			}
+		}
+		printf("%-28s %8d %12.1f %12.1f %12.1f %12.1f %12.1f %10s%s\n", bench->name, bench->batch, bench->min, bench->mean, bench->p50, bench->p90, bench->p99, diff, flag);
+	}
+
+	return regression;
+}
+
+int option_index = 0;
+const char* short_options = "w:r:f:o:b:t:p:h";
+static struct option long_options[] =
+{
+	{ "warmup",      required_argument,   NULL,    'w'  },
+	{ "repetitions", required_argument,   NULL,    'r'  },
+	{ "filter",      required_argument,   NULL,    'f'  },
+	{ "output",      required_argument,   NULL,    'o'  },
+	{ "baseline",    required_argument,   NULL,    'b'  },
+	{ "threshold",   required_argument,   NULL,    't'  },
+	{ "port",        required_argument,   NULL,    'p'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s\n"
+		"  -w, --warmup      samples dropped before measuring (default: %d)\n"
+		"  -r, --repetitions samples measured (default: %d, max: %d)\n"
+		"  -f, --filter      only the benches whose name contains it\n"
+		"  -o, --output      json result (default: %s)\n"
+		"  -b, --baseline    json result to compare with, exit 1 on regression\n"
+		"  -t, --threshold   p50 over the baseline in %%, a regression (default: %d)\n"
+		"  -p, --port        udp port of the loopback, tcp is port+1 (default: %d)\n"
+		"  -h, --help\n", TAG, bench_warmup, bench_repetitions, MAX_OF_BENCH_SAMPLE, bench_outfile, bench_threshold, bench_port);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -r 500 -b bench_baseline.json\n", TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'w':
+				if (optarg)
+				{
+					bench_warmup = atoi(optarg);
+				}
+				break;
+			case 'r':
+				if (optarg)
+				{
+					bench_repetitions = SAFE_MIN(SAFE_MAX(atoi(optarg), 1), MAX_OF_BENCH_SAMPLE);
+				}
+				break;
+			case 'f':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(bench_filter, "%s", optarg);
+				}
+				break;
+			case 'o':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(bench_outfile, "%s", optarg);
+				}
+				break;
+			case 'b':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(bench_basefile, "%s", optarg);
+				}
+				break;
+			case 't':
+				if (optarg)
+				{
+					bench_threshold = atoi(optarg);
+				}
+				break;
+			case 'p':
+				if (optarg)
+				{
+					bench_port = atoi(optarg);
+				}
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	app_ParseArguments(argc, argv);
+	signal(SIGPIPE, SIG_IGN);
+	dbg_lvl_set(DBG_LVL_WARN);
+
+	int idx = 0;
+	for (idx = 0; idx < (int)sizeof(bench_payload); idx++)
+	{
+		bench_payload[idx] = (unsigned char)(idx * 31 + 7);
+	}
+
+	BenchX_t *bench = NULL;
+	for (bench = bench_ary; bench->name; bench++)
+	{
+		if ((bench_filter[0] == 0) || (strstr(bench->name, bench_filter)))
+		{
+			bench_run(bench);
+		}
+	}
+
+	if (bench_basefile[0])
+	{
+		bench_baseline_load(bench_basefile);
+	}
+	bench_save(bench_outfile);
+
+	int regression = bench_report();
+	if (regression > 0)
+	{
+		DBG_ER_LN("%d regression(s) over %d%% !!! (baseline: %s)", regression, bench_threshold, bench_basefile);
+		exit(1);
+	}
+
+	exit(0);
+}
@@ -21,6 +21,7 @@
 #include <netinet/tcp.h> //TCP_NODELAY
 #include <arpa/inet.h> //inet_pton
 
+#define DBG_MOD DBG_MOD_ID_CHAINX
 #include "utilx9.h"
 
 #ifdef UTIL_EX_TTY
@@ -2178,7 +2179,8 @@ static int chainX_udp_bind(ChainX_t *chainX_req, int multi)
 	return ret;
 }
 
-static int chainX_tcp_connect(ChainX_t *chainX_req)
+// iswait: 0, returns while the connection is in progress, see chainX_connect_check
+static int chainX_tcp_connect(ChainX_t *chainX_req, int iswait)
 {
 	int ret = -1;
 
@@ -2227,6 +2229,11 @@ static int chainX_tcp_connect(ChainX_t *chainX_req)
 				// wait for SSL_connect
 				ret = 0;
 			}
+			else if (iswait == 0)
+			{
+				// the caller waits for the socket writable
+				ret = 0;
+			}
 			else
 			{
 				int sel = chainX_socket_select(chainX_req, TIMEOUT_OF_SOCKET, 0);
@@ -2638,7 +2645,7 @@ static int chainX_init(ChainX_t *chainX_req)
 			if (0 == chainX_netinfo_scan(chainX_req))
 			{
 				chainX_req->sockfd = chainX_tcp_socket();
-				ret = chainX_tcp_connect(chainX_req);
+				ret = chainX_tcp_connect(chainX_req, 1);
 			}
 		}
 		break;
@@ -2757,10 +2764,11 @@ static void chainX_loop_serial(ChainX_t *chainX_req)
 				size_t read_pos = 0;
 				int read_len = 0;
 				size_t left_len = nread;
-				char *buff = SAFE_CALLOC(1, nread+1);
+				char *buff = SAFE_POOLX_CALLOC(1, nread+1);
 				if (buff)
 				{
 					char *buff_cur = buff;
+					TRACEX_SPAN("chainx", "chainx_serial");
 
 					while ((buff_cur) && (left_len>0) && ((read_len=SOCKETX_READ(chainX_req, buff_cur, left_len)) > 0))
 					{
@@ -2774,12 +2782,14 @@ static void chainX_loop_serial(ChainX_t *chainX_req)
 						buff_cur += read_len;
 					}
 
+					TRACEX_SPAN_ARG(read_pos);
+
 					if ((chainX_req->serial_cb) && (read_pos>0))
 					{
 						//DBG_DB_LN("(buff %d/%d: %s)", read_pos, nread, buff);
 						chainX_req->serial_cb(chainX_req, buff, read_pos);
 					}
-					SAFE_FREE(buff);
+					SAFE_POOLX_FREE(buff);
 				}
 			}
 		}
@@ -2863,10 +2873,11 @@ static void chainX_loop_post(ChainX_t *chainX_req)
 				size_t read_pos = 0;
 				int read_len = 0;
 				size_t left_len = nread;
-				char *buff = SAFE_CALLOC(1, nread+1);
+				char *buff = SAFE_POOLX_CALLOC(1, nread+1);
 				if (buff)
 				{
 					char *buff_cur = buff;
+					TRACEX_SPAN("chainx", "chainx_post");
 
 					while ((buff_cur) && (left_len>0) && ((read_len=SOCKETX_RECV_FROM(chainX_req, buff_cur, left_len)) > 0))
 					{
@@ -2881,12 +2892,14 @@ static void chainX_loop_post(ChainX_t *chainX_req)
 						buff_cur += read_len;
 					}
 
+					TRACEX_SPAN_ARG(read_pos);
+
 					if ((chainX_req->post_cb) && (read_pos>0))
 					{
 						//DBG_DB_LN("(buff %d/%d: %s)", read_pos, nread, buff);
 						chainX_req->post_cb(chainX_req, buff, read_pos);
 					}
-					SAFE_FREE(buff);
+					SAFE_POOLX_FREE(buff);
 				}
 			}
 		}
@@ -3001,6 +3014,7 @@ static void chainX_loop_pipe(ChainX_t *chainX_req)
 							if (buff)
 							{
 								char *buff_cur = buff;
+								TRACEX_SPAN("chainx", "chainx_pipe");
 
 								while ((buff_cur) && (left_len>0) && ((read_len=SOCKETX_READ(chainX_req, buff_cur, left_len)) > 0))
 								{
@@ -3021,9 +3035,12 @@ static void chainX_loop_pipe(ChainX_t *chainX_req)
 										left_len += LEN_OF_SSL_BUFFER;
 									}
 
-									buff_cur += read_len;
+									// buff might be moved by SAFE_REALLOC
+									buff_cur = buff + read_pos;
 								}
 
+								TRACEX_SPAN_ARG(read_pos);
+
 								if ((chainX_req->pipe_cb) && (read_pos>0))
 								{
 									//DBG_DB_LN("(buff %d/%d: %s)", read_pos, nread, buff);
@@ -3481,6 +3498,48 @@ tty_exit:
 }
 #endif
 
+#ifdef UTIL_EX_METRICX
+typedef enum
+{
+	CHAINX_METRIC_ID_RX_BYTES = 0,
+	CHAINX_METRIC_ID_RX_PACKETS,
+	CHAINX_METRIC_ID_TX_BYTES,
+	CHAINX_METRIC_ID_TX_PACKETS,
+	CHAINX_METRIC_ID_MAX,
+} CHAINX_METRIC_ID;
+
+static MetricX_t *chainX_metric_ary[CHAINX_METRIC_ID_MAX];
+static pthread_once_t chainX_metric_once = PTHREAD_ONCE_INIT;
+
+static void chainX_metric_open(void)
+{
+	chainX_metric_ary[CHAINX_METRIC_ID_RX_BYTES] = metricx_counter_new("chainx_bytes_total", "bytes through SOCKETX_*", "dir=\"rx\"");
+	chainX_metric_ary[CHAINX_METRIC_ID_TX_BYTES] = metricx_counter_new("chainx_bytes_total", "bytes through SOCKETX_*", "dir=\"tx\"");
+	chainX_metric_ary[CHAINX_METRIC_ID_RX_PACKETS] = metricx_counter_new("chainx_packets_total", "successful calls of SOCKETX_*", "dir=\"rx\"");
+	chainX_metric_ary[CHAINX_METRIC_ID_TX_PACKETS] = metricx_counter_new("chainx_packets_total", "successful calls of SOCKETX_*", "dir=\"tx\"");
+}
+
+void chainX_metric_rx(int len)
+{
+	if (len > 0)
+	{
+		pthread_once(&chainX_metric_once, chainX_metric_open);
+		metricx_counter_add(chainX_metric_ary[CHAINX_METRIC_ID_RX_BYTES], len);
+		metricx_counter_add(chainX_metric_ary[CHAINX_METRIC_ID_RX_PACKETS], 1);
+	}
+}
+
+void chainX_metric_tx(int len)
+{
+	if (len > 0)
+	{
+		pthread_once(&chainX_metric_once, chainX_metric_open);
+		metricx_counter_add(chainX_metric_ary[CHAINX_METRIC_ID_TX_BYTES], len);
+		metricx_counter_add(chainX_metric_ary[CHAINX_METRIC_ID_TX_PACKETS], 1);
+	}
+}
+#endif
+
 void chainX_thread_stop(ChainX_t *chainX_req)
 {
 	if (chainX_req)
@@ -3500,6 +3559,53 @@ void chainX_thread_close(ChainX_t *chainX_req)
 	DBG_TR_LN("exit (mode: %d)", chainX_req->mode);
 }
 
+// after chainX_open, when the socket of a tcp client is writable, return 0 if connected
+int chainX_connect_check(ChainX_t *chainX_req)
+{
+	int ret = -1;
+
+	if ((chainX_req) && (chainX_fd_get(chainX_req) >= 0))
+	{
+		if (chainX_socket_error(chainX_req) == 0)
+		{
+			chainX_status_set(chainX_req, 1);
+			ret = 0;
+		}
+	}
+	return ret;
+}
+
+// to open the socket without the thread, the caller polls chainX_fd_get and calls chainX_close
+// the caller has to threadx_mutex_init(&chainX_req->tidx) once
+// a tcp client doesn't wait for the connection (chainX_linked_check is -1 until chainX_connect_check) and the ip has to be set, there is no nslookup
+int chainX_open(ChainX_t *chainX_req)
+{
+	if (chainX_req==NULL)
+	{
+		DBG_ER_LN("chainX_req is NULL !!!");
+		return -1;
+	}
+
+	if (chainX_check(chainX_req) == -1)
+	{
+		DBG_ER_LN("chainX_check error !!! (chainX_req->mode: %d)", chainX_req->mode);
+		return -1;
+	}
+
+	if (chainX_req->mode == CHAINX_MODE_ID_TCP_CLIENT)
+	{
+		if (strlen(chainX_req->netinfo.addr.ipv4) == 0)
+		{
+			DBG_ER_LN("no ip !!! (hostname: %s)", chainX_req->netinfo.addr.hostname);
+			return -1;
+		}
+		chainX_req->sockfd = chainX_tcp_socket();
+		return chainX_tcp_connect(chainX_req, 0);
+	}
+
+	return chainX_init(chainX_req);
+}
+
 int chainX_thread_init(ChainX_t *chainX_req)
 {
 	if (chainX_req==NULL)
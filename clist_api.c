@@ -420,7 +420,7 @@ void clist_free_ex(clist_t list, clist_item_free_fn free_cb)
 			{
 				free_cb(item);
 			}
-			free(item);
+			SAFE_FREE(item);
 		}
 	}
 }
@@ -432,7 +432,7 @@ void clist_free(clist_t list)
 		void *item = clist_pop(list);
 		if (item)
 		{
-			free(item);
+			SAFE_FREE(item);
 		}
 	}
 }
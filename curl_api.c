@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_CURL
 #include "utilx9.h"
 
 #include <sys/stat.h> // for fstat
@@ -71,6 +72,97 @@ static size_t dummy_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
 }
 #endif
 
+// response[res_size] is always '\0'
+static size_t http_sink_buffer(HttpX_t *http_req, size_t *res_size, char **response, char *ptr, size_t bytec)
+{
+	HttpSink_t *sink = &http_req->sink;
+	size_t need = *res_size + bytec + 1;
+
+	if ((*response == NULL) && (http_req->curl))
+	{
+		// the headers are done before the first chunk
+		CURL_OFF_X clength = -1;
+		curl_easy_getinfo(http_req->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_X, &clength);
+		if (clength > MAX_OF_HTTP_PRESIZE)
+		{
+			clength = MAX_OF_HTTP_PRESIZE;
+		}
+		if ((clength > 0) && ((size_t)clength + 1 > need))
+		{
+			need = (size_t)clength + 1;
+		}
+		sink->res_max = 0;
+	}
+
+	if (need > sink->res_max)
+	{
+		size_t new_max = (sink->res_max > LEN_OF_BUF4096/2) ? sink->res_max * 2 : LEN_OF_BUF4096;
+		if (new_max < need)
+		{
+			new_max = need;
+		}
+
+		char *new_buff = SAFE_REALLOC(*response, new_max);
+		if (new_buff == NULL)
+		{
+			DBG_ER_LN("SAFE_REALLOC error !!! (res_size: %zd -> %zd)", sink->res_max, new_max);
+			return 0;
+		}
+		*response = new_buff;
+		sink->res_max = new_max;
+	}
+
+	SAFE_MEMCPY(*response + *res_size, ptr, bytec, sink->res_max - *res_size);
+	*res_size += bytec;
+	(*response)[*res_size] = 0;
+	return bytec;
+}
+
+static size_t http_sink_write(HttpX_t *http_req, size_t *res_size, char **response, char *ptr, size_t bytec)
+{
+	HttpSink_t *sink = &http_req->sink;
+	size_t ret = 0;
+
+	switch (sink->sink_id)
+	{
+		case HTTP_SINK_ID_FD:
+			{
+				size_t pos = 0;
+				while (pos < bytec)
+				{
+					ssize_t len = SAFE_WRITE(sink->fd, ptr + pos, bytec - pos);
+					if (len <= 0)
+					{
+						DBG_ER_LN("SAFE_WRITE error !!! (fd: %d, errno: %d %s)", sink->fd, errno, strerror(errno));
+						break;
+					}
+					pos += len;
+				}
+				ret = pos;
+			}
+			break;
+		case HTTP_SINK_ID_STREAM:
+			if (sink->sink_cb)
+			{
+				ret = sink->sink_cb(http_req, ptr, bytec, sink->sink_data);
+			}
+			else
+			{
+				ret = bytec;
+			}
+			break;
+		case HTTP_SINK_ID_BUFFER:
+		default:
+			return http_sink_buffer(http_req, res_size, response, ptr, bytec);
+	}
+
+	if (ret == bytec)
+	{
+		*res_size += bytec;
+	}
+	return ret;
+}
+
 static size_t simple_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
 {
 	// my side <- server
@@ -78,19 +170,7 @@ static size_t simple_body_cb(char *ptr, size_t size, size_t nmemb, void *context
 	HttpX_t *http_req = (HttpX_t *)context;
 	SimpleRequest_t *simple_req = (SimpleRequest_t *)&http_req->simple_req;
 
-	size_t new_len = simple_req->res_size + bytec + 1;
-	char *new_buff = SAFE_REALLOC(simple_req->response, new_len);
-	if (new_buff == NULL)
-	{
-		DBG_ER_LN("SAFE_REALLOC error !!! (res_size: %zd -> %zd)", simple_req->res_size, new_len);
-		return 0;
-	}
-
-	simple_req->response = new_buff;
-	SAFE_MEMCPY(&(simple_req->response[simple_req->res_size]), ptr, bytec, new_len - simple_req->res_size);
-	simple_req->res_size += bytec;
-	simple_req->response[simple_req->res_size] = 0;
-	return bytec;
+	return http_sink_write(http_req, &simple_req->res_size, &simple_req->response, ptr, bytec);
 }
 
 static size_t soap_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
@@ -100,19 +180,7 @@ static size_t soap_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
 	HttpX_t *http_req = (HttpX_t *)context;
 	SoapRequest_t *soap_req = (SoapRequest_t *)&http_req->soap_req;
 
-	size_t new_len = soap_req->res_size + bytec + 1;
-	char *new_buff = SAFE_REALLOC(soap_req->response, new_len);
-	if (new_buff == NULL)
-	{
-		DBG_ER_LN("SAFE_REALLOC error !!! (size: %zd -> %zd)", soap_req->res_size, new_len);
-		return 0;
-	}
-
-	soap_req->response = new_buff;
-	SAFE_MEMCPY(&(soap_req->response[soap_req->res_size]), ptr, bytec, new_len - soap_req->res_size);
-	soap_req->res_size += bytec;
-	soap_req->response[soap_req->res_size] = 0;
-	return bytec;
+	return http_sink_write(http_req, &soap_req->res_size, &soap_req->response, ptr, bytec);
 }
 
 static size_t uploadfile_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
@@ -122,19 +190,119 @@ static size_t uploadfile_body_cb(char *ptr, size_t size, size_t nmemb, void *con
 	HttpX_t *http_req = (HttpX_t *)context;
 	FileRequest_t *file_req = (FileRequest_t *)&http_req->file_req;
 
-	size_t new_len = file_req->res_size + bytec + 1;
-	char *new_buff = SAFE_REALLOC(file_req->response, new_len);
-	if (new_buff == NULL)
+	return http_sink_write(http_req, &file_req->res_size, &file_req->response, ptr, bytec);
+}
+
+static CURL *http_curl_open(HttpX_t *http_req)
+{
+	CURL *curl = NULL;
+	if (http_req->pool)
+	{
+		curl = http_pool_get(http_req->pool);
+	}
+	else
 	{
-		DBG_ER_LN("SAFE_REALLOC error !!! (size: %zd -> %zd)", file_req->res_size, new_len);
-		return 0;
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+		curl = curl_easy_init();
 	}
+	http_req->curl = curl;
+	return curl;
+}
 
-	file_req->response = new_buff;
-	SAFE_MEMCPY(&(file_req->response[file_req->res_size]), ptr, bytec, new_len - file_req->res_size);
-	file_req->res_size += bytec;
-	file_req->response[file_req->res_size] = 0;
-	return bytec;
+static void http_curl_close(HttpX_t *http_req, CURL *curl)
+{
+	http_req->curl = NULL;
+	if (http_req->pool)
+	{
+		http_pool_put(http_req->pool, curl);
+	}
+	else
+	{
+		curl_easy_cleanup(curl);
+		curl_global_cleanup();
+	}
+}
+
+static void http_request_simple_setopt(HttpX_t *http_req, CURL *curl)
+{
+	SimpleRequest_t *simple_req = (SimpleRequest_t *)&http_req->simple_req;
+
+	{
+		curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
+		if (http_req->port!=0)
+		{
+			curl_easy_setopt(curl, CURLOPT_PORT, http_req->port);
+		}
+	}
+	{
+		// ** Auth **
+		if (SAFE_STRNCMP(http_req->url, "https", strlen("https")) == 0)
+		{
+			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+			//curl_easy_setopt(curl, CURLOPT_SSLVERSION, 3);
+			curl_easy_setopt(curl, CURLOPT_CAINFO, PJ_INSTALL_IOT "/cert/curl/cacert.pem");
+		}
+		if ((http_req->user) && (http_req->password))
+		{
+			curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
+			curl_easy_setopt(curl, CURLOPT_USERNAME, http_req->user);
+			curl_easy_setopt(curl, CURLOPT_PASSWORD, http_req->password);
+		}
+	}
+
+	{
+		// ** Debug & Timeout **
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, MAX_OF_CURL_CONNECTTIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, MAX_OF_CURL_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, VAL_OF_CURLOPT_VERBOSE);
+		// ** redirected **
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	}
+
+	{
+		// ** Header **
+		if (simple_req->headers)
+		{
+			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, simple_req->headers);
+		}
+	}
+
+	{
+		// ** Body **
+		if (simple_req->request)
+		{
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, simple_req->request);
+		}
+		switch (simple_req->method)
+		{
+			case HTTP_METHOD_ID_POST:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
+				break;
+			case HTTP_METHOD_ID_GET:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
+				break;
+			case HTTP_METHOD_ID_PUT:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+				break;
+			case HTTP_METHOD_ID_DELETE:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+				break;
+			case HTTP_METHOD_ID_PATCH:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
+				break;
+			case HTTP_METHOD_ID_OPTIONS:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "OPTIONS");
+				break;
+			case HTTP_METHOD_ID_HEAD:
+				curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "HEAD");
+				break;
+			default:
+				break;
+		}
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, simple_body_cb);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)http_req);
+	}
 }
 
 static int http_request_simple(HttpX_t *http_req)
@@ -148,86 +316,9 @@ static int http_request_simple(HttpX_t *http_req)
 	if (strlen(http_req->url) > 0)
 	{
 		{
-			curl_global_init(CURL_GLOBAL_DEFAULT);
-			CURL *curl = curl_easy_init();
-			http_req->curl = curl;
+			CURL *curl = http_curl_open(http_req);
 			CURLcode curl_res;
-			{
-				curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
-				if (http_req->port!=0)
-				{
-					curl_easy_setopt(curl, CURLOPT_PORT, http_req->port);
-				}
-			}
-			{
-				// ** Auth **
-				if (SAFE_STRNCMP(http_req->url, "https", strlen("https")) == 0)
-				{
-					curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-					curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-					//curl_easy_setopt(curl, CURLOPT_SSLVERSION, 3);
-					curl_easy_setopt(curl, CURLOPT_CAINFO, PJ_INSTALL_IOT "/cert/curl/cacert.pem");
-				}
-				if ((http_req->user) && (http_req->password))
-				{
-					curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
-					curl_easy_setopt(curl, CURLOPT_USERNAME, http_req->user);
-					curl_easy_setopt(curl, CURLOPT_PASSWORD, http_req->password);
-				}
-			}
-
-			{
-				// ** Debug & Timeout **
-				curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, MAX_OF_CURL_CONNECTTIMEOUT);
-				curl_easy_setopt(curl, CURLOPT_TIMEOUT, MAX_OF_CURL_TIMEOUT);
-				curl_easy_setopt(curl, CURLOPT_VERBOSE, VAL_OF_CURLOPT_VERBOSE);
-				// ** redirected **
-				curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-			}
-
-			{
-				// ** Header **
-				if (simple_req->headers)
-				{
-					curl_easy_setopt(curl, CURLOPT_HTTPHEADER, simple_req->headers);
-				}
-			}
-
-			{
-				// ** Body **
-				if (simple_req->request)
-				{
-					curl_easy_setopt(curl, CURLOPT_POSTFIELDS, simple_req->request);
-				}
-				switch (simple_req->method)
-				{
-					case HTTP_METHOD_ID_POST:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-						break;
-					case HTTP_METHOD_ID_GET:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-						break;
-					case HTTP_METHOD_ID_PUT:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-						break;
-					case HTTP_METHOD_ID_DELETE:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-						break;
-					case HTTP_METHOD_ID_PATCH:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
-						break;
-					case HTTP_METHOD_ID_OPTIONS:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "OPTIONS");
-						break;
-					case HTTP_METHOD_ID_HEAD:
-						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "HEAD");
-						break;
-					default:
-						break;
-				}
-				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, simple_body_cb);
-				curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)http_req);
-			}
+			http_request_simple_setopt(http_req, curl);
 
 			curl_res = curl_easy_perform(curl);
 			/* Check for errors */
@@ -241,9 +332,7 @@ static int http_request_simple(HttpX_t *http_req)
 				ret = 0;
 			}
 			/* always cleanup */
-			http_req->curl = NULL;
-			curl_easy_cleanup(curl);
-			curl_global_cleanup();
+			http_curl_close(http_req, curl);
 		}
 	}
 	else
@@ -254,6 +343,59 @@ static int http_request_simple(HttpX_t *http_req)
 	return ret;
 }
 
+static void http_request_soap_setopt(HttpX_t *http_req, CURL *curl)
+{
+	SoapRequest_t *soap_req = (SoapRequest_t *)&http_req->soap_req;
+
+	{
+		curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
+		if (http_req->port!=0)
+		{
+			curl_easy_setopt(curl, CURLOPT_PORT, http_req->port);
+		}
+	}
+	{
+		// ** Auth **
+		if (SAFE_STRNCMP(http_req->url, "https", strlen("https")) == 0)
+		{
+			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+			//curl_easy_setopt(curl, CURLOPT_SSLVERSION, 3);
+		}
+		if ((http_req->user) && (http_req->password))
+		{
+			curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
+			curl_easy_setopt(curl, CURLOPT_USERNAME, http_req->user);
+			curl_easy_setopt(curl, CURLOPT_PASSWORD, http_req->password);
+		}
+	}
+
+	{
+		// ** Debug & Timeout **
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, MAX_OF_CURL_CONNECTTIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, MAX_OF_CURL_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, VAL_OF_CURLOPT_VERBOSE);
+		// ** redirected **
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	}
+
+	{
+		// ** Header **
+		soap_req->headers = curl_slist_append(soap_req->headers, "Content-Type: application/soap+xml; charset=utf-8");
+		soap_req->headers = curl_slist_append(soap_req->headers, "Accept-Encoding: gzip, deflate");
+		//headers = curl_slist_append(headers, soap_req->h_action);
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, soap_req->headers);
+	}
+
+	{
+		// ** Body **
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, soap_req->request);
+
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, soap_body_cb);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)http_req);
+	}
+}
+
 static int http_request_soap(HttpX_t *http_req)
 {
 	int ret = -1;
@@ -264,57 +406,9 @@ static int http_request_soap(HttpX_t *http_req)
 	if (soap_req->request)
 	{
 		{
-			curl_global_init(CURL_GLOBAL_DEFAULT);
-			CURL *curl = curl_easy_init();
-			http_req->curl = curl;
+			CURL *curl = http_curl_open(http_req);
 			CURLcode curl_res;
-			{
-				curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
-				if (http_req->port!=0)
-				{
-					curl_easy_setopt(curl, CURLOPT_PORT, http_req->port);
-				}
-			}
-			{
-				// ** Auth **
-				if (SAFE_STRNCMP(http_req->url, "https", strlen("https")) == 0)
-				{
-					curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
-					curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-					//curl_easy_setopt(curl, CURLOPT_SSLVERSION, 3);
-				}
-				if ((http_req->user) && (http_req->password))
-				{
-					curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
-					curl_easy_setopt(curl, CURLOPT_USERNAME, http_req->user);
-					curl_easy_setopt(curl, CURLOPT_PASSWORD, http_req->password);
-				}
-			}
-
-			{
-				// ** Debug & Timeout **
-				curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, MAX_OF_CURL_CONNECTTIMEOUT);
-				curl_easy_setopt(curl, CURLOPT_TIMEOUT, MAX_OF_CURL_TIMEOUT);
-				curl_easy_setopt(curl, CURLOPT_VERBOSE, VAL_OF_CURLOPT_VERBOSE);
-				// ** redirected **
-				curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-			}
-
-			{
-				// ** Header **
-				soap_req->headers = curl_slist_append(soap_req->headers, "Content-Type: application/soap+xml; charset=utf-8");
-				soap_req->headers = curl_slist_append(soap_req->headers, "Accept-Encoding: gzip, deflate");
-				//headers = curl_slist_append(headers, soap_req->h_action);
-				curl_easy_setopt(curl, CURLOPT_HTTPHEADER, soap_req->headers);
-			}
-
-			{
-				// ** Body **
-				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, soap_req->request);
-
-				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, soap_body_cb);
-				curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)http_req);
-			}
+			http_request_soap_setopt(http_req, curl);
 
 			curl_res = curl_easy_perform(curl);
 			/* Check for errors */
@@ -328,9 +422,7 @@ static int http_request_soap(HttpX_t *http_req)
 				ret = 0;
 			}
 			/* always cleanup */
-			http_req->curl = NULL;
-			curl_easy_cleanup(curl);
-			curl_global_cleanup();
+			http_curl_close(http_req, curl);
 		}
 	}
 	else
@@ -358,9 +450,7 @@ static int http_request_uploadfile(HttpX_t *http_req)
 		}
 		else
 		{
-			curl_global_init(CURL_GLOBAL_DEFAULT);
-			CURL *curl = curl_easy_init();
-			http_req->curl = curl;
+			CURL *curl = http_curl_open(http_req);
 			CURLcode curl_res;
 			curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
 
@@ -436,9 +526,7 @@ static int http_request_uploadfile(HttpX_t *http_req)
 				ret = 0;
 			}
 			/* always cleanup */
-			http_req->curl = NULL;
-			curl_easy_cleanup(curl);
-			curl_global_cleanup();
+			http_curl_close(http_req, curl);
 		}
 		SAFE_FCLOSE(file_req->fp);
 	}
@@ -516,6 +604,7 @@ static size_t rtsp_describe_header_cb(char *ptr, size_t size, size_t nmemb, void
 }
 
 // scan sdp file for media control attribute
+
 static void rtsp_describe_parse(HttpX_t *http_req)
 {
 	if (http_req)
@@ -554,7 +643,13 @@ static void rtsp_describe_parse(HttpX_t *http_req)
 				mtype = 0;
 				//DBG_DB_LN(">>>>>>>> (mtype: %d)", mtype);
 			}
-			else if (SAFE_STRNCMP(token, "a=fmtp:", strlen("a=fmtp:")) == 0)
+			else if ((mtype == 0) && (SAFE_STRNCMP(token, "a=rtpmap:", strlen("a=rtpmap:")) == 0) && (strlen(rtsp_req->encoding) == 0))
+			{
+				// a=rtpmap:96 H265/90000
+				SAFE_SSCANF(token, "a=rtpmap:%d %15[^/]/%d", &rtsp_req->pt, rtsp_req->encoding, &rtsp_req->clock_rate);
+				DBG_DB_LN("(pt: %d, encoding: %s, clock_rate: %d)", rtsp_req->pt, rtsp_req->encoding, rtsp_req->clock_rate);
+			}
+			else if ((mtype == 0) && (SAFE_STRNCMP(token, "a=fmtp:", strlen("a=fmtp:")) == 0))
 			{
 #if (0)
 				char pmode_str[LEN_OF_VAL32] = "";
@@ -567,34 +662,19 @@ static void rtsp_describe_parse(HttpX_t *http_req)
 				SAFE_SSCANF(plid, "profile-level-id=%s;", plid_str);
 				//DBG_DB_LN(">>>>>>>> (plid: %d)", atoi(plid_str));
 #endif
-				char sps_str[LEN_OF_VAL64] = "";
-				char *sps = SAFE_STRSTR(token, "sprop-parameter-sets=");
-
-#ifdef UTIL_EX_SSL
-				if (sps)
+				char *don = SAFE_STRSTR(token, "sprop-max-don-diff=");
+				if (don)
 				{
-					// h264
-					SAFE_SSCANF(sps, "sprop-parameter-sets=%s", sps_str);
-					//DBG_DB_LN(">>>>>>>> (sps: %s)", sps_str);
-
-					char *token_sps = NULL;
-					char *saveptr_sps = sps_str;
-					while ((token_sps = SAFE_STRTOK_R(NULL, ",", &saveptr_sps)))
-					{
-						int sps_dec_len = 0;
-						char *sps_dec = sec_base64_dec(token_sps, strlen(token_sps), &sps_dec_len);
-						DBG_TMP_Y("(token_sps: %ld %s)", strlen(token_sps), token_sps);
-						DBG_TMP_DUMP(sps_dec, sps_dec_len, " ", "(sps_dec_len: %d)", sps_dec_len);
-
-						if (rtsp_req->fp)
-						{
-							unsigned char nal_header[4] = {0x00, 0x00, 0x00, 0x01};
-							SAFE_FWRITE(&nal_header, 1, sizeof(nal_header), rtsp_req->fp);
-							SAFE_FWRITE(sps_dec, 1, sps_dec_len, rtsp_req->fp);
-						}
-						SAFE_FREE(sps_dec);
-					}
+					rtsp_req->don_present = (atoi(don + strlen("sprop-max-don-diff=")) > 0);
 				}
+
+#ifdef UTIL_EX_SSL
+				// h264
+				rtp_sprop_write(NULL, rtsp_req->fp, token, "sprop-parameter-sets=");
+				// h265
+				rtp_sprop_write(NULL, rtsp_req->fp, token, "sprop-vps=");
+				rtp_sprop_write(NULL, rtsp_req->fp, token, "sprop-sps=");
+				rtp_sprop_write(NULL, rtsp_req->fp, token, "sprop-pps=");
 #endif
 			}
 			else if (SAFE_STRNCMP(token, "m=audio", strlen("m=audio")) == 0)
@@ -827,6 +907,9 @@ static CURLcode rtsp_receive(HttpX_t *http_req, CURL *curl)
 	}
 	sleep(1);
 
+	// the frames behind a hole are released even if the stream stalls
+	rtp_jitter_poll(rtsp_req->rtp_req);
+
 	return curl_res;
 }
 
@@ -926,6 +1009,7 @@ static int http_request_downloadfile_rtsp(HttpX_t *http_req)
 				curl_res = rtsp_describe(http_req, curl);
 
 				rtsp_req->no_of_track = 0;
+				SAFE_MEMSET(rtsp_req->encoding, 0, sizeof(rtsp_req->encoding));
 				// get media control attribute from sdp buffer
 				rtsp_describe_parse(http_req);
 
@@ -939,6 +1023,13 @@ static int http_request_downloadfile_rtsp(HttpX_t *http_req)
 				// to setup RTP
 				RTPX_t *rtp_req = rtp_init(rtsp_req->rtp_port, rtsp_req->interleaved);
 				rtp_req->http_req = http_req;
+				rtp_req->pt = rtsp_req->pt;
+				if (rtsp_req->clock_rate > 0)
+				{
+					rtp_req->clock_rate = rtsp_req->clock_rate;
+				}
+				rtp_req->don_present = rtsp_req->don_present;
+				rtp_codec_set(rtp_req, rtp_codec_find(rtsp_req->encoding));
 
 				rtsp_req->rtp_req = rtp_req;
 
@@ -1027,9 +1118,7 @@ static int http_request_downloadfile_normal(HttpX_t *http_req)
 		}
 		else
 		{
-			curl_global_init(CURL_GLOBAL_DEFAULT);
-			CURL *curl = curl_easy_init();
-			http_req->curl = curl;
+			CURL *curl = http_curl_open(http_req);
 			CURLcode curl_res;
 			curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
 
@@ -1097,9 +1186,7 @@ static int http_request_downloadfile_normal(HttpX_t *http_req)
 				ret = 0;
 			}
 			/* always cleanup */
-			http_req->curl = NULL;
-			curl_easy_cleanup(curl);
-			curl_global_cleanup();
+			http_curl_close(http_req, curl);
 		}
 		SAFE_FCLOSE(file_req->fp);
 	}
@@ -1130,24 +1217,275 @@ static size_t mjpeg_header_cb(char *ptr, size_t size, size_t nmemb, void *contex
 				&& (boundary = SAFE_STRSTR(ctype, "boundary="))
 			)
 			{
-				// No support
-				char *boundary = SAFE_STRSTR(ctype, "boundary=");
 				SAFE_SSCANF(boundary, "boundary=%s", mjpeg_req->boundary);
 				str_trim(mjpeg_req->boundary);
 				DBG_TR_LN("(boundary: %s)", mjpeg_req->boundary);
+
+				// the delimiter of a part, the leading \r\n belongs to it and not to the frame
+				if (SAFE_MEMCMP(mjpeg_req->boundary, "--", 2) == 0)
+				{
+					mjpeg_req->delim_len = SAFE_SNPRINTF(mjpeg_req->delim, (int)sizeof(mjpeg_req->delim), "\r\n%s", mjpeg_req->boundary);
+				}
+				else
+				{
+					mjpeg_req->delim_len = SAFE_SNPRINTF(mjpeg_req->delim, (int)sizeof(mjpeg_req->delim), "\r\n--%s", mjpeg_req->boundary);
+				}
+				mjpeg_req->hdr_len = 0;
+				mjpeg_req->frame_len = 0;
 				mjpeg_req->state = MJPEG_STATE_ID_BOUNDARY;
-				qbuf_init(&mjpeg_req->qbuf, MAX_OF_QBUF_1MB);
 			}
-
 		}
 		else if ((clength = SAFE_STRSTR(ptr, "Content-Length:")))
 		{
-			mjpeg_req->clength = atoi(clength);
+			mjpeg_req->clength = atoi(clength + strlen("Content-Length:"));
 		}
 	}
 	return bytec;
 }
 
+static int mjpeg_frame_append(MJPEGRequest_t *mjpeg_req, char *ptr, size_t len)
+{
+	int idx = mjpeg_req->pool_idx;
+	size_t need = mjpeg_req->frame_len + len;
+
+	if (need > mjpeg_req->pool_max[idx])
+	{
+		size_t new_max = (mjpeg_req->pool_max[idx] > 0) ? mjpeg_req->pool_max[idx] * 2 : LEN_OF_BUF_1MB/16;
+		if (new_max < need)
+		{
+			new_max = need;
+		}
+		if ((mjpeg_req->flength > 0) && (new_max < (size_t)mjpeg_req->flength))
+		{
+			new_max = mjpeg_req->flength;
+		}
+
+		char *new_buff = SAFE_REALLOC(mjpeg_req->pool_buf[idx], new_max);
+		if (new_buff == NULL)
+		{
+			DBG_ER_LN("SAFE_REALLOC error !!! (frame: %zd -> %zd)", mjpeg_req->pool_max[idx], new_max);
+			return -1;
+		}
+		mjpeg_req->pool_buf[idx] = new_buff;
+		mjpeg_req->pool_max[idx] = new_max;
+	}
+
+	SAFE_MEMCPY(mjpeg_req->pool_buf[idx] + mjpeg_req->frame_len, ptr, len, mjpeg_req->pool_max[idx] - mjpeg_req->frame_len);
+	mjpeg_req->frame_len += len;
+	return 0;
+}
+
+static void mjpeg_frame_pool_free(MJPEGRequest_t *mjpeg_req)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_MJPEG_POOL; idx++)
+	{
+		SAFE_FREE(mjpeg_req->pool_buf[idx]);
+		mjpeg_req->pool_max[idx] = 0;
+	}
+	mjpeg_req->pool_idx = 0;
+	mjpeg_req->frame_len = 0;
+}
+
+// data is a view of the curl chunk or pool_buf[pool_idx]
+static int mjpeg_frame_emit(HttpX_t *http_req, char *data, size_t len, int iscopy)
+{
+	int ret = 0;
+	MJPEGRequest_t *mjpeg_req = (MJPEGRequest_t *)&http_req->mjpeg_req;
+
+	if ((mjpeg_req->delim_len > 2) && (strlen(mjpeg_req->filename) > 0))
+	{
+		// ** disk sink **, single is written by mjpeg_body_cb directly
+		if (mjpeg_req->fp == NULL)
+		{
+			SAFE_SNPRINTF(mjpeg_req->filename, sizeof(mjpeg_req->filename), "%s_%02d.jpg", mjpeg_req->prefixname, mjpeg_req->num);
+			mjpeg_req->fp = SAFE_FOPEN(mjpeg_req->filename, "wb");
+		}
+		if (mjpeg_req->fp)
+		{
+			SAFE_FWRITE(data, 1, len, mjpeg_req->fp);
+			SAFE_FCLOSE(mjpeg_req->fp);
+		}
+		DBG_DB_LN("(filename[%d]: %s, ftype: %s, len: %zd)", mjpeg_req->num, mjpeg_req->filename, mjpeg_req->ftype, len);
+	}
+
+	if (mjpeg_req->frame_cb)
+	{
+		MJPEGFrame_t frame = {
+			.num = mjpeg_req->num,
+			.data = data,
+			.len = len,
+			.iscopy = iscopy,
+		};
+		SAFE_SNPRINTF(frame.ftype, (int)sizeof(frame.ftype), "%s", mjpeg_req->ftype);
+		ret = mjpeg_req->frame_cb(http_req, &frame, mjpeg_req->frame_data);
+	}
+
+	if (iscopy)
+	{
+		int pool_size = SAFE_MIN(SAFE_MAX(mjpeg_req->pool_size, 1), MAX_OF_MJPEG_POOL);
+		mjpeg_req->pool_idx = (mjpeg_req->pool_idx + 1) % pool_size;
+	}
+	mjpeg_req->frame_len = 0;
+	mjpeg_req->flength = 0;
+	SAFE_MEMSET(mjpeg_req->ftype, 0, sizeof(mjpeg_req->ftype));
+	mjpeg_req->state = MJPEG_STATE_ID_BOUNDARY;
+	mjpeg_req->num++;
+
+	if ((mjpeg_req->maxfiles) && (mjpeg_req->num >= mjpeg_req->maxfiles))
+	{
+		// finish !!!
+		DBG_DB_LN("(num: %d >= maxfiles: %d)", mjpeg_req->num, mjpeg_req->maxfiles);
+		ret = -1;
+	}
+	return ret;
+}
+
+// MJPEG_STATE_ID_BOUNDARY, only the boundary line and the part headers pass through hdr
+static size_t mjpeg_boundary_scan(HttpX_t *http_req, char *ptr, size_t len)
+{
+	MJPEGRequest_t *mjpeg_req = (MJPEGRequest_t *)&http_req->mjpeg_req;
+	char *dash = mjpeg_req->delim + 2; // --boundary
+	int dash_len = mjpeg_req->delim_len - 2;
+	size_t used = 0;
+
+	while (used < len)
+	{
+		size_t n = SAFE_MIN(len - used, sizeof(mjpeg_req->hdr) - 1 - mjpeg_req->hdr_len);
+		SAFE_MEMCPY(mjpeg_req->hdr + mjpeg_req->hdr_len, ptr + used, n, sizeof(mjpeg_req->hdr) - 1 - mjpeg_req->hdr_len);
+		mjpeg_req->hdr_len += n;
+		mjpeg_req->hdr[mjpeg_req->hdr_len] = 0;
+		used += n;
+
+		char *startptr = SAFE_MEMMEM(mjpeg_req->hdr, mjpeg_req->hdr_len, dash, dash_len);
+		if (startptr == NULL)
+		{
+			// keep the tail, it might be the head of the boundary
+			int keep = SAFE_MIN(mjpeg_req->hdr_len, dash_len - 1);
+			SAFE_MEMMOVE(mjpeg_req->hdr, mjpeg_req->hdr + mjpeg_req->hdr_len - keep, keep);
+			mjpeg_req->hdr_len = keep;
+			continue;
+		}
+		if (startptr != mjpeg_req->hdr)
+		{
+			mjpeg_req->hdr_len -= (startptr - mjpeg_req->hdr);
+			SAFE_MEMMOVE(mjpeg_req->hdr, startptr, mjpeg_req->hdr_len);
+			mjpeg_req->hdr[mjpeg_req->hdr_len] = 0;
+		}
+
+		char *endptr = SAFE_MEMMEM(mjpeg_req->hdr + dash_len, mjpeg_req->hdr_len - dash_len, "\r\n\r\n", 4);
+		if (endptr == NULL)
+		{
+			if (mjpeg_req->hdr_len >= (int)sizeof(mjpeg_req->hdr) - 1)
+			{
+				DBG_ER_LN("part headers are too large !!! (hdr_len: %d)", mjpeg_req->hdr_len);
+				mjpeg_req->hdr_len = 0;
+			}
+			continue;
+		}
+
+		// the bytes behind the headers came with the last copy, give them back to the body
+		size_t rest = mjpeg_req->hdr_len - (endptr + 4 - mjpeg_req->hdr);
+		used -= SAFE_MIN(rest, n);
+
+		*endptr = 0;
+		char *ctype = SAFE_STRCASESTR(mjpeg_req->hdr, "Content-Type:");
+		char *flength = SAFE_STRCASESTR(mjpeg_req->hdr, "Content-Length:");
+		if (ctype)
+		{
+			SAFE_SSCANF(ctype + strlen("Content-Type:"), "%31s", mjpeg_req->ftype);
+		}
+		mjpeg_req->flength = (flength) ? atoi(flength + strlen("Content-Length:")) : 0;
+		DBG_TR_LN("(num: %d, ftype: %s, flength: %d)", mjpeg_req->num, mjpeg_req->ftype, mjpeg_req->flength);
+
+		mjpeg_req->hdr_len = 0;
+		mjpeg_req->frame_len = 0;
+		mjpeg_req->state = MJPEG_STATE_ID_BODY;
+		break;
+	}
+	return used;
+}
+
+// MJPEG_STATE_ID_BODY, *isquit is set when the transfer has to stop
+static size_t mjpeg_body_scan(HttpX_t *http_req, char *ptr, size_t len, int *isquit)
+{
+	MJPEGRequest_t *mjpeg_req = (MJPEGRequest_t *)&http_req->mjpeg_req;
+
+	if (mjpeg_req->flength > 0)
+	{
+		size_t n = SAFE_MIN(len, (size_t)mjpeg_req->flength - mjpeg_req->frame_len);
+		if ((mjpeg_req->frame_len == 0) && (n == (size_t)mjpeg_req->flength))
+		{
+			// the whole frame is inside this chunk
+			*isquit = mjpeg_frame_emit(http_req, ptr, n, 0);
+		}
+		else if (mjpeg_frame_append(mjpeg_req, ptr, n) != 0)
+		{
+			*isquit = -1;
+		}
+		else if (mjpeg_req->frame_len == (size_t)mjpeg_req->flength)
+		{
+			*isquit = mjpeg_frame_emit(http_req, mjpeg_req->pool_buf[mjpeg_req->pool_idx], mjpeg_req->frame_len, 1);
+		}
+		return n;
+	}
+
+	// without Content-Length, the frame ends at the next delimiter
+	int delim_len = mjpeg_req->delim_len;
+	if (mjpeg_req->frame_len > 0)
+	{
+		// the delimiter might straddle the collected tail and this chunk
+		char seam[LEN_OF_VAL48*2] = "";
+		int tail = SAFE_MIN(mjpeg_req->frame_len, (size_t)delim_len - 1);
+		int head = SAFE_MIN(len, (size_t)delim_len - 1);
+		SAFE_MEMCPY(seam, mjpeg_req->pool_buf[mjpeg_req->pool_idx] + mjpeg_req->frame_len - tail, tail, sizeof(seam));
+		SAFE_MEMCPY(seam + tail, ptr, head, sizeof(seam) - tail);
+
+		char *delimptr = SAFE_MEMMEM(seam, tail + head, mjpeg_req->delim, delim_len);
+		if ((delimptr) && (delimptr - seam < tail))
+		{
+			int pos = delimptr - seam;
+			mjpeg_req->frame_len -= (tail - pos);
+			*isquit = mjpeg_frame_emit(http_req, mjpeg_req->pool_buf[mjpeg_req->pool_idx], mjpeg_req->frame_len, 1);
+
+			// hand --boundary over to MJPEG_STATE_ID_BOUNDARY
+			pos += 2;
+			if (pos < tail)
+			{
+				SAFE_MEMCPY(mjpeg_req->hdr, seam + pos, tail - pos, sizeof(mjpeg_req->hdr));
+				mjpeg_req->hdr_len = tail - pos;
+				return 0;
+			}
+			return pos - tail;
+		}
+	}
+
+	char *delimptr = SAFE_MEMMEM(ptr, len, mjpeg_req->delim, delim_len);
+	if (delimptr)
+	{
+		size_t n = delimptr - ptr;
+		if (mjpeg_req->frame_len == 0)
+		{
+			*isquit = mjpeg_frame_emit(http_req, ptr, n, 0);
+		}
+		else if (mjpeg_frame_append(mjpeg_req, ptr, n) != 0)
+		{
+			*isquit = -1;
+		}
+		else
+		{
+			*isquit = mjpeg_frame_emit(http_req, mjpeg_req->pool_buf[mjpeg_req->pool_idx], mjpeg_req->frame_len, 1);
+		}
+		return n + 2;
+	}
+
+	if (mjpeg_frame_append(mjpeg_req, ptr, len) != 0)
+	{
+		*isquit = -1;
+	}
+	return len;
+}
+
 static size_t mjpeg_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
 {
 	size_t bytec = size * nmemb;
@@ -1158,163 +1496,42 @@ static size_t mjpeg_body_cb(char *ptr, size_t size, size_t nmemb, void *context)
 	{
 		MJPEGRequest_t *mjpeg_req = (MJPEGRequest_t *)&http_req->mjpeg_req;
 
-		if (strlen(mjpeg_req->boundary) > 0)
+		if (mjpeg_req->delim_len > 2)
 		{
-			QBUF_t *qbuf = &mjpeg_req->qbuf;
-			qbuf_write(qbuf, ptr, bytec);
-
-mjpeg_parse:
+			// multi, walks the chunk in place
+			size_t pos = 0;
+			int isquit = 0;
+			while ((pos < bytec) && (isquit == 0))
 			{
-				//DBG_TR_LN("(size: %d, nmemb: %d)", size, nmemb);
-				char *startptr = qbuf_buff(qbuf);
-				char *saveptr = NULL;
-				size_t total = qbuf_total(qbuf);
-
-				//DBG_TR_LN("(startptr: %s, size: %d, nmemb: %d)", startptr, size, nmemb);
-				// multi
 				switch (mjpeg_req->state)
 				{
 					case MJPEG_STATE_ID_BOUNDARY:
-						//DBG_TR_LN("(startptr: %s, size: %d, nmemb: %d)", startptr, size, nmemb);
-					{
-						char boundary[LEN_OF_VAL48] = "";
-						//DBG_TR_LN("(ptr: %s, size: %d, nmemb: %d)", ptr, size, nmemb);
-						if (SAFE_MEMCMP(mjpeg_req->boundary, "--", 2) == 0)
-						{
-							SAFE_SNPRINTF(boundary, (int)sizeof(boundary), "%s\r\n", http_req->mjpeg_req.boundary);
-						}
-						else
-						{
-							SAFE_SNPRINTF(boundary, (int)sizeof(boundary), "--%s\r\n", http_req->mjpeg_req.boundary);
-						}
-
-						if (qbuf_shiftstr(qbuf, boundary) == 0)
-						{
-							// found !!!
-							if (mjpeg_req->fp == NULL)
-							{
-								// create a new file
-								SAFE_SNPRINTF(mjpeg_req->filename, sizeof(mjpeg_req->filename), "%s_%02d.jpg", mjpeg_req->prefixname, mjpeg_req->num);
-								mjpeg_req->fp = SAFE_FOPEN(mjpeg_req->filename, "wb");
-							}
-
-							if (mjpeg_req->fp)
-							{
-								mjpeg_req->state ++;
-							}
-
-							goto mjpeg_parse;
-						}
-					}
-					break;
-					case MJPEG_STATE_ID_TYPE:
-						if (qbuf_shiftstr(qbuf, "Content-Type:") == 0)
-						{
-							mjpeg_req->state ++;
-
-							goto mjpeg_parse;
-						}
-						break;
-					case MJPEG_STATE_ID_TYPE_0D0A:
-						if ((saveptr = qbuf_strstr(qbuf, "\r\n", NULL)))
-						{
-							SAFE_SNPRINTF(mjpeg_req->ftype, (int)(saveptr-startptr)+1, "%s", startptr);
-
-							{
-								DBG_TR_LN("(filename[%d]: %s, ftype: %s)", mjpeg_req->num, mjpeg_req->filename, mjpeg_req->ftype);
-								mjpeg_req->state ++;
-								qbuf_read(qbuf, NULL, (saveptr-startptr+1) + strlen("\r\n") - 1);
-							}
-
-							goto mjpeg_parse;
-						}
-						break;
-					case MJPEG_STATE_ID_LENGTH:
-						if (qbuf_shiftstr(qbuf, "Content-Length:") == 0)
-						{
-							mjpeg_req->state ++;
-
-							goto mjpeg_parse;
-						}
-						break;
-					case MJPEG_STATE_ID_LENGTH_0D0A:
-						if ((saveptr = qbuf_strstr(qbuf, "\r\n", NULL)))
-						{
-							char flength[LEN_OF_VAL16] = "";
-							SAFE_SNPRINTF(flength, (int)(saveptr-startptr)+1, "%s", startptr);
-							mjpeg_req->flength = atoi(flength);
-
-							if (mjpeg_req->flength)
-							{
-								DBG_TR_LN("(filename[%d]: %s, flength: %d)", mjpeg_req->num, mjpeg_req->filename, mjpeg_req->flength);
-								mjpeg_req->state ++;
-								qbuf_read(qbuf, NULL, (saveptr-startptr+1) + strlen("\r\n") - 1);
-							}
-
-							goto mjpeg_parse;
-						}
-						break;
-					case MJPEG_STATE_ID_STUPID_0D0A:
-						if (qbuf_total(qbuf) > 2)
-						{
-							if (SAFE_MEMCMP(qbuf_buff(qbuf), "\r\n", 2) == 0)
-							{
-								// found !!!
-								qbuf_read(qbuf, NULL, 2);
-							}
-
-							mjpeg_req->state ++;
-							goto mjpeg_parse;
-						}
+						pos += mjpeg_boundary_scan(http_req, ptr + pos, bytec - pos);
 						break;
 					case MJPEG_STATE_ID_BODY:
-						if (mjpeg_req->flength <= total)
-						{
-							nmemb = mjpeg_req->flength;
-							size = 1;
-						}
-						else
-						{
-							nmemb = total;
-							size = 1;
-						}
-						{
-							size_t written = SAFE_FWRITE(startptr, size, nmemb, mjpeg_req->fp);
-							qbuf_read(qbuf, NULL, size*nmemb);
-
-							//DBG_TR_LN("(size: %d, nmemb: %d, flength: %d, written: %d)", size, nmemb, mjpeg_req->flength, written);
-							mjpeg_req->flength -= written;
-							if (mjpeg_req->flength<=0)
-							{
-								SAFE_FCLOSE(mjpeg_req->fp);
-								DBG_DB_LN("(filename[%d]: %s, ftype: %s)", mjpeg_req->num, mjpeg_req->filename, mjpeg_req->ftype);
-
-								mjpeg_req->state ++;
-								mjpeg_req->state %= MJPEG_STATE_ID_MAX;
-								mjpeg_req->num++;
-
-								if ((mjpeg_req->maxfiles) && (mjpeg_req->num >= mjpeg_req->maxfiles))
-								{
-									// finish !!!
-									DBG_DB_LN("(num: %d >= maxfiles: %d)", mjpeg_req->num, mjpeg_req->maxfiles);
-									bytec = 0;
-								}
-								else
-								{
-									goto mjpeg_parse;
-								}
-							}
-						}
+						pos += mjpeg_body_scan(http_req, ptr + pos, bytec - pos, &isquit);
 						break;
 					default:
+						mjpeg_req->state = MJPEG_STATE_ID_BOUNDARY;
 						break;
 				}
 			}
+			if (isquit)
+			{
+				bytec = 0;
+			}
 		}
 		else
 		{
 			// single
-			SAFE_FWRITE(ptr, size, nmemb, mjpeg_req->fp);
+			if (mjpeg_req->fp)
+			{
+				SAFE_FWRITE(ptr, size, nmemb, mjpeg_req->fp);
+			}
+			if ((mjpeg_req->frame_cb) && (mjpeg_frame_append(mjpeg_req, ptr, bytec) != 0))
+			{
+				bytec = 0;
+			}
 		}
 	}
 	else
@@ -1344,24 +1561,34 @@ static int http_request_downloadfile_mjpeg(HttpX_t *http_req)
 
 		SAFE_SNPRINTF(mjpeg_req->filename, sizeof(mjpeg_req->filename), "%s.jpg", mjpeg_req->prefixname);
 	}
-	else
+	else if (mjpeg_req->frame_cb == NULL)
 	{
 		return ret;
 	}
 
-	mjpeg_req->fp = SAFE_FOPEN(mjpeg_req->filename, "wb"); /* open file to download */
-	if (mjpeg_req->fp)
+	// the same http_req might be used again, mjpeg_header_cb decides single or multi for this one
+	SAFE_MEMSET(mjpeg_req->boundary, 0, sizeof(mjpeg_req->boundary));
+	SAFE_MEMSET(mjpeg_req->delim, 0, sizeof(mjpeg_req->delim));
+	mjpeg_req->delim_len = 0;
+	mjpeg_req->state = MJPEG_STATE_ID_BOUNDARY;
+	mjpeg_req->hdr_len = 0;
+	mjpeg_req->flength = 0;
+	SAFE_MEMSET(mjpeg_req->ftype, 0, sizeof(mjpeg_req->ftype));
+
+	if (strlen(mjpeg_req->filename) > 0)
+	{
+		mjpeg_req->fp = SAFE_FOPEN(mjpeg_req->filename, "wb"); /* open file to download */
+	}
+	if ((mjpeg_req->fp) || (strlen(mjpeg_req->filename) == 0))
 	{
 		struct stat file_info;
-		if (fstat(SAFE_FILENO(mjpeg_req->fp), &file_info) != 0)
+		if ((mjpeg_req->fp) && (fstat(SAFE_FILENO(mjpeg_req->fp), &file_info) != 0))
 		{
 			SAFE_SPRINTF_EX(http_req->log, "fstat error !!! (url: %s, filename: %s)", http_req->url, mjpeg_req->filename);
 		}
 		else
 		{
-			curl_global_init(CURL_GLOBAL_DEFAULT);
-			CURL *curl = curl_easy_init();
-			http_req->curl = curl;
+			CURL *curl = http_curl_open(http_req);
 			CURLcode curl_res;
 			curl_easy_setopt(curl, CURLOPT_URL, http_req->url);
 
@@ -1421,17 +1648,21 @@ static int http_request_downloadfile_mjpeg(HttpX_t *http_req)
 				curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_X, &speed_download);
 				curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time);
 
-				SAFE_SPRINTF_EX(http_req->log, "Download Ok !!! (%s, %ld bytes, %ld bytes/sec, total: %.3f secs)", mjpeg_req->filename, size_download, speed_download, total_time);
+				if ((curl_res == CURLE_OK) && (mjpeg_req->delim_len <= 2) && (mjpeg_req->frame_cb) && (mjpeg_req->frame_len > 0))
+				{
+					// single, the whole body is the frame
+					mjpeg_frame_emit(http_req, mjpeg_req->pool_buf[mjpeg_req->pool_idx], mjpeg_req->frame_len, 1);
+				}
+
+				SAFE_SPRINTF_EX(http_req->log, "Download Ok !!! (%s, %ld bytes, %ld bytes/sec, total: %.3f secs, frames: %d)", mjpeg_req->filename, size_download, speed_download, total_time, mjpeg_req->num);
 				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_req->response_code);
 				ret = 0;
 			}
 			/* always cleanup */
-			http_req->curl = NULL;
-			curl_easy_cleanup(curl);
-			curl_global_cleanup();
+			http_curl_close(http_req, curl);
 		}
 		SAFE_FCLOSE(mjpeg_req->fp);
-		qbuf_free(&mjpeg_req->qbuf);
+		mjpeg_frame_pool_free(mjpeg_req);
 	}
 	else
 	{
@@ -1493,9 +1724,50 @@ void http_request_stop(HttpX_t *http_req)
 	}
 }
 
+#ifdef UTIL_EX_METRICX
+typedef enum
+{
+	HTTP_METRIC_ID_SYNC = 0,
+	HTTP_METRIC_ID_ASYNC,
+	HTTP_METRIC_ID_MAX,
+} HTTP_METRIC_ID;
+
+static MetricX_t *http_metric_requests[HTTP_METRIC_ID_MAX];
+static MetricX_t *http_metric_errors[HTTP_METRIC_ID_MAX];
+static MetricX_t *http_metric_request_us[HTTP_METRIC_ID_MAX];
+static pthread_once_t http_metric_once = PTHREAD_ONCE_INIT;
+
+static void http_metric_open(void)
+{
+	char *labels[HTTP_METRIC_ID_MAX] = { "mode=\"sync\"", "mode=\"async\"" };
+	int idx = 0;
+	for (idx = 0; idx < HTTP_METRIC_ID_MAX; idx++)
+	{
+		http_metric_requests[idx] = metricx_counter_new("http_requests_total", "requests of http_request/http_request_async", labels[idx]);
+		http_metric_errors[idx] = metricx_counter_new("http_errors_total", "requests failed before a response", labels[idx]);
+		http_metric_request_us[idx] = metricx_histogram_new("http_request_us", "request duration in microseconds", labels[idx]);
+	}
+}
+
+static void http_metric_done(HTTP_METRIC_ID id, int ret, unsigned long long spent_us)
+{
+	pthread_once(&http_metric_once, http_metric_open);
+	metricx_counter_add(http_metric_requests[id], 1);
+	if (ret != 0)
+	{
+		metricx_counter_add(http_metric_errors[id], 1);
+	}
+	metricx_histogram_add(http_metric_request_us[id], spent_us);
+}
+#endif
+
 int http_request(HttpX_t *http_req)
 {
 	int ret = -1;
+	TRACEX_SPAN("curl", "http_request");
+#ifdef UTIL_EX_METRICX
+	unsigned long long t_start = metricx_now_us();
+#endif
 	http_req->result = 0;
 	if ((pcheck(http_req->url)) && (strlen(http_req->url) >= 7))   // "http://" or "https://"
 	{
@@ -1528,6 +1800,10 @@ int http_request(HttpX_t *http_req)
 				break;
 		}
 	}
+#ifdef UTIL_EX_METRICX
+	http_metric_done(HTTP_METRIC_ID_SYNC, ret, metricx_now_us() - t_start);
+#endif
+	TRACEX_SPAN_ARG(http_req->response_code);
 	return ret;
 }
 
@@ -1586,6 +1862,12 @@ int http_upload_with_response(const char *url, const char *filename, void *userd
 }
 
 int http_simple(const char *url, HTTP_METHOD_ID method, struct curl_slist *headers, size_t req_size, char *request, void *userdata, http_response_fn cb)
+{
+	return http_simple_ex(url, method, headers, req_size, request, NULL, userdata, cb);
+}
+
+// sink: NULL: HTTP_SINK_ID_BUFFER
+int http_simple_ex(const char *url, HTTP_METHOD_ID method, struct curl_slist *headers, size_t req_size, char *request, HttpSink_t *sink, void *userdata, http_response_fn cb)
 {
 	int ret = -1;
 	if ((url) && strlen(url))
@@ -1604,6 +1886,10 @@ int http_simple(const char *url, HTTP_METHOD_ID method, struct curl_slist *heade
 		};
 		//DBG_ER_LN("(request: %s)", http_req.simple_req.request);
 		SAFE_SPRINTF_EX(http_req.url, "%s", url);
+		if (sink)
+		{
+			SAFE_MEMCPY(&http_req.sink, sink, sizeof(HttpSink_t), sizeof(HttpSink_t));
+		}
 		ret = http_request(&http_req);
 
 		if (cb)
@@ -1615,3 +1901,408 @@ int http_simple(const char *url, HTTP_METHOD_ID method, struct curl_slist *heade
 	return ret;
 }
 
+
+static void http_pool_lock_cb(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+	HttpXPool_t *pool = (HttpXPool_t *)userptr;
+	if ((pool) && (data < CURL_LOCK_DATA_LAST))
+	{
+		SAFE_THREAD_LOCK(&pool->share_mtx[data]);
+	}
+}
+
+static void http_pool_unlock_cb(CURL *handle, curl_lock_data data, void *userptr)
+{
+	HttpXPool_t *pool = (HttpXPool_t *)userptr;
+	if ((pool) && (data < CURL_LOCK_DATA_LAST))
+	{
+		SAFE_THREAD_UNLOCK(&pool->share_mtx[data]);
+	}
+}
+
+CURL *http_pool_get(HttpXPool_t *pool)
+{
+	CURL *curl = NULL;
+	if (pool)
+	{
+		SAFE_THREAD_LOCK(&pool->easy_mtx);
+		if (pool->easy_count > 0)
+		{
+			pool->easy_count--;
+			curl = pool->easy_ary[pool->easy_count];
+			pool->easy_ary[pool->easy_count] = NULL;
+		}
+		SAFE_THREAD_UNLOCK(&pool->easy_mtx);
+
+		if (curl == NULL)
+		{
+			curl = curl_easy_init();
+		}
+		if (curl)
+		{
+			curl_easy_setopt(curl, CURLOPT_SHARE, pool->share);
+			curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+		}
+	}
+	return curl;
+}
+
+// curl_easy_reset keeps the live connections, DNS and TLS session caches of curl
+void http_pool_put(HttpXPool_t *pool, CURL *curl)
+{
+	if ((pool) && (curl))
+	{
+		curl_easy_reset(curl);
+
+		SAFE_THREAD_LOCK(&pool->easy_mtx);
+		if (pool->easy_count < MAX_OF_HTTPX_POOL)
+		{
+			pool->easy_ary[pool->easy_count++] = curl;
+			curl = NULL;
+		}
+		SAFE_THREAD_UNLOCK(&pool->easy_mtx);
+
+		if (curl)
+		{
+			curl_easy_cleanup(curl);
+		}
+	}
+}
+
+static void http_pool_async_done(HttpXPool_t *pool, CURL *curl, CURLcode curl_res)
+{
+	HttpXAsync_t *async_req = NULL;
+	curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&async_req);
+	curl_multi_remove_handle(pool->multi, curl);
+	pool->running--;
+
+	if (async_req)
+	{
+		clist_remove(pool->running_list, async_req);
+
+		HttpX_t *http_req = async_req->http_req;
+		if (curl_res != CURLE_OK)
+		{
+			SAFE_SNPRINTF(http_req->log, sizeof(http_req->log), "%d %s !!! (url: %s)", curl_res, curl_easy_strerror(curl_res), http_req->url);
+			http_req->result = -1;
+		}
+		else
+		{
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_req->response_code);
+			http_req->result = 0;
+		}
+#ifdef UTIL_EX_METRICX
+		{
+			// from the start of the transfer, the wait inside the pool is not counted
+#if LIBCURL_VERSION_NUM >= 0x073d00
+			curl_off_t spent_us = 0;
+			curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &spent_us);
+#else
+			double spent_secs = 0;
+			curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &spent_secs);
+			unsigned long long spent_us = spent_secs * 1000000;
+#endif
+			http_metric_done(HTTP_METRIC_ID_ASYNC, http_req->result, (unsigned long long)spent_us);
+		}
+#endif
+#ifdef UTIL_EX_TRACEX
+		TRACEX_ASYNC("curl", "http_request_async", async_req, async_req->t_add);
+#endif
+		http_req->curl = NULL;
+		http_pool_put(pool, curl);
+
+		if (async_req->done_cb)
+		{
+			async_req->done_cb(http_req, async_req->userdata);
+		}
+		SAFE_FREE(async_req);
+	}
+	else
+	{
+		http_pool_put(pool, curl);
+	}
+}
+
+static void http_pool_async_add(HttpXPool_t *pool)
+{
+	HttpXAsync_t *async_req = NULL;
+	void *failed_head = NULL;
+	clist_t failed_list = &failed_head;
+
+	threadx_lock(&pool->tidx);
+	while ((async_req = (HttpXAsync_t *)clist_pop(pool->async_list)) != NULL)
+	{
+		HttpX_t *http_req = async_req->http_req;
+		CURL *curl = http_pool_get(pool);
+		if (curl == NULL)
+		{
+			SAFE_SNPRINTF(http_req->log, sizeof(http_req->log), "http_pool_get error !!! (url: %s)", http_req->url);
+			http_req->result = -1;
+			clist_push(failed_list, async_req);
+			continue;
+		}
+
+		http_req->curl = curl;
+		if (http_req->mode == HTTP_MODE_ID_SOAP)
+		{
+			http_request_soap_setopt(http_req, curl);
+		}
+		else
+		{
+			http_request_simple_setopt(http_req, curl);
+		}
+		// wait for a multiplexed connection instead of opening a new one
+		curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+		curl_easy_setopt(curl, CURLOPT_PRIVATE, (char *)async_req);
+
+		curl_multi_add_handle(pool->multi, curl);
+		clist_add(pool->running_list, async_req);
+		pool->running++;
+	}
+	threadx_unlock(&pool->tidx);
+
+	// done_cb might call http_request_async again
+	while ((async_req = (HttpXAsync_t *)clist_pop(failed_list)) != NULL)
+	{
+		if (async_req->done_cb)
+		{
+			async_req->done_cb(async_req->http_req, async_req->userdata);
+		}
+		SAFE_FREE(async_req);
+	}
+}
+
+// curl_multi_poll is from 7.66.0 and curl_multi_wakeup from 7.68.0
+static void http_pool_wakeup(HttpXPool_t *pool)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+	curl_multi_wakeup(pool->multi);
+#else
+	threadx_wakeup_simple(&pool->tidx);
+#endif
+}
+
+static void http_pool_wait(HttpXPool_t *pool)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+	// http_request_async and http_pool_stop call curl_multi_wakeup
+	curl_multi_poll(pool->multi, NULL, 0, 1000, NULL);
+#else
+	if (pool->running > 0)
+	{
+		// curl_multi_wait can't be woken up, keep it short for the new requests
+		curl_multi_wait(pool->multi, NULL, 0, 100, NULL);
+	}
+	else
+	{
+		// curl_multi_wait returns at once without any transfer, http_pool_wakeup signals here
+		threadx_lock(&pool->tidx);
+		if (clist_length(pool->async_list) == 0)
+		{
+			threadx_timewait(&pool->tidx, 1000);
+		}
+		threadx_unlock(&pool->tidx);
+	}
+#endif
+}
+
+static void http_pool_async_free(HttpXPool_t *pool)
+{
+	CURLMsg *msg = NULL;
+	int msgs_left = 0;
+
+	http_pool_async_add(pool);
+
+	// the finished ones first, then the unfinished ones are aborted
+	while ((msg = curl_multi_info_read(pool->multi, &msgs_left)) != NULL)
+	{
+		if (msg->msg == CURLMSG_DONE)
+		{
+			http_pool_async_done(pool, msg->easy_handle, msg->data.result);
+		}
+	}
+
+	HttpXAsync_t *async_req = NULL;
+	while ((async_req = (HttpXAsync_t *)clist_head(pool->running_list)) != NULL)
+	{
+		http_pool_async_done(pool, async_req->http_req->curl, CURLE_ABORTED_BY_CALLBACK);
+	}
+}
+
+static void *http_pool_thread_handler(void *user)
+{
+	HttpXPool_t *pool = (HttpXPool_t *)user;
+
+	if (pool)
+	{
+		ThreadX_t *tidx_req = &pool->tidx;
+		threadx_detach(tidx_req);
+
+		while (threadx_isquit(tidx_req) == 0)
+		{
+			int still_running = 0;
+			CURLMsg *msg = NULL;
+			int msgs_left = 0;
+
+			http_pool_async_add(pool);
+
+			curl_multi_perform(pool->multi, &still_running);
+			while ((msg = curl_multi_info_read(pool->multi, &msgs_left)) != NULL)
+			{
+				if (msg->msg == CURLMSG_DONE)
+				{
+					http_pool_async_done(pool, msg->easy_handle, msg->data.result);
+				}
+			}
+
+			http_pool_wait(pool);
+		}
+
+		http_pool_async_free(pool);
+
+		threadx_leave(tidx_req);
+	}
+
+	return NULL;
+}
+
+// http_req has to be kept until cb, http_req->result: 0: ok, -1: failed
+int http_request_async(HttpX_t *http_req, void *userdata, http_response_fn cb)
+{
+	int ret = -1;
+
+	if ((http_req == NULL) || (http_req->pool == NULL) || (http_req->pool->multi == NULL))
+	{
+		return ret;
+	}
+	if ((http_req->mode != HTTP_MODE_ID_SIMPLE) && (http_req->mode != HTTP_MODE_ID_SOAP))
+	{
+		DBG_ER_LN("%s (mode: %d)", DBG_TXT_NO_SUPPORT, http_req->mode);
+		return ret;
+	}
+	if ((strlen(http_req->url) < 7) || ((http_req->mode == HTTP_MODE_ID_SOAP) && (http_req->soap_req.request == NULL)))
+	{
+		return ret;
+	}
+
+	HttpXPool_t *pool = http_req->pool;
+	HttpXAsync_t *async_req = (HttpXAsync_t *)SAFE_CALLOC(1, sizeof(HttpXAsync_t));
+	if (async_req)
+	{
+		async_req->http_req = http_req;
+		async_req->done_cb = cb;
+		async_req->userdata = userdata;
+#ifdef UTIL_EX_TRACEX
+		async_req->t_add = TRACEX_NOW();
+#endif
+		http_req->result = 0;
+
+		threadx_lock(&pool->tidx);
+		if (threadx_isquit(&pool->tidx) == 0)
+		{
+			clist_push(pool->async_list, async_req);
+			ret = 0;
+		}
+		threadx_unlock(&pool->tidx);
+
+		if (ret == 0)
+		{
+			http_pool_wakeup(pool);
+		}
+		else
+		{
+			SAFE_FREE(async_req);
+		}
+	}
+
+	return ret;
+}
+
+void http_pool_stop(HttpXPool_t *pool)
+{
+	if ((pool) && (pool->multi))
+	{
+		threadx_stop(&pool->tidx);
+		http_pool_wakeup(pool);
+	}
+}
+
+void http_pool_close(HttpXPool_t *pool)
+{
+	if ((pool) && (pool->isfree == 0))
+	{
+		pool->isfree ++;
+
+		if (pool->multi)
+		{
+			http_pool_stop(pool);
+			threadx_close(&pool->tidx);
+
+			curl_multi_cleanup(pool->multi);
+			pool->multi = NULL;
+			clist_free(pool->async_list);
+			clist_free(pool->running_list);
+		}
+
+		int idx = 0;
+		for (idx = 0; idx < pool->easy_count; idx++)
+		{
+			curl_easy_cleanup(pool->easy_ary[idx]);
+		}
+		pool->easy_count = 0;
+
+		curl_share_cleanup(pool->share);
+		for (idx = 0; idx < CURL_LOCK_DATA_LAST; idx++)
+		{
+			SAFE_MUTEX_DESTROY(&pool->share_mtx[idx]);
+		}
+		SAFE_MUTEX_DESTROY(&pool->easy_mtx);
+
+		curl_global_cleanup();
+		SAFE_FREE(pool);
+	}
+}
+
+// isasync: 1: to start a thread to drive curl_multi for http_request_async
+HttpXPool_t *http_pool_init(char *name, int isasync)
+{
+	HttpXPool_t *pool = (HttpXPool_t*)SAFE_CALLOC(1, sizeof(HttpXPool_t));
+
+	if (pool)
+	{
+		SAFE_SPRINTF_EX(pool->name, "%s", name);
+		pool->dbg_more = DBG_LVL_MAX;
+
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+
+		int idx = 0;
+		for (idx = 0; idx < CURL_LOCK_DATA_LAST; idx++)
+		{
+			SAFE_MUTEX_ATTR_RECURSIVE(pool->share_mtx[idx]);
+		}
+		SAFE_MUTEX_ATTR_RECURSIVE(pool->easy_mtx);
+
+		pool->share = curl_share_init();
+		curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, http_pool_lock_cb);
+		curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, http_pool_unlock_cb);
+		curl_share_setopt(pool->share, CURLSHOPT_USERDATA, (void *)pool);
+		curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+		if (isasync)
+		{
+			pool->multi = curl_multi_init();
+			curl_multi_setopt(pool->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+			curl_multi_setopt(pool->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)MAX_OF_HTTPX_HOST_CONNECTIONS);
+			CLIST_STRUCT_INIT(pool, async_list);
+			CLIST_STRUCT_INIT(pool, running_list);
+
+			ThreadX_t *tidx_req = &pool->tidx;
+			tidx_req->thread_cb = http_pool_thread_handler;
+			tidx_req->data = pool;
+			threadx_init(tidx_req, pool->name);
+		}
+	}
+	return pool;
+}
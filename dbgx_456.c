@@ -0,0 +1,118 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "utilx9.h"
+
+// DBG_IF_LN per second of the callers, printf vs. dbgx (DbgX_t)
+
+#define MAX_OF_BENCH_THREAD 4
+#define MAX_OF_BENCH_LOOP 100000
+
+#define BENCH_FILENAME "/tmp/dbgx_456.log"
+
+static void *bench_thread_handler(void *user)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_BENCH_LOOP; idx++)
+	{
+		DBG_IF_LN("(idx: %d, user: %p, name: %s)", idx, user, "dbgx_456");
+	}
+	return NULL;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_run(char *name, DbgX_t *dbgx_req)
+{
+	pthread_t tid_ary[MAX_OF_BENCH_THREAD];
+
+	// stdout of the printf is the same file
+	fflush(stdout);
+	int stdout_fd = dup(STDOUT_FILENO);
+	int fd = open(BENCH_FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+
+	if (dbgx_req)
+	{
+		dbgx_open(dbgx_req);
+	}
+
+	double t_start = bench_now();
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_BENCH_THREAD; idx++)
+	{
+		pthread_create(&tid_ary[idx], NULL, bench_thread_handler, (void *)(long)idx);
+	}
+	for (idx = 0; idx < MAX_OF_BENCH_THREAD; idx++)
+	{
+		pthread_join(tid_ary[idx], NULL);
+	}
+	double t_caller = bench_now() - t_start;
+
+	unsigned long drops = 0;
+	if (dbgx_req)
+	{
+		drops = dbgx_drops();
+		dbgx_close();
+	}
+	fflush(stdout);
+	double t_spent = bench_now() - t_start;
+
+	dup2(stdout_fd, STDOUT_FILENO);
+	close(stdout_fd);
+
+	unsigned long total = MAX_OF_BENCH_THREAD * MAX_OF_BENCH_LOOP;
+	DBG_WN_LN("(%-12s lines: %lu, drops: %lu, caller: %.3f secs, %.0f lines/sec, written: %.3f secs)", name, total, drops, t_caller, total / t_caller, t_spent);
+}
+
+int main(int argc, char* argv[])
+{
+	dbg_lvl_set(DBG_LVL_INFO);
+
+	bench_run("printf", NULL);
+
+	DbgX_t dbgx_drop =
+	{
+		.sink = DBGX_SINK_ID_STDOUT,
+		.overflow = DBGX_OVERFLOW_ID_DROP,
+		.iscolor = 1,
+	};
+	bench_run("dbgx drop", &dbgx_drop);
+
+	DbgX_t dbgx_block =
+	{
+		.sink = DBGX_SINK_ID_STDOUT,
+		.overflow = DBGX_OVERFLOW_ID_BLOCK,
+		.iscolor = 1,
+	};
+	bench_run("dbgx block", &dbgx_block);
+
+	DbgX_t dbgx_file =
+	{
+		.sink = DBGX_SINK_ID_FILE,
+		.filename = BENCH_FILENAME,
+		.overflow = DBGX_OVERFLOW_ID_BLOCK,
+		.ring_size = 256*1024,
+		.istime = 1,
+	};
+	bench_run("dbgx file", &dbgx_file);
+
+	exit(0);
+}
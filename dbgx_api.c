@@ -0,0 +1,630 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <sched.h>
+#include <syslog.h>
+
+#include "utilx9.h"
+
+#ifdef UTIL_EX_DBG_ASYNC
+// every thread formats its DBG_* into its own ring (single producer, single consumer),
+// nothing is shared on the way in. the writer thread merges the rings by timestamp and
+// prints them to stdout, a file or syslog. before dbgx_open (or after dbgx_close, or in
+// a forked child) the caller prints it directly, the same as printf did.
+
+#define DBGX_RECORD_PAD 0x80000000 // the rest of the ring is skipped
+#define DBGX_ALIGN(x) (((x) + 7) & ~7)
+
+typedef struct DbgXRecord_STRUCT
+{
+	uint32_t len; // header + text, 8 bytes aligned
+	uint16_t flags;
+	uint16_t text_len;
+	int line;
+	const char *color;
+	const char *func;
+	struct timespec ts;
+	char text[];
+} DbgXRecord_t;
+
+typedef struct DbgXRing_STRUCT
+{
+	struct DbgXRing_STRUCT *next;
+
+	unsigned int tid;
+	int isexit; // the thread is gone, freed by the writer after the last record
+
+	uint32_t size;
+	uint64_t head; // the owner
+	uint64_t tail; // the writer
+
+	unsigned long drops;
+	unsigned long drops_seen; // the writer
+
+	char *buf;
+} DbgXRing_t;
+
+static DbgX_t dbgx_cfg;
+static int dbgx_isopen = 0;
+static int dbgx_isquit = 0;
+static int dbgx_issleep = 0;
+static unsigned long dbgx_round = 0;
+static long dbgx_pid = 0;
+
+static FILE *dbgx_fp = NULL;
+static pthread_t dbgx_tid;
+static pthread_mutex_t dbgx_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dbgx_cond = PTHREAD_COND_INITIALIZER;
+
+static DbgXRing_t *dbgx_ring_list = NULL;
+static pthread_once_t dbgx_once = PTHREAD_ONCE_INIT;
+static pthread_key_t dbgx_key;
+
+static __thread DbgXRing_t *dbgx_ring = NULL;
+static __thread int dbgx_isbusy = 0; // the writer itself, or SAFE_CALLOC of a new ring
+
+static int dbgx_syslog_prio(const char *color)
+{
+	if (SAFE_STRCMP((char *)color, COLORX_RED) == 0)
+	{
+		return LOG_ERR;
+	}
+	else if (SAFE_STRCMP((char *)color, COLORX_PURPLE) == 0)
+	{
+		return LOG_WARNING;
+	}
+	else if ((SAFE_STRCMP((char *)color, COLORX_YELLOW) == 0) || (SAFE_STRCMP((char *)color, COLORX_LIGHT_GREEN) == 0))
+	{
+		return LOG_INFO;
+	}
+	return LOG_DEBUG;
+}
+
+// the same output as printf(color "[%02ld/%u] %s:%d - " format "" COLORX_NONE "\n", ...)
+static int dbgx_line(char *buf, int buf_len, const char *color, long pid, unsigned int tid, const char *func, int line, int flags, struct timespec *ts, const char *text, int text_len)
+{
+	int len = 0;
+	int iscolor = (dbgx_isopen) ? dbgx_cfg.iscolor : 1;
+
+	if ((dbgx_isopen) && (dbgx_cfg.istime) && (ts))
+	{
+		struct tm tm_now;
+		localtime_r(&ts->tv_sec, &tm_now);
+		len += snprintf(buf + len, buf_len - len, "%02d:%02d:%02d.%06ld ", tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec, ts->tv_nsec / 1000);
+	}
+	if (iscolor)
+	{
+		len += snprintf(buf + len, buf_len - len, "%s", color);
+	}
+	if (flags & DBGX_FLAG_PREFIX)
+	{
+		len += snprintf(buf + len, buf_len - len, "[%02ld/%u] %s:%d - ", pid, tid, func, line);
+	}
+	if (len < buf_len)
+	{
+		len += snprintf(buf + len, buf_len - len, "%.*s", text_len, text);
+	}
+	if ((iscolor) && (len < buf_len))
+	{
+		len += snprintf(buf + len, buf_len - len, "%s", COLORX_NONE);
+	}
+	if ((flags & DBGX_FLAG_LN) && (len < buf_len))
+	{
+		len += snprintf(buf + len, buf_len - len, "\n");
+	}
+
+	return (len < buf_len) ? len : buf_len - 1;
+}
+
+static void dbgx_sync_print(const char *color, const char *func, int line, int flags, const char *format, va_list ap)
+{
+	if ((dbgx_isopen) && (dbgx_cfg.sink == DBGX_SINK_ID_SYSLOG))
+	{
+		char text[LEN_OF_DBGX_TEXT] = "";
+		vsnprintf(text, sizeof(text), format, ap);
+		syslog(dbgx_syslog_prio(color), "[%u] %s:%d - %s", (unsigned int)gettidv1_ex(), func, line, text);
+		return;
+	}
+
+	FILE *fp = ((dbgx_isopen) && (dbgx_fp)) ? dbgx_fp : stdout;
+	char prefix[LEN_OF_BUF512] = "";
+	char suffix[LEN_OF_VAL16] = "";
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	// the prefix and the suffix of dbgx_line, the text is printed between them
+	int len = dbgx_line(prefix, sizeof(prefix), color, (long)getpid(), (unsigned int)gettidv1_ex(), func, line, flags & DBGX_FLAG_PREFIX, &ts, "", 0);
+	int iscolor = (dbgx_isopen) ? dbgx_cfg.iscolor : 1;
+	if (iscolor)
+	{
+		len -= strlen(COLORX_NONE);
+		SAFE_SPRINTF_EX(suffix, "%s", COLORX_NONE);
+	}
+	if (flags & DBGX_FLAG_LN)
+	{
+		SAFE_STRCAT(suffix, "\n");
+	}
+
+	flockfile(fp);
+	fwrite_unlocked(prefix, 1, len, fp);
+	vfprintf(fp, format, ap);
+	fputs_unlocked(suffix, fp);
+	funlockfile(fp);
+}
+
+static void dbgx_ring_exit(void *arg)
+{
+	DbgXRing_t *ring = (DbgXRing_t *)arg;
+	// the destructors after this one print directly
+	dbgx_ring = NULL;
+	dbgx_isbusy = 1;
+	__atomic_store_n(&ring->isexit, 1, __ATOMIC_RELEASE);
+}
+
+static void dbgx_atfork_child(void)
+{
+	// the writer is not in the child
+	dbgx_isopen = 0;
+	dbgx_ring = NULL;
+	dbgx_ring_list = NULL;
+	pthread_mutex_init(&dbgx_mtx, NULL);
+}
+
+static void dbgx_once_init(void)
+{
+	pthread_key_create(&dbgx_key, dbgx_ring_exit);
+	pthread_atfork(NULL, NULL, dbgx_atfork_child);
+}
+
+static DbgXRing_t *dbgx_ring_get(void)
+{
+	if (dbgx_ring == NULL)
+	{
+		dbgx_isbusy = 1;
+		DbgXRing_t *ring = (DbgXRing_t *)SAFE_CALLOC(1, sizeof(DbgXRing_t));
+		if (ring)
+		{
+			ring->size = (dbgx_cfg.ring_size > 0) ? dbgx_cfg.ring_size : DBGX_RING_SIZE;
+			ring->buf = (char *)SAFE_CALLOC(1, ring->size);
+			if (ring->buf == NULL)
+			{
+				SAFE_FREE(ring);
+			}
+		}
+		dbgx_isbusy = 0;
+
+		if (ring)
+		{
+			ring->tid = (unsigned int)gettidv1_ex();
+			pthread_setspecific(dbgx_key, ring);
+
+			SAFE_THREAD_LOCK(&dbgx_mtx);
+			ring->next = dbgx_ring_list;
+			dbgx_ring_list = ring;
+			SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+			dbgx_ring = ring;
+		}
+	}
+	return dbgx_ring;
+}
+
+static void dbgx_wakeup(void)
+{
+	if (__atomic_load_n(&dbgx_issleep, __ATOMIC_RELAXED))
+	{
+		SAFE_THREAD_LOCK(&dbgx_mtx);
+		pthread_cond_signal(&dbgx_cond);
+		SAFE_THREAD_UNLOCK(&dbgx_mtx);
+	}
+}
+
+// 0: in the ring, -1: full
+static int dbgx_ring_push(DbgXRing_t *ring, const char *color, const char *func, int line, int flags, struct timespec *ts, const char *text, int text_len)
+{
+	uint32_t need = DBGX_ALIGN(sizeof(DbgXRecord_t) + text_len);
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint32_t off = head & (ring->size - 1);
+	uint32_t contiguous = ring->size - off;
+	uint32_t total = (contiguous < need) ? (need + contiguous) : need;
+
+	if (ring->size - (uint32_t)(head - tail) < total)
+	{
+		return -1;
+	}
+
+	if (contiguous < need)
+	{
+		*(uint32_t *)(ring->buf + off) = DBGX_RECORD_PAD | contiguous;
+		head += contiguous;
+		off = 0;
+	}
+
+	DbgXRecord_t *record = (DbgXRecord_t *)(ring->buf + off);
+	record->len = need;
+	record->flags = flags;
+	record->text_len = text_len;
+	record->line = line;
+	record->color = color;
+	record->func = func;
+	record->ts = *ts;
+	memcpy(record->text, text, text_len);
+
+	__atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+
+	if (((uint32_t)(head + need - tail) > (ring->size / 2)) || (SAFE_STRCMP((char *)color, COLORX_RED) == 0))
+	{
+		dbgx_wakeup();
+	}
+	return 0;
+}
+
+void dbgx_printf(const char *color, const char *func, int line, int flags, const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+
+	if ((__atomic_load_n(&dbgx_isopen, __ATOMIC_ACQUIRE) == 0) || (dbgx_isbusy) || (dbgx_ring_get() == NULL))
+	{
+		dbgx_sync_print(color, func, line, flags, format, ap);
+		va_end(ap);
+		return;
+	}
+
+	DbgXRing_t *ring = dbgx_ring;
+	char text[LEN_OF_DBGX_TEXT];
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+	int text_len = vsnprintf(text, sizeof(text), format, ap_copy);
+	va_end(ap_copy);
+
+	if ((text_len < 0) || (text_len >= (int)sizeof(text)) || (DBGX_ALIGN(sizeof(DbgXRecord_t) + text_len) > ring->size / 4))
+	{
+		dbgx_sync_print(color, func, line, flags, format, ap);
+		va_end(ap);
+		return;
+	}
+	va_end(ap);
+
+	while (dbgx_ring_push(ring, color, func, line, flags, &ts, text, text_len) != 0)
+	{
+		switch (dbgx_cfg.overflow)
+		{
+			case DBGX_OVERFLOW_ID_BLOCK:
+				if (__atomic_load_n(&dbgx_isopen, __ATOMIC_ACQUIRE))
+				{
+					dbgx_wakeup();
+					sched_yield();
+					continue;
+				}
+				// closed, nobody drains it
+				// fall through
+			case DBGX_OVERFLOW_ID_SYNC:
+				{
+					va_list ap_sync;
+					va_start(ap_sync, format);
+					dbgx_sync_print(color, func, line, flags, format, ap_sync);
+					va_end(ap_sync);
+				}
+				return;
+			case DBGX_OVERFLOW_ID_DROP:
+			default:
+				__atomic_add_fetch(&ring->drops, 1, __ATOMIC_RELAXED);
+				return;
+		}
+	}
+}
+
+static DbgXRecord_t *dbgx_ring_peek(DbgXRing_t *ring)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	while (ring->tail < head)
+	{
+		DbgXRecord_t *record = (DbgXRecord_t *)(ring->buf + (ring->tail & (ring->size - 1)));
+		if (record->len & DBGX_RECORD_PAD)
+		{
+			__atomic_store_n(&ring->tail, ring->tail + (record->len & ~DBGX_RECORD_PAD), __ATOMIC_RELEASE);
+			continue;
+		}
+		return record;
+	}
+	return NULL;
+}
+
+static void dbgx_write(DbgXRing_t *ring, DbgXRecord_t *record)
+{
+	if (dbgx_cfg.sink == DBGX_SINK_ID_SYSLOG)
+	{
+		if (record->flags & DBGX_FLAG_PREFIX)
+		{
+			syslog(dbgx_syslog_prio(record->color), "[%u] %s:%d - %.*s", ring->tid, record->func, record->line, record->text_len, record->text);
+		}
+		else
+		{
+			syslog(dbgx_syslog_prio(record->color), "%.*s", record->text_len, record->text);
+		}
+	}
+	else if (dbgx_fp)
+	{
+		char buf[LEN_OF_DBGX_TEXT + LEN_OF_BUF512];
+		int len = dbgx_line(buf, sizeof(buf), record->color, dbgx_pid, ring->tid, record->func, record->line, record->flags, &record->ts, record->text, record->text_len);
+		fwrite_unlocked(buf, 1, len, dbgx_fp);
+	}
+}
+
+static void dbgx_write_drops(DbgXRing_t *ring)
+{
+	unsigned long drops = __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+	if (drops != ring->drops_seen)
+	{
+		char text[LEN_OF_BUF256];
+		int text_len = SAFE_SPRINTF_EX(text, "Drop !!! (tid: %u, drops: %lu)", ring->tid, drops - ring->drops_seen);
+		ring->drops_seen = drops;
+
+		char buf[LEN_OF_BUF512];
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		if (dbgx_cfg.sink == DBGX_SINK_ID_SYSLOG)
+		{
+			syslog(LOG_WARNING, "%s", text);
+		}
+		else if (dbgx_fp)
+		{
+			int len = dbgx_line(buf, sizeof(buf), COLORX_PURPLE, dbgx_pid, (unsigned int)gettidv1_ex(), __FUNCTION__, __LINE__, DBGX_FLAG_PREFIX|DBGX_FLAG_LN, &ts, text, text_len);
+			fwrite_unlocked(buf, 1, len, dbgx_fp);
+		}
+	}
+}
+
+// merges the rings by timestamp, it returns the number of records
+static int dbgx_drain(void)
+{
+	int count = 0;
+
+	// a new ring is put in front, the ones behind are only removed by the writer
+	SAFE_THREAD_LOCK(&dbgx_mtx);
+	DbgXRing_t *ring_list = dbgx_ring_list;
+	SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+	if (dbgx_fp)
+	{
+		flockfile(dbgx_fp);
+	}
+	while (1)
+	{
+		DbgXRing_t *ring_min = NULL;
+		DbgXRecord_t *record_min = NULL;
+
+		DbgXRing_t *ring = ring_list;
+		while (ring)
+		{
+			DbgXRecord_t *record = dbgx_ring_peek(ring);
+			if ((record) && ((record_min == NULL)
+				|| (record->ts.tv_sec < record_min->ts.tv_sec)
+				|| ((record->ts.tv_sec == record_min->ts.tv_sec) && (record->ts.tv_nsec < record_min->ts.tv_nsec))))
+			{
+				ring_min = ring;
+				record_min = record;
+			}
+			ring = ring->next;
+		}
+
+		if (record_min == NULL)
+		{
+			break;
+		}
+		dbgx_write(ring_min, record_min);
+		__atomic_store_n(&ring_min->tail, ring_min->tail + record_min->len, __ATOMIC_RELEASE);
+		count++;
+	}
+
+	{
+		DbgXRing_t *ring = ring_list;
+		while (ring)
+		{
+			dbgx_write_drops(ring);
+			ring = ring->next;
+		}
+	}
+	if (dbgx_fp)
+	{
+		funlockfile(dbgx_fp);
+		fflush(dbgx_fp);
+	}
+
+	// the rings of the finished threads
+	SAFE_THREAD_LOCK(&dbgx_mtx);
+	DbgXRing_t **ring_ptr = &dbgx_ring_list;
+	while (*ring_ptr)
+	{
+		DbgXRing_t *ring = *ring_ptr;
+		if ((__atomic_load_n(&ring->isexit, __ATOMIC_ACQUIRE)) && (dbgx_ring_peek(ring) == NULL))
+		{
+			*ring_ptr = ring->next;
+			SAFE_FREE(ring->buf);
+			SAFE_FREE(ring);
+			continue;
+		}
+		ring_ptr = &ring->next;
+	}
+	SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+	return count;
+}
+
+static void *dbgx_thread_handler(void *user)
+{
+	dbgx_isbusy = 1;
+
+	while (1)
+	{
+		int count = dbgx_drain();
+
+		SAFE_THREAD_LOCK(&dbgx_mtx);
+		dbgx_round++;
+		if (dbgx_isquit)
+		{
+			SAFE_THREAD_UNLOCK(&dbgx_mtx);
+			break;
+		}
+		if (count == 0)
+		{
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += DBGX_FLUSH_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+
+			__atomic_store_n(&dbgx_issleep, 1, __ATOMIC_RELAXED);
+			pthread_cond_timedwait(&dbgx_cond, &dbgx_mtx, &ts);
+			__atomic_store_n(&dbgx_issleep, 0, __ATOMIC_RELAXED);
+		}
+		SAFE_THREAD_UNLOCK(&dbgx_mtx);
+	}
+
+	// the last ones
+	dbgx_drain();
+	return NULL;
+}
+
+unsigned long dbgx_drops(void)
+{
+	unsigned long drops = 0;
+
+	SAFE_THREAD_LOCK(&dbgx_mtx);
+	DbgXRing_t *ring = dbgx_ring_list;
+	while (ring)
+	{
+		drops += __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+		ring = ring->next;
+	}
+	SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+	return drops;
+}
+
+// waits for 2 rounds of the writer, the records before this are printed
+void dbgx_flush(void)
+{
+	if ((__atomic_load_n(&dbgx_isopen, __ATOMIC_ACQUIRE) == 0) || (dbgx_isbusy))
+	{
+		fflush(stdout);
+		return;
+	}
+
+	SAFE_THREAD_LOCK(&dbgx_mtx);
+	unsigned long round = dbgx_round;
+	SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+	while (1)
+	{
+		SAFE_THREAD_LOCK(&dbgx_mtx);
+		int isdone = ((dbgx_round - round) >= 2) || (dbgx_isquit);
+		pthread_cond_signal(&dbgx_cond);
+		SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+		if (isdone)
+		{
+			break;
+		}
+		usleep(1000);
+	}
+}
+
+void dbgx_close(void)
+{
+	SAFE_THREAD_LOCK(&dbgx_mtx);
+	if (dbgx_isopen == 0)
+	{
+		SAFE_THREAD_UNLOCK(&dbgx_mtx);
+		return;
+	}
+	__atomic_store_n(&dbgx_isopen, 0, __ATOMIC_RELEASE);
+	dbgx_isquit = 1;
+	pthread_cond_signal(&dbgx_cond);
+	SAFE_THREAD_UNLOCK(&dbgx_mtx);
+
+	pthread_join(dbgx_tid, NULL);
+
+	if ((dbgx_fp) && (dbgx_fp != stdout))
+	{
+		SAFE_FCLOSE(dbgx_fp);
+	}
+	dbgx_fp = NULL;
+	if (dbgx_cfg.sink == DBGX_SINK_ID_SYSLOG)
+	{
+		closelog();
+	}
+}
+
+int dbgx_open(DbgX_t *dbgx_req)
+{
+	if ((dbgx_req == NULL) || (dbgx_isopen))
+	{
+		return -1;
+	}
+
+	if ((dbgx_req->ring_size > 0) && ((dbgx_req->ring_size & (dbgx_req->ring_size - 1)) || (dbgx_req->ring_size < LEN_OF_DBGX_TEXT * 8)))
+	{
+		DBG_ER_LN("ring_size error !!! (ring_size: %d)", dbgx_req->ring_size);
+		return -1;
+	}
+
+	pthread_once(&dbgx_once, dbgx_once_init);
+
+	switch (dbgx_req->sink)
+	{
+		case DBGX_SINK_ID_FILE:
+			dbgx_fp = SAFE_FOPEN(dbgx_req->filename, "a");
+			if (dbgx_fp == NULL)
+			{
+				DBG_ER_LN("SAFE_FOPEN error !!! (filename: %s)", dbgx_req->filename);
+				return -1;
+			}
+			setvbuf(dbgx_fp, NULL, _IOFBF, DBGX_RING_SIZE);
+			break;
+		case DBGX_SINK_ID_SYSLOG:
+			openlog((strlen(dbgx_req->ident) > 0) ? dbgx_req->ident : NULL, LOG_PID, LOG_USER);
+			break;
+		case DBGX_SINK_ID_STDOUT:
+		default:
+			fflush(stdout);
+			dbgx_fp = stdout;
+			break;
+	}
+
+	SAFE_MEMCPY(&dbgx_cfg, dbgx_req, sizeof(DbgX_t), sizeof(DbgX_t));
+	dbgx_pid = (long)getpid();
+	dbgx_isquit = 0;
+
+	if (pthread_create(&dbgx_tid, NULL, dbgx_thread_handler, NULL) != 0)
+	{
+		DBG_ER_LN("pthread_create error !!! (errno: %d %s)", errno, strerror(errno));
+		if ((dbgx_fp) && (dbgx_fp != stdout))
+		{
+			SAFE_FCLOSE(dbgx_fp);
+		}
+		dbgx_fp = NULL;
+		return -1;
+	}
+
+	__atomic_store_n(&dbgx_isopen, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+#endif
@@ -22,8 +22,18 @@
 // ** app **
 static int is_quit = 0;
 static int is_service = 0;
+static int is_uv = 0;
+static int async_count = 0;
 char msg[LEN_OF_BUF4096]="";
 
+#ifdef UTIL_EX_UV
+static uv_loop_t *uv_loop = NULL;
+static uv_timer_t uv_timer_quit_fd;
+
+static int async_reply = 0;
+static int async_error = 0;
+#endif
+
 static DbusX_t dbusx_456 =
 {
 	.name = "dbusx_456",
@@ -105,6 +115,33 @@ static int app_quit(void)
 	return is_quit;
 }
 
+#ifdef UTIL_EX_UV
+static void timer_quit_loop(uv_timer_t *handle)
+{
+	if (app_quit())
+	{
+		SAFE_UV_LOOP_STOP(uv_loop);
+	}
+}
+
+static void dbus_reply_cb(DBusMessage *dbus_msg_res, char *retStr, void *usr_data)
+{
+	if (retStr)
+	{
+		async_reply ++;
+	}
+	else
+	{
+		async_error ++;
+	}
+
+	if (async_reply + async_error >= async_count)
+	{
+		SAFE_UV_LOOP_STOP(uv_loop);
+	}
+}
+#endif
+
 static void app_set_quit(int mode)
 {
 	is_quit = mode;
@@ -116,7 +153,7 @@ static void app_stop(void)
 	{
 		app_set_quit(1);
 
-		if (is_service)
+		if ((is_service) && (is_uv==0))
 		{
 			dbusx_thread_close(&dbusx_456);
 		}
@@ -125,7 +162,56 @@ static void app_stop(void)
 
 static void app_loop(void)
 {
-	if (is_service)
+	if ((is_service) && (is_uv))
+	{
+#ifdef UTIL_EX_UV
+		SAFE_UV_LOOP_INIT(uv_loop);
+		SAFE_UV_TIMER_INIT(uv_loop, &uv_timer_quit_fd);
+		SAFE_UV_TIMER_START(&uv_timer_quit_fd, timer_quit_loop, 1000, 1000);
+
+		if (dbusx_uv_init(dbus_match_cb, dbus_filter_cb, &dbusx_456, uv_loop) == 0)
+		{
+			SAFE_UV_LOOP_RUN(uv_loop);
+		}
+
+		dbusx_uv_close(&dbusx_456);
+		SAFE_UV_LOOP_CLOSE_VALGRIND(uv_loop);
+#else
+		DBG_ER_LN("%s", DBG_TXT_NO_SUPPORT);
+#endif
+	}
+	else if (async_count > 0)
+	{
+#ifdef UTIL_EX_UV
+		// all the calls are sent before the first reply
+		SAFE_UV_LOOP_INIT(uv_loop);
+
+		if (dbusx_uv_init(NULL, NULL, &dbusx_456, uv_loop) == 0)
+		{
+			unsigned long long start = metricx_now_us();
+			int i = 0;
+			for (i = 0; i < async_count; i++)
+			{
+				if (dbusx_method_simple_str2async(&dbusx_456, DBUS_DEST_LANKAHSU520, DBUS_M_IFAC_LANKAHSU520_DEMO, DBUS_METHOD_COMMAND, msg, TIMEOUT_OF_DBUS_REPLY, dbus_reply_cb, NULL) == -1)
+				{
+					async_error ++;
+				}
+			}
+
+			if (async_reply + async_error < async_count)
+			{
+				SAFE_UV_LOOP_RUN(uv_loop);
+			}
+			DBG_IF_LN("(async_count: %d, async_reply: %d, async_error: %d, elapsed: %llu us)", async_count, async_reply, async_error, metricx_now_us() - start);
+		}
+
+		dbusx_uv_close(&dbusx_456);
+		SAFE_UV_LOOP_CLOSE_VALGRIND(uv_loop);
+#else
+		DBG_ER_LN("%s", DBG_TXT_NO_SUPPORT);
+#endif
+	}
+	else if (is_service)
 	{
 		dbusx_thread_init(dbus_match_cb, dbus_filter_cb, &dbusx_456);
 
@@ -215,11 +301,22 @@ static void app_signal_register(void)
 }
 
 int option_index = 0;
-const char* short_options = "d:e:sh";
+#ifdef UTIL_EX_UV
+const char* short_options = "d:e:suSa:h";
+#else
+const char* short_options = "d:e:sSh";
+#endif
 static struct option long_options[] =
 {
 	{ "debug",       required_argument,   NULL,    'd'  },
 	{ "service",     no_argument,         NULL,    's'  },
+#ifdef UTIL_EX_UV
+	{ "uv",          no_argument,         NULL,    'u'  },
+#endif
+	{ "session",     no_argument,         NULL,    'S'  },
+#ifdef UTIL_EX_UV
+	{ "async",       required_argument,   NULL,    'a'  },
+#endif
 	{ "echo",        no_argument,         NULL,    'e'  },
 	{ "help",        no_argument,         NULL,    'h'  },
 	{ 0,             0,                      0,    0    }
@@ -231,10 +328,21 @@ static void app_showusage(int exit_code)
 		"  -d, --debug       debug level\n"
 		"  -e, --echo        message\n"
 		"  -s, --service\n"
+#ifdef UTIL_EX_UV
+		"  -u, --uv          service on uv_loop instead of a thread\n"
+#endif
+		"  -S, --session     session bus\n"
+#ifdef UTIL_EX_UV
+		"  -a, --async       count of the pipelined method calls\n"
+#endif
 		"  -h, --help\n", TAG);
 	printf("Version: %s\n", version_show());
 	printf("Example:\n"
-		"  %s -d 4 -s\n", TAG);
+		"  %s -d 4 -s\n"
+		"  %s -S -e 123\n", TAG, TAG);
+#ifdef UTIL_EX_UV
+	printf("  %s -S -a 1000 -e 123\n", TAG);
+#endif
 	exit(exit_code);
 }
 
@@ -261,6 +369,22 @@ static void app_ParseArguments(int argc, char **argv)
 			case 's':
 				is_service = 1;
 				break;
+#ifdef UTIL_EX_UV
+			case 'u':
+				is_uv = 1;
+				break;
+#endif
+			case 'S':
+				dbusx_456.issession = 1;
+				break;
+#ifdef UTIL_EX_UV
+			case 'a':
+				if (optarg)
+				{
+					async_count = atoi(optarg);
+				}
+				break;
+#endif
 			default:
 				app_showusage(-1);
 				break;
@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_DBUS
 #include "utilx9.h"
 
 // DBUS_S_NAME_COMMAND -> DBUS_TYPE_STRING
@@ -321,37 +322,26 @@ exit_send:
 	return retStr;
 }
 
-char *dbusx_method_helper_simple(DBusConnection *dbus_conn, char *dbus_path, const char *dest, const char *ifac, char *cmd, int itype, void *arg, int otype, int timeout)
+static DBusMessage *dbusx_method_new(char *dbus_path, const char *dest, const char *ifac, char *cmd, int itype, void *arg)
 {
-	DBusError dbus_err;
 	DBusMessage *dbus_msg_req = NULL;
-	DBusMessage *dbus_msg_res = NULL;
-	DBusMessageIter dbus_iter;
-	char *retStr = NULL;
-
-	SAFE_DBUS_ERR_INIT(&dbus_err);
 
-	if (dbus_conn == NULL)
-	{
-		DBG_ER_LN("dbus_conn is NULL !!!");
-		goto exit_send;
-	}
-	else if ((ifac == NULL) || (cmd == NULL))
+	if ((ifac == NULL) || (cmd == NULL))
 	{
 		DBG_ER_LN("ifac or cmd is NULL !!! (ifac: %p, cmd: %p)", ifac, cmd);
-		goto exit_send;
+		return NULL;
 	}
 	else if (arg == NULL)
 	{
 		DBG_ER_LN("arg is NULL !!!");
-		goto exit_send;
+		return NULL;
 	}
 
 	dbus_msg_req = dbus_message_new_method_call(dest, dbus_path, ifac, cmd);
 	if (NULL == dbus_msg_req)
 	{
 		DBG_ER_LN("dbus_message_new_method_call error !!!");
-		goto exit_send;
+		return NULL;
 	}
 
 	switch (itype)
@@ -361,7 +351,7 @@ char *dbusx_method_helper_simple(DBusConnection *dbus_conn, char *dbus_path, con
 		case DBUS_TYPE_STRING:
 			if (!dbus_message_append_args(dbus_msg_req, DBUS_TYPE_STRING, (char *)&arg, DBUS_TYPE_INVALID))
 			{
-				goto exit_send;
+				SAFE_DBUS_MSG_FREE(dbus_msg_req);
 			}
 			break;
 		case DBUS_TYPE_BYTE:
@@ -375,11 +365,100 @@ char *dbusx_method_helper_simple(DBusConnection *dbus_conn, char *dbus_path, con
 		default:
 			if (!dbus_message_append_args(dbus_msg_req, itype, arg, DBUS_TYPE_INVALID))
 			{
-				goto exit_send;
+				SAFE_DBUS_MSG_FREE(dbus_msg_req);
 			}
 			break;
 	}
 
+	return dbus_msg_req;
+}
+
+static char *dbusx_reply_parse(DBusMessage *dbus_msg_res)
+{
+	DBusMessageIter dbus_iter;
+	char *retStr = NULL;
+
+	if (!dbus_message_iter_init(dbus_msg_res, &dbus_iter))
+	{
+		DBG_ER_LN("dbus_message_iter_init error !!!");
+	}
+	else
+	{
+		int ctype = DBUS_TYPE_INVALID;
+		while ((ctype = dbus_message_iter_get_arg_type(&dbus_iter)) != DBUS_TYPE_INVALID)
+		{
+			switch (ctype)
+			{
+				case DBUS_TYPE_STRING:
+				{
+					char *response = NULL;
+					dbus_message_iter_get_basic(&dbus_iter, &response);
+					if (response)
+					{
+						SAFE_ASPRINTF(retStr, "%s", response);
+					}
+				}
+				break;
+#ifdef UTIL_EX_JSON
+				case DBUS_TYPE_ARRAY:
+				{
+					json_t *jitem_ary = JSON_ARY_NEW();
+					DBusMessageIter dSubIter;
+					dbus_message_iter_recurse(&dbus_iter, &dSubIter);
+					do
+					{
+						char *item = NULL;
+						dbus_message_iter_get_basic(&dSubIter, &item);
+
+						if (item)
+						{
+							JSON_ARY_APPEND_STR(jitem_ary, item);
+							DBG_DB_LN("(item: %s)", item);
+						}
+					} while (dbus_message_iter_next(&dSubIter) == TRUE);
+
+					retStr = JSON_DUMPS_EASY(jitem_ary);
+					JSON_FREE(jitem_ary);
+				}
+#endif
+				case DBUS_TYPE_VARIANT:
+					break;
+				default:
+				{
+					int response = 0;
+					dbus_message_iter_get_basic(&dbus_iter, &response);
+					SAFE_ASPRINTF(retStr, "%d", response);
+				}
+				break;
+			}
+			dbus_message_iter_next(&dbus_iter);
+		}
+	}
+
+	return retStr;
+}
+
+char *dbusx_method_helper_simple(DBusConnection *dbus_conn, char *dbus_path, const char *dest, const char *ifac, char *cmd, int itype, void *arg, int otype, int timeout)
+{
+	DBusError dbus_err;
+	DBusMessage *dbus_msg_req = NULL;
+	DBusMessage *dbus_msg_res = NULL;
+	char *retStr = NULL;
+
+	SAFE_DBUS_ERR_INIT(&dbus_err);
+
+	if (dbus_conn == NULL)
+	{
+		DBG_ER_LN("dbus_conn is NULL !!!");
+		goto exit_send;
+	}
+
+	dbus_msg_req = dbusx_method_new(dbus_path, dest, ifac, cmd, itype, arg);
+	if (dbus_msg_req == NULL)
+	{
+		goto exit_send;
+	}
+
 	if (otype == DBUS_TYPE_INVALID)
 	{
 		if (!dbus_connection_send(dbus_conn, dbus_msg_req, NULL))
@@ -397,62 +476,7 @@ char *dbusx_method_helper_simple(DBusConnection *dbus_conn, char *dbus_path, con
 		}
 		else
 		{
-			if (!dbus_message_iter_init(dbus_msg_res, &dbus_iter))
-			{
-				DBG_ER_LN("dbus_message_iter_init error !!! (message: %s)", dbus_err.message);
-			}
-			else
-			{
-				int ctype = DBUS_TYPE_INVALID;
-				while ((ctype = dbus_message_iter_get_arg_type(&dbus_iter)) != DBUS_TYPE_INVALID)
-				{
-					switch (ctype)
-					{
-						case DBUS_TYPE_STRING:
-						{
-							char *response = NULL;
-							dbus_message_iter_get_basic(&dbus_iter, &response);
-							if (response)
-							{
-								SAFE_ASPRINTF(retStr, "%s", response);
-							}
-						}
-						break;
-#ifdef UTIL_EX_JSON
-						case DBUS_TYPE_ARRAY:
-						{
-							json_t *jitem_ary = JSON_ARY_NEW();
-							DBusMessageIter dSubIter;
-							dbus_message_iter_recurse(&dbus_iter, &dSubIter);
-							do
-							{
-								char *item = NULL;
-								dbus_message_iter_get_basic(&dSubIter, &item);
-
-								if (item)
-								{
-									JSON_ARY_APPEND_STR(jitem_ary, item);
-									DBG_DB_LN("(item: %s)", item);
-								}
-							} while (dbus_message_iter_next(&dSubIter) == TRUE);
-
-							retStr = JSON_DUMPS_EASY(jitem_ary);
-							JSON_FREE(jitem_ary);
-						}
-#endif
-						case DBUS_TYPE_VARIANT:
-							break;
-						default:
-						{
-							int response = 0;
-							dbus_message_iter_get_basic(&dbus_iter, &response);
-							SAFE_ASPRINTF(retStr, "%d", response);
-						}
-						break;
-					}
-					dbus_message_iter_next(&dbus_iter);
-				}
-			}
+			retStr = dbusx_reply_parse(dbus_msg_res);
 		}
 	}
 
@@ -515,6 +539,121 @@ void dbusx_method_simple_str2null(DbusX_t *dbusx_req, const char *dest, const ch
 	SAFE_FREE(retStr);
 }
 
+typedef struct DbusXPending_Struct
+{
+	dbusx_reply_fn *reply_cb;
+	void *usr_data;
+} DbusXPending_t;
+
+static void dbusx_pending_free(void *memory)
+{
+	SAFE_FREE(memory);
+}
+
+static void dbusx_pending_notify(DBusPendingCall *pending, void *user_data)
+{
+	DbusXPending_t *pending_req = (DbusXPending_t *)user_data;
+	DBusMessage *dbus_msg_res = dbus_pending_call_steal_reply(pending);
+	char *retStr = NULL;
+
+	if (dbus_msg_res == NULL)
+	{
+		DBG_ER_LN("dbus_pending_call_steal_reply error !!!");
+	}
+	else if (dbus_message_get_type(dbus_msg_res) == DBUS_MESSAGE_TYPE_ERROR)
+	{
+		DBG_ER_LN("dbus reply error !!! (error: %s)", dbus_message_get_error_name(dbus_msg_res));
+	}
+	else
+	{
+		retStr = dbusx_reply_parse(dbus_msg_res);
+	}
+
+	if (pending_req->reply_cb)
+	{
+		pending_req->reply_cb(dbus_msg_res, retStr, pending_req->usr_data);
+	}
+
+	SAFE_FREE(retStr);
+	SAFE_DBUS_MSG_FREE(dbus_msg_res);
+}
+
+// the reply comes back by reply_cb when dbus_conn is dispatched (dbusx_uv_init), so many calls can be outstanding on one connection.
+// reply_cb gets retStr == NULL for an error reply (including the timeout), retStr is freed after reply_cb.
+// uv mode only, please call it on the thread of the uv_loop. libdbus adds the timeout and the watch (uv_timer_start, uv_poll_start)
+// from dbus_connection_send_with_reply, and libuv isn't thread-safe. dbus_conn of dbusx_thread_init is never dispatched, reply_cb wouldn't come.
+int dbusx_method_helper_async(DBusConnection *dbus_conn, char *dbus_path, const char *dest, const char *ifac, char *cmd, int itype, void *arg, int timeout, dbusx_reply_fn *reply_cb, void *usr_data)
+{
+	int ret = -1;
+	DBusMessage *dbus_msg_req = NULL;
+	DBusPendingCall *pending = NULL;
+	DbusXPending_t *pending_req = NULL;
+
+	if (dbus_conn == NULL)
+	{
+		DBG_ER_LN("dbus_conn is NULL !!!");
+		goto exit_async;
+	}
+
+	dbus_msg_req = dbusx_method_new(dbus_path, dest, ifac, cmd, itype, arg);
+	if (dbus_msg_req == NULL)
+	{
+		goto exit_async;
+	}
+
+	pending_req = (DbusXPending_t *)SAFE_CALLOC(1, sizeof(DbusXPending_t));
+	if (pending_req == NULL)
+	{
+		goto exit_async;
+	}
+	pending_req->reply_cb = reply_cb;
+	pending_req->usr_data = usr_data;
+
+	if ((!dbus_connection_send_with_reply(dbus_conn, dbus_msg_req, &pending, timeout)) || (pending == NULL))
+	{
+		// pending is NULL when dbus_conn is disconnected
+		DBG_ER_LN("dbus_connection_send_with_reply error !!! (pending: %p)", pending);
+		SAFE_FREE(pending_req);
+		goto exit_async;
+	}
+
+	if (!dbus_pending_call_set_notify(pending, dbusx_pending_notify, pending_req, dbusx_pending_free))
+	{
+		DBG_ER_LN("dbus_pending_call_set_notify error !!!");
+		dbus_pending_call_cancel(pending);
+		SAFE_FREE(pending_req);
+		goto exit_async;
+	}
+
+	ret = 0;
+
+exit_async:
+	// dbus_conn keeps its own reference until the reply
+	if (pending)
+	{
+		dbus_pending_call_unref(pending);
+	}
+	SAFE_DBUS_MSG_FREE(dbus_msg_req);
+
+	return ret;
+}
+
+// uv mode only (dbusx_uv_init), on the thread of the uv_loop
+int dbusx_method_simple_str2async(DbusX_t *dbusx_req, const char *dest, const char *ifac, char *cmd, char *arg, int timeout, dbusx_reply_fn *reply_cb, void *usr_data)
+{
+#ifdef UTIL_EX_UV
+	if ((dbusx_req == NULL) || (dbusx_req->uv_conn == NULL))
+#endif
+	{
+		DBG_ER_LN("uv_conn is NULL, please call dbusx_uv_init first !!!");
+		return -1;
+	}
+
+	DBusConnection *dbus_conn = dbusx_conn_get(dbusx_req);
+	char *dbus_path = dbusx_path_get(dbusx_req);
+	return dbusx_method_helper_async(dbus_conn, dbus_path, dest, ifac, cmd, DBUS_TYPE_STRING, (void*)arg, timeout, reply_cb, usr_data);
+}
+
 static DBusHandlerResult dbusx_filter(DBusConnection *connection, DBusMessage *message, void *usr_data)
 {
 	dbus_bool_t handled = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -559,6 +698,11 @@ void dbusx_conn_free(DbusX_t *dbusx_req)
 	}
 }
 
+static DBusBusType dbusx_bus_type(DbusX_t *dbusx_req)
+{
+	return (dbusx_req->issession) ? DBUS_BUS_SESSION : DBUS_BUS_SYSTEM;
+}
+
 int dbusx_client_init(DbusX_t *dbusx_req)
 {
 	int ret = -1;
@@ -567,7 +711,7 @@ int dbusx_client_init(DbusX_t *dbusx_req)
 	// initialize the errors
 	SAFE_DBUS_ERR_INIT(&dbus_err);
 
-	if ((dbusx_req->dbus_conn = dbus_bus_get_private(DBUS_BUS_SYSTEM, &dbus_err)) == NULL)
+	if ((dbusx_req->dbus_conn = dbus_bus_get_private(dbusx_bus_type(dbusx_req), &dbus_err)) == NULL)
 	{
 		DBG_ER_LN("dbus_bus_get_private error !!! (message: %s)", dbus_err.message);
 		goto exit_init;
@@ -603,6 +747,44 @@ static int dbusx_add_match(DBusConnection *dbus_listen, DBusError *err, void *us
 	return ret;
 }
 
+static int dbusx_listen_init(DbusX_t *dbusx_req)
+{
+	int ret = -1;
+	DBusError dbus_err;
+
+	SAFE_DBUS_ERR_INIT(&dbus_err);
+	dbusx_req->dbus_conn_listen = dbus_bus_get_private(dbusx_bus_type(dbusx_req), &dbus_err);
+	if (dbus_error_is_set(&dbus_err))
+	{
+		DBG_ER_LN("dbus_bus_get_private error !!! (message: %s)", dbus_err.message);
+		goto exit_listen;
+	}
+
+	if (NULL == dbusx_req->dbus_conn_listen)
+	{
+		DBG_ER_LN("dbus_conn_listen is NULL !!!");
+		goto exit_listen;
+	}
+
+	if (!dbus_connection_add_filter(dbusx_req->dbus_conn_listen, dbusx_filter, (void *)dbusx_req, NULL))
+	{
+		DBG_ER_LN("dbus_connection_add_filter error !!!");
+		goto exit_listen;
+	}
+
+	if (dbusx_add_match(dbusx_req->dbus_conn_listen, &dbus_err, (void *)dbusx_req) != 0)
+	{
+		goto exit_listen;
+	}
+
+	ret = 0;
+
+exit_listen:
+	SAFE_DBUS_ERR_FREE(&dbus_err);
+
+	return ret;
+}
+
 static void *dbusx_thread_handler(void *user)
 {
 	DbusX_t *dbusx_req = (DbusX_t*)user;
@@ -612,8 +794,6 @@ static void *dbusx_thread_handler(void *user)
 		ThreadX_t *tidx_req = &dbusx_req->tidx;
 		threadx_detach(tidx_req);
 
-		DBusError dbus_err;
-
 		if (dbusx_req_check(dbusx_req) == -1)
 		{
 			goto exit_dbus;
@@ -625,27 +805,7 @@ static void *dbusx_thread_handler(void *user)
 			goto exit_dbus;
 		}
 
-		SAFE_DBUS_ERR_INIT(&dbus_err);
-		dbusx_req->dbus_conn_listen = dbus_bus_get_private(DBUS_BUS_SYSTEM, &dbus_err);
-		if (dbus_error_is_set(&dbus_err))
-		{
-			DBG_ER_LN("dbus_bus_get_private error !!! (message: %s)", dbus_err.message);
-			goto exit_dbus;
-		}
-
-		if (NULL == dbusx_req->dbus_conn_listen)
-		{
-			DBG_ER_LN("dbus_conn_listen is NULL !!!");
-			goto exit_dbus;
-		}
-
-		if (!dbus_connection_add_filter(dbusx_req->dbus_conn_listen, dbusx_filter, (void *)user, NULL))
-		{
-			DBG_ER_LN("dbus_connection_add_filter error !!!");
-			goto exit_dbus;
-		}
-
-		if (dbusx_add_match(dbusx_req->dbus_conn_listen, &dbus_err, (void *)user) != 0)
+		if (dbusx_listen_init(dbusx_req) == -1)
 		{
 			goto exit_dbus;
 		}
@@ -658,7 +818,6 @@ static void *dbusx_thread_handler(void *user)
 
 exit_dbus:
 		dbusx_conn_free(dbusx_req);
-		SAFE_DBUS_ERR_FREE(&dbus_err);
 
 		threadx_leave(tidx_req);
 	}
@@ -857,3 +1016,411 @@ void dbusx_thread_close(DbusX_t *dbusx_req)
 	}
 }
 
+
+#ifdef UTIL_EX_UV
+// libdbus gives the read and the write DBusWatch of the same fd, libuv allows only one uv_poll_t per fd.
+#define MAX_OF_DBUSX_UV_WATCH 4
+
+typedef struct DbusXUvWatch_Struct
+{
+	struct DbusXUvWatch_Struct *next;
+	DbusXUv_t *uv_req;
+
+	int fd;
+	uv_poll_t poll;
+	DBusWatch *watch_ary[MAX_OF_DBUSX_UV_WATCH];
+} DbusXUvWatch_t;
+
+typedef struct DbusXUvTimeout_Struct
+{
+	uv_timer_t timer;
+	DBusTimeout *timeout;
+} DbusXUvTimeout_t;
+
+struct DbusXUv_Struct
+{
+	DBusConnection *dbus_conn;
+	uv_loop_t *loop;
+
+	uv_async_t dispatch;
+	DbusXUvWatch_t *watch_list;
+};
+
+// handle is inside of handle->data
+static void dbusx_uv_free_cb(uv_handle_t *handle)
+{
+	void *data = handle->data;
+	SAFE_FREE(data);
+}
+
+static void dbusx_uv_poll_cb(uv_poll_t *handle, int status, int events);
+
+static void dbusx_uv_watch_update(DbusXUvWatch_t *watch_req)
+{
+	int events = 0;
+	int i = 0;
+
+	for (i = 0; i < MAX_OF_DBUSX_UV_WATCH; i++)
+	{
+		DBusWatch *watch = watch_req->watch_ary[i];
+		if ((watch) && (dbus_watch_get_enabled(watch)))
+		{
+			unsigned int flags = dbus_watch_get_flags(watch);
+			if (flags & DBUS_WATCH_READABLE)
+			{
+				events |= UV_READABLE;
+			}
+			if (flags & DBUS_WATCH_WRITABLE)
+			{
+				events |= UV_WRITABLE;
+			}
+		}
+	}
+
+	if (events)
+	{
+		uv_poll_start(&watch_req->poll, events, dbusx_uv_poll_cb);
+	}
+	else
+	{
+		uv_poll_stop(&watch_req->poll);
+	}
+}
+
+static void dbusx_uv_poll_cb(uv_poll_t *handle, int status, int events)
+{
+	DbusXUvWatch_t *watch_req = (DbusXUvWatch_t *)handle->data;
+	int i = 0;
+
+	// dbus_watch_handle might remove the watches, watch_req is freed by the close callback later
+	for (i = 0; i < MAX_OF_DBUSX_UV_WATCH; i++)
+	{
+		DBusWatch *watch = watch_req->watch_ary[i];
+		if ((watch) && (dbus_watch_get_enabled(watch)))
+		{
+			unsigned int wflags = dbus_watch_get_flags(watch);
+			unsigned int flags = 0;
+
+			if (status < 0)
+			{
+				flags = DBUS_WATCH_ERROR;
+			}
+			else
+			{
+				if ((events & UV_READABLE) && (wflags & DBUS_WATCH_READABLE))
+				{
+					flags |= DBUS_WATCH_READABLE;
+				}
+				if ((events & UV_WRITABLE) && (wflags & DBUS_WATCH_WRITABLE))
+				{
+					flags |= DBUS_WATCH_WRITABLE;
+				}
+			}
+
+			if (flags)
+			{
+				dbus_watch_handle(watch, flags);
+			}
+		}
+	}
+}
+
+static dbus_bool_t dbusx_uv_watch_add(DBusWatch *watch, void *data)
+{
+	DbusXUv_t *uv_req = (DbusXUv_t *)data;
+	int fd = dbus_watch_get_unix_fd(watch);
+	int i = 0;
+
+	DbusXUvWatch_t *watch_req = uv_req->watch_list;
+	while ((watch_req) && (watch_req->fd != fd))
+	{
+		watch_req = watch_req->next;
+	}
+
+	if (watch_req == NULL)
+	{
+		watch_req = (DbusXUvWatch_t *)SAFE_CALLOC(1, sizeof(DbusXUvWatch_t));
+		if (watch_req == NULL)
+		{
+			return FALSE;
+		}
+
+		if (uv_poll_init(uv_req->loop, &watch_req->poll, fd) != 0)
+		{
+			DBG_ER_LN("uv_poll_init error !!! (fd: %d)", fd);
+			SAFE_FREE(watch_req);
+			return FALSE;
+		}
+		watch_req->poll.data = (void *)watch_req;
+		watch_req->uv_req = uv_req;
+		watch_req->fd = fd;
+		watch_req->next = uv_req->watch_list;
+		uv_req->watch_list = watch_req;
+	}
+
+	for (i = 0; i < MAX_OF_DBUSX_UV_WATCH; i++)
+	{
+		if (watch_req->watch_ary[i] == NULL)
+		{
+			watch_req->watch_ary[i] = watch;
+			dbus_watch_set_data(watch, (void *)watch_req, NULL);
+			dbusx_uv_watch_update(watch_req);
+			return TRUE;
+		}
+	}
+
+	DBG_ER_LN("too many watches !!! (fd: %d)", fd);
+	return FALSE;
+}
+
+static void dbusx_uv_watch_remove(DBusWatch *watch, void *data)
+{
+	DbusXUvWatch_t *watch_req = (DbusXUvWatch_t *)dbus_watch_get_data(watch);
+	int isempty = 1;
+	int i = 0;
+
+	if (watch_req == NULL)
+	{
+		return;
+	}
+	dbus_watch_set_data(watch, NULL, NULL);
+
+	for (i = 0; i < MAX_OF_DBUSX_UV_WATCH; i++)
+	{
+		if (watch_req->watch_ary[i] == watch)
+		{
+			watch_req->watch_ary[i] = NULL;
+		}
+		else if (watch_req->watch_ary[i])
+		{
+			isempty = 0;
+		}
+	}
+
+	if (isempty)
+	{
+		DbusXUvWatch_t **prev = &watch_req->uv_req->watch_list;
+		while ((*prev) && (*prev != watch_req))
+		{
+			prev = &(*prev)->next;
+		}
+		if (*prev)
+		{
+			*prev = watch_req->next;
+		}
+
+		uv_poll_stop(&watch_req->poll);
+		uv_close((uv_handle_t *)&watch_req->poll, dbusx_uv_free_cb);
+	}
+	else
+	{
+		dbusx_uv_watch_update(watch_req);
+	}
+}
+
+static void dbusx_uv_watch_toggled(DBusWatch *watch, void *data)
+{
+	DbusXUvWatch_t *watch_req = (DbusXUvWatch_t *)dbus_watch_get_data(watch);
+
+	if (watch_req)
+	{
+		dbusx_uv_watch_update(watch_req);
+	}
+}
+
+static void dbusx_uv_timer_cb(uv_timer_t *handle)
+{
+	DbusXUvTimeout_t *timeout_req = (DbusXUvTimeout_t *)handle->data;
+
+	dbus_timeout_handle(timeout_req->timeout);
+}
+
+static void dbusx_uv_timeout_start(DbusXUvTimeout_t *timeout_req)
+{
+	uv_timer_stop(&timeout_req->timer);
+	if (dbus_timeout_get_enabled(timeout_req->timeout))
+	{
+		int interval = dbus_timeout_get_interval(timeout_req->timeout);
+		uv_timer_start(&timeout_req->timer, dbusx_uv_timer_cb, interval, interval);
+	}
+}
+
+static dbus_bool_t dbusx_uv_timeout_add(DBusTimeout *timeout, void *data)
+{
+	DbusXUv_t *uv_req = (DbusXUv_t *)data;
+
+	DbusXUvTimeout_t *timeout_req = (DbusXUvTimeout_t *)SAFE_CALLOC(1, sizeof(DbusXUvTimeout_t));
+	if (timeout_req == NULL)
+	{
+		return FALSE;
+	}
+
+	uv_timer_init(uv_req->loop, &timeout_req->timer);
+	timeout_req->timer.data = (void *)timeout_req;
+	timeout_req->timeout = timeout;
+	dbus_timeout_set_data(timeout, (void *)timeout_req, NULL);
+
+	dbusx_uv_timeout_start(timeout_req);
+
+	return TRUE;
+}
+
+static void dbusx_uv_timeout_remove(DBusTimeout *timeout, void *data)
+{
+	DbusXUvTimeout_t *timeout_req = (DbusXUvTimeout_t *)dbus_timeout_get_data(timeout);
+
+	if (timeout_req)
+	{
+		dbus_timeout_set_data(timeout, NULL, NULL);
+		uv_timer_stop(&timeout_req->timer);
+		uv_close((uv_handle_t *)&timeout_req->timer, dbusx_uv_free_cb);
+	}
+}
+
+static void dbusx_uv_timeout_toggled(DBusTimeout *timeout, void *data)
+{
+	DbusXUvTimeout_t *timeout_req = (DbusXUvTimeout_t *)dbus_timeout_get_data(timeout);
+
+	if (timeout_req)
+	{
+		dbusx_uv_timeout_start(timeout_req);
+	}
+}
+
+static void dbusx_uv_dispatch_cb(uv_async_t *handle)
+{
+	DbusXUv_t *uv_req = (DbusXUv_t *)handle->data;
+
+	while (dbus_connection_dispatch(uv_req->dbus_conn) == DBUS_DISPATCH_DATA_REMAINS)
+	{
+	}
+}
+
+// libdbus must not dispatch from here, it is deferred to the loop
+static void dbusx_uv_dispatch_status(DBusConnection *dbus_conn, DBusDispatchStatus new_status, void *data)
+{
+	DbusXUv_t *uv_req = (DbusXUv_t *)data;
+
+	if (new_status == DBUS_DISPATCH_DATA_REMAINS)
+	{
+		uv_async_send(&uv_req->dispatch);
+	}
+}
+
+static void dbusx_uv_detach(DbusXUv_t *uv_req)
+{
+	if (uv_req)
+	{
+		// the old remove functions are called for every watch and timeout
+		dbus_connection_set_dispatch_status_function(uv_req->dbus_conn, NULL, NULL, NULL);
+		dbus_connection_set_watch_functions(uv_req->dbus_conn, NULL, NULL, NULL, NULL, NULL);
+		dbus_connection_set_timeout_functions(uv_req->dbus_conn, NULL, NULL, NULL, NULL, NULL);
+
+		uv_close((uv_handle_t *)&uv_req->dispatch, dbusx_uv_free_cb);
+	}
+}
+
+static DbusXUv_t *dbusx_uv_attach(DBusConnection *dbus_conn, uv_loop_t *loop)
+{
+	DbusXUv_t *uv_req = (DbusXUv_t *)SAFE_CALLOC(1, sizeof(DbusXUv_t));
+	if (uv_req == NULL)
+	{
+		return NULL;
+	}
+
+	uv_req->dbus_conn = dbus_conn;
+	uv_req->loop = loop;
+	uv_async_init(loop, &uv_req->dispatch, dbusx_uv_dispatch_cb);
+	uv_req->dispatch.data = (void *)uv_req;
+
+	if ( (!dbus_connection_set_watch_functions(dbus_conn, dbusx_uv_watch_add, dbusx_uv_watch_remove, dbusx_uv_watch_toggled, (void *)uv_req, NULL))
+		|| (!dbus_connection_set_timeout_functions(dbus_conn, dbusx_uv_timeout_add, dbusx_uv_timeout_remove, dbusx_uv_timeout_toggled, (void *)uv_req, NULL)) )
+	{
+		DBG_ER_LN("dbus_connection_set_watch_functions error !!!");
+		dbusx_uv_detach(uv_req);
+		return NULL;
+	}
+	dbus_connection_set_dispatch_status_function(dbus_conn, dbusx_uv_dispatch_status, (void *)uv_req, NULL);
+
+	// the messages which came during dbus_bus_add_match and dbus_bus_request_name
+	if (dbus_connection_get_dispatch_status(dbus_conn) == DBUS_DISPATCH_DATA_REMAINS)
+	{
+		uv_async_send(&uv_req->dispatch);
+	}
+
+	return uv_req;
+}
+
+// instead of dbusx_thread_init, both connections are served by loop (on the thread of loop).
+// without match_cb and filter_cb, it is a client and dbus_conn_listen is not created.
+int dbusx_uv_init(dbusx_match_fn *match_cb, dbusx_filter_fn *filter_cb, DbusX_t *dbusx_req, uv_loop_t *loop)
+{
+	int ret = -1;
+
+	if ((dbusx_req == NULL) || (loop == NULL))
+	{
+		DBG_ER_LN("dbusx_req or loop is NULL !!! (dbusx_req: %p, loop: %p)", dbusx_req, loop);
+		return -1;
+	}
+
+	dbusx_req->add_match_cb = match_cb;
+	dbusx_req->filter_user_cb = filter_cb;
+	dbusx_req->loop = loop;
+
+	if (dbusx_req_check(dbusx_req) == -1)
+	{
+		goto exit_uv;
+	}
+
+	if (dbusx_client_init(dbusx_req) == -1)
+	{
+		goto exit_uv;
+	}
+
+	if ((dbusx_req->uv_conn = dbusx_uv_attach(dbusx_req->dbus_conn, loop)) == NULL)
+	{
+		goto exit_uv;
+	}
+
+	if ((match_cb) || (filter_cb))
+	{
+		if (dbusx_listen_init(dbusx_req) == -1)
+		{
+			goto exit_uv;
+		}
+
+		if ((dbusx_req->uv_listen = dbusx_uv_attach(dbusx_req->dbus_conn_listen, loop)) == NULL)
+		{
+			goto exit_uv;
+		}
+		DBG_IF_LN("dbus listen ...");
+	}
+
+	ret = 0;
+
+exit_uv:
+	if (ret == -1)
+	{
+		dbusx_uv_close(dbusx_req);
+	}
+
+	return ret;
+}
+
+// the outstanding calls of dbusx_method_helper_async are dropped without reply_cb.
+// the handles are closed, run loop once more to free them.
+void dbusx_uv_close(DbusX_t *dbusx_req)
+{
+	if ((dbusx_req) && (dbusx_req->isfree == 0))
+	{
+		dbusx_req->isfree ++;
+
+		dbusx_uv_detach(dbusx_req->uv_listen);
+		dbusx_req->uv_listen = NULL;
+		dbusx_uv_detach(dbusx_req->uv_conn);
+		dbusx_req->uv_conn = NULL;
+
+		dbusx_conn_free(dbusx_req);
+	}
+}
+#endif
@@ -100,10 +100,11 @@ static void app_signal_register(void)
 }
 
 int option_index = 0;
-const char* short_options = "d:h";
+const char* short_options = "d:m:h";
 static struct option long_options[] =
 {
 	{ "debug",       required_argument,   NULL,    'd'  },
+	{ "module",      required_argument,   NULL,    'm'  },
 	{ "help",        no_argument,         NULL,    'h'  },
 	{ 0,             0,                      0,    0    }
 };
@@ -112,10 +113,12 @@ static void app_showusage(int exit_code)
 {
 	printf( "Usage: %s\n"
 					"  -d, --debug       debug level\n"
+					"  -m, --module      debug level of the modules\n"
 					"  -h, --help\n", TAG);
 	printf( "Version: %s\n", version_show());
 	printf( "Example:\n"
-					"  %s -d 4\n", TAG);
+					"  %s -d 4\n"
+					"  %s -d 1 -m chainx:4,queuex:3\n", TAG, TAG);
 	exit(exit_code);
 }
 
@@ -133,6 +136,12 @@ static void app_ParseArguments(int argc, char **argv)
 					dbg_lvl_set(atoi(optarg));
 				}
 				break;
+			case 'm':
+				if (optarg)
+				{
+					dbg_mod_parse(optarg);
+				}
+				break;
 			default:
 				app_showusage(-1);
 				break;
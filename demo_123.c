@@ -213,7 +213,7 @@ int main(int argc, char* argv[])
 	DBG_IF_LN("(max_size: %zd)", sizeof(http_req.mjpeg_req.max_size));
 	DBG_IF_LN("(filename: %zd)", sizeof(http_req.mjpeg_req.filename));
 	DBG_IF_LN("(fp: %zd)", sizeof(http_req.mjpeg_req.fp));
-	DBG_IF_LN("(qbuf: %zd)", sizeof(http_req.mjpeg_req.qbuf));
+	DBG_IF_LN("(hdr: %zd)", sizeof(http_req.mjpeg_req.hdr));
 	DBG_IF_LN("(boundary: %zd)", sizeof(http_req.mjpeg_req.boundary));
 	DBG_IF_LN("(state: %zd)", sizeof(http_req.mjpeg_req.state));
 
@@ -146,6 +146,11 @@ static int app_init(void)
 {
 	int ret = 0;
 
+#ifdef UTIL_EX_MEMX
+	// the leak dump is written at exit, kill -USR1 for the callsites
+	memx_open(NULL);
+#endif
+
 	return ret;
 }
 
@@ -168,6 +173,9 @@ static void app_signal_handler(int signum)
 			break;
 
 		case SIGUSR1:
+#ifdef UTIL_EX_MEMX
+			memx_dump_async();
+#endif
 			break;
 
 		case SIGUSR2:
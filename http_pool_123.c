@@ -0,0 +1,279 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <signal.h>
+#include <getopt.h>
+
+#include "utilx9.h"
+
+#define TAG "http_pool_123"
+
+// N GETs through one HttpXPool
+//  -s: http_request one by one (the pool keeps the easy handles and the connections)
+//  otherwise: http_request_async, all of them on the thread of the pool
+
+#define TIMEOUT_OF_POOL_DONE 30 // seconds
+
+static int is_quit = 0;
+static int is_sync = 0;
+static int req_count = 20;
+static char url[LEN_OF_URL] = "http://127.0.0.1:8000/";
+
+static HttpXPool_t *http_pool = NULL;
+static HttpX_t *http_ary = NULL;
+
+static pthread_mutex_t done_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int done_ok = 0;
+static int done_error = 0;
+
+static double pool_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pool_done(HttpX_t *http_req)
+{
+	SAFE_THREAD_LOCK(&done_mtx);
+	if ((http_req->result == 0) && (http_req->response_code == 200))
+	{
+		done_ok ++;
+	}
+	else
+	{
+		done_error ++;
+		DBG_WN_LN("(response_code: %ld, log: %s)", http_req->response_code, http_req->log);
+	}
+	SAFE_THREAD_UNLOCK(&done_mtx);
+}
+
+// on the thread of http_pool
+static void pool_response_cb(HttpX_t *http_req, void *userdata)
+{
+	int idx = (int)(long)userdata;
+
+	DBG_DB_LN("(idx: %d, response_code: %ld, res_size: %zd)", idx, http_req->response_code, http_req->simple_req.res_size);
+	pool_done(http_req);
+}
+
+static int pool_total(void)
+{
+	int total = 0;
+	SAFE_THREAD_LOCK(&done_mtx);
+	total = done_ok + done_error;
+	SAFE_THREAD_UNLOCK(&done_mtx);
+	return total;
+}
+
+static int app_quit(void)
+{
+	return is_quit;
+}
+
+static void app_set_quit(int mode)
+{
+	is_quit = mode;
+}
+
+static void app_stop(void)
+{
+	if (app_quit()==0)
+	{
+		app_set_quit(1);
+	}
+}
+
+static void app_loop(void)
+{
+	int idx = 0;
+
+	http_pool = http_pool_init(TAG, (is_sync==0));
+	http_ary = (HttpX_t *)SAFE_CALLOC(req_count, sizeof(HttpX_t));
+	if ((http_pool == NULL) || (http_ary == NULL))
+	{
+		goto exit_loop;
+	}
+
+	double t_start = pool_now();
+	for (idx = 0; (idx < req_count) && (app_quit()==0); idx++)
+	{
+		HttpX_t *http_req = &http_ary[idx];
+		http_req->mode = HTTP_MODE_ID_SIMPLE;
+		http_req->pool = http_pool;
+		http_req->simple_req.method = HTTP_METHOD_ID_GET;
+		SAFE_SPRINTF_EX(http_req->url, "%s", url);
+
+		if (is_sync)
+		{
+			http_request(http_req);
+			pool_done(http_req);
+		}
+		else if (http_request_async(http_req, (void *)(long)idx, pool_response_cb) != 0)
+		{
+			http_req->result = -1;
+			pool_done(http_req);
+		}
+	}
+
+	// http_ary has to be kept until the last pool_response_cb
+	double t_end = t_start + TIMEOUT_OF_POOL_DONE;
+	while ((app_quit()==0) && (pool_total() < idx) && (pool_now() < t_end))
+	{
+		usleep(10*1000);
+	}
+	double t_spent = pool_now() - t_start;
+
+	DBG_WN_LN("(%s, url: %s, count: %d, ok: %d, error: %d, %.3f secs, %.0f reqs/sec)", (is_sync) ? "sync" : "async", url, idx, done_ok, done_error, t_spent, (t_spent > 0) ? idx / t_spent : 0);
+
+exit_loop:
+	// the unfinished ones are aborted and called back inside http_pool_close
+	http_pool_close(http_pool);
+	if (http_ary)
+	{
+		for (idx = 0; idx < req_count; idx++)
+		{
+			http_request_free(&http_ary[idx]);
+		}
+		SAFE_FREE(http_ary);
+	}
+}
+
+static int app_init(void)
+{
+	int ret = 0;
+
+	return ret;
+}
+
+static void app_exit(void)
+{
+	app_stop();
+}
+
+static void app_signal_handler(int signum)
+{
+	DBG_ER_LN("(signum: %d)", signum);
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			app_stop();
+			break;
+		case SIGPIPE:
+			break;
+
+		case SIGUSR1:
+			break;
+
+		case SIGUSR2:
+			dbg_lvl_round();
+			DBG_ER_LN("dbg_lvl_get(): %d", dbg_lvl_get());
+			DBG_ER_LN("(Version: %s)", version_show());
+			break;
+	}
+}
+
+static void app_signal_register(void)
+{
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGUSR1, app_signal_handler);
+	signal(SIGUSR2, app_signal_handler);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int option_index = 0;
+const char* short_options = "d:n:sh";
+static struct option long_options[] =
+{
+	{ "debug",       required_argument,   NULL,    'd'  },
+	{ "count",       required_argument,   NULL,    'n'  },
+	{ "sync",        no_argument,         NULL,    's'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s [url]\n"
+		"  -d, --debug       debug level\n"
+		"  -n, --count       count of the requests\n"
+		"  -s, --sync        http_request one by one instead of http_request_async\n"
+		"  -h, --help\n", TAG);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -n 100 http://127.0.0.1:8000/\n"
+		"  %s -s -n 100 http://127.0.0.1:8000/\n", TAG, TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				if (optarg)
+				{
+					dbg_lvl_set(atoi(optarg));
+				}
+				break;
+			case 'n':
+				if (optarg)
+				{
+					req_count = atoi(optarg);
+				}
+				break;
+			case 's':
+				is_sync = 1;
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+
+	if (optind < argc)
+	{
+		SAFE_SPRINTF_EX(url, "%s", argv[optind]);
+	}
+	if (req_count <= 0)
+	{
+		app_showusage(-1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	app_ParseArguments(argc, argv);
+	app_signal_register();
+	atexit(app_exit);
+
+	if (app_init() == -1)
+	{
+		return -1;
+	}
+
+	app_loop();
+
+	DBG_WN_LN(DBG_TXT_BYE_BYE);
+	return 0;
+}
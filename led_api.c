@@ -21,6 +21,14 @@ void led_gosleep(LedRequest_t *ledreq)
 		return;
 	}
 
+#ifdef UTIL_EX_TIMERX
+	if (ledreq->timerx_req)
+	{
+		timerx_cancel((TimerX_t *)ledreq->timerx_req, (TimerXNode_t *)ledreq->timer_node);
+		return;
+	}
+#endif
+
 	ThreadX_t *tidx_req = &ledreq->tidx;
 	threadx_set_pause(tidx_req, 1);
 }
@@ -32,11 +40,40 @@ void led_wakeup_simple(LedRequest_t *ledreq)
 		return;
 	}
 
+#ifdef UTIL_EX_TIMERX
+	if (ledreq->timerx_req)
+	{
+		// the same as led_thread_handler, a finished pattern doesn't restart
+		if (ledreq->infinite != 0)
+		{
+			timerx_mod((TimerX_t *)ledreq->timerx_req, (TimerXNode_t *)ledreq->timer_node, 0);
+		}
+		return;
+	}
+#endif
+
 	ThreadX_t *tidx_req = &ledreq->tidx;
 	threadx_set_pause(tidx_req, 0);
 	threadx_wakeup_simple(tidx_req);
 }
 
+static void led_max_count(LedRequest_t *ledreq)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_LEDON; idx++)
+	{
+		LedOn_t *ledon = (LedOn_t *)&ledreq->ledon_ary[idx];
+		if ((ledon->id > LED_ID_NONE) && (ledon->id < LED_ID_MAX))
+		{
+			ledreq->max_led = idx+1;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
 static void *led_thread_handler(void *user)
 {
 	LedRequest_t *ledreq = (LedRequest_t*)user;
@@ -57,21 +94,9 @@ static void *led_thread_handler(void *user)
 		goto led_exit;
 	}
 
-	int idx = 0;
-	for (idx = 0; idx < MAX_OF_LEDON; idx++)
-	{
-		LedOn_t *ledon = (LedOn_t *)&ledreq->ledon_ary[idx];
-		if ((ledon->id > LED_ID_NONE) && (ledon->id < LED_ID_MAX))
-		{
-			ledreq->max_led = idx+1;
-		}
-		else
-		{
-			break;
-		}
-	}
+	led_max_count(ledreq);
 
-	idx = 0;
+	int idx = 0;
 	while (threadx_isquit(tidx_req)==0)
 	{
 		if (threadx_ispause(tidx_req)==0)
@@ -130,6 +155,13 @@ void led_thread_stop(LedRequest_t *ledreq)
 {
 	if (ledreq)
 	{
+#ifdef UTIL_EX_TIMERX
+		if (ledreq->timerx_req)
+		{
+			timerx_cancel((TimerX_t *)ledreq->timerx_req, (TimerXNode_t *)ledreq->timer_node);
+			return;
+		}
+#endif
 		threadx_stop(&ledreq->tidx);
 	}
 }
@@ -140,6 +172,15 @@ void led_thread_close(LedRequest_t *ledreq)
 	{
 		ledreq->isfree ++;
 
+#ifdef UTIL_EX_TIMERX
+		if (ledreq->timerx_req)
+		{
+			timerx_del((TimerX_t *)ledreq->timerx_req, (TimerXNode_t *)ledreq->timer_node);
+			ledreq->timer_node = NULL;
+			led_thread_free(ledreq);
+			return;
+		}
+#endif
 		threadx_close(&ledreq->tidx);
 		led_thread_free(ledreq);
 	}
@@ -166,3 +207,61 @@ LedRequest_t *led_thread_init(char *name, int infinite, LedOn_t *ledon_ary, led_
 	}
 	return ledreq;
 }
+
+#ifdef UTIL_EX_TIMERX
+static void led_timer_cb(TimerXNode_t *node, void *usr_data)
+{
+	LedRequest_t *ledreq = (LedRequest_t*)usr_data;
+
+	if ((ledreq == NULL) || (ledreq->max_led <= 0) || (ledreq->infinite == 0))
+	{
+		return;
+	}
+
+	LedOn_t *ledon = (LedOn_t *)&ledreq->ledon_ary[ledreq->idx];
+	ledreq->led_on_cb(ledon);
+
+	ledreq->idx ++;
+	ledreq->idx %= ledreq->max_led;
+	if (ledreq->infinite < 0)
+	{
+		// in loop
+	}
+	else if (ledreq->idx == 0)
+	{
+		ledreq->infinite --;
+		if (ledreq->infinite == 0)
+		{
+			// end the pattern
+			return;
+		}
+	}
+
+	timerx_mod(node->timerx_req, node, ledon->duration);
+}
+
+// the same as led_thread_init, but the pattern is driven by timerx_req instead of its own thread
+LedRequest_t *led_timer_init(TimerX_t *timerx_req, char *name, int infinite, LedOn_t *ledon_ary, led_on_fn led_on_cb)
+{
+	if ((timerx_req == NULL) || (ledon_ary == NULL) || (led_on_cb == NULL))
+	{
+		return NULL;
+	}
+
+	LedRequest_t *ledreq = (LedRequest_t*)SAFE_CALLOC(1, sizeof(LedRequest_t));
+
+	if (ledreq)
+	{
+		SAFE_SPRINTF_EX(ledreq->name, "%s", name);
+
+		ledreq->infinite = infinite;
+		ledreq->ledon_ary = ledon_ary;
+		ledreq->led_on_cb = led_on_cb;
+		ledreq->timerx_req = timerx_req;
+		led_max_count(ledreq);
+
+		ledreq->timer_node = timerx_add(timerx_req, 0, 0, led_timer_cb, ledreq);
+	}
+	return ledreq;
+}
+#endif
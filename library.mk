@@ -8,22 +8,47 @@ CLEAN_BINS += \
 							tty_123 \
 							ping_123
 
+#** dbgx_api **
+CLEAN_BINS += \
+							dbgx_456
+
+#** metricx_api **
+CLEAN_BINS += \
+							metricx_123
+
+#** tracex_api **
+CLEAN_BINS += \
+							tracex_123
+
 #** clist_api **
 CLEAN_BINS += \
 							clist_123
 
+#** bench (make bench) **
+CLEAN_BINS += \
+							bench_456
+
+#** loadgen (chainX, mctt) **
+CLEAN_BINS += \
+							loadgen_456
+
 #** thread_api, led_api **
 CLEAN_BINS += \
 							led_123
 
 #** statex_api **
 CLEAN_BINS += \
-							statex_123
+							statex_123 \
+							statex_456
 
 #** thread_api **
 CLEAN_BINS += \
 							thread_123
 
+#** timerx_api **
+CLEAN_BINS += \
+							timerx_123
+
 ifeq ("$(PJ_HAS_LIBUSB)", "yes")
 CLEAN_BINS += \
 							usb_123
@@ -50,6 +75,7 @@ ifeq ("$(PJ_HAS_MXML)", "yes")
 CLEAN_BINS += \
 							onvif_pass_123 \
 							onvif_client_123 \
+							soap_456 \
 							wsdiscovery_123
 LIBXXX_OBJS += \
 							onvif_api.o \
@@ -76,10 +102,14 @@ endif
 
 ifeq ("$(PJ_HAS_CURL)", "yes")
 CLEAN_BINS += \
-							http_client_123
+							http_client_123 \
+							http_pool_123 \
+							mjpeg_123 \
+							rtspx_123
 LIBXXX_OBJS += \
 							curl_api.o \
-							rtp_api.o
+							rtp_api.o \
+							rtsp_api.o
 LIBS_yes += -lcurl
 endif
 
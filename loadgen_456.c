@@ -0,0 +1,1030 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <sched.h>
+#include <signal.h>
+#include <getopt.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "utilx9.h"
+
+#define TAG "loadgen_456"
+
+// N loopback connections (or multicast senders) against the servers of the library.
+//  tcp : chainX TCP clients, the echo server is built in (or -a ip:port)
+//  udp : the echo is a chainX UDP server (or -a ip:port)
+//  mctt: mctt_publish from N senders, one mctt_thread_init receiver, one-way latency
+//  ws  : raw websocket clients against a lws2 server with isecho (-a ip:port, -P protocol)
+// rate 0 is ping-pong (one message in flight), otherwise messages/sec of each connection.
+// -c and -r take lists, every combination is one run, one line of the json result.
+
+#define MAX_OF_LOAD_CONN 1024
+#define MAX_OF_LOAD_RUN 32
+#define MIN_OF_LOAD_SIZE 16
+#define MAX_OF_LOAD_SIZE LEN_OF_BUF2048 // MAX_OF_MCTT
+#define TIMEOUT_OF_LOAD_REPLY 1000 // ms
+
+// the first MIN_OF_LOAD_SIZE bytes of every message
+typedef struct LoadStamp_Struct
+{
+	uint64_t ts; // ns, CLOCK_MONOTONIC
+	uint32_t idx; // of the connection
+	uint32_t seq;
+} LoadStamp_t;
+
+typedef struct LoadConn_Struct
+{
+	int idx;
+	int fd; // udp and ws, tcp is chainX's
+
+	ChainX_t chainX; // tcp: the client, mctt: the sender
+	ThreadX_t tidx; // the sender
+
+	// a stream is cut into records of rec_len bytes, the stamp is at rec_off
+	int rec_len;
+	int rec_off;
+	int rec_pos;
+	unsigned char rec_stamp[sizeof(LoadStamp_t)];
+
+	uint32_t seq;
+	uint64_t tx;
+	uint64_t rx;
+	uint64_t err;
+} LoadConn_t;
+
+typedef struct LoadMode_Struct
+{
+	const char *name;
+	int isoneway; // no reply, the receiver stamps the latency
+	int (*open_cb)(void); // the server
+	void (*close_cb)(void);
+	int (*conn_open_cb)(LoadConn_t *conn);
+	void (*conn_close_cb)(LoadConn_t *conn);
+	int (*send_cb)(LoadConn_t *conn, char *buff, int buff_len);
+	int (*poll_cb)(LoadConn_t *conn, int ms); // NULL: replies are pushed by another thread
+} LoadMode_t;
+
+static LoadMode_t *load_mode = NULL;
+static LoadConn_t *load_conn_ary = NULL;
+static int load_conns = 0;
+static int load_rate = 0;
+
+static int load_conns_ary[MAX_OF_LOAD_RUN] = { 1 };
+static int load_conns_count = 1;
+static int load_rate_ary[MAX_OF_LOAD_RUN] = { 0 };
+static int load_rate_count = 1;
+static int load_size = 64;
+static int load_secs = 5;
+static int load_port = 18461;
+static char load_ip[LEN_OF_IP] = "127.0.0.1";
+static int load_isexternal = 0; // -a, no built-in server
+static char load_protocol[LEN_OF_NAME32] = "lws-minimal";
+static char load_outfile[LEN_OF_FULLNAME] = "loadgen_result.json";
+
+static MetricX_t *load_latency = NULL; // ns
+static uint64_t load_t_end = 0;
+static int is_quit = 0;
+
+static uint64_t load_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ** a reply (or a multicast message) arrived **
+// buff might be unaligned
+static void load_reply(void *buff)
+{
+	uint64_t now = load_now();
+	LoadStamp_t stamp;
+	SAFE_MEMCPY(&stamp, buff, sizeof(stamp), sizeof(stamp));
+	if ((stamp.idx < (uint32_t)load_conns) && (stamp.ts <= now))
+	{
+		LoadConn_t *conn = &load_conn_ary[stamp.idx];
+		metricx_histogram_add(load_latency, now - stamp.ts);
+
+		threadx_lock(&conn->tidx);
+		__atomic_add_fetch(&conn->rx, 1, __ATOMIC_RELEASE);
+		threadx_wakeup(&conn->tidx);
+		threadx_unlock(&conn->tidx);
+	}
+}
+
+static void load_stream_feed(LoadConn_t *conn, unsigned char *buff, int buff_len)
+{
+	int pos = 0;
+	while (pos < buff_len)
+	{
+		int len = SAFE_MIN(buff_len - pos, conn->rec_len - conn->rec_pos);
+
+		// the part of the stamp inside [rec_pos, rec_pos+len)
+		int from = SAFE_MAX(conn->rec_pos, conn->rec_off);
+		int to = SAFE_MIN(conn->rec_pos + len, conn->rec_off + (int)sizeof(LoadStamp_t));
+		if (from < to)
+		{
+			SAFE_MEMCPY(conn->rec_stamp + (from - conn->rec_off), buff + pos + (from - conn->rec_pos), to - from, sizeof(conn->rec_stamp));
+		}
+
+		conn->rec_pos += len;
+		pos += len;
+		if (conn->rec_pos == conn->rec_len)
+		{
+			load_reply(conn->rec_stamp);
+			conn->rec_pos = 0;
+		}
+	}
+}
+
+static int load_fd_connect(int type, char *ip, int port)
+{
+	int fd = socket(AF_INET, type, 0);
+	if (fd >= 0)
+	{
+		struct sockaddr_in addr;
+		SAFE_MEMSET(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr(ip);
+		addr.sin_port = htons(port);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		{
+			DBG_ER_LN("connect error !!! (%s:%d, errno: %d %s)", ip, port, errno, strerror(errno));
+			SAFE_CLOSE(fd);
+		}
+		else if (type == SOCK_STREAM)
+		{
+			int flag = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+		}
+	}
+	return fd;
+}
+
+// waits for the readable fd, then read_cb
+static int load_fd_poll(LoadConn_t *conn, int ms, int (*read_cb)(LoadConn_t *conn))
+{
+	struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+	int ret = poll(&pfd, 1, ms);
+	if (ret > 0)
+	{
+		ret = read_cb(conn);
+	}
+	return ret;
+}
+
+// ** tcp, the built-in echo server **
+static ThreadX_t load_echo_tidx;
+static int load_echo_fd = -1;
+
+static void *load_echo_handler(void *user)
+{
+	ThreadX_t *tidx_req = &load_echo_tidx;
+	threadx_detach(tidx_req);
+
+	struct pollfd *pfd_ary = (struct pollfd *)SAFE_CALLOC(MAX_OF_LOAD_CONN + 1, sizeof(struct pollfd));
+	int nfds = 1;
+	if (pfd_ary)
+	{
+		pfd_ary[0].fd = load_echo_fd;
+		pfd_ary[0].events = POLLIN;
+	}
+
+	char buff[LEN_OF_BUF4096];
+	while ((pfd_ary) && (threadx_isquit(tidx_req) == 0))
+	{
+		if (poll(pfd_ary, nfds, 200) <= 0)
+		{
+			continue;
+		}
+
+		int idx = 0;
+		for (idx = nfds - 1; idx >= 1; idx--)
+		{
+			if (pfd_ary[idx].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				int nread = read(pfd_ary[idx].fd, buff, sizeof(buff));
+				if ((nread <= 0) || (write(pfd_ary[idx].fd, buff, nread) != nread))
+				{
+					SAFE_CLOSE(pfd_ary[idx].fd);
+					pfd_ary[idx] = pfd_ary[--nfds];
+				}
+			}
+		}
+
+		if (pfd_ary[0].revents & POLLIN)
+		{
+			int fd = accept(load_echo_fd, NULL, NULL);
+			if ((fd >= 0) && (nfds <= MAX_OF_LOAD_CONN))
+			{
+				int flag = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+				pfd_ary[nfds].fd = fd;
+				pfd_ary[nfds].events = POLLIN;
+				nfds++;
+			}
+			else if (fd >= 0)
+			{
+				SAFE_CLOSE(fd);
+			}
+		}
+	}
+
+	int idx = 0;
+	for (idx = 1; (pfd_ary) && (idx < nfds); idx++)
+	{
+		SAFE_CLOSE(pfd_ary[idx].fd);
+	}
+	SAFE_FREE(pfd_ary);
+
+	threadx_leave(tidx_req);
+	return NULL;
+}
+
+static int load_tcp_open(void)
+{
+	if (load_isexternal)
+	{
+		return 0;
+	}
+
+	load_echo_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (load_echo_fd < 0)
+	{
+		return -1;
+	}
+
+	int flag = 1;
+	setsockopt(load_echo_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+	struct sockaddr_in addr;
+	SAFE_MEMSET(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(load_port);
+	if ((bind(load_echo_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(load_echo_fd, MAX_OF_LOAD_CONN) != 0))
+	{
+		DBG_ER_LN("bind/listen error !!! (port: %d, errno: %d %s)", load_port, errno, strerror(errno));
+		SAFE_CLOSE(load_echo_fd);
+		return -1;
+	}
+
+	load_echo_tidx.thread_cb = load_echo_handler;
+	load_echo_tidx.data = NULL;
+	if (threadx_init(&load_echo_tidx, "loadgen - echo") != 0)
+	{
+		SAFE_CLOSE(load_echo_fd);
+		return -1;
+	}
+	return 0;
+}
+
+static void load_tcp_close(void)
+{
+	if (load_echo_fd >= 0)
+	{
+		threadx_close(&load_echo_tidx);
+		SAFE_CLOSE(load_echo_fd);
+	}
+}
+
+static void load_tcp_pipe_cb(ChainX_t *chainX_req, char *buff, int buff_len)
+{
+	load_stream_feed((LoadConn_t *)chainX_req->c_data, (unsigned char *)buff, buff_len);
+}
+
+static int load_tcp_conn_open(LoadConn_t *conn)
+{
+	ChainX_t *chainX_req = &conn->chainX;
+	chainX_req->mode = CHAINX_MODE_ID_TCP_CLIENT;
+	chainX_req->sockfd = -1;
+	chainX_req->noblock = 1;
+	chainX_req->retry_hold = TIMEOUT_OF_RETRY_HOLD;
+	chainX_req->select_wait = TIMEOUT_OF_SELECT_1;
+	chainX_req->c_data = conn;
+
+	conn->rec_len = load_size;
+	conn->rec_off = 0;
+
+	chainX_ip_set(chainX_req, load_ip);
+	chainX_port_set(chainX_req, load_port);
+	chainX_pipe_register(chainX_req, load_tcp_pipe_cb);
+	if (chainX_thread_init(chainX_req) != 0)
+	{
+		return -1;
+	}
+
+	int retry = 50;
+	while ((chainX_linked_check(chainX_req) != 0) && (retry-- > 0))
+	{
+		usleep(100*1000);
+	}
+	return (chainX_linked_check(chainX_req) == 0) ? 0 : -1;
+}
+
+static void load_tcp_conn_close(LoadConn_t *conn)
+{
+	chainX_thread_stop(&conn->chainX);
+	chainX_thread_close(&conn->chainX);
+}
+
+static int load_tcp_send(LoadConn_t *conn, char *buff, int buff_len)
+{
+	return (SOCKETX_WRITE(&conn->chainX, buff, buff_len) == buff_len) ? 0 : -1;
+}
+
+// ** udp, the echo is a chainX UDP server **
+static ChainX_t load_udp_server =
+{
+	.mode = CHAINX_MODE_ID_UDP_SERVER,
+	.sockfd = -1,
+	.status = 0,
+	.isfree = 0,
+
+	.security = 0,
+	.noblock = 1,
+
+	.select_wait = TIMEOUT_OF_SELECT_1,
+};
+
+static void load_udp_post_cb(ChainX_t *chainX_req, char *buff, int buff_len)
+{
+	sendto(chainX_fd_get(chainX_req), buff, buff_len, 0, (struct sockaddr*)chainX_addr_from_get(chainX_req), sizeof(struct sockaddr_in));
+}
+
+static int load_udp_open(void)
+{
+	if (load_isexternal)
+	{
+		return 0;
+	}
+
+	load_udp_server.isfree = 0;
+	chainX_ip_set(&load_udp_server, load_ip);
+	chainX_port_set(&load_udp_server, load_port);
+	chainX_post_register(&load_udp_server, load_udp_post_cb);
+	return chainX_thread_init(&load_udp_server);
+}
+
+static void load_udp_close(void)
+{
+	if (load_isexternal == 0)
+	{
+		chainX_thread_stop(&load_udp_server);
+		chainX_thread_close(&load_udp_server);
+	}
+}
+
+static int load_udp_conn_open(LoadConn_t *conn)
+{
+	conn->fd = load_fd_connect(SOCK_DGRAM, load_ip, load_port);
+	return (conn->fd >= 0) ? 0 : -1;
+}
+
+static void load_fd_conn_close(LoadConn_t *conn)
+{
+	SAFE_CLOSE(conn->fd);
+}
+
+static int load_udp_send(LoadConn_t *conn, char *buff, int buff_len)
+{
+	return (send(conn->fd, buff, buff_len, 0) == buff_len) ? 0 : -1;
+}
+
+static int load_udp_read(LoadConn_t *conn)
+{
+	char buff[MAX_OF_LOAD_SIZE];
+	int count = 0;
+	int nread = 0;
+	while ((nread = recv(conn->fd, buff, sizeof(buff), MSG_DONTWAIT)) >= (int)sizeof(LoadStamp_t))
+	{
+		load_reply(buff);
+		count++;
+	}
+	return count;
+}
+
+static int load_udp_poll(LoadConn_t *conn, int ms)
+{
+	return load_fd_poll(conn, ms, load_udp_read);
+}
+
+// ** mctt, one receiver, one-way latency **
+static ChainX_t *load_mctt_receiver = NULL;
+
+static void load_mctt_recv_cb(void *userdata, unsigned char *payload, int payload_len)
+{
+	if (payload_len >= (int)sizeof(LoadStamp_t))
+	{
+		load_reply(payload);
+	}
+}
+
+static int load_mctt_open(void)
+{
+	load_mctt_receiver = mctt_thread_init(NULL, MCTT_IP, load_port, load_mctt_recv_cb);
+	return (load_mctt_receiver) ? 0 : -1;
+}
+
+static void load_mctt_close(void)
+{
+	mctt_thread_close(load_mctt_receiver);
+	load_mctt_receiver = NULL;
+}
+
+static int load_mctt_conn_open(LoadConn_t *conn)
+{
+	ChainX_t *chainX_req = &conn->chainX;
+	chainX_req->mode = CHAINX_MODE_ID_MULTI_SENDER;
+	chainX_req->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (chainX_req->sockfd < 0)
+	{
+		return -1;
+	}
+
+	// the receiver joins on INADDR_ANY, so the default interface is kept and looped back
+	unsigned char loop = 1;
+	SAFE_SSETOPT(chainX_req->sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+	chainX_ip_set(chainX_req, MCTT_IP);
+	chainX_port_set(chainX_req, load_port);
+	return 0;
+}
+
+static void load_mctt_conn_close(LoadConn_t *conn)
+{
+	SAFE_CLOSE(conn->chainX.sockfd);
+}
+
+static int load_mctt_send(LoadConn_t *conn, char *buff, int buff_len)
+{
+	mctt_publish(&conn->chainX, buff, buff_len);
+	return 0;
+}
+
+// ** ws, raw RFC 6455 clients (binary frames, masked) **
+static int load_ws_hdr_len(int payload_len)
+{
+	// server -> client, no mask
+	return (payload_len < 126) ? 2 : 4;
+}
+
+static int load_ws_conn_open(LoadConn_t *conn)
+{
+	conn->fd = load_fd_connect(SOCK_STREAM, load_ip, load_port);
+	if (conn->fd < 0)
+	{
+		return -1;
+	}
+
+	char *key = NULL;
+	{
+		char *nonce = os_urandom(16);
+		if (nonce)
+		{
+			int key_len = 0;
+			key = sec_base64_enc(nonce, 16, &key_len);
+			SAFE_FREE(nonce);
+		}
+	}
+
+	char request[LEN_OF_BUF1024] = "";
+	SAFE_SPRINTF_EX(request,
+		"GET / HTTP/1.1\r\n"
+		"Host: %s:%d\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: %s\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"Sec-WebSocket-Protocol: %s\r\n\r\n", load_ip, load_port, (key) ? key : "dGhlIHNhbXBsZSBub25jZQ==", load_protocol);
+	SAFE_FREE(key);
+
+	if (write(conn->fd, request, strlen(request)) != (ssize_t)strlen(request))
+	{
+		return -1;
+	}
+
+	// 101 Switching Protocols, read byte by byte, the frames follow
+	char response[LEN_OF_BUF1024] = "";
+	int pos = 0;
+	while ((pos < (int)sizeof(response) - 1) && (strstr(response, "\r\n\r\n") == NULL))
+	{
+		struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+		if ((poll(&pfd, 1, TIMEOUT_OF_LOAD_REPLY) <= 0) || (read(conn->fd, response + pos, 1) != 1))
+		{
+			break;
+		}
+		pos++;
+	}
+	if (strncmp(response, "HTTP/1.1 101", strlen("HTTP/1.1 101")) != 0)
+	{
+		DBG_ER_LN("websocket handshake error !!! (%s:%d, response: %.32s)", load_ip, load_port, response);
+		return -1;
+	}
+
+	conn->rec_off = load_ws_hdr_len(load_size);
+	conn->rec_len = conn->rec_off + load_size;
+	return 0;
+}
+
+static int load_ws_send(LoadConn_t *conn, char *buff, int buff_len)
+{
+	unsigned char frame[MAX_OF_LOAD_SIZE + 8];
+	int pos = 0;
+	frame[pos++] = 0x82; // FIN, binary
+	if (buff_len < 126)
+	{
+		frame[pos++] = 0x80 | buff_len;
+	}
+	else
+	{
+		frame[pos++] = 0x80 | 126;
+		frame[pos++] = (buff_len >> 8) & 0xFF;
+		frame[pos++] = buff_len & 0xFF;
+	}
+
+	uint32_t mask = (uint32_t)rand();
+	unsigned char *mask_key = frame + pos;
+	SAFE_MEMCPY(mask_key, &mask, 4, 4);
+	pos += 4;
+
+	int idx = 0;
+	for (idx = 0; idx < buff_len; idx++)
+	{
+		frame[pos++] = buff[idx] ^ mask_key[idx & 3];
+	}
+
+	return (write(conn->fd, frame, pos) == pos) ? 0 : -1;
+}
+
+static int load_ws_read(LoadConn_t *conn)
+{
+	unsigned char buff[LEN_OF_BUF4096];
+	int nread = recv(conn->fd, buff, sizeof(buff), MSG_DONTWAIT);
+	if (nread > 0)
+	{
+		load_stream_feed(conn, buff, nread);
+	}
+	return nread;
+}
+
+static int load_ws_poll(LoadConn_t *conn, int ms)
+{
+	return load_fd_poll(conn, ms, load_ws_read);
+}
+
+static LoadMode_t load_mode_ary[] =
+{
+	{ "tcp", 0, load_tcp_open, load_tcp_close, load_tcp_conn_open, load_tcp_conn_close, load_tcp_send, NULL },
+	{ "udp", 0, load_udp_open, load_udp_close, load_udp_conn_open, load_fd_conn_close, load_udp_send, load_udp_poll },
+	{ "mctt", 1, load_mctt_open, load_mctt_close, load_mctt_conn_open, load_mctt_conn_close, load_mctt_send, NULL },
+	{ "ws", 0, NULL, NULL, load_ws_conn_open, load_fd_conn_close, load_ws_send, load_ws_poll },
+	{ NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL },
+};
+
+// ** the sender of each connection **
+static int load_conn_wait(LoadConn_t *conn, uint64_t tx, int ms)
+{
+	if (load_mode->poll_cb)
+	{
+		uint64_t t_end = load_now() + ms * 1000000ULL;
+		while ((__atomic_load_n(&conn->rx, __ATOMIC_ACQUIRE) < tx) && (load_now() < t_end))
+		{
+			load_mode->poll_cb(conn, ms);
+		}
+	}
+	else
+	{
+		// EINVAL: threadx_stop
+		threadx_lock(&conn->tidx);
+		while ((__atomic_load_n(&conn->rx, __ATOMIC_ACQUIRE) < tx) && (threadx_timewait(&conn->tidx, ms) == 0))
+		{
+		}
+		threadx_unlock(&conn->tidx);
+	}
+	return (__atomic_load_n(&conn->rx, __ATOMIC_ACQUIRE) >= tx) ? 0 : -1;
+}
+
+static void *load_conn_handler(void *user)
+{
+	LoadConn_t *conn = (LoadConn_t *)user;
+	ThreadX_t *tidx_req = &conn->tidx;
+	threadx_detach(tidx_req);
+
+	char buff[MAX_OF_LOAD_SIZE];
+	SAFE_MEMSET(buff, 'x', sizeof(buff));
+	LoadStamp_t *stamp = (LoadStamp_t *)buff;
+	stamp->idx = conn->idx;
+
+	uint64_t period = (load_rate > 0) ? 1000000000ULL / load_rate : 0;
+	// spread the first messages of the connections
+	uint64_t t_next = load_now() + ((period) ? (period * conn->idx / load_conns) : 0);
+
+	while ((threadx_isquit(tidx_req) == 0) && (is_quit == 0) && (load_now() < load_t_end))
+	{
+		if (period)
+		{
+			struct timespec ts = { .tv_sec = t_next / 1000000000ULL, .tv_nsec = t_next % 1000000000ULL };
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			t_next += period;
+		}
+
+		stamp->seq = conn->seq++;
+		stamp->ts = load_now();
+		if (load_mode->send_cb(conn, buff, load_size) != 0)
+		{
+			conn->err++;
+			continue;
+		}
+		__atomic_add_fetch(&conn->tx, 1, __ATOMIC_RELEASE);
+
+		if (period == 0)
+		{
+			if (load_mode->isoneway)
+			{
+				// no reply, the receiver is the limit
+				sched_yield();
+			}
+			else if (load_conn_wait(conn, conn->tx, TIMEOUT_OF_LOAD_REPLY) != 0)
+			{
+				conn->err++;
+				// the late one would be counted as the next reply
+				break;
+			}
+		}
+		else if (load_mode->poll_cb)
+		{
+			load_mode->poll_cb(conn, 0);
+		}
+	}
+
+	// the replies on the way
+	load_conn_wait(conn, conn->tx, TIMEOUT_OF_LOAD_REPLY);
+
+	threadx_leave(tidx_req);
+	return NULL;
+}
+
+static uint64_t load_pending(void)
+{
+	uint64_t pending = 0;
+	int idx = 0;
+	for (idx = 0; idx < load_conns; idx++)
+	{
+		LoadConn_t *conn = &load_conn_ary[idx];
+		uint64_t tx = __atomic_load_n(&conn->tx, __ATOMIC_ACQUIRE);
+		uint64_t rx = __atomic_load_n(&conn->rx, __ATOMIC_ACQUIRE);
+		pending += (tx > rx) ? tx - rx : 0;
+	}
+	return pending;
+}
+
+typedef struct LoadResult_Struct
+{
+	int conns;
+	int rate;
+	double secs;
+	uint64_t tx;
+	uint64_t rx;
+	uint64_t err;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+} LoadResult_t;
+
+static int load_run(int conns, int rate, LoadResult_t *result)
+{
+	SAFE_MEMSET(result, 0, sizeof(LoadResult_t));
+	result->conns = conns;
+	result->rate = rate;
+
+	load_conns = conns;
+	load_rate = rate;
+	load_conn_ary = (LoadConn_t *)SAFE_CALLOC(conns, sizeof(LoadConn_t));
+	if (load_conn_ary == NULL)
+	{
+		return -1;
+	}
+
+	metricx_free(load_latency);
+	load_latency = metricx_histogram_new("loadgen_latency_ns", "round trip (one-way for mctt)", NULL);
+
+	int ret = 0;
+	if ((load_mode->open_cb) && (load_mode->open_cb() != 0))
+	{
+		DBG_ER_LN("open error !!! (mode: %s, %s:%d)", load_mode->name, load_ip, load_port);
+		ret = -1;
+	}
+
+	int opened = 0;
+	for (opened = 0; (ret == 0) && (opened < conns); opened++)
+	{
+		LoadConn_t *conn = &load_conn_ary[opened];
+		conn->idx = opened;
+		conn->fd = -1;
+		if (load_mode->conn_open_cb(conn) != 0)
+		{
+			DBG_ER_LN("connection error !!! (mode: %s, idx: %d)", load_mode->name, opened);
+			load_mode->conn_close_cb(conn);
+			ret = -1;
+			break;
+		}
+	}
+
+	if (ret == 0)
+	{
+		uint64_t t_start = load_now();
+		load_t_end = t_start + load_secs * 1000000000ULL;
+
+		int idx = 0;
+		for (idx = 0; idx < conns; idx++)
+		{
+			LoadConn_t *conn = &load_conn_ary[idx];
+			conn->tidx.thread_cb = load_conn_handler;
+			conn->tidx.data = conn;
+			threadx_init(&conn->tidx, "loadgen - conn");
+		}
+		// the senders leave by themselves after load_t_end and the replies on the way
+		while ((is_quit == 0) && (load_now() < load_t_end + TIMEOUT_OF_LOAD_REPLY * 1000000ULL))
+		{
+			usleep(50*1000);
+			if ((load_now() >= load_t_end) && (load_pending() == 0))
+			{
+				break;
+			}
+		}
+		for (idx = 0; idx < conns; idx++)
+		{
+			threadx_close(&load_conn_ary[idx].tidx);
+		}
+		if (load_mode->isoneway)
+		{
+			// the last ones
+			usleep(200*1000);
+		}
+		result->secs = (SAFE_MIN(load_now(), load_t_end) - t_start) / 1e9;
+
+		for (idx = 0; idx < conns; idx++)
+		{
+			LoadConn_t *conn = &load_conn_ary[idx];
+			uint64_t rx = __atomic_load_n(&conn->rx, __ATOMIC_ACQUIRE);
+			result->tx += conn->tx;
+			result->rx += rx;
+			// lost ones are errors too
+			result->err += conn->err + ((conn->tx > rx) ? conn->tx - rx : 0);
+		}
+		result->p50 = metricx_histogram_quantile(load_latency, 0.5);
+		result->p99 = metricx_histogram_quantile(load_latency, 0.99);
+		result->p999 = metricx_histogram_quantile(load_latency, 0.999);
+	}
+
+	while (opened-- > 0)
+	{
+		load_mode->conn_close_cb(&load_conn_ary[opened]);
+	}
+	if (load_mode->close_cb)
+	{
+		load_mode->close_cb();
+	}
+	SAFE_FREE(load_conn_ary);
+
+	return ret;
+}
+
+static void load_report(FILE *fp, LoadResult_t *result)
+{
+	double msgs = (result->secs > 0) ? result->rx / result->secs : 0;
+	double mbytes = msgs * load_size / (1024 * 1024);
+
+	printf("%-5s %6d %8d %6d %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %12.0f %9.2f %10.1f %10.1f %10.1f\n",
+		load_mode->name, result->conns, result->rate, load_size, result->tx, result->rx, result->err, msgs, mbytes,
+		result->p50 / 1000.0, result->p99 / 1000.0, result->p999 / 1000.0);
+
+	if (fp)
+	{
+		fprintf(fp, "{\"mode\":\"%s\",\"conns\":%d,\"rate\":%d,\"size\":%d,\"secs\":%.3f,\"sent\":%" PRIu64 ",\"recv\":%" PRIu64 ",\"errors\":%" PRIu64 ",\"msgs_per_sec\":%.1f,\"mbytes_per_sec\":%.3f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}",
+			load_mode->name, result->conns, result->rate, load_size, result->secs, result->tx, result->rx, result->err, msgs, mbytes,
+			result->p50 / 1000.0, result->p99 / 1000.0, result->p999 / 1000.0);
+	}
+}
+
+static void app_signal_handler(int signum)
+{
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			is_quit = 1;
+			break;
+	}
+}
+
+// "1,8,64" -> ary
+static int load_list_parse(char *list, int *ary, int max)
+{
+	int count = 0;
+	char *saveptr = NULL;
+	char *token = SAFE_STRTOK_R(list, ",", &saveptr);
+	while ((token) && (count < max))
+	{
+		ary[count++] = atoi(token);
+		token = SAFE_STRTOK_R(NULL, ",", &saveptr);
+	}
+	return count;
+}
+
+int option_index = 0;
+const char* short_options = "m:c:r:s:d:a:p:P:o:h";
+static struct option long_options[] =
+{
+	{ "mode",        required_argument,   NULL,    'm'  },
+	{ "conns",       required_argument,   NULL,    'c'  },
+	{ "rate",        required_argument,   NULL,    'r'  },
+	{ "size",        required_argument,   NULL,    's'  },
+	{ "duration",    required_argument,   NULL,    'd'  },
+	{ "addr",        required_argument,   NULL,    'a'  },
+	{ "port",        required_argument,   NULL,    'p'  },
+	{ "protocol",    required_argument,   NULL,    'P'  },
+	{ "output",      required_argument,   NULL,    'o'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s\n"
+		"  -m, --mode        tcp, udp, mctt or ws (default: tcp)\n"
+		"  -c, --conns       connections (senders), a list runs each (max: %d)\n"
+		"  -r, --rate        messages/sec of each connection, 0: ping-pong, a list runs each\n"
+		"  -s, --size        message size (%d ~ %d, default: %d)\n"
+		"  -d, --duration    seconds of each run (default: %d)\n"
+		"  -a, --addr        ip:port of an external server (ws needs it)\n"
+		"  -p, --port        port of the built-in server (default: %d)\n"
+		"  -P, --protocol    websocket protocol (default: %s)\n"
+		"  -o, --output      json result (default: %s)\n"
+		"  -h, --help\n", TAG, MAX_OF_LOAD_CONN, MIN_OF_LOAD_SIZE, MAX_OF_LOAD_SIZE, load_size, load_secs, load_port, load_protocol, load_outfile);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -m tcp -c 1,8,64 -r 0 -d 5\n"
+		"  %s -m udp -c 16 -r 1000,10000 -s 256\n"
+		"  %s -m ws -a 127.0.0.1:9000 -P lws-minimal -c 8\n", TAG, TAG, TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'm':
+				if (optarg)
+				{
+					LoadMode_t *mode = NULL;
+					for (mode = load_mode_ary; mode->name; mode++)
+					{
+						if (SAFE_STRCMP((char *)mode->name, optarg) == 0)
+						{
+							load_mode = mode;
+						}
+					}
+				}
+				break;
+			case 'c':
+				if (optarg)
+				{
+					load_conns_count = load_list_parse(optarg, load_conns_ary, MAX_OF_LOAD_RUN);
+				}
+				break;
+			case 'r':
+				if (optarg)
+				{
+					load_rate_count = load_list_parse(optarg, load_rate_ary, MAX_OF_LOAD_RUN);
+				}
+				break;
+			case 's':
+				if (optarg)
+				{
+					load_size = SAFE_MIN(SAFE_MAX(atoi(optarg), MIN_OF_LOAD_SIZE), MAX_OF_LOAD_SIZE);
+				}
+				break;
+			case 'd':
+				if (optarg)
+				{
+					load_secs = SAFE_MAX(atoi(optarg), 1);
+				}
+				break;
+			case 'a':
+				if (optarg)
+				{
+					char *port = strrchr(optarg, ':');
+					if (port)
+					{
+						*port = 0;
+						load_port = atoi(port + 1);
+					}
+					SAFE_SPRINTF_EX(load_ip, "%s", optarg);
+					load_isexternal = 1;
+				}
+				break;
+			case 'p':
+				if (optarg)
+				{
+					load_port = atoi(optarg);
+				}
+				break;
+			case 'P':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(load_protocol, "%s", optarg);
+				}
+				break;
+			case 'o':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(load_outfile, "%s", optarg);
+				}
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+
+	if (load_mode == NULL)
+	{
+		load_mode = &load_mode_ary[0];
+	}
+	if ((load_mode->open_cb == NULL) && (load_isexternal == 0))
+	{
+		DBG_ER_LN("%s needs -a ip:port !!!", load_mode->name);
+		app_showusage(-1);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	app_ParseArguments(argc, argv);
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+	dbg_lvl_set(DBG_LVL_WARN);
+
+	FILE *fp = SAFE_FOPEN(load_outfile, "w");
+	if (fp)
+	{
+		fprintf(fp, "{\"runs\":[\n");
+	}
+
+	printf("%-5s %6s %8s %6s %12s %12s %8s %12s %9s %10s %10s %10s\n", "mode", "conns", "rate", "size", "sent", "recv", "errors", "msgs/sec", "MB/sec", "p50_us", "p99_us", "p999_us");
+
+	int failed = 0;
+	int isfirst = 1;
+	int c_idx = 0;
+	for (c_idx = 0; (c_idx < load_conns_count) && (is_quit == 0); c_idx++)
+	{
+		int r_idx = 0;
+		for (r_idx = 0; (r_idx < load_rate_count) && (is_quit == 0); r_idx++)
+		{
+			int conns = SAFE_MIN(SAFE_MAX(load_conns_ary[c_idx], 1), MAX_OF_LOAD_CONN);
+			LoadResult_t result;
+			if (load_run(conns, SAFE_MAX(load_rate_ary[r_idx], 0), &result) != 0)
+			{
+				failed++;
+				continue;
+			}
+
+			if ((fp) && (isfirst == 0))
+			{
+				fprintf(fp, ",\n");
+			}
+			load_report(fp, &result);
+			isfirst = 0;
+		}
+	}
+
+	if (fp)
+	{
+		fprintf(fp, "\n]}\n");
+		SAFE_FCLOSE(fp);
+	}
+	metricx_free(load_latency);
+
+	exit((failed) ? 1 : 0);
+}
@@ -12,8 +12,17 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_LWS
 #include "utilx9.h"
 
+#ifdef UTIL_EX_METRICX
+#define LWS2_METRIC_ADD(lws_req, key, val) do { if (lws_req) metricx_counter_add((lws_req)->metric.key, val); } while(0)
+#define LWS2_METRIC_GAUGE(lws_req, key, val) do { if (lws_req) metricx_gauge_add((lws_req)->metric.key, val); } while(0)
+#else
+#define LWS2_METRIC_ADD(lws_req, key, val)
+#define LWS2_METRIC_GAUGE(lws_req, key, val)
+#endif
+
 //#define USE_LWS_MINIMAL
 
 #ifdef USE_LWS_MINIMAL
@@ -141,6 +150,7 @@ static int callback_minimal(struct lws *wsi, enum lws_callback_reasons reason, v
 static int lws2_simple_cb(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
 {
 	int ret = -1;
+	int rc = 0;
 
 	LWSX_t *lws_req = lws2_protocol_user(wsi);
 
@@ -186,13 +196,21 @@ static int lws2_simple_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 							session->use_foreign_loops = 0;
 						}
 						session->wsi = wsi;
-						CLIST_STRUCT_INIT(session, msg_list);
+						session->ring = NULL;
+						session->ring_size = 0;
+						session->ring_head = 0;
+						session->isclose = 0;
+						session->iswake = 0;
+						session->frag_msg = NULL;
+						session->frag_pos = 0;
+						SAFE_MEMSET(&session->q_stat, 0, sizeof(LWSQStat_t));
 						//SAFE_MUTEX_ATTR_RECURSIVE(session->in_mtx);
 
 						DBG_IF_LN("%d %s !!! (session: %p)", reason, translate_lws_cb(reason), session);
 						//lws_set_wsi_user(wsi, (void *)session);
 
 						clist_push(lws_req->session_list, session);
+						LWS2_METRIC_GAUGE(lws_req, sessions, 1);
 					}
 				}
 				lws2_unlock(lws_req);
@@ -219,7 +237,7 @@ static int lws2_simple_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 				lws2_lock(lws_req);
 				if (lws_req->wsi_id == LWS_WSI_ID_SERVER)
 				{
-					lws2_session_write((LWSSession_t *)user);
+					rc = lws2_session_write((LWSSession_t *)user);
 				}
 				lws2_unlock(lws_req);
 			}
@@ -230,7 +248,7 @@ static int lws2_simple_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 				lws2_lock(lws_req);
 				if (lws_req->wsi_id == LWS_WSI_ID_CLIENT)
 				{
-					lws2_session_write((LWSSession_t *)user);
+					rc = lws2_session_write((LWSSession_t *)user);
 				}
 				lws2_unlock(lws_req);
 			}
@@ -254,7 +272,7 @@ static int lws2_simple_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 		}
 	}
 
-	return 0;
+	return rc;
 }
 
 #endif
@@ -403,23 +421,152 @@ void lws2_session_unlock(LWSSession_t *session)
 	}
 }
 
-static void lws2_session_msg_free_cb(void *item)
+LWSMsg_t *lws2_msg_new(char *payload, int payload_len)
+{
+	return lws2_msg_new_ex(payload, payload_len, LWS_WRITE_TEXT);
+}
+
+LWSMsg_t *lws2_msg_new_ex(char *payload, int payload_len, int wp)
+{
+	if (payload_len < 0)
+	{
+		return NULL;
+	}
+
+	// the pre-padding is reserved once, every session writes from the same buffer
+	int data_len = LWS_SEND_BUFFER_PRE_PADDING + payload_len + 1;
+	LWSMsg_t *msg = (LWSMsg_t*)SAFE_POOLX_CALLOC(1, sizeof(LWSMsg_t) + data_len);
+	if (msg)
+	{
+		msg->ref = 1;
+		msg->payload = msg->data;
+		msg->payload_len = payload_len;
+		msg->wp = wp;
+		if ((payload) && (payload_len > 0))
+		{
+			SAFE_LWS_MEMCPY(msg->payload, payload, payload_len, payload_len);
+		}
+	}
+	return msg;
+}
+
+LWSMsg_t *lws2_msg_ref(LWSMsg_t *msg)
+{
+	if (msg)
+	{
+		__atomic_add_fetch(&msg->ref, 1, __ATOMIC_RELAXED);
+	}
+	return msg;
+}
+
+void lws2_msg_unref(LWSMsg_t *msg)
 {
-	LWSMsg_t *msg = (LWSMsg_t *)item;
 	if (msg)
 	{
-		char *payload = msg->payload;
-		SAFE_FREE(payload);
+		if (__atomic_sub_fetch(&msg->ref, 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			SAFE_POOLX_FREE(msg);
+		}
 	}
 }
 
+static LWSMsg_t *lws2_ring_pop(LWSSession_t *session)
+{
+	LWSMsg_t *msg = NULL;
+	if ((session->ring) && (session->q_stat.depth > 0))
+	{
+		msg = session->ring[session->ring_head];
+		session->ring[session->ring_head] = NULL;
+		session->ring_head = (session->ring_head + 1) % session->ring_size;
+		session->q_stat.depth--;
+	}
+	return msg;
+}
+
+static void lws2_ring_free(LWSSession_t *session)
+{
+	LWSMsg_t *msg = NULL;
+	while ((msg = lws2_ring_pop(session)) != NULL)
+	{
+		lws2_msg_unref(msg);
+	}
+	SAFE_FREE(session->ring);
+	session->ring_size = 0;
+	session->ring_head = 0;
+
+	lws2_msg_unref(session->frag_msg);
+	session->frag_msg = NULL;
+	session->frag_pos = 0;
+}
+
+// msg is moved into the ring, 1: queued
+static int lws2_ring_push(LWSX_t *lws_req, LWSSession_t *session, LWSMsg_t *msg)
+{
+	if (session->ring == NULL)
+	{
+		int ring_size = ((lws_req) && (lws_req->max_ring > 0)) ? lws_req->max_ring : MAX_OF_RING;
+		session->ring = (LWSMsg_t**)SAFE_CALLOC(ring_size, sizeof(LWSMsg_t*));
+		if (session->ring == NULL)
+		{
+			lws2_msg_unref(msg);
+			return 0;
+		}
+		session->ring_size = ring_size;
+		session->ring_head = 0;
+	}
+
+	session->q_stat.pushes++;
+	LWS2_METRIC_ADD(lws_req, pushes, 1);
+	if (session->q_stat.depth >= session->ring_size)
+	{
+		LWS_SLOW_ID slow_id = (lws_req) ? lws_req->slow_id : LWS_SLOW_ID_DROP_OLDEST;
+		switch (slow_id)
+		{
+			case LWS_SLOW_ID_COALESCE:
+			{
+				int tail = (session->ring_head + session->q_stat.depth - 1) % session->ring_size;
+				lws2_msg_unref(session->ring[tail]);
+				session->ring[tail] = msg;
+				session->q_stat.coalesces++;
+				LWS2_METRIC_ADD(lws_req, coalesces, 1);
+				return 1;
+			}
+			case LWS_SLOW_ID_DISCONNECT:
+				if (session->isclose == 0)
+				{
+					DBG_WN_LN("slow consumer, disconnect !!! (session: %p, depth: %d)", session, session->q_stat.depth);
+				}
+				session->isclose = 1;
+				session->q_stat.drops++;
+				LWS2_METRIC_ADD(lws_req, drops, 1);
+				lws2_msg_unref(msg);
+				return 0;
+			case LWS_SLOW_ID_DROP_OLDEST:
+			default:
+				lws2_msg_unref(lws2_ring_pop(session));
+				session->q_stat.drops++;
+				LWS2_METRIC_ADD(lws_req, drops, 1);
+				break;
+		}
+	}
+
+	int tail = (session->ring_head + session->q_stat.depth) % session->ring_size;
+	session->ring[tail] = msg;
+	session->q_stat.depth++;
+	if (session->q_stat.depth > session->q_stat.max_depth)
+	{
+		session->q_stat.max_depth = session->q_stat.depth;
+	}
+	return 1;
+}
+
 static void lws2_session_free_cb(void *item)
 {
 	LWSSession_t *session = (LWSSession_t *)item;
 	DBG_IF_LN("(session: %p)", session);
 	if (session)
 	{
-		clist_free_ex(session->msg_list, lws2_session_msg_free_cb);
+		lws2_ring_free(session);
 	}
 }
 
@@ -427,88 +574,242 @@ void lws2_session_pop(LWSX_t *lws_req, LWSSession_t *session)
 {
 	if (session)
 	{
-		clist_free_ex(session->msg_list, lws2_session_msg_free_cb);
+		lws2_ring_free(session);
 		//SAFE_MUTEX_DESTROY_EX(session);
 		DBG_IF_LN("(session: %p)", session);
 		if (lws_req)
 		{
 			clist_remove(lws_req->session_list, session);
+			LWS2_METRIC_GAUGE(lws_req, sessions, -1);
 		}
 	}
 }
 
-void lws2_session_write(LWSSession_t *session)
+// 1: the service thread has to be woken up
+static int lws2_session_wakeup(LWSSession_t *session)
 {
-	if (session)
+	if (session->iswake)
 	{
-		lws2_session_lock(session);
+		// a burst of pushes is served by the same writeable callback
+		return 0;
+	}
 
-		LWSMsg_t *msg = clist_pop(session->msg_list);
-		if ((msg) && (msg->payload))
-		{
-			SAFE_LWS_WRITE(session->wsi, msg->payload, msg->payload_len, LWS_WRITE_TEXT);
-			SAFE_FREE(msg->payload);
+	session->iswake = 1;
+	lws_callback_on_writable(session->wsi);
+	return (session->use_foreign_loops==0);
+}
 
-			if (clist_length(session->msg_list) > 0)
-			{
-				lws_callback_on_writable(session->wsi);
-				// 20211122 Lanka Hsu: send data ASAP
-				// https://issueexplorer.com/issue/warmcat/libwebsockets/2358
-				if (session->use_foreign_loops==0)
-				{
-					lws_cancel_service_pt(session->wsi);
-				}
-			}
+// the pre-padding in front of payload + frag_pos belongs to the previous fragment, so the fragment is copied into tx
+static void lws2_session_write_frag(LWSX_t *lws_req, LWSSession_t *session)
+{
+	LWSMsg_t *msg = session->frag_msg;
+	int max_frame = (lws_req->max_frame < LEN_OF_WEBSOCKET) ? lws_req->max_frame : LEN_OF_WEBSOCKET;
+	int len = msg->payload_len - session->frag_pos;
+	if (len > max_frame)
+	{
+		len = max_frame;
+	}
+
+	int wp = (session->frag_pos == 0) ? msg->wp : LWS_WRITE_CONTINUATION;
+	if (session->frag_pos + len < msg->payload_len)
+	{
+		wp |= LWS_WRITE_NO_FIN;
+	}
+
+	SAFE_LWS_MEMCPY(lws_req->tx, msg->payload + LWS_SEND_BUFFER_PRE_PADDING + session->frag_pos, len, LEN_OF_WEBSOCKET);
+	SAFE_LWS_WRITE(session->wsi, lws_req->tx, len, wp);
+	session->q_stat.writes++;
+	LWS2_METRIC_ADD(lws_req, writes, 1);
+
+	session->frag_pos += len;
+	if (session->frag_pos >= msg->payload_len)
+	{
+		lws2_msg_unref(msg);
+		session->frag_msg = NULL;
+		session->frag_pos = 0;
+	}
+}
+
+// joins msg and the following small text messages into one frame
+static void lws2_session_write_coalesce(LWSX_t *lws_req, LWSSession_t *session, LWSMsg_t *msg)
+{
+	int max_size = (lws_req->coalesce_size < LEN_OF_WEBSOCKET) ? lws_req->coalesce_size : LEN_OF_WEBSOCKET;
+	char *tx = lws_req->tx + LWS_SEND_BUFFER_PRE_PADDING;
+	int tx_size = 0;
+
+	SAFE_MEMCPY(tx, msg->payload + LWS_SEND_BUFFER_PRE_PADDING, msg->payload_len, LEN_OF_WEBSOCKET);
+	tx_size = msg->payload_len;
+	lws2_msg_unref(msg);
+
+	while (session->q_stat.depth > 0)
+	{
+		LWSMsg_t *next = session->ring[session->ring_head];
+		if ((next->wp != LWS_WRITE_TEXT) || (tx_size + 1 + next->payload_len > max_size))
+		{
+			break;
 		}
-		SAFE_FREE(msg);
 
-		lws2_session_unlock(session);
+		next = lws2_ring_pop(session);
+		tx[tx_size++] = '\n';
+		if (next->payload_len > 0)
+		{
+			SAFE_MEMCPY(tx + tx_size, next->payload + LWS_SEND_BUFFER_PRE_PADDING, next->payload_len, LEN_OF_WEBSOCKET - tx_size);
+			tx_size += next->payload_len;
+		}
+		lws2_msg_unref(next);
+		session->q_stat.merges++;
 	}
+
+	SAFE_LWS_WRITE(session->wsi, lws_req->tx, tx_size, LWS_WRITE_TEXT);
+	session->q_stat.writes++;
+	LWS2_METRIC_ADD(lws_req, writes, 1);
 }
 
-void lws2_session_write_q_push(LWSSession_t *session, char *payload, int payload_len)
+// -1: close the connection (LWS_SLOW_ID_DISCONNECT)
+int lws2_session_write(LWSSession_t *session)
 {
+	int ret = 0;
 	if (session)
 	{
+		LWSX_t *lws_req = lws2_protocol_user(session->wsi);
+
 		lws2_session_lock(session);
 
-		LWSMsg_t *msg = (LWSMsg_t*)SAFE_CALLOC(1, sizeof(LWSMsg_t));
-		if (msg)
+		session->iswake = 0;
+		if (session->isclose)
 		{
-			msg->payload = (char*)SAFE_CALLOC(1, LWS_SEND_BUFFER_PRE_PADDING + payload_len + 1);
-			if (msg->payload)
+			ret = -1;
+		}
+		else if (session->frag_msg)
+		{
+			lws2_session_write_frag(lws_req, session);
+		}
+		else
+		{
+			LWSMsg_t *msg = lws2_ring_pop(session);
+			if (msg)
 			{
-				SAFE_LWS_MEMCPY(msg->payload, payload, payload_len, payload);
+				if ((lws_req->max_frame > 0) && (msg->payload_len > lws_req->max_frame))
+				{
+					session->frag_msg = msg;
+					session->frag_pos = 0;
+					lws2_session_write_frag(lws_req, session);
+				}
+				else if ((lws_req->coalesce_size > 0) && (msg->wp == LWS_WRITE_TEXT) && (msg->payload_len < lws_req->coalesce_size))
+				{
+					lws2_session_write_coalesce(lws_req, session, msg);
+				}
+				else
+				{
+					SAFE_LWS_WRITE(session->wsi, msg->payload, msg->payload_len, msg->wp);
+					session->q_stat.writes++;
+					LWS2_METRIC_ADD(lws_req, writes, 1);
+					lws2_msg_unref(msg);
+				}
 			}
+		}
 
-			msg->payload_len = payload_len;
-			clist_push(session->msg_list, msg);
-
-			lws_callback_on_writable(session->wsi);
+		if ((ret == 0) && ((session->frag_msg) || (session->q_stat.depth > 0)))
+		{
 			// 20211122 Lanka Hsu: send data ASAP
 			// https://issueexplorer.com/issue/warmcat/libwebsockets/2358
-			if (session->use_foreign_loops==0)
+			if (lws2_session_wakeup(session))
 			{
 				lws_cancel_service_pt(session->wsi);
 			}
 		}
+
 		lws2_session_unlock(session);
 	}
+	return ret;
+}
+
+// 1: the service thread has to be woken up
+static int lws2_session_write_q_add(LWSSession_t *session, LWSMsg_t *msg)
+{
+	int ret = 0;
+
+	lws2_session_lock(session);
+	if (lws2_ring_push(lws2_protocol_user(session->wsi), session, lws2_msg_ref(msg)) || (session->isclose))
+	{
+		ret = lws2_session_wakeup(session);
+	}
+	lws2_session_unlock(session);
+
+	return ret;
+}
+
+// lws2_session_write_q_msg takes a reference of msg
+void lws2_session_write_q_msg(LWSSession_t *session, LWSMsg_t *msg)
+{
+	if ((session) && (msg))
+	{
+		// 20211122 Lanka Hsu: send data ASAP
+		// https://issueexplorer.com/issue/warmcat/libwebsockets/2358
+		if (lws2_session_write_q_add(session, msg))
+		{
+			lws_cancel_service_pt(session->wsi);
+		}
+	}
+}
+
+void lws2_session_write_q_push(LWSSession_t *session, char *payload, int payload_len)
+{
+	lws2_session_write_q_push_ex(session, payload, payload_len, LWS_WRITE_TEXT);
+}
+
+void lws2_session_write_q_push_ex(LWSSession_t *session, char *payload, int payload_len, int wp)
+{
+	if (session)
+	{
+		LWSMsg_t *msg = lws2_msg_new_ex(payload, payload_len, wp);
+		lws2_session_write_q_msg(session, msg);
+		lws2_msg_unref(msg);
+	}
 }
 
 void lws2_session_write_q_broadcast(LWSX_t *lws_req, char *payload, int payload_len)
+{
+	lws2_session_write_q_broadcast_ex(lws_req, payload, payload_len, LWS_WRITE_TEXT);
+}
+
+// one copy of payload and one lws_cancel_service for all the sessions
+void lws2_session_write_q_broadcast_ex(LWSX_t *lws_req, char *payload, int payload_len, int wp)
 {
 	if (lws_req)
 	{
-		LWSSession_t *cur = NULL;
-
-		for (cur = clist_head(lws_req->session_list); cur != NULL; cur = clist_item_next(cur))
+		LWSMsg_t *msg = lws2_msg_new_ex(payload, payload_len, wp);
+		if (msg)
 		{
-			lws2_session_write_q_push(cur, payload, payload_len);
+			LWSSession_t *cur = NULL;
+			int iscancel = 0;
+
+			lws2_lock(lws_req);
+			for (cur = clist_head(lws_req->session_list); cur != NULL; cur = clist_item_next(cur))
+			{
+				iscancel |= lws2_session_write_q_add(cur, msg);
+			}
+			if ((iscancel) && (lws_req->context))
+			{
+				lws_cancel_service(lws_req->context);
+			}
+			lws2_unlock(lws_req);
+
+			lws2_msg_unref(msg);
 		}
 	}
 }
 
+void lws2_session_stat(LWSSession_t *session, LWSQStat_t *q_stat)
+{
+	if ((session) && (q_stat))
+	{
+		lws2_session_lock(session);
+		SAFE_MEMCPY(q_stat, &session->q_stat, sizeof(LWSQStat_t), sizeof(LWSQStat_t));
+		lws2_session_unlock(session);
+	}
+}
+
 int lws2_session_count(LWSX_t *lws_req)
 {
 	int ret = 0;
@@ -531,6 +832,9 @@ static void lws2_context_close(LWSX_t *lws_req)
 			//for libwebsockets-4.2.2
 			//clist_free_ex(lws_req->session_list, lws2_session_free_cb);
 			clist_pop_ex(lws_req->session_list, lws2_session_free_cb);
+#ifdef UTIL_EX_METRICX
+			metricx_gauge_set(lws_req->metric.sessions, 0);
+#endif
 
 			lws_context_destroy(lws_req->context);
 			lws_req->context = NULL;
@@ -835,6 +1139,32 @@ void lws2_thread_stop(LWSX_t *lws_req)
 	}
 }
 
+#ifdef UTIL_EX_METRICX
+static void lws2_metric_open(LWSX_t *lws_req)
+{
+	char labels[LEN_OF_METRICX_LABELS] = "";
+	SAFE_SPRINTF_EX(labels, "name=\"%s\"", lws_req->name);
+
+	LWSMetric_t *metric = &lws_req->metric;
+	metric->sessions = metricx_gauge_new("lws_sessions", "websocket sessions", labels);
+	metric->pushes = metricx_counter_new("lws_pushes_total", "messages queued to the sessions", labels);
+	metric->drops = metricx_counter_new("lws_drops_total", "messages dropped by slow consumers", labels);
+	metric->coalesces = metricx_counter_new("lws_coalesces_total", "queued messages replaced by newer ones", labels);
+	metric->writes = metricx_counter_new("lws_writes_total", "calls of lws_write", labels);
+}
+
+static void lws2_metric_close(LWSX_t *lws_req)
+{
+	LWSMetric_t *metric = &lws_req->metric;
+	metricx_free(metric->sessions);
+	metricx_free(metric->pushes);
+	metricx_free(metric->drops);
+	metricx_free(metric->coalesces);
+	metricx_free(metric->writes);
+	SAFE_MEMSET(metric, 0, sizeof(LWSMetric_t));
+}
+#endif
+
 void lws2_thread_close(LWSX_t *lws_req)
 {
 	if ((lws_req) && (lws_req->isfree == 0))
@@ -843,6 +1173,10 @@ void lws2_thread_close(LWSX_t *lws_req)
 
 		ThreadX_t *tidx_req = &lws_req->tidx;
 		threadx_close(tidx_req);
+
+#ifdef UTIL_EX_METRICX
+		lws2_metric_close(lws_req);
+#endif
 	}
 }
 
@@ -850,6 +1184,10 @@ void lws2_thread_init(LWSX_t *lws_req)
 {
 	if (lws_req)
 	{
+#ifdef UTIL_EX_METRICX
+		lws2_metric_open(lws_req);
+#endif
+
 		ThreadX_t *tidx_req = &lws_req->tidx;
 		tidx_req->thread_cb = lws2_thread_handler;
 		tidx_req->data = lws_req;
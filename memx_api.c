@@ -0,0 +1,499 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <semaphore.h>
+
+#include "utilx9.h"
+
+#ifdef UTIL_EX_MEMX
+// every live pointer of SAFE_* is kept in a hash table of MAX_OF_MEMX_SHARD shards, one lock each.
+// the callsites are statics of the macros (MEMX_SITE), their counters are atomic, no lookup.
+// a pointer must be removed before it is freed, someone else might get the same address.
+// a pointer freed by free() stays until its address comes back from malloc, then it is replaced.
+// here only calloc / realloc / free are called, SAFE_* would track themselves.
+
+#define LEN_OF_MEMX_CHUNK 256 // entries
+#define MIN_OF_MEMX_BUCKET 256 // per shard, doubled when the entries are twice the buckets
+#define MEMX_THREAD_POLL_MS 250
+
+typedef struct MemXEntry_Struct
+{
+	struct MemXEntry_Struct *next;
+
+	void *ptr;
+	size_t size;
+	MemXSite_t *site;
+	unsigned int tid;
+} MemXEntry_t;
+
+typedef struct MemXShard_Struct
+{
+	pthread_mutex_t mtx;
+
+	MemXEntry_t **bucket_ary;
+	size_t buckets; // power of 2
+	size_t count;
+
+	MemXEntry_t *free_list;
+} __attribute__((aligned(64))) MemXShard_t;
+
+static MemXShard_t memx_shard_ary[MAX_OF_MEMX_SHARD] = { [0 ... MAX_OF_MEMX_SHARD-1] = { .mtx = PTHREAD_MUTEX_INITIALIZER } };
+
+static pthread_mutex_t memx_site_mtx = PTHREAD_MUTEX_INITIALIZER;
+static MemXSite_t *memx_site_list = NULL;
+
+static pthread_mutex_t memx_dump_mtx = PTHREAD_MUTEX_INITIALIZER;
+static double memx_dump_last = 0;
+
+static __thread unsigned int memx_tid = 0;
+
+static uint64_t memx_hash(void *ptr)
+{
+	return ((uint64_t)(uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static void memx_site_join(MemXSite_t *site)
+{
+	int isjoin = 0;
+	if (__atomic_compare_exchange_n(&site->isjoin, &isjoin, 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		SAFE_THREAD_LOCK(&memx_site_mtx);
+		site->next = memx_site_list;
+		memx_site_list = site;
+		SAFE_THREAD_UNLOCK(&memx_site_mtx);
+	}
+}
+
+static void memx_site_add(MemXSite_t *site, int64_t bytes, int64_t count)
+{
+	__atomic_add_fetch(&site->live_bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->live_count, count, __ATOMIC_RELAXED);
+}
+
+// ** shard, shard->mtx is held **
+static void memx_shard_grow(MemXShard_t *shard)
+{
+	size_t buckets = (shard->buckets) ? shard->buckets * 2 : MIN_OF_MEMX_BUCKET;
+	MemXEntry_t **bucket_ary = (MemXEntry_t **)calloc(buckets, sizeof(MemXEntry_t *));
+	if (bucket_ary == NULL)
+	{
+		return;
+	}
+
+	size_t idx = 0;
+	for (idx = 0; idx < shard->buckets; idx++)
+	{
+		MemXEntry_t *entry = shard->bucket_ary[idx];
+		while (entry)
+		{
+			MemXEntry_t *next = entry->next;
+			size_t pos = (memx_hash(entry->ptr) >> 32) & (buckets - 1);
+			entry->next = bucket_ary[pos];
+			bucket_ary[pos] = entry;
+			entry = next;
+		}
+	}
+	free(shard->bucket_ary);
+	shard->bucket_ary = bucket_ary;
+	shard->buckets = buckets;
+}
+
+static MemXEntry_t *memx_entry_new(MemXShard_t *shard)
+{
+	if (shard->free_list == NULL)
+	{
+		// never freed, they are kept by the shard
+		MemXEntry_t *chunk = (MemXEntry_t *)calloc(LEN_OF_MEMX_CHUNK, sizeof(MemXEntry_t));
+		if (chunk == NULL)
+		{
+			return NULL;
+		}
+		int idx = 0;
+		for (idx = 0; idx < LEN_OF_MEMX_CHUNK; idx++)
+		{
+			chunk[idx].next = shard->free_list;
+			shard->free_list = &chunk[idx];
+		}
+	}
+
+	MemXEntry_t *entry = shard->free_list;
+	shard->free_list = entry->next;
+	return entry;
+}
+
+static MemXEntry_t **memx_shard_find(MemXShard_t *shard, void *ptr, uint64_t hash)
+{
+	if (shard->buckets == 0)
+	{
+		return NULL;
+	}
+
+	MemXEntry_t **prev = &shard->bucket_ary[(hash >> 32) & (shard->buckets - 1)];
+	while (*prev)
+	{
+		if ((*prev)->ptr == ptr)
+		{
+			return prev;
+		}
+		prev = &(*prev)->next;
+	}
+	return prev;
+}
+
+// ** track **
+static void memx_insert(MemXSite_t *site, void *ptr, size_t size)
+{
+	if (memx_tid == 0)
+	{
+		memx_tid = (unsigned int)gettidv1_ex();
+	}
+	memx_site_join(site);
+	__atomic_add_fetch(&site->allocs, 1, __ATOMIC_RELAXED);
+	memx_site_add(site, size, 1);
+
+	uint64_t hash = memx_hash(ptr);
+	MemXShard_t *shard = &memx_shard_ary[hash & (MAX_OF_MEMX_SHARD - 1)];
+
+	SAFE_THREAD_LOCK(&shard->mtx);
+	if (shard->count >= shard->buckets * 2)
+	{
+		memx_shard_grow(shard);
+	}
+
+	MemXEntry_t **prev = memx_shard_find(shard, ptr, hash);
+	MemXEntry_t *entry = (prev) ? *prev : NULL;
+	if (entry)
+	{
+		// freed by free(), the address is back
+		memx_site_add(entry->site, -(int64_t)entry->size, -1);
+	}
+	else if ((prev) && ((entry = memx_entry_new(shard)) != NULL))
+	{
+		entry->next = NULL;
+		*prev = entry;
+		shard->count++;
+	}
+
+	if (entry)
+	{
+		entry->ptr = ptr;
+		entry->size = size;
+		entry->site = site;
+		entry->tid = memx_tid;
+	}
+	else
+	{
+		// untracked, no memory for the entry
+		memx_site_add(site, -(int64_t)size, -1);
+	}
+	SAFE_THREAD_UNLOCK(&shard->mtx);
+}
+
+// 0: found, the entry is copied to removed
+static int memx_remove(void *ptr, MemXEntry_t *removed)
+{
+	int ret = -1;
+	uint64_t hash = memx_hash(ptr);
+	MemXShard_t *shard = &memx_shard_ary[hash & (MAX_OF_MEMX_SHARD - 1)];
+
+	SAFE_THREAD_LOCK(&shard->mtx);
+	MemXEntry_t **prev = memx_shard_find(shard, ptr, hash);
+	if ((prev) && (*prev))
+	{
+		MemXEntry_t *entry = *prev;
+		*prev = entry->next;
+		shard->count--;
+
+		memx_site_add(entry->site, -(int64_t)entry->size, -1);
+		if (removed)
+		{
+			*removed = *entry;
+		}
+
+		entry->next = shard->free_list;
+		shard->free_list = entry;
+		ret = 0;
+	}
+	SAFE_THREAD_UNLOCK(&shard->mtx);
+
+	return ret;
+}
+
+void *memx_malloc(MemXSite_t *site, size_t size)
+{
+	// SAFE_MALLOC is zeroed
+	return memx_calloc(site, 1, size);
+}
+
+void *memx_calloc(MemXSite_t *site, size_t nitems, size_t size)
+{
+	void *ptr = calloc(nitems, size);
+	if ((ptr) && (site))
+	{
+		memx_insert(site, ptr, nitems * size);
+	}
+	return ptr;
+}
+
+void *memx_realloc(MemXSite_t *site, void *ptr, size_t size)
+{
+	MemXEntry_t removed;
+	int istrack = (ptr) ? (memx_remove(ptr, &removed) == 0) : 0;
+
+	void *new_ptr = realloc(ptr, size);
+	if (new_ptr)
+	{
+		if (site)
+		{
+			memx_insert(site, new_ptr, size);
+		}
+	}
+	else if ((istrack) && (size))
+	{
+		// ptr is still there
+		memx_insert(removed.site, ptr, removed.size);
+		__atomic_sub_fetch(&removed.site->allocs, 1, __ATOMIC_RELAXED);
+	}
+	return new_ptr;
+}
+
+void memx_track(MemXSite_t *site, void *ptr, size_t size)
+{
+	if ((ptr) && (site))
+	{
+		memx_insert(site, ptr, size);
+	}
+}
+
+void memx_free(void *ptr)
+{
+	if (ptr)
+	{
+		memx_remove(ptr, NULL);
+		free(ptr);
+	}
+}
+
+// ** dump **
+static double memx_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static int memx_site_cmp(const void *a, const void *b)
+{
+	int64_t bytes_a = __atomic_load_n(&(*(MemXSite_t **)a)->live_bytes, __ATOMIC_RELAXED);
+	int64_t bytes_b = __atomic_load_n(&(*(MemXSite_t **)b)->live_bytes, __ATOMIC_RELAXED);
+	return (bytes_a < bytes_b) ? 1 : (bytes_a > bytes_b) ? -1 : 0;
+}
+
+static void memx_dump_leak(FILE *fp)
+{
+	fprintf(fp, "%-18s %10s %8s  %s\n", "ptr", "size", "tid", "callsite");
+
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_MEMX_SHARD; idx++)
+	{
+		MemXShard_t *shard = &memx_shard_ary[idx];
+		SAFE_THREAD_LOCK(&shard->mtx);
+		size_t pos = 0;
+		for (pos = 0; pos < shard->buckets; pos++)
+		{
+			MemXEntry_t *entry = NULL;
+			for (entry = shard->bucket_ary[pos]; entry != NULL; entry = entry->next)
+			{
+				MemXSite_t *site = entry->site;
+				if (site->leaks++ < MAX_OF_MEMX_LEAK)
+				{
+					fprintf(fp, "%-18p %10zd %8u  %s:%d %s\n", entry->ptr, entry->size, entry->tid, site->file, site->line, site->func);
+				}
+			}
+		}
+		SAFE_THREAD_UNLOCK(&shard->mtx);
+	}
+}
+
+int memx_dump(char *filename, int isleak)
+{
+	FILE *fp = (filename) ? SAFE_FOPEN(filename, "a") : stderr;
+	if (fp == NULL)
+	{
+		DBG_ER_LN("SAFE_FOPEN error !!! (filename: %s)", filename);
+		return -1;
+	}
+
+	SAFE_THREAD_LOCK(&memx_dump_mtx);
+
+	int count = 0;
+	SAFE_THREAD_LOCK(&memx_site_mtx);
+	MemXSite_t *site = NULL;
+	for (site = memx_site_list; site != NULL; site = site->next)
+	{
+		count++;
+	}
+	MemXSite_t **site_ary = (MemXSite_t **)calloc(count + 1, sizeof(MemXSite_t *));
+	count = 0;
+	for (site = memx_site_list; (site_ary) && (site != NULL); site = site->next)
+	{
+		site_ary[count++] = site;
+	}
+	SAFE_THREAD_UNLOCK(&memx_site_mtx);
+
+	if (site_ary == NULL)
+	{
+		SAFE_THREAD_UNLOCK(&memx_dump_mtx);
+		if (filename)
+		{
+			SAFE_FCLOSE(fp);
+		}
+		return -1;
+	}
+	qsort(site_ary, count, sizeof(MemXSite_t *), memx_site_cmp);
+
+	double now = memx_now();
+	double secs = (memx_dump_last > 0) ? now - memx_dump_last : 0;
+	memx_dump_last = now;
+
+	int64_t total_bytes = 0;
+	int64_t total_count = 0;
+	int idx = 0;
+	for (idx = 0; idx < count; idx++)
+	{
+		total_bytes += __atomic_load_n(&site_ary[idx]->live_bytes, __ATOMIC_RELAXED);
+		total_count += __atomic_load_n(&site_ary[idx]->live_count, __ATOMIC_RELAXED);
+	}
+
+	fprintf(fp, "== memx (pid: %d, live_bytes: %lld, live_count: %lld, callsites: %d, secs: %.3f) ==\n", (int)getpid(), (long long)total_bytes, (long long)total_count, count, secs);
+	fprintf(fp, "%12s %10s %12s %12s  %s\n", "live_bytes", "live_count", "allocs", "allocs/sec", "callsite");
+	for (idx = 0; idx < count; idx++)
+	{
+		site = site_ary[idx];
+		int64_t live_bytes = __atomic_load_n(&site->live_bytes, __ATOMIC_RELAXED);
+		int64_t live_count = __atomic_load_n(&site->live_count, __ATOMIC_RELAXED);
+		uint64_t allocs = __atomic_load_n(&site->allocs, __ATOMIC_RELAXED);
+		double rate = (secs > 0) ? (double)(allocs - site->allocs_last) / secs : 0;
+		site->allocs_last = allocs;
+		site->leaks = 0;
+
+		if ((live_count != 0) || (rate > 0) || (isleak == 0))
+		{
+			fprintf(fp, "%12lld %10lld %12llu %12.1f  %s:%d %s\n", (long long)live_bytes, (long long)live_count, (unsigned long long)allocs, rate, site->file, site->line, site->func);
+		}
+	}
+	free(site_ary);
+
+	if (isleak)
+	{
+		memx_dump_leak(fp);
+	}
+
+	SAFE_THREAD_UNLOCK(&memx_dump_mtx);
+
+	if (filename)
+	{
+		SAFE_FCLOSE(fp);
+	}
+	else
+	{
+		fflush(fp);
+	}
+	return count;
+}
+
+// ** thread, memx_dump_async **
+static ThreadX_t memx_tidx;
+static sem_t memx_sem;
+static int memx_isopen = 0;
+static char memx_filename[LEN_OF_FULLNAME] = "";
+
+void memx_dump_async(void)
+{
+	if (memx_isopen)
+	{
+		sem_post(&memx_sem);
+	}
+}
+
+static char *memx_filename_get(void)
+{
+	return (memx_filename[0]) ? memx_filename : NULL;
+}
+
+static void *memx_thread_handler(void *user)
+{
+	ThreadX_t *tidx_req = (ThreadX_t *)user;
+
+	if (tidx_req)
+	{
+		threadx_detach(tidx_req);
+
+		while (threadx_isquit(tidx_req) == 0)
+		{
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += MEMX_THREAD_POLL_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L)
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+
+			if ((sem_timedwait(&memx_sem, &ts) == 0) && (threadx_isquit(tidx_req) == 0))
+			{
+				memx_dump(memx_filename_get(), 0);
+			}
+		}
+
+		threadx_leave(tidx_req);
+	}
+
+	return NULL;
+}
+
+static void memx_exit(void)
+{
+	memx_dump(memx_filename_get(), 1);
+}
+
+void memx_open(char *filename)
+{
+	if (memx_isopen == 0)
+	{
+		if (filename)
+		{
+			SAFE_SPRINTF_EX(memx_filename, "%s", filename);
+		}
+		sem_init(&memx_sem, 0, 0);
+		memx_isopen = 1;
+		atexit(memx_exit);
+
+		memx_tidx.thread_cb = memx_thread_handler;
+		memx_tidx.data = &memx_tidx;
+		threadx_init(&memx_tidx, "memx");
+		DBG_IF_LN("(filename: %s)", (filename) ? filename : "stderr");
+	}
+}
+
+void memx_close(void)
+{
+	if (memx_isopen)
+	{
+		memx_isopen = 0;
+		threadx_close(&memx_tidx);
+		sem_destroy(&memx_sem);
+	}
+}
+#endif
@@ -0,0 +1,225 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <signal.h>
+#include <getopt.h>
+
+#include "utilx9.h"
+
+#define TAG "metricx_123"
+
+#define MAX_OF_QTEST 64
+
+typedef struct TestX_Struct
+{
+	int idx;
+} TestX_t;
+
+static QueueX_t *test_q = NULL;
+static MetricX_t *test_loops = NULL;
+
+static char metricx_addr[LEN_OF_FULLNAME] = "/tmp/metricx.sock";
+static int metricx_secs = 0; // 0: forever
+
+static int test_q_exec_cb(void *arg)
+{
+	TestX_t *data_pop = (TestX_t *)arg;
+
+	if (data_pop)
+	{
+		// 1 ~ 1024 us
+		usleep(1 + (data_pop->idx % 1024));
+	}
+
+	return 0;
+}
+
+// ** app **
+static int is_quit = 0;
+
+static int app_quit(void)
+{
+	return is_quit;
+}
+
+static void app_set_quit(int mode)
+{
+	is_quit = mode;
+}
+
+static void app_stop(void)
+{
+	if (app_quit()==0)
+	{
+		app_set_quit(1);
+	}
+}
+
+static void app_loop(void)
+{
+	test_loops = metricx_counter_new("metricx_123_loops_total", "loops of app_loop", NULL);
+	test_q = queuex_thread_init("metricx_123", MAX_OF_QTEST, sizeof(TestX_t), test_q_exec_cb, NULL);
+	queuex_isready(test_q, 5);
+
+	if (metricx_server_open(metricx_addr) == 0)
+	{
+		if (metricx_addr[0] == '/')
+		{
+			DBG_WN_LN("curl --unix-socket %s http://localhost/metrics", metricx_addr);
+		}
+		else
+		{
+			DBG_WN_LN("curl http://127.0.0.1:%s/metrics", metricx_addr);
+		}
+	}
+
+	int idx = 0;
+	time_t t_end = time(NULL) + metricx_secs;
+	while ((app_quit() == 0) && ((metricx_secs == 0) || (time(NULL) < t_end)))
+	{
+		TestX_t data_new = { .idx = idx++ };
+		queuex_push(test_q, (void*)&data_new);
+		metricx_counter_add(test_loops, 1);
+		usleep(500);
+	}
+
+	{
+		QBUF_t qbuf;
+		qbuf_init(&qbuf, MAX_OF_QBUF_1MB);
+		if (metricx_prometheus(&qbuf) > 0)
+		{
+			printf("%s", qbuf_buff(&qbuf));
+		}
+		qbuf_free(&qbuf);
+	}
+
+	metricx_server_close();
+
+	queuex_thread_stop(test_q);
+	queuex_thread_close(test_q);
+	metricx_free(test_loops);
+}
+
+static int app_init(void)
+{
+	int ret = 0;
+
+	return ret;
+}
+
+static void app_exit(void)
+{
+	app_stop();
+}
+
+static void app_signal_handler(int signum)
+{
+	DBG_ER_LN("(signum: %d)", signum);
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			app_stop();
+			break;
+		case SIGPIPE:
+			break;
+
+		case SIGUSR1:
+			break;
+
+		case SIGUSR2:
+			dbg_lvl_round();
+			DBG_ER_LN("dbg_lvl_get(): %d", dbg_lvl_get());
+			DBG_ER_LN("(Version: %s)", version_show());
+			break;
+	}
+}
+
+static void app_signal_register(void)
+{
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGUSR1, app_signal_handler);
+	signal(SIGUSR2, app_signal_handler);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int option_index = 0;
+const char* short_options = "a:s:h";
+static struct option long_options[] =
+{
+	{ "addr",        required_argument,   NULL,    'a'  },
+	{ "secs",        required_argument,   NULL,    's'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s\n"
+		"  -a, --addr        /path.sock, @abstract or port of 127.0.0.1\n"
+		"  -s, --secs        seconds to run, 0: until Ctrl+C\n"
+		"  -h, --help\n", TAG);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -a 9100 -s 10\n", TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(metricx_addr, "%s", optarg);
+				}
+				break;
+			case 's':
+				if (optarg)
+				{
+					metricx_secs = atoi(optarg);
+				}
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	app_ParseArguments(argc, argv);
+	app_signal_register();
+	atexit(app_exit);
+
+	if ( app_init() == -1 )
+	{
+		return -1;
+	}
+
+	app_loop();
+
+	DBG_WN_LN(DBG_TXT_BYE_BYE);
+	return 0;
+}
@@ -0,0 +1,667 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "utilx9.h"
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef UTIL_EX_METRICX
+// counters and the count/sum of histograms are spread over MAX_OF_METRICX_SHARD cache lines,
+// a thread always hits the same shard, readers sum them up.
+// histogram buckets are HDR-like, 8 linear sub-buckets per power of 2, and one set per shard as well.
+
+#define METRICX_SERVER_POLL_MS 200
+#define METRICX_SERVER_READ_MS 1000
+
+static pthread_mutex_t metricx_mtx = PTHREAD_MUTEX_INITIALIZER;
+CLIST(metricx_list);
+
+static int metricx_shard_next = 0;
+static __thread int metricx_shard = -1;
+
+static char *metricx_type_name[METRICX_TYPE_ID_MAX] =
+{
+	"counter",
+	"gauge",
+	"histogram",
+};
+
+static inline int metricx_shard_idx(void)
+{
+	if (metricx_shard < 0)
+	{
+		metricx_shard = __atomic_fetch_add(&metricx_shard_next, 1, __ATOMIC_RELAXED) & (MAX_OF_METRICX_SHARD - 1);
+	}
+	return metricx_shard;
+}
+
+static inline MetricXShard_t *metricx_shard_get(MetricX_t *metricx_req)
+{
+	return &metricx_req->shard_ary[metricx_shard_idx()];
+}
+
+// the bucket of all shards
+static uint64_t metricx_bucket_get(MetricX_t *metricx_req, int idx)
+{
+	uint64_t count = 0;
+	int shard = 0;
+
+	for (shard = 0; shard < MAX_OF_METRICX_SHARD; shard++)
+	{
+		count += __atomic_load_n(&metricx_req->bucket_ary[shard * MAX_OF_METRICX_BUCKET + idx], __ATOMIC_RELAXED);
+	}
+	return count;
+}
+
+int metricx_bucket_idx(uint64_t val)
+{
+	if (val < 8)
+	{
+		return (int)val;
+	}
+
+	int msb = 63 - __builtin_clzll(val);
+	return ((msb - 2) << 3) + (int)((val >> (msb - 3)) & 7);
+}
+
+uint64_t metricx_bucket_upper(int idx)
+{
+	if (idx < 8)
+	{
+		return (uint64_t)idx;
+	}
+
+	int msb = (idx >> 3) + 2;
+	uint64_t lower = (uint64_t)(8 + (idx & 7)) << (msb - 3);
+	return lower + (((uint64_t)1 << (msb - 3)) - 1);
+}
+
+unsigned long long metricx_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static MetricX_t *metricx_new(METRICX_TYPE_ID type, char *name, char *help, char *labels)
+{
+	MetricX_t *metricx_req = NULL;
+
+	if (name == NULL)
+	{
+		return NULL;
+	}
+
+	metricx_req = (MetricX_t *)SAFE_CALLOC(1, sizeof(MetricX_t));
+	if (metricx_req)
+	{
+		SAFE_SPRINTF_EX(metricx_req->name, "%s", name);
+		SAFE_SPRINTF_EX(metricx_req->help, "%s", (help) ? help : name);
+		SAFE_SPRINTF_EX(metricx_req->labels, "%s", (labels) ? labels : "");
+		metricx_req->type = type;
+
+		if (type != METRICX_TYPE_ID_GAUGE)
+		{
+			void *shard_ary = NULL;
+			if (posix_memalign(&shard_ary, LEN_OF_METRICX_CACHELINE, MAX_OF_METRICX_SHARD * sizeof(MetricXShard_t)) == 0)
+			{
+				SAFE_MEMSET(shard_ary, 0, MAX_OF_METRICX_SHARD * sizeof(MetricXShard_t));
+				metricx_req->shard_ary = (MetricXShard_t *)shard_ary;
+			}
+		}
+		if (type == METRICX_TYPE_ID_HISTOGRAM)
+		{
+			// MAX_OF_METRICX_BUCKET * 8 is a multiple of the cache line, the shards don't share one
+			void *bucket_ary = NULL;
+			if (posix_memalign(&bucket_ary, LEN_OF_METRICX_CACHELINE, MAX_OF_METRICX_SHARD * MAX_OF_METRICX_BUCKET * sizeof(uint64_t)) == 0)
+			{
+				SAFE_MEMSET(bucket_ary, 0, MAX_OF_METRICX_SHARD * MAX_OF_METRICX_BUCKET * sizeof(uint64_t));
+				metricx_req->bucket_ary = (uint64_t *)bucket_ary;
+			}
+		}
+
+		if ( ((type != METRICX_TYPE_ID_GAUGE) && (metricx_req->shard_ary == NULL))
+			|| ((type == METRICX_TYPE_ID_HISTOGRAM) && (metricx_req->bucket_ary == NULL)) )
+		{
+			DBG_ER_LN("SAFE_CALLOC error !!! (name: %s)", name);
+			SAFE_FREE(metricx_req->shard_ary);
+			SAFE_FREE(metricx_req->bucket_ary);
+			SAFE_FREE(metricx_req);
+		}
+		else
+		{
+			SAFE_THREAD_LOCK(&metricx_mtx);
+			clist_push(metricx_list, metricx_req);
+			SAFE_THREAD_UNLOCK(&metricx_mtx);
+		}
+	}
+
+	return metricx_req;
+}
+
+MetricX_t *metricx_counter_new(char *name, char *help, char *labels)
+{
+	return metricx_new(METRICX_TYPE_ID_COUNTER, name, help, labels);
+}
+
+MetricX_t *metricx_gauge_new(char *name, char *help, char *labels)
+{
+	return metricx_new(METRICX_TYPE_ID_GAUGE, name, help, labels);
+}
+
+MetricX_t *metricx_histogram_new(char *name, char *help, char *labels)
+{
+	return metricx_new(METRICX_TYPE_ID_HISTOGRAM, name, help, labels);
+}
+
+void metricx_free(MetricX_t *metricx_req)
+{
+	if (metricx_req)
+	{
+		SAFE_THREAD_LOCK(&metricx_mtx);
+		clist_remove(metricx_list, metricx_req);
+		SAFE_THREAD_UNLOCK(&metricx_mtx);
+
+		SAFE_FREE(metricx_req->shard_ary);
+		SAFE_FREE(metricx_req->bucket_ary);
+		SAFE_FREE(metricx_req);
+	}
+}
+
+void metricx_counter_add(MetricX_t *metricx_req, uint64_t val)
+{
+	if ((metricx_req) && (metricx_req->shard_ary))
+	{
+		MetricXShard_t *shard = metricx_shard_get(metricx_req);
+		__atomic_fetch_add(&shard->count, val, __ATOMIC_RELAXED);
+	}
+}
+
+void metricx_gauge_set(MetricX_t *metricx_req, int64_t val)
+{
+	if (metricx_req)
+	{
+		__atomic_store_n(&metricx_req->gauge, val, __ATOMIC_RELAXED);
+	}
+}
+
+void metricx_gauge_add(MetricX_t *metricx_req, int64_t val)
+{
+	if (metricx_req)
+	{
+		__atomic_fetch_add(&metricx_req->gauge, val, __ATOMIC_RELAXED);
+	}
+}
+
+void metricx_histogram_add(MetricX_t *metricx_req, uint64_t val)
+{
+	if ((metricx_req) && (metricx_req->bucket_ary))
+	{
+		int shard_idx = metricx_shard_idx();
+		MetricXShard_t *shard = &metricx_req->shard_ary[shard_idx];
+		__atomic_fetch_add(&metricx_req->bucket_ary[shard_idx * MAX_OF_METRICX_BUCKET + metricx_bucket_idx(val)], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&shard->count, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&shard->sum, val, __ATOMIC_RELAXED);
+	}
+}
+
+uint64_t metricx_counter_get(MetricX_t *metricx_req)
+{
+	uint64_t count = 0;
+	if ((metricx_req) && (metricx_req->shard_ary))
+	{
+		int idx = 0;
+		for (idx = 0; idx < MAX_OF_METRICX_SHARD; idx++)
+		{
+			count += __atomic_load_n(&metricx_req->shard_ary[idx].count, __ATOMIC_RELAXED);
+		}
+	}
+	return count;
+}
+
+int64_t metricx_gauge_get(MetricX_t *metricx_req)
+{
+	int64_t val = 0;
+	if (metricx_req)
+	{
+		val = __atomic_load_n(&metricx_req->gauge, __ATOMIC_RELAXED);
+	}
+	return val;
+}
+
+uint64_t metricx_histogram_count(MetricX_t *metricx_req)
+{
+	return metricx_counter_get(metricx_req);
+}
+
+uint64_t metricx_histogram_sum(MetricX_t *metricx_req)
+{
+	uint64_t sum = 0;
+	if ((metricx_req) && (metricx_req->shard_ary))
+	{
+		int idx = 0;
+		for (idx = 0; idx < MAX_OF_METRICX_SHARD; idx++)
+		{
+			sum += __atomic_load_n(&metricx_req->shard_ary[idx].sum, __ATOMIC_RELAXED);
+		}
+	}
+	return sum;
+}
+
+uint64_t metricx_histogram_quantile(MetricX_t *metricx_req, double q)
+{
+	uint64_t bucket_ary[MAX_OF_METRICX_BUCKET];
+	uint64_t total = 0;
+	int idx = 0;
+
+	if ((metricx_req == NULL) || (metricx_req->bucket_ary == NULL))
+	{
+		return 0;
+	}
+
+	// the buckets themselves, count of the shards may be a little ahead
+	// one snapshot of the shards, both passes see the same buckets
+	for (idx = 0; idx < MAX_OF_METRICX_BUCKET; idx++)
+	{
+		bucket_ary[idx] = metricx_bucket_get(metricx_req, idx);
+		total += bucket_ary[idx];
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	// ceil(q * total)
+	uint64_t rank = (uint64_t)(q * total);
+	if ((double)rank < q * total)
+	{
+		rank++;
+	}
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	else if (rank > total)
+	{
+		rank = total;
+	}
+
+	uint64_t seen = 0;
+	for (idx = 0; idx < MAX_OF_METRICX_BUCKET; idx++)
+	{
+		seen += bucket_ary[idx];
+		if (seen >= rank)
+		{
+			break;
+		}
+	}
+	return metricx_bucket_upper((idx < MAX_OF_METRICX_BUCKET) ? idx : MAX_OF_METRICX_BUCKET - 1);
+}
+
+#define METRICX_QBUF_PRINTF(qbuf, format, args...) \
+	do { \
+		char __line[LEN_OF_BUF512] = ""; \
+		int __len = SAFE_SPRINTF_EX(__line, format, ## args); \
+		if (__len >= (int)sizeof(__line)) __len = sizeof(__line) - 1; \
+		if (__len > 0) qbuf_write(qbuf, __line, __len); \
+	} while(0)
+
+static void metricx_prometheus_one(QBUF_t *qbuf, MetricX_t *metricx_req)
+{
+	char *labels = metricx_req->labels;
+	char *comma = (labels[0]) ? "," : "";
+	char braces[LEN_OF_METRICX_LABELS+2] = "";
+	if (labels[0])
+	{
+		SAFE_SPRINTF_EX(braces, "{%s}", labels);
+	}
+
+	switch (metricx_req->type)
+	{
+		case METRICX_TYPE_ID_COUNTER:
+			METRICX_QBUF_PRINTF(qbuf, "%s%s %" PRIu64 "\n", metricx_req->name, braces, metricx_counter_get(metricx_req));
+			break;
+		case METRICX_TYPE_ID_GAUGE:
+			METRICX_QBUF_PRINTF(qbuf, "%s%s %" PRId64 "\n", metricx_req->name, braces, metricx_gauge_get(metricx_req));
+			break;
+		case METRICX_TYPE_ID_HISTOGRAM:
+		{
+			// only the buckets which were hit, le is cumulative
+			uint64_t seen = 0;
+			int idx = 0;
+			for (idx = 0; idx < MAX_OF_METRICX_BUCKET; idx++)
+			{
+				uint64_t count = metricx_bucket_get(metricx_req, idx);
+				if (count)
+				{
+					seen += count;
+					METRICX_QBUF_PRINTF(qbuf, "%s_bucket{%s%sle=\"%" PRIu64 "\"} %" PRIu64 "\n", metricx_req->name, labels, comma, metricx_bucket_upper(idx), seen);
+				}
+			}
+			METRICX_QBUF_PRINTF(qbuf, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n", metricx_req->name, labels, comma, seen);
+			METRICX_QBUF_PRINTF(qbuf, "%s_sum%s %" PRIu64 "\n", metricx_req->name, braces, metricx_histogram_sum(metricx_req));
+			METRICX_QBUF_PRINTF(qbuf, "%s_count%s %" PRIu64 "\n", metricx_req->name, braces, seen);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+size_t metricx_prometheus(QBUF_t *qbuf)
+{
+	if (qbuf == NULL)
+	{
+		return 0;
+	}
+
+	SAFE_THREAD_LOCK(&metricx_mtx);
+	MetricX_t *cursor = NULL;
+	for (cursor = clist_head(metricx_list); cursor != NULL; cursor = clist_item_next(cursor))
+	{
+		// one group per name, the first one of the name writes the whole group
+		MetricX_t *prev = NULL;
+		for (prev = clist_head(metricx_list); (prev != cursor) && (SAFE_STRCMP(prev->name, cursor->name) != 0); prev = clist_item_next(prev))
+		{
+		}
+		if (prev != cursor)
+		{
+			continue;
+		}
+
+		METRICX_QBUF_PRINTF(qbuf, "# HELP %s %s\n", cursor->name, cursor->help);
+		METRICX_QBUF_PRINTF(qbuf, "# TYPE %s %s\n", cursor->name, metricx_type_name[cursor->type]);
+
+		MetricX_t *member = NULL;
+		for (member = cursor; member != NULL; member = clist_item_next(member))
+		{
+			if (SAFE_STRCMP(member->name, cursor->name) == 0)
+			{
+				metricx_prometheus_one(qbuf, member);
+			}
+		}
+	}
+	SAFE_THREAD_UNLOCK(&metricx_mtx);
+
+	return qbuf_total(qbuf);
+}
+
+#ifdef UTIL_EX_JSON
+json_t *metricx_json(void)
+{
+	json_t *jary = JSON_ARY_NEW();
+
+	SAFE_THREAD_LOCK(&metricx_mtx);
+	MetricX_t *cursor = NULL;
+	for (cursor = clist_head(metricx_list); (jary) && (cursor != NULL); cursor = clist_item_next(cursor))
+	{
+		json_t *jobj = JSON_OBJ_NEW();
+		if (jobj == NULL)
+		{
+			break;
+		}
+
+		JSON_OBJ_SET_STR(jobj, "name", cursor->name);
+		JSON_OBJ_SET_STR(jobj, "type", metricx_type_name[cursor->type]);
+		JSON_OBJ_SET_STR(jobj, "labels", cursor->labels);
+		switch (cursor->type)
+		{
+			case METRICX_TYPE_ID_COUNTER:
+				JSON_OBJ_SET_INT(jobj, "value", metricx_counter_get(cursor));
+				break;
+			case METRICX_TYPE_ID_GAUGE:
+				JSON_OBJ_SET_INT(jobj, "value", metricx_gauge_get(cursor));
+				break;
+			case METRICX_TYPE_ID_HISTOGRAM:
+				JSON_OBJ_SET_INT(jobj, "count", metricx_histogram_count(cursor));
+				JSON_OBJ_SET_INT(jobj, "sum", metricx_histogram_sum(cursor));
+				JSON_OBJ_SET_INT(jobj, "p50", metricx_histogram_quantile(cursor, 0.5));
+				JSON_OBJ_SET_INT(jobj, "p99", metricx_histogram_quantile(cursor, 0.99));
+				JSON_OBJ_SET_INT(jobj, "p999", metricx_histogram_quantile(cursor, 0.999));
+				break;
+			default:
+				break;
+		}
+		JSON_ARY_APPEND_OBJ(jary, jobj);
+	}
+	SAFE_THREAD_UNLOCK(&metricx_mtx);
+
+	return jary;
+}
+#endif
+
+//** server **
+typedef struct MetricXServer_Struct
+{
+	ThreadX_t tidx;
+
+	char addr[LEN_OF_FULLNAME];
+	int sockfd;
+} MetricXServer_t;
+
+static MetricXServer_t *metricx_server = NULL;
+
+static void metricx_server_reply(int fd)
+{
+	char request[LEN_OF_BUF1024] = "";
+	int isjson = 0;
+
+	// curl sends "GET /metrics HTTP/1.1", nc -U sends nothing
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	if (poll(&pfd, 1, METRICX_SERVER_READ_MS) > 0)
+	{
+		int len = read(fd, request, sizeof(request) - 1);
+		if (len > 0)
+		{
+			request[len] = '\0';
+			isjson = (strstr(request, "/metrics.json") != NULL);
+		}
+	}
+
+	char *ctype = "text/plain; version=0.0.4";
+	char *body = NULL;
+	size_t body_len = 0;
+	QBUF_t qbuf;
+	qbuf_init(&qbuf, MAX_OF_QBUF_4MB);
+
+#ifdef UTIL_EX_JSON
+	char *jbuff = NULL;
+	if (isjson)
+	{
+		json_t *jary = metricx_json();
+		jbuff = json_dumps(jary, JSON_INDENT(0));
+		JSON_FREE(jary);
+		ctype = "application/json";
+		body = jbuff;
+		body_len = (jbuff) ? strlen(jbuff) : 0;
+	}
+	else
+#endif
+	{
+		(void)isjson;
+		metricx_prometheus(&qbuf);
+		body = qbuf_buff(&qbuf);
+		body_len = qbuf_total(&qbuf);
+	}
+
+	char header[LEN_OF_BUF512] = "";
+	int header_len = SAFE_SPRINTF_EX(header, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", ctype, body_len);
+	if (write(fd, header, header_len) == header_len)
+	{
+		size_t pos = 0;
+		while (pos < body_len)
+		{
+			ssize_t wlen = write(fd, body + pos, body_len - pos);
+			if (wlen <= 0)
+			{
+				break;
+			}
+			pos += wlen;
+		}
+	}
+
+#ifdef UTIL_EX_JSON
+	SAFE_FREE(jbuff);
+#endif
+	qbuf_free(&qbuf);
+}
+
+static void *metricx_server_handler(void *user)
+{
+	MetricXServer_t *server_req = (MetricXServer_t *)user;
+
+	if (server_req)
+	{
+		ThreadX_t *tidx_req = &server_req->tidx;
+		threadx_detach(tidx_req);
+
+		while (threadx_isquit(tidx_req) == 0)
+		{
+			struct pollfd pfd = { .fd = server_req->sockfd, .events = POLLIN };
+			if (poll(&pfd, 1, METRICX_SERVER_POLL_MS) <= 0)
+			{
+				continue;
+			}
+
+			int fd = accept(server_req->sockfd, NULL, NULL);
+			if (fd >= 0)
+			{
+				metricx_server_reply(fd);
+				SAFE_CLOSE(fd);
+			}
+		}
+
+		threadx_leave(tidx_req);
+	}
+
+	return NULL;
+}
+
+static int metricx_server_listen(char *addr)
+{
+	int sockfd = -1;
+	int ret = -1;
+
+	if ((addr[0] == '/') || (addr[0] == '@'))
+	{
+		struct sockaddr_un addr_un;
+		SAFE_MEMSET(&addr_un, 0, sizeof(addr_un));
+		addr_un.sun_family = AF_UNIX;
+		SAFE_SPRINTF_EX(addr_un.sun_path, "%s", addr);
+
+		socklen_t addr_len = sizeof(addr_un);
+		if (addr[0] == '@')
+		{
+			// abstract namespace, no file
+			addr_un.sun_path[0] = '\0';
+			addr_len = offsetof(struct sockaddr_un, sun_path) + strlen(addr);
+		}
+		else
+		{
+			unlink(addr);
+		}
+
+		if ((sockfd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0)) >= 0)
+		{
+			ret = bind(sockfd, (struct sockaddr *)&addr_un, addr_len);
+		}
+	}
+	else
+	{
+		struct sockaddr_in addr_in;
+		SAFE_MEMSET(&addr_in, 0, sizeof(addr_in));
+		addr_in.sin_family = AF_INET;
+		addr_in.sin_port = htons(atoi(addr));
+		addr_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if ((sockfd = socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0)) >= 0)
+		{
+			int reuse = 1;
+			setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			ret = bind(sockfd, (struct sockaddr *)&addr_in, sizeof(addr_in));
+		}
+	}
+
+	if ((sockfd >= 0) && (ret == 0) && (listen(sockfd, 8) == 0))
+	{
+		return sockfd;
+	}
+
+	DBG_ER_LN("bind/listen error !!! (addr: %s, errno: %d %s)", addr, errno, strerror(errno));
+	SAFE_CLOSE(sockfd);
+	return -1;
+}
+
+void metricx_server_close(void)
+{
+	MetricXServer_t *server_req = metricx_server;
+	metricx_server = NULL;
+
+	if (server_req)
+	{
+		ThreadX_t *tidx_req = &server_req->tidx;
+		threadx_close(tidx_req);
+
+		SAFE_CLOSE(server_req->sockfd);
+		if (server_req->addr[0] == '/')
+		{
+			unlink(server_req->addr);
+		}
+		SAFE_FREE(server_req);
+	}
+}
+
+int metricx_server_open(char *addr)
+{
+	if ((addr == NULL) || (addr[0] == '\0') || (metricx_server))
+	{
+		return -1;
+	}
+
+	int sockfd = metricx_server_listen(addr);
+	if (sockfd < 0)
+	{
+		return -1;
+	}
+
+	MetricXServer_t *server_req = (MetricXServer_t *)SAFE_CALLOC(1, sizeof(MetricXServer_t));
+	if (server_req == NULL)
+	{
+		SAFE_CLOSE(sockfd);
+		return -1;
+	}
+
+	SAFE_SPRINTF_EX(server_req->addr, "%s", addr);
+	server_req->sockfd = sockfd;
+	metricx_server = server_req;
+
+	ThreadX_t *tidx_req = &server_req->tidx;
+	tidx_req->thread_cb = metricx_server_handler;
+	tidx_req->data = server_req;
+	if (threadx_init(tidx_req, "metricx") != 0)
+	{
+		metricx_server = NULL;
+		SAFE_CLOSE(server_req->sockfd);
+		SAFE_FREE(server_req);
+		return -1;
+	}
+
+	DBG_IF_LN("(addr: %s)", addr);
+	return 0;
+}
+#endif
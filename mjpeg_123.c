@@ -0,0 +1,457 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <signal.h>
+#include <getopt.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "utilx9.h"
+
+#define TAG "mjpeg_123"
+
+// a loopback server for the mjpeg parser of curl_api.c (HTTP_MODE_ID_DOWNLOAFILE_MJPEG)
+//  /multi : multipart/x-mixed-replace, every write is cut inside "\r\n--boundary" at a different offset,
+//           the parts go with and without Content-Length, the frames carry pieces of the boundary
+//  /single: image/jpeg, the same HttpX_t as /multi, the parser has to start over
+// every frame is compared with the one which was sent
+
+#define MJPEG_BOUNDARY "utilx9boundary"
+#define MJPEG_DELIM "\r\n--" MJPEG_BOUNDARY
+
+#define MAX_OF_MJPEG_FRAME 32
+#define TIMEOUT_OF_MJPEG_WRITE 2 // ms, between two writes, curl gets them one by one
+
+typedef struct MJpegFrame_Struct
+{
+	char *data;
+	size_t len;
+} MJpegFrame_t;
+
+static int is_quit = 0;
+static int frame_count = 16;
+
+static int srv_fd = -1;
+static int srv_port = 0;
+static pthread_t srv_tid;
+
+static MJpegFrame_t frame_ary[MAX_OF_MJPEG_FRAME];
+
+static int frame_recv = 0;
+static int frame_error = 0;
+
+static void mjpeg_frame_init(void)
+{
+	int idx = 0;
+	for (idx = 0; idx < frame_count; idx++)
+	{
+		MJpegFrame_t *frame = &frame_ary[idx];
+		size_t len = 64 + idx * 97; // < LEN_OF_BUF4096 - delim
+		frame->data = (char *)SAFE_CALLOC(1, len);
+		if (frame->data == NULL)
+		{
+			continue;
+		}
+
+		size_t pos = 0;
+		frame->data[pos++] = (char)0xFF;
+		frame->data[pos++] = (char)0xD8;
+		while (pos < len - 2)
+		{
+			// a piece of the delimiter, not the whole one
+			static char piece[] = MJPEG_DELIM;
+			size_t n = SAFE_MIN(len - 2 - pos, (size_t)(idx % (sizeof(piece) - 2)) + 1);
+			SAFE_MEMCPY(frame->data + pos, piece, n, len - pos);
+			pos += n;
+			if (pos < len - 2)
+			{
+				frame->data[pos] = (char)('a' + (pos % 26));
+				pos++;
+			}
+		}
+		frame->data[pos++] = (char)0xFF;
+		frame->data[pos++] = (char)0xD9;
+		frame->len = len;
+	}
+}
+
+static void mjpeg_frame_free(void)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_MJPEG_FRAME; idx++)
+	{
+		SAFE_FREE(frame_ary[idx].data);
+		frame_ary[idx].len = 0;
+	}
+}
+
+static void mjpeg_write(int fd, char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = SAFE_WRITE(fd, data, len);
+		if (n <= 0)
+		{
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+	usleep(TIMEOUT_OF_MJPEG_WRITE*1000);
+}
+
+static void mjpeg_send_multi(int fd)
+{
+	char hdr[LEN_OF_BUF1024] = "";
+	int hdr_len = SAFE_SNPRINTF(hdr, (int)sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=%s\r\nConnection: close\r\n\r\n", MJPEG_BOUNDARY);
+	mjpeg_write(fd, hdr, hdr_len);
+
+	int delim_len = strlen(MJPEG_DELIM);
+	char *tail = NULL; // the delimiter which is not sent yet
+	int tail_len = 0;
+	int idx = 0;
+	for (idx = 0; idx < frame_count; idx++)
+	{
+		MJpegFrame_t *frame = &frame_ary[idx];
+		int iscontent_length = (idx % 2);
+
+		// "--boundary", the leading "\r\n" of the 1st one is optional
+		hdr_len = SAFE_SNPRINTF(hdr, (int)sizeof(hdr), "%s--%s\r\nContent-Type: image/jpeg\r\n", (idx == 0) ? "" : "\r\n", MJPEG_BOUNDARY);
+		if (iscontent_length)
+		{
+			hdr_len += SAFE_SNPRINTF(hdr + hdr_len, (int)sizeof(hdr) - hdr_len, "Content-Length: %zd\r\n", frame->len);
+		}
+		hdr_len += SAFE_SNPRINTF(hdr + hdr_len, (int)sizeof(hdr) - hdr_len, "\r\n");
+
+		if (tail)
+		{
+			// the rest of the delimiter goes with the part headers
+			mjpeg_write(fd, tail, tail_len);
+			tail = NULL;
+			mjpeg_write(fd, hdr + 2, hdr_len - 2);
+		}
+		else
+		{
+			mjpeg_write(fd, hdr, hdr_len);
+		}
+
+		// cut the frame in two, then the delimiter behind it at 1 .. delim_len-1
+		size_t half = frame->len / 2;
+		mjpeg_write(fd, frame->data, half);
+
+		int cut = 1 + (idx % (delim_len - 1));
+		char buff[LEN_OF_BUF4096];
+		size_t len = frame->len - half;
+		SAFE_MEMCPY(buff, frame->data + half, len, sizeof(buff));
+		SAFE_MEMCPY(buff + len, MJPEG_DELIM, cut, sizeof(buff) - len);
+		mjpeg_write(fd, buff, len + cut);
+
+		static char delim[] = MJPEG_DELIM;
+		tail = delim + cut;
+		tail_len = delim_len - cut;
+	}
+
+	// the close delimiter
+	if (tail)
+	{
+		mjpeg_write(fd, tail, tail_len);
+	}
+	mjpeg_write(fd, "--\r\n", 4);
+}
+
+static void mjpeg_send_single(int fd)
+{
+	char hdr[LEN_OF_BUF1024] = "";
+	MJpegFrame_t *frame = &frame_ary[0];
+	int hdr_len = SAFE_SNPRINTF(hdr, (int)sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %zd\r\nConnection: close\r\n\r\n", frame->len);
+	mjpeg_write(fd, hdr, hdr_len);
+	mjpeg_write(fd, frame->data, frame->len);
+}
+
+static void *mjpeg_srv_handler(void *user)
+{
+	while (is_quit == 0)
+	{
+		int fd = accept(srv_fd, NULL, NULL);
+		if (fd < 0)
+		{
+			break;
+		}
+
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		char req[LEN_OF_BUF1024] = "";
+		int req_len = 0;
+		while ((req_len < (int)sizeof(req) - 1) && (SAFE_STRSTR(req, "\r\n\r\n") == NULL))
+		{
+			ssize_t n = SAFE_READ(fd, req + req_len, sizeof(req) - 1 - req_len);
+			if (n <= 0)
+			{
+				break;
+			}
+			req_len += n;
+		}
+
+		if (SAFE_STRNCMP(req, "GET /multi", strlen("GET /multi")) == 0)
+		{
+			mjpeg_send_multi(fd);
+		}
+		else
+		{
+			mjpeg_send_single(fd);
+		}
+		SAFE_CLOSE(fd);
+	}
+	return NULL;
+}
+
+static int mjpeg_srv_open(void)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	srv_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (srv_fd < 0)
+	{
+		return -1;
+	}
+
+	SAFE_MEMSET(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if ((bind(srv_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		|| (listen(srv_fd, 4) != 0)
+		|| (getsockname(srv_fd, (struct sockaddr *)&addr, &addr_len) != 0))
+	{
+		DBG_ER_LN("bind error !!! (errno: %d %s)", errno, strerror(errno));
+		SAFE_CLOSE(srv_fd);
+		return -1;
+	}
+	srv_port = ntohs(addr.sin_port);
+
+	return pthread_create(&srv_tid, NULL, mjpeg_srv_handler, NULL);
+}
+
+static void mjpeg_srv_close(void)
+{
+	if (srv_fd >= 0)
+	{
+		shutdown(srv_fd, SHUT_RDWR);
+		pthread_join(srv_tid, NULL);
+		SAFE_CLOSE(srv_fd);
+	}
+}
+
+static int mjpeg_frame_cb(HttpX_t *http_req, MJPEGFrame_t *frame, void *userdata)
+{
+	char *name = (char *)userdata;
+	MJpegFrame_t *expect = &frame_ary[frame_recv % frame_count];
+
+	if ((frame->len != expect->len) || (SAFE_MEMCMP(frame->data, expect->data, expect->len) != 0))
+	{
+		DBG_ER_LN("(%s, num: %d, len: %zd, expect: %zd, iscopy: %d) mismatch !!!", name, frame->num, frame->len, expect->len, frame->iscopy);
+		frame_error ++;
+	}
+	else
+	{
+		DBG_DB_LN("(%s, num: %d, len: %zd, iscopy: %d, ftype: %s)", name, frame->num, frame->len, frame->iscopy, frame->ftype);
+	}
+	frame_recv ++;
+
+	return (is_quit) ? -1 : 0;
+}
+
+static int mjpeg_run(HttpX_t *http_req, char *path, int expect)
+{
+	frame_recv = 0;
+	frame_error = 0;
+	SAFE_SPRINTF_EX(http_req->url, "http://127.0.0.1:%d%s", srv_port, path);
+	http_req->mjpeg_req.frame_data = path;
+
+	http_request(http_req);
+
+	int ret = ((frame_recv == expect) && (frame_error == 0)) ? 0 : -1;
+	DBG_WN_LN("(%s, frames: %d/%d, error: %d) %s", path, frame_recv, expect, frame_error, (ret == 0) ? "ok" : "failed !!!");
+	return ret;
+}
+
+static int app_quit(void)
+{
+	return is_quit;
+}
+
+static void app_set_quit(int mode)
+{
+	is_quit = mode;
+}
+
+static void app_stop(void)
+{
+	if (app_quit()==0)
+	{
+		app_set_quit(1);
+	}
+}
+
+static int app_loop(void)
+{
+	int ret = -1;
+
+	mjpeg_frame_init();
+	if (mjpeg_srv_open() != 0)
+	{
+		goto exit_loop;
+	}
+
+	HttpX_t http_req =
+	{
+		.mode = HTTP_MODE_ID_DOWNLOAFILE_MJPEG,
+		.url = "",
+		.log = "",
+
+		.mjpeg_req.frame_cb = mjpeg_frame_cb,
+		.mjpeg_req.pool_size = 2,
+	};
+
+	ret = mjpeg_run(&http_req, "/multi", frame_count);
+	// the same http_req, the boundary of /multi is gone
+	ret |= mjpeg_run(&http_req, "/single", 1);
+
+exit_loop:
+	app_stop();
+	mjpeg_srv_close();
+	mjpeg_frame_free();
+
+	return ret;
+}
+
+static int app_init(void)
+{
+	int ret = 0;
+
+	return ret;
+}
+
+static void app_exit(void)
+{
+	app_stop();
+}
+
+static void app_signal_handler(int signum)
+{
+	DBG_ER_LN("(signum: %d)", signum);
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			app_stop();
+			break;
+		case SIGPIPE:
+			break;
+
+		case SIGUSR1:
+			break;
+
+		case SIGUSR2:
+			dbg_lvl_round();
+			DBG_ER_LN("dbg_lvl_get(): %d", dbg_lvl_get());
+			DBG_ER_LN("(Version: %s)", version_show());
+			break;
+	}
+}
+
+static void app_signal_register(void)
+{
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGUSR1, app_signal_handler);
+	signal(SIGUSR2, app_signal_handler);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int option_index = 0;
+const char* short_options = "d:n:h";
+static struct option long_options[] =
+{
+	{ "debug",       required_argument,   NULL,    'd'  },
+	{ "count",       required_argument,   NULL,    'n'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s\n"
+		"  -d, --debug       debug level\n"
+		"  -n, --count       count of the frames of /multi (1 .. %d)\n"
+		"  -h, --help\n", TAG, MAX_OF_MJPEG_FRAME);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -n 32\n", TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				if (optarg)
+				{
+					dbg_lvl_set(atoi(optarg));
+				}
+				break;
+			case 'n':
+				if (optarg)
+				{
+					frame_count = atoi(optarg);
+				}
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+
+	if ((frame_count <= 0) || (frame_count > MAX_OF_MJPEG_FRAME))
+	{
+		app_showusage(-1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	app_ParseArguments(argc, argv);
+	app_signal_register();
+	atexit(app_exit);
+
+	if (app_init() == -1)
+	{
+		return -1;
+	}
+
+	int ret = app_loop();
+
+	DBG_WN_LN(DBG_TXT_BYE_BYE);
+	return (ret == 0) ? 0 : 1;
+}
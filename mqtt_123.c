@@ -322,10 +322,11 @@ static void app_signal_register(void)
 }
 
 int option_index = 0;
-const char* short_options = "d:f:p:i:u:w:c:h";
+const char* short_options = "d:m:f:p:i:u:w:c:h";
 static struct option long_options[] =
 {
 	{ "debug",       required_argument,   NULL,    'd'  },
+	{ "module",      required_argument,   NULL,    'm'  },
 	{ "host",        required_argument,   NULL,    'f'  },
 	{ "port",        required_argument,   NULL,    'p'  },
 	{ "iface",       required_argument,   NULL,    'i'  },
@@ -343,6 +344,7 @@ static void app_showusage(int exit_code)
 {
 	printf("Usage: %s\n"
 		"  -d, --debug       debug level\n"
+		"  -m, --module      debug level of the modules\n"
 		"  -f, --host        hostname\n"
 		"  -p, --port        port\n"
 		"  -i, --iface       iface\n"
@@ -352,7 +354,8 @@ static void app_showusage(int exit_code)
 		"  -h, --help\n", TAG);
 	printf("Version: %s\n", version_show());
 	printf("Example:\n"
-		"  %s -d 2 -f 192.168.50.9 -p 1883\n", TAG);
+		"  %s -d 2 -f 192.168.50.9 -p 1883\n"
+		"  %s -d 1 -m mqtt:4 -f 192.168.50.9 -p 1883\n", TAG, TAG);
 	exit(exit_code);
 }
 
@@ -394,6 +397,12 @@ static void app_ParseArguments(int argc, char **argv)
 					dbg_lvl_set(atoi(optarg));
 				}
 				break;
+			case 'm':
+				if (optarg)
+				{
+					dbg_mod_parse(optarg);
+				}
+				break;
 			case 'u':
 #ifdef USE_MQTT_DEMO
 				if (optarg)
@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_MQTT
 #include "utilx9.h"
 
 int mqtt_session_isconnect(MQTTX_t *mqtt_req)
@@ -47,6 +48,221 @@ void mqtt_log_cb(struct mosquitto *mosq, void *userdata, int level, const char *
 	}
 }
 
+static unsigned long long mqtt_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int mqtt_ack_bucket(unsigned long long latency)
+{
+	int idx = 0;
+	if (latency > 0)
+	{
+		idx = 64 - __builtin_clzll(latency);
+	}
+	if (idx >= MQTT_ACK_HIST_BUCKETS)
+	{
+		idx = MQTT_ACK_HIST_BUCKETS - 1;
+	}
+	return idx;
+}
+
+// pub_stat and metric, the caller has to lock qpub
+static void mqtt_stat_pub(MQTTSession_t *session)
+{
+	session->pub_stat.pub_count++;
+#ifdef UTIL_EX_METRICX
+	metricx_counter_add(session->metric.pubs, 1);
+#endif
+}
+
+static void mqtt_stat_ack(MQTTSession_t *session, unsigned long long latency)
+{
+	session->pub_stat.ack_hist[mqtt_ack_bucket(latency)]++;
+	session->pub_stat.ack_count++;
+#ifdef UTIL_EX_METRICX
+	metricx_counter_add(session->metric.acks, 1);
+	metricx_histogram_add(session->metric.ack_us, latency);
+#endif
+}
+
+static void mqtt_stat_retry(MQTTSession_t *session)
+{
+	session->pub_stat.retry_count++;
+#ifdef UTIL_EX_METRICX
+	metricx_counter_add(session->metric.retries, 1);
+#endif
+}
+
+static void mqtt_stat_drop(MQTTSession_t *session)
+{
+	session->pub_stat.drops++;
+#ifdef UTIL_EX_METRICX
+	metricx_counter_add(session->metric.drops, 1);
+#endif
+}
+
+static void mqtt_stat_inflight(MQTTSession_t *session, int val)
+{
+	session->pub_stat.inflight += val;
+#ifdef UTIL_EX_METRICX
+	metricx_gauge_set(session->metric.inflight, session->pub_stat.inflight);
+#endif
+}
+
+// the caller has to lock qpub
+static void mqtt_inflight_release(MQTTSession_t *session, MQTTInflight_t *inflight)
+{
+	mqtt_msg_unref(inflight->mqtt_msg);
+	SAFE_MEMSET(inflight, 0, sizeof(MQTTInflight_t));
+	mqtt_stat_inflight(session, -1);
+}
+
+// the caller has to lock qpub
+static void mqtt_inflight_ack(MQTTSession_t *session, MQTTInflight_t *inflight)
+{
+	mqtt_stat_ack(session, mqtt_now_us() - inflight->t_send);
+	mqtt_inflight_release(session, inflight);
+
+	// mqtt_inflight_add might wait for a free slot
+	queuex_signal(session->qpub);
+}
+
+// the caller has to lock qpub
+static void mqtt_early_add(MQTTSession_t *session, int mid)
+{
+	session->early_ack[session->early_idx].mid = mid;
+	session->early_ack[session->early_idx].send_seq = session->send_seq;
+	session->early_idx = (session->early_idx + 1) % MAX_OF_EARLY_ACK;
+}
+
+// the caller has to lock qpub
+// only an ack recorded after inflight was handed to mosquitto_publish can be its ack,
+// the older ones (QoS0, the ones outside the window, an earlier wrap of mid) are stale
+static int mqtt_early_take(MQTTSession_t *session, MQTTInflight_t *inflight, int mid)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_EARLY_ACK; idx++)
+	{
+		MQTTEarlyAck_t *early = &session->early_ack[idx];
+		if ((early->mid == mid) && (early->send_seq >= inflight->send_seq))
+		{
+			early->mid = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// the connection is gone, mqtt_inflight_retry publishes it again after reconnect
+static int mqtt_publish_istransient(int rc)
+{
+	switch (rc)
+	{
+		case MOSQ_ERR_NO_CONN:
+		case MOSQ_ERR_CONN_LOST:
+		case MOSQ_ERR_ERRNO:
+			return 1;
+		default:
+			break;
+	}
+	return 0;
+}
+
+// the caller has to lock qpub, the lock is released while mosquitto_publish runs
+static int mqtt_inflight_publish(MQTTSession_t *session, MQTTInflight_t *inflight)
+{
+	MQTTMsg_t *mqtt_msg = inflight->mqtt_msg;
+	int mid = 0;
+
+	inflight->issending = 1;
+	inflight->send_seq = ++session->send_seq;
+	inflight->t_send = mqtt_now_us();
+	queuex_unlock(session->qpub);
+
+	int rc = mosquitto_publish(session->mosq, &mid, mqtt_msg->topic, mqtt_msg->payloadlen, mqtt_msg->payload, mqtt_msg->qos, mqtt_msg->retain);
+
+	queuex_lock(session->qpub);
+	inflight->issending = 0;
+	if (rc == MOSQ_ERR_SUCCESS)
+	{
+		mqtt_stat_pub(session);
+		if (mqtt_early_take(session, inflight, mid))
+		{
+			mqtt_inflight_ack(session, inflight);
+		}
+		else
+		{
+			inflight->mid = mid;
+		}
+	}
+	else if (mqtt_publish_istransient(rc))
+	{
+		inflight->mid = 0;
+	}
+	else
+	{
+		DBG_ER_LN("mosquitto_publish error !!! (topic: %s, payloadlen: %d, rc: %d)", mqtt_msg->topic, mqtt_msg->payloadlen, rc);
+		mqtt_stat_drop(session);
+		mqtt_inflight_release(session, inflight);
+		queuex_signal(session->qpub);
+	}
+	return rc;
+}
+
+// QoS0: sent, QoS1: PUBACK, QoS2: PUBCOMP
+static void mqtt_publish_cb(struct mosquitto *mosq, void *userdata, int mid)
+{
+	if ((mosq) && (userdata) && (mid > 0))
+	{
+		MQTTSession_t *session = (MQTTSession_t *)userdata;
+
+		queuex_lock(session->qpub);
+		int issending = 0;
+		int idx = 0;
+		for (idx = 0; (session->inflight_ary) && (idx < session->pub_stat.max_inflight); idx++)
+		{
+			MQTTInflight_t *inflight = &session->inflight_ary[idx];
+			if ((inflight->mqtt_msg) && (inflight->mid == mid))
+			{
+				mqtt_inflight_ack(session, inflight);
+				issending = 0;
+				break;
+			}
+			else if (inflight->issending)
+			{
+				issending = 1;
+			}
+		}
+
+		if (issending)
+		{
+			// mosquitto_publish hasn't returned the mid yet, mqtt_inflight_publish will pick it up
+			mqtt_early_add(session, mid);
+		}
+		queuex_unlock(session->qpub);
+	}
+}
+
+// mosquitto resends what it has accepted (the same mid), here only the rejected ones are published again
+static void mqtt_inflight_retry(MQTTSession_t *session)
+{
+	queuex_lock(session->qpub);
+	int idx = 0;
+	for (idx = 0; (session->inflight_ary) && (idx < session->pub_stat.max_inflight); idx++)
+	{
+		MQTTInflight_t *inflight = &session->inflight_ary[idx];
+		if ((inflight->mqtt_msg) && (inflight->mid == 0) && (inflight->issending == 0))
+		{
+			mqtt_stat_retry(session);
+			mqtt_inflight_publish(session, inflight);
+		}
+	}
+	queuex_unlock(session->qpub);
+}
+
 static void mqtt_connect_cb(struct mosquitto *mosq, void *userdata, int result)
 {
 	if ((mosq) && (userdata))
@@ -63,6 +279,7 @@ static void mqtt_connect_cb(struct mosquitto *mosq, void *userdata, int result)
 			session->connect_cb(mosq, userdata, result);
 		}
 
+		mqtt_inflight_retry(session);
 		mqtt_queue_wakeup(session);
 	}
 }
@@ -84,6 +301,203 @@ static void mqtt_disconnect_cb(struct mosquitto *mosq, void *userdata, int resul
 	}
 }
 
+static unsigned int mqtt_trie_hash(char *level, int len)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261U;
+	int i = 0;
+	for (i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)level[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static MQTTTrie_t *mqtt_trie_new(char *level, int len)
+{
+	MQTTTrie_t *node = (MQTTTrie_t*)SAFE_CALLOC(1, sizeof(MQTTTrie_t));
+	if (node)
+	{
+		node->level = (char*)SAFE_CALLOC(1, len+1);
+		SAFE_MEMCPY(node->level, level, len, len+1);
+		node->level_len = len;
+		node->hash = mqtt_trie_hash(level, len);
+	}
+	return node;
+}
+
+static void mqtt_trie_free(MQTTTrie_t *node)
+{
+	if (node)
+	{
+		int i = 0;
+		for (i = 0; i < node->child_size; i++)
+		{
+			MQTTTrie_t *child = node->child_ary[i];
+			while (child)
+			{
+				MQTTTrie_t *sibling = child->sibling;
+				mqtt_trie_free(child);
+				child = sibling;
+			}
+		}
+		SAFE_FREE(node->child_ary);
+		mqtt_trie_free(node->plus);
+		mqtt_trie_free(node->sharp);
+		SAFE_FREE(node->level);
+		SAFE_FREE(node);
+	}
+}
+
+static MQTTTrie_t *mqtt_trie_find(MQTTTrie_t *node, char *level, int len, unsigned int hash)
+{
+	if (node->child_size > 0)
+	{
+		MQTTTrie_t *child = node->child_ary[hash % node->child_size];
+		for (; child != NULL; child = child->sibling)
+		{
+			if ((child->hash == hash) && (child->level_len == len) && ((len == 0) || (SAFE_MEMCMP(child->level, level, len) == 0)))
+			{
+				return child;
+			}
+		}
+	}
+	return NULL;
+}
+
+static void mqtt_trie_rehash(MQTTTrie_t *node, int child_size)
+{
+	MQTTTrie_t **child_ary = (MQTTTrie_t**)SAFE_CALLOC(child_size, sizeof(MQTTTrie_t*));
+	if (child_ary)
+	{
+		int i = 0;
+		for (i = 0; i < node->child_size; i++)
+		{
+			MQTTTrie_t *child = node->child_ary[i];
+			while (child)
+			{
+				MQTTTrie_t *sibling = child->sibling;
+				child->sibling = child_ary[child->hash % child_size];
+				child_ary[child->hash % child_size] = child;
+				child = sibling;
+			}
+		}
+		SAFE_FREE(node->child_ary);
+		node->child_ary = child_ary;
+		node->child_size = child_size;
+	}
+}
+
+static MQTTTrie_t *mqtt_trie_child(MQTTTrie_t *node, char *level, int len)
+{
+	MQTTTrie_t *child = NULL;
+
+	if ((len == 1) && (level[0] == '+'))
+	{
+		if (node->plus == NULL)
+		{
+			node->plus = mqtt_trie_new(level, len);
+		}
+		child = node->plus;
+	}
+	else if ((len == 1) && (level[0] == '#'))
+	{
+		if (node->sharp == NULL)
+		{
+			node->sharp = mqtt_trie_new(level, len);
+		}
+		child = node->sharp;
+	}
+	else
+	{
+		unsigned int hash = mqtt_trie_hash(level, len);
+		child = mqtt_trie_find(node, level, len, hash);
+		if (child == NULL)
+		{
+			if (node->child_count >= node->child_size * 2)
+			{
+				mqtt_trie_rehash(node, (node->child_size > 0) ? (node->child_size * 2) : MQTT_TRIE_HASH_SIZE);
+			}
+			child = mqtt_trie_new(level, len);
+			if ((child) && (node->child_size > 0))
+			{
+				child->sibling = node->child_ary[hash % node->child_size];
+				node->child_ary[hash % node->child_size] = child;
+				node->child_count ++;
+			}
+		}
+	}
+
+	return child;
+}
+
+// the node of the subscription, create it if not found
+static MQTTTrie_t *mqtt_trie_insert(MQTTTrie_t *root, char *topic)
+{
+	MQTTTrie_t *node = root;
+	char *level = topic;
+
+	while ((node) && (level))
+	{
+		char *slash = SAFE_STRCHR(level, '/');
+		int len = (slash) ? (slash - level) : SAFE_STRLEN(level);
+
+		node = mqtt_trie_child(node, level, len);
+		level = (slash) ? (slash + 1) : NULL;
+	}
+	return node;
+}
+
+static void mqtt_trie_deliver(MQTTTrie_t *node, struct mosquitto *mosq, void *userdata, const struct mosquitto_message *message)
+{
+	MQTTSub_t *cur = NULL;
+	for (cur = node->sub_head; cur != NULL; cur = cur->trie_next)
+	{
+		DBG_DB_LN("(cur->topic: %s ?= %s)", cur->topic, message->topic);
+		if (cur->message_cb)
+		{
+			cur->message_cb(mosq, userdata, message);
+		}
+	}
+}
+
+// level: the rest of the topic, NULL: no more level
+// the topics beginning with '$' don't match the wildcards at the first level
+static void mqtt_trie_match(MQTTTrie_t *node, char *level, int isfirst, struct mosquitto *mosq, void *userdata, const struct mosquitto_message *message)
+{
+	if (level == NULL)
+	{
+		mqtt_trie_deliver(node, mosq, userdata, message);
+		if (node->sharp)
+		{
+			// "a/#" also matches "a"
+			mqtt_trie_deliver(node->sharp, mosq, userdata, message);
+		}
+		return;
+	}
+
+	char *slash = SAFE_STRCHR(level, '/');
+	int len = (slash) ? (slash - level) : SAFE_STRLEN(level);
+	char *rest = (slash) ? (slash + 1) : NULL;
+	int iswild = ((isfirst == 0) || (level[0] != '$'));
+
+	if ((iswild) && (node->sharp))
+	{
+		mqtt_trie_deliver(node->sharp, mosq, userdata, message);
+	}
+	if ((iswild) && (node->plus))
+	{
+		mqtt_trie_match(node->plus, rest, 0, mosq, userdata, message);
+	}
+
+	MQTTTrie_t *child = mqtt_trie_find(node, level, len, mqtt_trie_hash(level, len));
+	if (child)
+	{
+		mqtt_trie_match(child, rest, 0, mosq, userdata, message);
+	}
+}
+
 static void mqtt_message_cb(struct mosquitto *mosq, void *userdata, const struct mosquitto_message *message)
 {
 	if ((mosq) && (userdata))
@@ -91,24 +505,70 @@ static void mqtt_message_cb(struct mosquitto *mosq, void *userdata, const struct
 		MQTTSession_t *session = (MQTTSession_t *)userdata;
 
 		DBG_TR_LN("(%s:%d, topic: %s, [%d]%s)", session->hostname, session->port, message->topic, message->payloadlen, (char*) message->payload);
+#ifdef UTIL_EX_METRICX
+		metricx_counter_add(session->metric.recvs, 1);
+#endif
 		if (session->root_subscribe_cb)
 		{
 			session->root_subscribe_cb(mosq, userdata, message);
 		}
 
-		MQTTSub_t *cur = NULL;
-		for (cur = clist_head(session->sub_list); cur != NULL; cur = clist_item_next(cur))
+		mqtt_lock((MQTTX_t *)session->mqtt_req);
+		if ((session->sub_trie) && (message->topic))
 		{
-			bool match = 0;
-			mosquitto_topic_matches_sub(cur->topic, message->topic, &match);
-			if (match)
-			{
-				DBG_DB_LN("(match: %d, cur->topic: %s ?= %s)", match, cur->topic, message->topic);
-				if (cur->message_cb)
-				{
-					cur->message_cb(mosq, userdata, message);
-				}
-			}
+			mqtt_trie_match(session->sub_trie, (char *)message->topic, 1, mosq, userdata, message);
+		}
+		mqtt_unlock((MQTTX_t *)session->mqtt_req);
+	}
+}
+
+// payload: NULL, only reserve payloadlen bytes and let the caller fill mqtt_msg->payload
+MQTTMsg_t *mqtt_msg_new(char *topic, void *payload, int payloadlen, int qos, int retain)
+{
+	if ((topic == NULL) || (payloadlen < 0))
+	{
+		return NULL;
+	}
+
+	int topiclen = SAFE_STRLEN(topic);
+	MQTTMsg_t *mqtt_msg = (MQTTMsg_t*)SAFE_POOLX_CALLOC(1, sizeof(MQTTMsg_t) + topiclen + 1 + payloadlen + 1);
+	if (mqtt_msg)
+	{
+		mqtt_msg->ref = 1;
+		mqtt_msg->topic = mqtt_msg->data;
+		SAFE_MEMCPY(mqtt_msg->topic, topic, topiclen, topiclen);
+		mqtt_msg->topic[topiclen] = '\0';
+
+		mqtt_msg->payload = mqtt_msg->data + topiclen + 1;
+		mqtt_msg->payloadlen = payloadlen;
+		if (payload)
+		{
+			SAFE_MEMCPY(mqtt_msg->payload, payload, payloadlen, payloadlen);
+		}
+		((char*)mqtt_msg->payload)[payloadlen] = '\0';
+
+		mqtt_msg->qos = qos;
+		mqtt_msg->retain = retain;
+	}
+	return mqtt_msg;
+}
+
+MQTTMsg_t *mqtt_msg_ref(MQTTMsg_t *mqtt_msg)
+{
+	if (mqtt_msg)
+	{
+		__atomic_add_fetch(&mqtt_msg->ref, 1, __ATOMIC_RELAXED);
+	}
+	return mqtt_msg;
+}
+
+void mqtt_msg_unref(MQTTMsg_t *mqtt_msg)
+{
+	if (mqtt_msg)
+	{
+		if (__atomic_sub_fetch(&mqtt_msg->ref, 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			SAFE_POOLX_FREE(mqtt_msg);
 		}
 	}
 }
@@ -118,25 +578,47 @@ int mqtt_publish(MQTTSession_t *session, char *topic, char *msg)
 	int ret = 0;
 	if ((session) && (msg))
 	{
-		return mosquitto_publish(session->mosq, NULL, topic, SAFE_STRLEN(msg), msg, 0, 0);
+		return mqtt_publish_ex(session, topic, msg, SAFE_STRLEN(msg), 0, 0);
+	}
+	return ret;
+}
+
+// mosquitto keeps its own copy, the caller still owns payload
+int mqtt_publish_ex(MQTTSession_t *session, char *topic, void *payload, int payloadlen, int qos, int retain)
+{
+	int ret = 0;
+	if ((session) && (topic) && ((payload) || (payloadlen == 0)))
+	{
+		return mosquitto_publish(session->mosq, NULL, topic, payloadlen, payload, qos, retain);
+	}
+	return ret;
+}
+
+int mqtt_publish_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg)
+{
+	int ret = 0;
+	if ((session) && (mqtt_msg))
+	{
+		return mqtt_publish_ex(session, mqtt_msg->topic, mqtt_msg->payload, mqtt_msg->payloadlen, mqtt_msg->qos, mqtt_msg->retain);
 	}
 	return ret;
 }
 
 // 1: found
-static int mqtt_subscribe_duplicate(MQTTSession_t *session, char *topic, mqtt_message_fn *message_cb)
+static int mqtt_subscribe_duplicate(MQTTTrie_t *node, mqtt_message_fn *message_cb)
 {
 	int ret = 0;
 
-	if (session)
+	if (node)
 	{
 		MQTTSub_t *cur = NULL;
 
-		for (cur = clist_head(session->sub_list); cur != NULL; cur = clist_item_next(cur))
+		for (cur = node->sub_head; cur != NULL; cur = cur->trie_next)
 		{
-			if ((SAFE_STRCMP(topic, cur->topic)==0) && (message_cb == cur->message_cb))
+			if (message_cb == cur->message_cb)
 			{
 				ret = 1;
+				break;
 			}
 		}
 	}
@@ -148,7 +630,18 @@ void mqtt_subscribe_add(MQTTSession_t *session, char *topic, mqtt_message_fn *me
 {
 	if ((session) && (topic) && (message_cb))
 	{
-		if (mqtt_subscribe_duplicate(session, topic, message_cb) == 1)
+		mqtt_lock((MQTTX_t *)session->mqtt_req);
+		if (session->sub_trie == NULL)
+		{
+			session->sub_trie = mqtt_trie_new("", 0);
+		}
+
+		MQTTTrie_t *node = mqtt_trie_insert(session->sub_trie, topic);
+		if (node == NULL)
+		{
+			DBG_ER_LN("mqtt_trie_insert error !!! (topic: %s)", topic);
+		}
+		else if (mqtt_subscribe_duplicate(node, message_cb) == 1)
 		{
 			// found
 		}
@@ -158,20 +651,49 @@ void mqtt_subscribe_add(MQTTSession_t *session, char *topic, mqtt_message_fn *me
 			SAFE_SPRINTF_EX(sub_new->topic, "%s", topic);
 			sub_new->message_cb = message_cb;
 
+			// keep the order of mqtt_subscribe_add
+			MQTTSub_t **tail = &node->sub_head;
+			while (*tail)
+			{
+				tail = &(*tail)->trie_next;
+			}
+			*tail = sub_new;
+
 			DBG_IF_LN("(topic: %s)", sub_new->topic);
 			clist_push(session->sub_list, sub_new);
 		}
+		mqtt_unlock((MQTTX_t *)session->mqtt_req);
 	}
 }
 
-static void mqtt_queue_new(MQTTTopic_t *new, MQTTSession_t *session, char *topic, char *msg, mqtt_topic_fn *topic_cb)
+// mqtt_msg is moved into the queue
+static void mqtt_queue_new(MQTTTopic_t *new, MQTTSession_t *session, MQTTMsg_t *mqtt_msg, mqtt_topic_fn *topic_cb, mqtt_msg_fn *msg_cb)
+{
+	SAFE_MEMSET(new, 0, sizeof(MQTTTopic_t));
+	new->session = session;
+	new->mqtt_msg = mqtt_msg;
+	new->topic = mqtt_msg->topic;
+	new->msg = (char*)mqtt_msg->payload;
+	new->topic_cb = topic_cb;
+	new->msg_cb = msg_cb;
+}
+
+static void mqtt_queue_add(MQTTSession_t *session, QueueX_t *queuex_req, MQTTMsg_t *mqtt_msg, mqtt_topic_fn *topic_cb, mqtt_msg_fn *msg_cb)
 {
-	if ((new) && (session) && (topic) && (msg))
+	MQTTTopic_t topic_new;
+	mqtt_queue_new(&topic_new, session, mqtt_msg, topic_cb, msg_cb);
+
+	// only the pointer of mqtt_msg is copied
+	if (queuex_add(queuex_req, (void*)&topic_new) != 0)
 	{
-		new->session = session;
-		SAFE_ASPRINTF(new->topic, "%s", topic);
-		SAFE_ASPRINTF(new->msg, "%s", msg);
-		new->topic_cb = topic_cb;
+		// full or quitting, the queue didn't take the reference
+		if (queuex_req == session->qpub)
+		{
+			queuex_lock(session->qpub);
+			mqtt_stat_drop(session);
+			queuex_unlock(session->qpub);
+		}
+		mqtt_msg_unref(mqtt_msg);
 	}
 }
 
@@ -179,10 +701,20 @@ void mqtt_qsub_add(MQTTSession_t *session, char *topic, char *msg, mqtt_topic_fn
 {
 	if ((session) && (session->qsub) && (topic) && (msg))
 	{
-		MQTTTopic_t topic_new;
-		mqtt_queue_new(&topic_new, session, topic, msg, topic_cb);
+		MQTTMsg_t *mqtt_msg = mqtt_msg_new(topic, msg, SAFE_STRLEN(msg), 0, 0);
+		if (mqtt_msg)
+		{
+			mqtt_queue_add(session, session->qsub, mqtt_msg, topic_cb, NULL);
+		}
+	}
+}
 
-		queuex_add(session->qsub, (void*)&topic_new);
+// binary-safe, mqtt_qsub_add_msg takes a reference of mqtt_msg
+void mqtt_qsub_add_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg, mqtt_msg_fn *msg_cb)
+{
+	if ((session) && (session->qsub) && (mqtt_msg))
+	{
+		mqtt_queue_add(session, session->qsub, mqtt_msg_ref(mqtt_msg), NULL, msg_cb);
 	}
 }
 
@@ -190,11 +722,16 @@ static int mqtt_qsub_exec_cb(void *arg)
 {
 	MQTTTopic_t *data_pop = (MQTTTopic_t *)arg;
 
-	if (data_pop)
+	if ((data_pop) && (data_pop->mqtt_msg))
 	{
-		data_pop->topic_cb(data_pop->session, data_pop->topic, data_pop->msg);
-		SAFE_FREE(data_pop->topic);
-		SAFE_FREE(data_pop->msg);
+		if (data_pop->msg_cb)
+		{
+			data_pop->msg_cb(data_pop->session, data_pop->mqtt_msg);
+		}
+		else if (data_pop->topic_cb)
+		{
+			data_pop->topic_cb(data_pop->session, data_pop->topic, data_pop->msg);
+		}
 	}
 
 	return 0;
@@ -204,23 +741,89 @@ void mqtt_qpub_add(MQTTSession_t *session, char *topic, char *msg, mqtt_topic_fn
 {
 	if ((session) && (session->qpub) && (topic) && (msg))
 	{
-		MQTTTopic_t topic_new;
-		mqtt_queue_new(&topic_new, session, topic, msg, topic_cb);
+		MQTTMsg_t *mqtt_msg = mqtt_msg_new(topic, msg, SAFE_STRLEN(msg), 0, 0);
+		if (mqtt_msg)
+		{
+			mqtt_queue_add(session, session->qpub, mqtt_msg, topic_cb, NULL);
+		}
+	}
+}
 
-		queuex_add(session->qpub, (void*)&topic_new);
+// binary-safe, mqtt_qpub_add_msg takes a reference of mqtt_msg, the same mqtt_msg can be queued to many sessions
+void mqtt_qpub_add_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg)
+{
+	if ((session) && (session->qpub) && (mqtt_msg))
+	{
+		mqtt_queue_add(session, session->qpub, mqtt_msg_ref(mqtt_msg), NULL, NULL);
 	}
 }
 
+// waits until the window has a free slot (at most inflight_wait ms), the slot keeps a reference of mqtt_msg until the ack
+static void mqtt_inflight_add(MQTTSession_t *session, MQTTMsg_t *mqtt_msg)
+{
+	QueueX_t *queuex_req = session->qpub;
+	MQTTInflight_t *inflight = NULL;
+	int inflight_wait = (session->inflight_wait > 0) ? session->inflight_wait : TIMEOUT_OF_INFLIGHT;
+	unsigned long long t_end = mqtt_now_us() + (unsigned long long)inflight_wait * 1000;
+
+	queuex_lock(queuex_req);
+	while (inflight == NULL)
+	{
+		int idx = 0;
+		for (idx = 0; idx < session->pub_stat.max_inflight; idx++)
+		{
+			if (session->inflight_ary[idx].mqtt_msg == NULL)
+			{
+				inflight = &session->inflight_ary[idx];
+				break;
+			}
+		}
+
+		if ((inflight == NULL) && ((queuex_timewait(queuex_req, 100) == EINVAL) || (mqtt_now_us() >= t_end)))
+		{
+			break;
+		}
+	}
+
+	if (inflight)
+	{
+		inflight->mqtt_msg = mqtt_msg_ref(mqtt_msg);
+		mqtt_stat_inflight(session, 1);
+		mqtt_inflight_publish(session, inflight);
+	}
+	else
+	{
+		mqtt_stat_drop(session);
+	}
+	queuex_unlock(queuex_req);
+}
+
 static int mqtt_qpub_exec_cb(void *arg)
 {
 	MQTTTopic_t *data_pop = (MQTTTopic_t *)arg;
 
-	if (data_pop)
+	if ((data_pop) && (data_pop->mqtt_msg))
 	{
-		mqtt_publish(data_pop->session, data_pop->topic, data_pop->msg);
+		MQTTSession_t *session = data_pop->session;
+		if ((data_pop->mqtt_msg->qos > 0) && (session->inflight_ary))
+		{
+			mqtt_inflight_add(session, data_pop->mqtt_msg);
+		}
+		else
+		{
+			int rc = mqtt_publish_msg(session, data_pop->mqtt_msg);
 
-		SAFE_FREE(data_pop->topic);
-		SAFE_FREE(data_pop->msg);
+			queuex_lock(session->qpub);
+			if (rc == MOSQ_ERR_SUCCESS)
+			{
+				mqtt_stat_pub(session);
+			}
+			else
+			{
+				mqtt_stat_drop(session);
+			}
+			queuex_unlock(session->qpub);
+		}
 	}
 
 	return 0;
@@ -232,8 +835,8 @@ static int mqtt_queue_free_cb(void *arg)
 
 	if (data_pop)
 	{
-		SAFE_FREE(data_pop->topic);
-		SAFE_FREE(data_pop->msg);
+		mqtt_msg_unref(data_pop->mqtt_msg);
+		data_pop->mqtt_msg = NULL;
 	}
 
 	return 0;
@@ -248,6 +851,16 @@ void mqtt_queue_wakeup(MQTTSession_t *session)
 	}
 }
 
+void mqtt_pub_stat(MQTTSession_t *session, MQTTPubStat_t *pub_stat)
+{
+	if ((session) && (pub_stat))
+	{
+		queuex_lock(session->qpub);
+		SAFE_MEMCPY(pub_stat, &session->pub_stat, sizeof(MQTTPubStat_t), sizeof(MQTTPubStat_t));
+		queuex_unlock(session->qpub);
+	}
+}
+
 void mqtt_queue_gosleep(MQTTSession_t *session)
 {
 	if (session)
@@ -257,15 +870,65 @@ void mqtt_queue_gosleep(MQTTSession_t *session)
 	}
 }
 
+#ifdef UTIL_EX_METRICX
+static void mqtt_metric_open(MQTTSession_t *session)
+{
+	char labels[LEN_OF_METRICX_LABELS] = "";
+	SAFE_SPRINTF_EX(labels, "broker=\"%s:%d\",client=\"%s\"", session->hostname, session->port, session->clientid);
+
+	MQTTMetric_t *metric = &session->metric;
+	metric->pubs = metricx_counter_new("mqtt_pubs_total", "messages handed to mosquitto", labels);
+	metric->acks = metricx_counter_new("mqtt_acks_total", "messages acknowledged, QoS1: PUBACK, QoS2: PUBCOMP", labels);
+	metric->retries = metricx_counter_new("mqtt_retries_total", "messages published again after reconnect", labels);
+	metric->drops = metricx_counter_new("mqtt_drops_total", "messages lost, qpub was full, publish failed or never acked", labels);
+	metric->recvs = metricx_counter_new("mqtt_recvs_total", "messages received", labels);
+	metric->inflight = metricx_gauge_new("mqtt_inflight", "messages waiting for the ack", labels);
+	metric->ack_us = metricx_histogram_new("mqtt_ack_us", "publish to ack in microseconds", labels);
+}
+
+static void mqtt_metric_close(MQTTSession_t *session)
+{
+	MQTTMetric_t *metric = &session->metric;
+	metricx_free(metric->pubs);
+	metricx_free(metric->acks);
+	metricx_free(metric->retries);
+	metricx_free(metric->drops);
+	metricx_free(metric->recvs);
+	metricx_free(metric->inflight);
+	metricx_free(metric->ack_us);
+	SAFE_MEMSET(metric, 0, sizeof(MQTTMetric_t));
+}
+#endif
+
 static void mqtt_queue_close(MQTTSession_t *session)
 {
 	if (session)
 	{
 		queuex_thread_stop(session->qpub);
 		queuex_thread_close(session->qpub);
+		session->qpub = NULL;
+
+		if (session->inflight_ary)
+		{
+			int idx = 0;
+			for (idx = 0; idx < session->pub_stat.max_inflight; idx++)
+			{
+				if (session->inflight_ary[idx].mqtt_msg)
+				{
+					mqtt_stat_drop(session);
+					mqtt_inflight_release(session, &session->inflight_ary[idx]);
+				}
+			}
+			SAFE_FREE(session->inflight_ary);
+		}
 
 		queuex_thread_stop(session->qsub);
 		queuex_thread_close(session->qsub);
+		session->qsub = NULL;
+
+#ifdef UTIL_EX_METRICX
+		mqtt_metric_close(session);
+#endif
 	}
 }
 
@@ -273,11 +936,19 @@ static void mqtt_queue_init(MQTTSession_t *session)
 {
 	if (session)
 	{
+		SAFE_MEMSET(&session->pub_stat, 0, sizeof(MQTTPubStat_t));
+#ifdef UTIL_EX_METRICX
+		mqtt_metric_open(session);
+#endif
+		session->pub_stat.max_inflight = (session->max_inflight > 0) ? session->max_inflight : MAX_OF_INFLIGHT;
+		session->inflight_ary = (MQTTInflight_t *)SAFE_CALLOC(session->pub_stat.max_inflight, sizeof(MQTTInflight_t));
+
 		session->qpub = queuex_thread_init("qpub", MAX_OF_QPUB, sizeof(MQTTTopic_t), mqtt_qpub_exec_cb, mqtt_queue_free_cb);
 		if (session->qpub)
 		{
 			queuex_isready(session->qpub, 20);
 		}
+		queuex_batch(session->qpub, MAX_OF_QPUB_BATCH);
 		queuex_gosleep(session->qpub);
 
 		session->qsub = queuex_thread_init("qsub", MAX_OF_QSUB, sizeof(MQTTTopic_t), mqtt_qsub_exec_cb, mqtt_queue_free_cb);
@@ -377,6 +1048,8 @@ static struct mosquitto *mqtt_srv_open(MQTTX_t *mqtt_req)
 			mosquitto_connect_callback_set(mosq, mqtt_connect_cb);
 			mosquitto_disconnect_callback_set(mosq, mqtt_disconnect_cb);
 			mosquitto_message_callback_set(mosq, mqtt_message_cb);
+			mosquitto_publish_callback_set(mosq, mqtt_publish_cb);
+			mosquitto_max_inflight_messages_set(mosq, session->pub_stat.max_inflight);
 		}
 	}
 
@@ -481,7 +1154,11 @@ exit_mqtt:
 		//SSL_COMP_free_compression_methods();
 
 		mqtt_queue_close(mqtt_req->session);
+		mqtt_lock(mqtt_req);
+		mqtt_trie_free(session->sub_trie);
+		session->sub_trie = NULL;
 		clist_free(session->sub_list);
+		mqtt_unlock(mqtt_req);
 
 		threadx_leave(tidx_req);
 	}
@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_CHAINX
 #include "utilx9.h"
 
 mctt_recv_fn mctt_recv_cb = NULL;
@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_ONVIF
 #include "utilx9.h"
 
 #define DBG_TMP_Y(format,args...) //DBG_LN_Y(format, ## args)
@@ -109,7 +110,45 @@ exit_sha1:
 	return buffer;
 }
 
-void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
+// create_s, nonce_s and password_s: LEN_OF_VAL32
+static int onvif_auth_token(char *pass, char *create_s, char *nonce_s, char *password_s)
+{
+	int ret = -1;
+	time_t create_t;
+	struct tm create_tm;
+
+	time(&create_t);
+	localtime_r(&create_t, &create_tm);
+	//strftime(create_s, sizeof(create_s), "%Y-%m-%dT%T.000Z", time(NULL));
+	strftime(create_s, LEN_OF_VAL32, "%Y-%m-%dT%H:%M:%S.000Z", &create_tm);
+
+	char *nonce_rand = os_urandom(20);
+	if (nonce_rand)
+	{
+		int enc_len = 0;
+		char *nonce_b64 = sec_base64_enc(nonce_rand, 20, &enc_len);
+		char *password = onvif_pass_sha1(nonce_rand, 20, create_s, strlen(create_s), pass, strlen(pass));
+		if ((nonce_b64) && (password))
+		{
+			char *password_b64 = sec_base64_enc(password, 20, &enc_len);
+			if (password_b64)
+			{
+				DBG_TMP_Y("(nonce_b64: %s, password_b64: %s)", nonce_b64, password_b64);
+				SAFE_SNPRINTF(nonce_s, LEN_OF_VAL32, "%s", nonce_b64);
+				SAFE_SNPRINTF(password_s, LEN_OF_VAL32, "%s", password_b64);
+				ret = 0;
+				SAFE_FREE(password_b64);
+			}
+		}
+		SAFE_FREE(password);
+		SAFE_FREE(nonce_b64);
+		SAFE_FREE(nonce_rand);
+	}
+
+	return ret;
+}
+
+static void onvif_auth_fill(OnvifX_t *onvif_req, SoapX_t *soap, char *create_s, char *nonce_s, char *password_s)
 {
 	soap_node_t *request_node = soap->request_node;
 
@@ -125,13 +164,6 @@ void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
 				{
 					soap_node_t *UsernameToken_node = soap_element_add(Security_node, "UsernameToken");
 					{
-						time_t create_t;
-						char create_s[LEN_OF_VAL32] = "";
-
-						time(&create_t);
-						//strftime(create_s, sizeof(create_s), "%Y-%m-%dT%T.000Z", time(NULL));
-						strftime(create_s, sizeof(create_s), "%Y-%m-%dT%H:%M:%S.000Z", localtime(&create_t));
-
 						soap_node_t *Created_node = soap_element_add(UsernameToken_node, "Created");
 						{
 							soap_element_attr_set(Created_node, "xmlns", "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-wssecurity-utility-1.0.xsd");
@@ -140,21 +172,13 @@ void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
 							soap_element_text_new(Created_node, 0, create_s);
 						}
 
-						char *nonce_rand = os_urandom(20);
-						if (nonce_rand)
+						if (nonce_s)
 						{
-							int enc_len = 0;
-							char *nonce_b64 = sec_base64_enc(nonce_rand, 20, &enc_len);
-							if (nonce_b64)
+							soap_node_t *Nonce_node = soap_element_add(UsernameToken_node, "Nonce");
 							{
-								DBG_TMP_Y("nonce_b64 (enc_len: %d, [%s])", enc_len, nonce_b64);
-								soap_node_t *Nonce_node = soap_element_add(UsernameToken_node, "Nonce");
-								{
-									soap_element_attr_set(Nonce_node, "EncodingType", "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-soap-message-security-1.0#Base64Binary");
-
-									soap_element_text_new(Nonce_node, 0, nonce_b64);
-								}
-								SAFE_FREE(nonce_b64);
+								soap_element_attr_set(Nonce_node, "EncodingType", "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-soap-message-security-1.0#Base64Binary");
+
+								soap_element_text_new(Nonce_node, 0, nonce_s);
 							}
 
 							soap_node_t *Username_node = soap_element_add(UsernameToken_node, "Username");
@@ -162,27 +186,12 @@ void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
 								soap_element_text_new(Username_node, 0, (const char *)onvif_req->netinfo.user);
 							}
 
-							char *password = onvif_pass_sha1(nonce_rand, 20, create_s, strlen(create_s), onvif_req->netinfo.pass, strlen(onvif_req->netinfo.pass));
-							if (password)
+							soap_node_t *Password_node = soap_element_add(UsernameToken_node, "Password");
 							{
-								int enc_len = 0;
-								char *password_b64 = sec_base64_enc(password, 20, &enc_len);
-								if (password_b64)
-								{
-									DBG_TMP_Y("password_b64 (enc_len: %d, [%s] -> [%s])", enc_len, onvif_req->netinfo.pass, password_b64);
-
-									soap_node_t *Password_node = soap_element_add(UsernameToken_node, "Password");
-									{
-										soap_element_attr_set(Password_node, "Type", "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-username-token-profile-1.0#PasswordDigest");
-
-										soap_element_text_new(Password_node, 0, password_b64);
-									}
-									SAFE_FREE(password_b64);
-								}
-								SAFE_FREE(password);
-							}
+								soap_element_attr_set(Password_node, "Type", "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-username-token-profile-1.0#PasswordDigest");
 
-							SAFE_FREE(nonce_rand);
+								soap_element_text_new(Password_node, 0, password_s);
+							}
 						}
 					}
 				}
@@ -193,6 +202,22 @@ void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
 	//soap_element_save(request_node, "/tmp/sdk/test.xml");
 }
 
+void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap)
+{
+	char create_s[LEN_OF_VAL32] = "";
+	char nonce_s[LEN_OF_VAL32] = "";
+	char password_s[LEN_OF_VAL32] = "";
+
+	if (onvif_auth_token(onvif_req->netinfo.pass, create_s, nonce_s, password_s) == 0)
+	{
+		onvif_auth_fill(onvif_req, soap, create_s, nonce_s, password_s);
+	}
+	else
+	{
+		onvif_auth_fill(onvif_req, soap, create_s, NULL, NULL);
+	}
+}
+
 soap_node_t *onvif_open(OnvifX_t *onvif_req, onvif_resuest_fn request_cb)
 {
 	soap_node_t *response_node = NULL;
@@ -285,10 +310,10 @@ static void onvif_GeCommon_request_cb(SoapX_t *soap, OnvifX_t *onvif_req)
 	}
 }
 
-soap_node_t *onvif_GetCommon(OnvifX_t *onvif_req)
+static onvif_resuest_fn onvif_request_cb_get(SOAP_ACTION_ID act_id)
 {
 	onvif_resuest_fn request_cb = NULL;
-	switch (onvif_req->act_id)
+	switch (act_id)
 	{
 		case SOAP_ACTION_ID_MEDIA_GETSNAPSHOTURI:
 			request_cb = onvif_media_GetSnapshotUri_request_cb;
@@ -312,7 +337,12 @@ soap_node_t *onvif_GetCommon(OnvifX_t *onvif_req)
 			break;
 	}
 
-	return onvif_open(onvif_req, request_cb);
+	return request_cb;
+}
+
+soap_node_t *onvif_GetCommon(OnvifX_t *onvif_req)
+{
+	return onvif_open(onvif_req, onvif_request_cb_get(onvif_req->act_id));
 }
 
 int onvif_GetSnapshot(OnvifX_t *onvif_req, char *snapshot_uri, char *prefixname)
@@ -380,3 +410,553 @@ int onvif_GetVideoClip(OnvifX_t *onvif_req, char *videoclip_uri, char *filename,
 	return ret;
 }
 
+
+//** async, many devices share one HttpXPool **
+#define ONVIF_XML_CREATED "{ONVIF_XML_CREATED}"
+#define ONVIF_XML_NONCE "{ONVIF_XML_NONCE}"
+#define ONVIF_XML_USERNAME "{ONVIF_XML_USERNAME}"
+#define ONVIF_XML_PASSWORD "{ONVIF_XML_PASSWORD}"
+#define ONVIF_XML_PROFILETOKEN "{ONVIF_XML_PROFILETOKEN}"
+
+typedef struct OnvifAct_STRUCT
+{
+	SOAP_ACTION_ID act_id;
+	char *act_ns;
+	char *act_name;
+	int ismedia; // to media.uri
+} OnvifAct_t;
+
+static OnvifAct_t onvif_act_ary[] =
+{
+	{ SOAP_ACTION_ID_DEVICE_GETCAPABILITIES, "tds", "GetCapabilities", 0 },
+	{ SOAP_ACTION_ID_DEVICE_GETDEVICEINFORMATION, "tds", "GetDeviceInformation", 0 },
+	{ SOAP_ACTION_ID_DEVICE_GETHOSTNAME, "tds", "GetHostname", 0 },
+	{ SOAP_ACTION_ID_DEVICE_GETNETWORKINTERFACES, "tds", "GetNetworkInterfaces", 0 },
+	{ SOAP_ACTION_ID_DEVICE_GETSERVICES, "tds", "GetServices", 0 },
+	{ SOAP_ACTION_ID_DEVICE_GETSCOPES, "tds", "GetScopes", 0 },
+	{ SOAP_ACTION_ID_MEDIA_GETPROFILES, "trt", "GetProfiles", 1 },
+	{ SOAP_ACTION_ID_MEDIA_GETSNAPSHOTURI, "trt", "GetSnapshotUri", 1 },
+	{ SOAP_ACTION_ID_MEDIA_GETSTREAMURI, "trt", "GetStreamUri", 1 },
+	{ SOAP_ACTION_ID_MAX, NULL, NULL, 0 },
+};
+
+static OnvifAct_t *onvif_act_get(SOAP_ACTION_ID act_id)
+{
+	OnvifAct_t *act = onvif_act_ary;
+	while (act->act_name)
+	{
+		if (act->act_id == act_id)
+		{
+			return act;
+		}
+		act++;
+	}
+	return NULL;
+}
+
+// mxml builds the request with the slots only once, the values are rendered per call
+static SoapTmpl_t *onvif_tmpl_build(OnvifAct_t *act)
+{
+	SoapTmpl_t *tmpl = NULL;
+
+	OnvifX_t onvif_req =
+	{
+		.act_id = act->act_id,
+		.netinfo.user = ONVIF_XML_USERNAME,
+		.request = (void *)ONVIF_XML_PROFILETOKEN
+	};
+	SAFE_SPRINTF_EX(onvif_req.act_ns, "%s", act->act_ns);
+	SAFE_SPRINTF_EX(onvif_req.act_name, "%s", act->act_name);
+
+	SoapX_t *soap = soap_create(onvif_xml(act->act_id));
+	if (soap)
+	{
+		onvif_auth_fill(&onvif_req, soap, ONVIF_XML_CREATED, ONVIF_XML_NONCE, ONVIF_XML_PASSWORD);
+
+		onvif_resuest_fn request_cb = onvif_request_cb_get(act->act_id);
+		if (request_cb)
+		{
+			request_cb(soap, &onvif_req);
+		}
+
+		char *xml = soap_element_2string(soap->request_node);
+		tmpl = soap_tmpl_compile(xml);
+		DBG_TMP_Y("(act_name: %s, xml: %s)", act->act_name, xml);
+		SAFE_FREE(xml);
+
+		soap_free(soap);
+	}
+
+	if (tmpl == NULL)
+	{
+		DBG_ER_LN("onvif_tmpl_build error !!! (act_name: %s)", act->act_name);
+	}
+	return tmpl;
+}
+
+static OnvifJob_t *onvif_job_new(OnvifDev_t *dev, SOAP_ACTION_ID act_id, char *token, onvif_response_fn cb, void *userdata)
+{
+	OnvifJob_t *job = (OnvifJob_t *)SAFE_CALLOC(1, sizeof(OnvifJob_t));
+	if (job)
+	{
+		job->dev = dev;
+		job->act_id = act_id;
+		if (token)
+		{
+			SAFE_SPRINTF_EX(job->token, "%s", token);
+		}
+		job->done_cb = cb;
+		job->userdata = userdata;
+		job->http_req.mode = HTTP_MODE_ID_SOAP;
+	}
+	return job;
+}
+
+static void onvif_job_free(OnvifJob_t *job)
+{
+	if (job)
+	{
+		http_request_free(&job->http_req);
+		SAFE_FREE(job);
+	}
+}
+
+static void onvif_job_finish(OnvifJob_t *job, soap_node_t *response_node)
+{
+	if (job->done_cb)
+	{
+		job->done_cb(job->dev, job->act_id, response_node, job->userdata);
+	}
+	onvif_job_free(job);
+}
+
+// the request is rendered from the template of the action
+static int onvif_job_prepare(OnvifPool_t *onvif_pool, OnvifJob_t *job)
+{
+	int ret = -1;
+	OnvifDev_t *dev = job->dev;
+	OnvifAct_t *act = onvif_act_get(job->act_id);
+	HttpX_t *http_req = &job->http_req;
+	char create_s[LEN_OF_VAL32] = "";
+	char nonce_s[LEN_OF_VAL32] = "";
+	char password_s[LEN_OF_VAL32] = "";
+
+	if ((act == NULL) || (onvif_auth_token(dev->netinfo.pass, create_s, nonce_s, password_s) != 0))
+	{
+		return ret;
+	}
+
+	SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+	if (onvif_pool->tmpl_ary[act->act_id] == NULL)
+	{
+		onvif_pool->tmpl_ary[act->act_id] = onvif_tmpl_build(act);
+	}
+	SoapTmpl_t *tmpl = onvif_pool->tmpl_ary[act->act_id];
+
+	char *token = job->token;
+	if ((strlen(token) == 0) && (dev->profile_count > 0))
+	{
+		token = dev->profile_ary[0];
+	}
+
+	if (tmpl)
+	{
+		const char *value_ary[MAX_OF_SOAP_SLOT] = { NULL };
+		int idx = 0;
+		for (idx = 0; idx < tmpl->slot_count; idx++)
+		{
+			char *name = tmpl->slot_ary[idx];
+			if (SAFE_STRCMP(name, "ONVIF_XML_CREATED") == 0)
+			{
+				value_ary[idx] = create_s;
+			}
+			else if (SAFE_STRCMP(name, "ONVIF_XML_NONCE") == 0)
+			{
+				value_ary[idx] = nonce_s;
+			}
+			else if (SAFE_STRCMP(name, "ONVIF_XML_USERNAME") == 0)
+			{
+				value_ary[idx] = dev->netinfo.user;
+			}
+			else if (SAFE_STRCMP(name, "ONVIF_XML_PASSWORD") == 0)
+			{
+				value_ary[idx] = password_s;
+			}
+			else if (SAFE_STRCMP(name, "ONVIF_XML_PROFILETOKEN") == 0)
+			{
+				value_ary[idx] = token;
+			}
+		}
+
+		http_req->soap_req.request = soap_tmpl_render_alloc(tmpl, value_ary, NULL);
+		if (http_req->soap_req.request)
+		{
+			ret = 0;
+		}
+	}
+
+	// the services from GetCapabilities, or the url of the device
+	char *uri = (act->ismedia) ? dev->service.media.uri : dev->service.device.uri;
+	if (strlen(uri) > 0)
+	{
+		SAFE_SPRINTF_EX(http_req->url, "%s", uri);
+		http_req->port = 0;
+	}
+	else
+	{
+		SAFE_SPRINTF_EX(http_req->url, "%s", dev->netinfo.url);
+		http_req->port = dev->netinfo.port;
+	}
+	SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+	http_req->mode = HTTP_MODE_ID_SOAP;
+	http_req->pool = onvif_pool->http_pool;
+	if (dev->http_auth > 0)
+	{
+		http_req->user = dev->netinfo.user;
+		http_req->password = dev->netinfo.pass;
+	}
+
+	return ret;
+}
+
+static soap_node_t *onvif_job_response(OnvifJob_t *job)
+{
+	soap_node_t *response_node = NULL;
+	HttpX_t *http_req = &job->http_req;
+	OnvifAct_t *act = onvif_act_get(job->act_id);
+
+	if ((act) && (http_req->result == 0) && (http_req->soap_req.response))
+	{
+		soap_node_t *root_node = soap_load_string(http_req->soap_req.response);
+
+		char act_name[LEN_OF_NAME_ONVIF_ACT] = "";
+		SAFE_SNPRINTF(act_name, (int)sizeof(act_name), "%sResponse", act->act_name);
+
+		response_node = soap_element_fetch(root_node, act->act_ns, act_name, NULL, NULL);
+		soap_element_remove(response_node);
+		soap_element_delete(root_node);
+	}
+
+	if (response_node == NULL)
+	{
+		DBG_WN_LN("%s (url: %s, response_code: %ld, log: %s)", DBG_TXT_NO_SUPPORT, http_req->url, http_req->response_code, http_req->log);
+	}
+	return response_node;
+}
+
+static void onvif_dev_capabilities(OnvifDev_t *dev, soap_node_t *response_node)
+{
+	soap_node_t *curr_node = soap_element_fetch(response_node, NULL, "Capabilities", NULL, NULL);
+	curr_node = soap_element_1st_child(curr_node);
+	while (curr_node)
+	{
+		const char *Name = soap_element_name(curr_node);
+		soap_node_t *XAddr_node = soap_element_fetch(curr_node, NULL, "XAddr", NULL, NULL);
+		const char *XAddr = soap_element_text(XAddr_node, NULL);
+
+		char *uri = NULL;
+		if ((Name == NULL) || (XAddr == NULL) || (SAFE_STRSTR((char *)Name, "Extension")))
+		{
+		}
+		else if (SAFE_STRSTR((char *)Name, "Device"))
+		{
+			uri = dev->service.device.uri;
+		}
+		else if (SAFE_STRSTR((char *)Name, "Media"))
+		{
+			uri = dev->service.media.uri;
+		}
+		else if (SAFE_STRSTR((char *)Name, "Events"))
+		{
+			uri = dev->service.events.uri;
+		}
+		else if (SAFE_STRSTR((char *)Name, "Imaging"))
+		{
+			uri = dev->service.imaging.uri;
+		}
+		else if (SAFE_STRSTR((char *)Name, "PTZ"))
+		{
+			uri = dev->service.ptz.uri;
+		}
+		else if (SAFE_STRSTR((char *)Name, "Analytics"))
+		{
+			uri = dev->service.analytics.uri;
+		}
+
+		if (uri)
+		{
+			SAFE_SNPRINTF(uri, LEN_OF_URL_ONVIF, "%s", XAddr);
+			DBG_TMP_Y("(%s: %s)", Name, XAddr);
+		}
+		curr_node = soap_element_next_sibling(curr_node);
+	}
+}
+
+static void onvif_dev_profiles(OnvifDev_t *dev, soap_node_t *response_node)
+{
+	dev->profile_count = 0;
+
+	soap_node_t *curr_node = soap_element_fetch(response_node, NULL, "Profiles", NULL, NULL);
+	while ((curr_node) && (dev->profile_count < MAX_OF_ONVIF_PROFILES))
+	{
+		const char *token = soap_element_attr(curr_node, "token");
+		if (token)
+		{
+			SAFE_SNPRINTF(dev->profile_ary[dev->profile_count], LEN_OF_VAL32, "%s", token);
+			dev->profile_count++;
+		}
+		curr_node = soap_element_next_sibling(curr_node);
+	}
+
+	if (dev->profile_count > 0)
+	{
+		SAFE_SPRINTF_EX(dev->service.media.profiletoken, "%s", dev->profile_ary[0]);
+	}
+}
+
+// GetCapabilities -> GetProfiles -> the parked requests
+static void onvif_dev_boot(OnvifJob_t *job, soap_node_t *response_node)
+{
+	OnvifDev_t *dev = job->dev;
+	OnvifPool_t *onvif_pool = dev->onvif_pool;
+	OnvifJob_t *parked_job = NULL;
+	void *failed_head = NULL;
+	clist_t failed_list = &failed_head;
+
+	SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+	if (response_node == NULL)
+	{
+		// GetCapabilities or GetProfiles failed, the next request will try again
+		dev->state = ONVIF_DEV_STATE_ID_NONE;
+		clist_copy(failed_list, dev->parked_list);
+		clist_init(dev->parked_list);
+	}
+	else if (job->act_id == SOAP_ACTION_ID_DEVICE_GETCAPABILITIES)
+	{
+		onvif_dev_capabilities(dev, response_node);
+
+		// the same job goes on with GetProfiles, ahead of the others
+		dev->state = ONVIF_DEV_STATE_ID_PROFILES;
+		job->act_id = SOAP_ACTION_ID_MEDIA_GETPROFILES;
+		http_request_free(&job->http_req);
+		SAFE_MEMSET(&job->http_req, 0, sizeof(HttpX_t));
+		job->http_req.mode = HTTP_MODE_ID_SOAP;
+		clist_add(onvif_pool->job_list, job);
+		job = NULL;
+	}
+	else
+	{
+		// a device with an empty list of profiles is still ready for the device service
+		onvif_dev_profiles(dev, response_node);
+		dev->state = ONVIF_DEV_STATE_ID_READY;
+		while ((parked_job = (OnvifJob_t *)clist_pop(dev->parked_list)) != NULL)
+		{
+			clist_push(onvif_pool->job_list, parked_job);
+		}
+	}
+	SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+	while ((parked_job = (OnvifJob_t *)clist_pop(failed_list)) != NULL)
+	{
+		onvif_job_finish(parked_job, NULL);
+	}
+	onvif_job_free(job);
+}
+
+static void onvif_job_done(OnvifJob_t *job, soap_node_t *response_node)
+{
+	if (job->isboot)
+	{
+		onvif_dev_boot(job, response_node);
+	}
+	else
+	{
+		onvif_job_finish(job, response_node);
+	}
+}
+
+static void onvif_pool_dispatch(OnvifPool_t *onvif_pool);
+
+// at the thread of HttpXPool
+static void onvif_job_response_cb(HttpX_t *http_req, void *userdata)
+{
+	OnvifJob_t *job = (OnvifJob_t *)userdata;
+	OnvifPool_t *onvif_pool = job->dev->onvif_pool;
+
+	soap_node_t *response_node = onvif_job_response(job);
+	onvif_job_done(job, response_node);
+	soap_element_delete(response_node);
+
+	SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+	onvif_pool->inflight--;
+	SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+	onvif_pool_dispatch(onvif_pool);
+}
+
+// keeps at most max_inflight requests inside the HttpXPool
+static void onvif_pool_dispatch(OnvifPool_t *onvif_pool)
+{
+	while (1)
+	{
+		OnvifJob_t *job = NULL;
+
+		SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+		if (onvif_pool->inflight < onvif_pool->max_inflight)
+		{
+			job = (OnvifJob_t *)clist_pop(onvif_pool->job_list);
+			if (job)
+			{
+				onvif_pool->inflight++;
+			}
+		}
+		SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+		if (job == NULL)
+		{
+			break;
+		}
+
+		if ((onvif_pool->isfree) || (onvif_job_prepare(onvif_pool, job) != 0) || (http_request_async(&job->http_req, (void *)job, onvif_job_response_cb) != 0))
+		{
+			SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+			onvif_pool->inflight--;
+			SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+			onvif_job_done(job, NULL);
+		}
+	}
+}
+
+// cb is called at the thread of HttpXPool, token: NULL or "" for the 1st profile
+int onvif_request_async(OnvifDev_t *dev, SOAP_ACTION_ID act_id, char *token, onvif_response_fn cb, void *userdata)
+{
+	int ret = -1;
+
+	if ((dev == NULL) || (dev->onvif_pool == NULL) || (dev->onvif_pool->isfree))
+	{
+		return ret;
+	}
+	if (onvif_act_get(act_id) == NULL)
+	{
+		DBG_ER_LN("%s (act_id: %d)", DBG_TXT_NO_SUPPORT, act_id);
+		return ret;
+	}
+
+	OnvifPool_t *onvif_pool = dev->onvif_pool;
+	OnvifJob_t *job = onvif_job_new(dev, act_id, token, cb, userdata);
+	if (job)
+	{
+		SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+		if (dev->state == ONVIF_DEV_STATE_ID_READY)
+		{
+			clist_push(onvif_pool->job_list, job);
+		}
+		else
+		{
+			clist_push(dev->parked_list, job);
+			if (dev->state == ONVIF_DEV_STATE_ID_NONE)
+			{
+				OnvifJob_t *boot_job = onvif_job_new(dev, SOAP_ACTION_ID_DEVICE_GETCAPABILITIES, NULL, NULL, NULL);
+				if (boot_job)
+				{
+					boot_job->isboot = 1;
+					dev->state = ONVIF_DEV_STATE_ID_CAPABILITIES;
+					clist_push(onvif_pool->job_list, boot_job);
+				}
+			}
+		}
+		SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+
+		onvif_pool_dispatch(onvif_pool);
+		ret = 0;
+	}
+
+	return ret;
+}
+
+OnvifDev_t *onvif_dev_add(OnvifPool_t *onvif_pool, char *url, char *user, char *pass, int http_auth)
+{
+	if ((onvif_pool == NULL) || (url == NULL))
+	{
+		return NULL;
+	}
+
+	OnvifDev_t *dev = (OnvifDev_t *)SAFE_CALLOC(1, sizeof(OnvifDev_t));
+	if (dev)
+	{
+		dev->onvif_pool = onvif_pool;
+		SAFE_SPRINTF_EX(dev->netinfo.url, "%s", url);
+		SAFE_SPRINTF_EX(dev->netinfo.user, "%s", (user) ? user : "");
+		SAFE_SPRINTF_EX(dev->netinfo.pass, "%s", (pass) ? pass : "");
+		dev->http_auth = http_auth;
+
+		dev->state = ONVIF_DEV_STATE_ID_NONE;
+		dev->service.ver = ONVIF_STRUCT_VER;
+		dev->service.prot_id = NET_PROTOCOL_ID_ONVIF;
+		CLIST_STRUCT_INIT(dev, parked_list);
+
+		SAFE_THREAD_LOCK(&onvif_pool->in_mtx);
+		clist_add(onvif_pool->dev_list, dev);
+		SAFE_THREAD_UNLOCK(&onvif_pool->in_mtx);
+	}
+	return dev;
+}
+
+void onvif_pool_close(OnvifPool_t *onvif_pool)
+{
+	if ((onvif_pool) && (onvif_pool->isfree == 0))
+	{
+		onvif_pool->isfree ++;
+
+		// the running ones are aborted, and the waiting ones fail inside onvif_pool_dispatch
+		http_pool_close(onvif_pool->http_pool);
+		onvif_pool->http_pool = NULL;
+		onvif_pool_dispatch(onvif_pool);
+
+		OnvifDev_t *dev = NULL;
+		while ((dev = (OnvifDev_t *)clist_pop(onvif_pool->dev_list)) != NULL)
+		{
+			OnvifJob_t *job = NULL;
+			while ((job = (OnvifJob_t *)clist_pop(dev->parked_list)) != NULL)
+			{
+				onvif_job_finish(job, NULL);
+			}
+			SAFE_FREE(dev);
+		}
+
+		int idx = 0;
+		for (idx = 0; idx < SOAP_ACTION_ID_MAX; idx++)
+		{
+			soap_tmpl_free(onvif_pool->tmpl_ary[idx]);
+		}
+
+		SAFE_MUTEX_DESTROY(&onvif_pool->in_mtx);
+		SAFE_FREE(onvif_pool);
+	}
+}
+
+// max_inflight: 0 for MAX_OF_ONVIF_INFLIGHT
+OnvifPool_t *onvif_pool_init(char *name, int max_inflight)
+{
+	OnvifPool_t *onvif_pool = (OnvifPool_t *)SAFE_CALLOC(1, sizeof(OnvifPool_t));
+
+	if (onvif_pool)
+	{
+		SAFE_SPRINTF_EX(onvif_pool->name, "%s", name);
+		onvif_pool->max_inflight = (max_inflight > 0) ? max_inflight : MAX_OF_ONVIF_INFLIGHT;
+
+		SAFE_MUTEX_ATTR_RECURSIVE(onvif_pool->in_mtx);
+		CLIST_STRUCT_INIT(onvif_pool, job_list);
+		CLIST_STRUCT_INIT(onvif_pool, dev_list);
+
+		onvif_pool->http_pool = http_pool_init(onvif_pool->name, 1);
+		if (onvif_pool->http_pool == NULL)
+		{
+			SAFE_MUTEX_DESTROY(&onvif_pool->in_mtx);
+			SAFE_FREE(onvif_pool);
+		}
+	}
+	return onvif_pool;
+}
@@ -629,6 +629,41 @@ void qtask_process(TaskInfo_t *task)
 
 }
 
+static void onvif_async_response_cb(OnvifDev_t *dev, SOAP_ACTION_ID act_id, soap_node_t *response_node, void *userdata)
+{
+	if (response_node)
+	{
+		soap_node_t *Uri_node = soap_element_fetch(response_node, NULL, "Uri", NULL, NULL);
+		DBG_IF_LN("(url: %s, act_id: %d, profiletoken: %s, Uri: %s)", dev->netinfo.url, act_id, dev->service.media.profiletoken, soap_element_text(Uri_node, NULL));
+	}
+	else
+	{
+		DBG_ER_LN("%s (url: %s, act_id: %d)", DBG_TXT_NO_SUPPORT, dev->netinfo.url, act_id);
+	}
+}
+
+void onvif_async_cameras(int duration)
+{
+	// the services and profiles of each device are fetched only once
+	OnvifPool_t *onvif_pool = onvif_pool_init("onvif", 0);
+	if (onvif_pool)
+	{
+		OnvifDev_t *dev_ary[2];
+		dev_ary[0] = onvif_dev_add(onvif_pool, "http://192.168.50.21/onvif/device_service", srv_user, srv_pass, http_auth);
+		dev_ary[1] = onvif_dev_add(onvif_pool, "http://192.168.50.238/onvif/device_service", srv_user, srv_pass, http_auth);
+
+		int idx = 0;
+		for (idx = 0; idx < 2; idx++)
+		{
+			onvif_request_async(dev_ary[idx], SOAP_ACTION_ID_MEDIA_GETSTREAMURI, NULL, onvif_async_response_cb, NULL);
+			onvif_request_async(dev_ary[idx], SOAP_ACTION_ID_MEDIA_GETSNAPSHOTURI, NULL, onvif_async_response_cb, NULL);
+		}
+
+		sleep(duration);
+		onvif_pool_close(onvif_pool);
+	}
+}
+
 static int qtask_exec_cb(void *arg)
 {
 	TaskInfo_t *data_pop = (TaskInfo_t *)arg;
@@ -853,6 +888,10 @@ int main(int argc, char* argv[])
 	if (result == 0)
 #endif
 	{
+#if (0)
+		onvif_async_cameras(5);
+#endif
+
 		qtask = queuex_thread_init("qtask", MAX_OF_TASK, sizeof(TaskInfo_t), qtask_exec_cb, NULL);
 		usleep(500*1000);
 
@@ -0,0 +1,657 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "utilx9.h"
+
+#ifdef UTIL_EX_POOLX
+// the magazine layer of Bonwick's slab allocator.
+// every thread keeps two magazines (loaded and previous) of every class, poolx_calloc and
+// poolx_free only touch them. when both are empty (or full), the thread visits the depot of
+// the class, which exchanges whole magazines and carves new objects from slabs.
+// every object starts with PoolXHdr_t, poolx_free finds its class there.
+// with -fsanitize=address everything goes to calloc, the pools would hide use-after-free.
+
+// gcc defines __SANITIZE_ADDRESS__, clang only has __has_feature(address_sanitizer)
+#if defined(__SANITIZE_ADDRESS__)
+#define POOLX_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define POOLX_ASAN
+#endif
+#endif
+
+#define POOLX_MAGIC 0x706F6F6C // pool
+#define POOLX_MAGIC_FREE 0x66726565 // free
+
+typedef struct PoolXHdr_Struct
+{
+	uint32_t magic;
+	int32_t class_idx; // -1: above the classes, from calloc
+	void *next; // free_list of the depot
+} __attribute__((aligned(LEN_OF_POOLX_HDR))) PoolXHdr_t;
+
+typedef struct PoolXMag_Struct
+{
+	struct PoolXMag_Struct *next;
+	int rounds;
+	void *round_ary[MAX_OF_POOLX_ROUNDS];
+} PoolXMag_t;
+
+typedef struct PoolXCache_Struct
+{
+	struct PoolXCache_Struct *next; // cache_list of the class
+
+	int isjoin;
+	PoolXMag_t *loaded;
+	PoolXMag_t *previous;
+
+	int64_t live; // allocs - frees of the owner, it might be negative
+	uint64_t allocs;
+} PoolXCache_t;
+
+typedef struct PoolXClass_Struct
+{
+	pthread_mutex_t mtx;
+	size_t obj_size; // the header included
+
+	PoolXMag_t *full_list; // full or partially filled
+	PoolXMag_t *empty_list;
+	PoolXHdr_t *free_list; // no magazine was available
+	uint64_t depot;
+
+	void *slab_list;
+	char *slab_cur;
+	size_t slab_left;
+	uint64_t slabs;
+
+	PoolXCache_t *cache_list;
+	int64_t live_exited;
+	uint64_t allocs_exited;
+	int64_t high_water;
+
+#ifdef UTIL_EX_METRICX
+	MetricX_t *live_gauge;
+	MetricX_t *high_water_gauge;
+#endif
+} PoolXClass_t;
+
+static size_t poolx_class_size_ary[MAX_OF_POOLX_CLASS] = { 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 640, 768, 1024, 1280, 1536, 2048, 2560, 3072, 4096 };
+static PoolXClass_t poolx_class_ary[MAX_OF_POOLX_CLASS];
+
+static int64_t poolx_big_live = 0;
+static int64_t poolx_big_high_water = 0;
+static uint64_t poolx_big_allocs = 0;
+
+static pthread_once_t poolx_once = PTHREAD_ONCE_INIT;
+static pthread_key_t poolx_key;
+
+static __thread PoolXCache_t *poolx_cache_ary = NULL; // MAX_OF_POOLX_CLASS
+
+static int poolx_class_idx(size_t len)
+{
+#ifndef POOLX_ASAN
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_POOLX_CLASS; idx++)
+	{
+		if (len <= poolx_class_size_ary[idx])
+		{
+			return idx;
+		}
+	}
+#endif
+	return -1;
+}
+
+// only the owner writes, poolx_class_live and poolx_stat read it
+#define POOLX_OWNER_ADD(val, diff) __atomic_store_n(&(val), (val) + (diff), __ATOMIC_RELAXED)
+
+// ** depot, class->mtx is held **
+static int64_t poolx_class_live(PoolXClass_t *class, int *threads)
+{
+	int64_t live = class->live_exited;
+	int count = 0;
+	PoolXCache_t *cache = NULL;
+	for (cache = class->cache_list; cache != NULL; cache = cache->next)
+	{
+		live += __atomic_load_n(&cache->live, __ATOMIC_RELAXED);
+		count++;
+	}
+	if (threads)
+	{
+		*threads = count;
+	}
+	return live;
+}
+
+static void poolx_class_sample(PoolXClass_t *class)
+{
+	int64_t live = poolx_class_live(class, NULL);
+	if (live > class->high_water)
+	{
+		class->high_water = live;
+	}
+#ifdef UTIL_EX_METRICX
+	metricx_gauge_set(class->live_gauge, live);
+	metricx_gauge_set(class->high_water_gauge, class->high_water);
+#endif
+}
+
+static PoolXMag_t *poolx_mag_get(PoolXClass_t *class)
+{
+	PoolXMag_t *mag = class->empty_list;
+	if (mag)
+	{
+		class->empty_list = mag->next;
+		mag->next = NULL;
+	}
+	else
+	{
+		mag = (PoolXMag_t *)SAFE_CALLOC(1, sizeof(PoolXMag_t));
+	}
+	return mag;
+}
+
+static void poolx_mag_put(PoolXClass_t *class, PoolXMag_t *mag)
+{
+	if (mag)
+	{
+		if (mag->rounds > 0)
+		{
+			mag->next = class->full_list;
+			class->full_list = mag;
+			class->depot += mag->rounds;
+		}
+		else
+		{
+			mag->next = class->empty_list;
+			class->empty_list = mag;
+		}
+	}
+}
+
+static PoolXMag_t *poolx_mag_full(PoolXClass_t *class)
+{
+	PoolXMag_t *mag = class->full_list;
+	if (mag)
+	{
+		class->full_list = mag->next;
+		class->depot -= mag->rounds;
+		mag->next = NULL;
+	}
+	return mag;
+}
+
+static PoolXHdr_t *poolx_slab_carve(PoolXClass_t *class)
+{
+	PoolXHdr_t *hdr = class->free_list;
+	if (hdr)
+	{
+		class->free_list = (PoolXHdr_t *)hdr->next;
+		class->depot--;
+		return hdr;
+	}
+
+	if (class->slab_left < class->obj_size)
+	{
+		char *slab = (char *)SAFE_CALLOC(1, LEN_OF_POOLX_SLAB);
+		if (slab == NULL)
+		{
+			DBG_ER_LN("SAFE_CALLOC error !!! (obj_size: %zd)", class->obj_size);
+			return NULL;
+		}
+		*(void **)slab = class->slab_list;
+		class->slab_list = slab;
+		class->slab_cur = slab + LEN_OF_POOLX_HDR;
+		class->slab_left = LEN_OF_POOLX_SLAB - LEN_OF_POOLX_HDR;
+		class->slabs++;
+	}
+
+	hdr = (PoolXHdr_t *)class->slab_cur;
+	class->slab_cur += class->obj_size;
+	class->slab_left -= class->obj_size;
+	return hdr;
+}
+
+static void poolx_cache_join(PoolXClass_t *class, PoolXCache_t *cache)
+{
+	if (cache->isjoin == 0)
+	{
+		cache->isjoin = 1;
+		cache->next = class->cache_list;
+		class->cache_list = cache;
+
+#ifdef UTIL_EX_METRICX
+		if (class->live_gauge == NULL)
+		{
+			char labels[LEN_OF_METRICX_LABELS] = "";
+			SAFE_SPRINTF_EX(labels, "size=\"%zd\"", class->obj_size - LEN_OF_POOLX_HDR);
+			class->live_gauge = metricx_gauge_new("poolx_live", "objects allocated by poolx_calloc and not freed", labels);
+			class->high_water_gauge = metricx_gauge_new("poolx_high_water", "max. of poolx_live", labels);
+		}
+#endif
+	}
+
+	if (cache->loaded == NULL)
+	{
+		cache->loaded = poolx_mag_get(class);
+	}
+	if (cache->previous == NULL)
+	{
+		cache->previous = poolx_mag_get(class);
+	}
+}
+
+static void poolx_cache_leave(PoolXClass_t *class, PoolXCache_t *cache)
+{
+	poolx_mag_put(class, cache->loaded);
+	poolx_mag_put(class, cache->previous);
+	cache->loaded = NULL;
+	cache->previous = NULL;
+
+	class->live_exited += cache->live;
+	class->allocs_exited += cache->allocs;
+	cache->live = 0;
+	cache->allocs = 0;
+
+	PoolXCache_t **prev = &class->cache_list;
+	while (*prev)
+	{
+		if (*prev == cache)
+		{
+			*prev = cache->next;
+			break;
+		}
+		prev = &(*prev)->next;
+	}
+	cache->next = NULL;
+	cache->isjoin = 0;
+}
+
+// loaded and previous are empty
+static PoolXHdr_t *poolx_depot_alloc(PoolXClass_t *class, PoolXCache_t *cache)
+{
+	PoolXHdr_t *hdr = NULL;
+
+	SAFE_THREAD_LOCK(&class->mtx);
+	poolx_cache_join(class, cache);
+
+	if ((cache->loaded) && (class->full_list))
+	{
+		poolx_mag_put(class, cache->previous);
+		cache->previous = cache->loaded;
+		cache->loaded = poolx_mag_full(class);
+	}
+
+	PoolXMag_t *mag = cache->loaded;
+	if (mag)
+	{
+		while (mag->rounds < MAX_OF_POOLX_ROUNDS)
+		{
+			PoolXHdr_t *obj = poolx_slab_carve(class);
+			if (obj == NULL)
+			{
+				break;
+			}
+			mag->round_ary[mag->rounds++] = obj;
+		}
+		if (mag->rounds > 0)
+		{
+			hdr = (PoolXHdr_t *)mag->round_ary[--mag->rounds];
+		}
+	}
+	else
+	{
+		hdr = poolx_slab_carve(class);
+	}
+
+	if (hdr)
+	{
+		POOLX_OWNER_ADD(cache->allocs, 1);
+		POOLX_OWNER_ADD(cache->live, 1);
+	}
+	poolx_class_sample(class);
+	SAFE_THREAD_UNLOCK(&class->mtx);
+
+	return hdr;
+}
+
+// loaded is full, previous isn't empty. cache: NULL, the thread has no cache
+static void poolx_depot_free(PoolXClass_t *class, PoolXCache_t *cache, PoolXHdr_t *hdr)
+{
+	SAFE_THREAD_LOCK(&class->mtx);
+	PoolXMag_t *mag = NULL;
+	if (cache)
+	{
+		poolx_cache_join(class, cache);
+
+		if ((cache->loaded) && (cache->loaded->rounds >= MAX_OF_POOLX_ROUNDS))
+		{
+			poolx_mag_put(class, cache->previous);
+			cache->previous = cache->loaded;
+			cache->loaded = poolx_mag_get(class);
+		}
+		mag = cache->loaded;
+		POOLX_OWNER_ADD(cache->live, -1);
+	}
+	else
+	{
+		class->live_exited--;
+	}
+
+	if ((mag) && (mag->rounds < MAX_OF_POOLX_ROUNDS))
+	{
+		mag->round_ary[mag->rounds++] = hdr;
+	}
+	else
+	{
+		hdr->next = class->free_list;
+		class->free_list = hdr;
+		class->depot++;
+	}
+	poolx_class_sample(class);
+	SAFE_THREAD_UNLOCK(&class->mtx);
+}
+
+// ** thread cache **
+static void poolx_cache_exit(void *arg)
+{
+	PoolXCache_t *cache_ary = (PoolXCache_t *)arg;
+	if (cache_ary == poolx_cache_ary)
+	{
+		poolx_cache_ary = NULL;
+	}
+
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_POOLX_CLASS; idx++)
+	{
+		PoolXCache_t *cache = &cache_ary[idx];
+		if (cache->isjoin)
+		{
+			PoolXClass_t *class = &poolx_class_ary[idx];
+			SAFE_THREAD_LOCK(&class->mtx);
+			poolx_cache_leave(class, cache);
+			SAFE_THREAD_UNLOCK(&class->mtx);
+		}
+	}
+	SAFE_FREE(cache_ary);
+}
+
+static void poolx_once_init(void)
+{
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_POOLX_CLASS; idx++)
+	{
+		PoolXClass_t *class = &poolx_class_ary[idx];
+		pthread_mutex_init(&class->mtx, NULL);
+		class->obj_size = poolx_class_size_ary[idx];
+	}
+	pthread_key_create(&poolx_key, poolx_cache_exit);
+}
+
+static PoolXCache_t *poolx_cache_get(int class_idx)
+{
+	if (poolx_cache_ary == NULL)
+	{
+		pthread_once(&poolx_once, poolx_once_init);
+
+		poolx_cache_ary = (PoolXCache_t *)SAFE_CALLOC(MAX_OF_POOLX_CLASS, sizeof(PoolXCache_t));
+		if (poolx_cache_ary == NULL)
+		{
+			return NULL;
+		}
+		pthread_setspecific(poolx_key, poolx_cache_ary);
+	}
+	return &poolx_cache_ary[class_idx];
+}
+
+// ** api **
+void *poolx_calloc(size_t nitems, size_t size)
+{
+	if ((size) && (nitems > (SIZE_MAX - LEN_OF_POOLX_HDR) / size))
+	{
+		return NULL;
+	}
+
+	size_t len = nitems * size;
+	PoolXHdr_t *hdr = NULL;
+	int class_idx = poolx_class_idx(len + LEN_OF_POOLX_HDR);
+	PoolXCache_t *cache = (class_idx >= 0) ? poolx_cache_get(class_idx) : NULL;
+
+	if (cache)
+	{
+		PoolXMag_t *mag = cache->loaded;
+		if ((mag == NULL) || (mag->rounds == 0))
+		{
+			if ((cache->previous) && (cache->previous->rounds > 0))
+			{
+				cache->loaded = cache->previous;
+				cache->previous = mag;
+				mag = cache->loaded;
+			}
+			else
+			{
+				mag = NULL;
+			}
+		}
+
+		if (mag)
+		{
+			hdr = (PoolXHdr_t *)mag->round_ary[--mag->rounds];
+			POOLX_OWNER_ADD(cache->allocs, 1);
+			POOLX_OWNER_ADD(cache->live, 1);
+		}
+		else
+		{
+			hdr = poolx_depot_alloc(&poolx_class_ary[class_idx], cache);
+		}
+
+		if (hdr)
+		{
+			SAFE_MEMSET(hdr + 1, 0, len);
+		}
+	}
+	else
+	{
+		class_idx = -1;
+		hdr = (PoolXHdr_t *)SAFE_CALLOC(1, LEN_OF_POOLX_HDR + len);
+		if (hdr)
+		{
+			int64_t live = __atomic_add_fetch(&poolx_big_live, 1, __ATOMIC_RELAXED);
+			int64_t high_water = __atomic_load_n(&poolx_big_high_water, __ATOMIC_RELAXED);
+			while ((live > high_water) && (!__atomic_compare_exchange_n(&poolx_big_high_water, &high_water, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)));
+			__atomic_add_fetch(&poolx_big_allocs, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (hdr == NULL)
+	{
+		return NULL;
+	}
+
+	hdr->magic = POOLX_MAGIC;
+	hdr->class_idx = class_idx;
+	hdr->next = NULL;
+	return (void *)(hdr + 1);
+}
+
+void poolx_free(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		return;
+	}
+
+	PoolXHdr_t *hdr = (PoolXHdr_t *)ptr - 1;
+	if (hdr->magic != POOLX_MAGIC)
+	{
+		// leaked rather than corrupted
+		DBG_ER_LN("%s !!! (ptr: %p, magic: 0x%08X)", (hdr->magic == POOLX_MAGIC_FREE) ? "double free" : "not from poolx_calloc", ptr, hdr->magic);
+		return;
+	}
+	hdr->magic = POOLX_MAGIC_FREE;
+
+	int class_idx = hdr->class_idx;
+	if ((class_idx < 0) || (class_idx >= MAX_OF_POOLX_CLASS))
+	{
+		__atomic_sub_fetch(&poolx_big_live, 1, __ATOMIC_RELAXED);
+		SAFE_FREE(hdr);
+		return;
+	}
+
+	PoolXCache_t *cache = poolx_cache_get(class_idx);
+	if (cache)
+	{
+		PoolXMag_t *mag = cache->loaded;
+		if ((mag == NULL) || (mag->rounds >= MAX_OF_POOLX_ROUNDS))
+		{
+			if ((cache->previous) && (cache->previous->rounds == 0))
+			{
+				cache->loaded = cache->previous;
+				cache->previous = mag;
+				mag = cache->loaded;
+			}
+			else
+			{
+				mag = NULL;
+			}
+		}
+
+		if (mag)
+		{
+			mag->round_ary[mag->rounds++] = hdr;
+			POOLX_OWNER_ADD(cache->live, -1);
+			return;
+		}
+	}
+
+	poolx_depot_free(&poolx_class_ary[class_idx], cache, hdr);
+}
+
+int poolx_stat(int idx, PoolXStat_t *stat)
+{
+	if ((stat == NULL) || (idx < 0) || (idx > MAX_OF_POOLX_CLASS))
+	{
+		return -1;
+	}
+
+	pthread_once(&poolx_once, poolx_once_init);
+	SAFE_MEMSET(stat, 0, sizeof(PoolXStat_t));
+	if (idx == MAX_OF_POOLX_CLASS)
+	{
+		stat->live = __atomic_load_n(&poolx_big_live, __ATOMIC_RELAXED);
+		stat->high_water = __atomic_load_n(&poolx_big_high_water, __ATOMIC_RELAXED);
+		stat->allocs = __atomic_load_n(&poolx_big_allocs, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	PoolXClass_t *class = &poolx_class_ary[idx];
+	SAFE_THREAD_LOCK(&class->mtx);
+	stat->obj_size = class->obj_size - LEN_OF_POOLX_HDR;
+	stat->live = poolx_class_live(class, &stat->threads);
+	if (stat->live > class->high_water)
+	{
+		class->high_water = stat->live;
+	}
+	stat->high_water = class->high_water;
+	stat->allocs = class->allocs_exited;
+	PoolXCache_t *cache = NULL;
+	for (cache = class->cache_list; cache != NULL; cache = cache->next)
+	{
+		stat->allocs += __atomic_load_n(&cache->allocs, __ATOMIC_RELAXED);
+	}
+	stat->slabs = class->slabs;
+	stat->depot = class->depot;
+	SAFE_THREAD_UNLOCK(&class->mtx);
+
+	return 0;
+}
+
+void poolx_print(void)
+{
+	int idx = 0;
+	for (idx = 0; idx <= MAX_OF_POOLX_CLASS; idx++)
+	{
+		PoolXStat_t stat;
+		if ((poolx_stat(idx, &stat) == 0) && (stat.allocs > 0))
+		{
+			DBG_IF_LN("(obj_size: %4zd, live: %lld, high_water: %lld, allocs: %llu, slabs: %llu, depot: %llu, threads: %d)", stat.obj_size, (long long)stat.live, (long long)stat.high_water, (unsigned long long)stat.allocs, (unsigned long long)stat.slabs, (unsigned long long)stat.depot, stat.threads);
+		}
+	}
+}
+
+void poolx_close(void)
+{
+	pthread_once(&poolx_once, poolx_once_init);
+
+	if (poolx_cache_ary)
+	{
+		pthread_setspecific(poolx_key, NULL);
+		poolx_cache_exit(poolx_cache_ary);
+	}
+
+	int idx = 0;
+	for (idx = 0; idx < MAX_OF_POOLX_CLASS; idx++)
+	{
+		PoolXClass_t *class = &poolx_class_ary[idx];
+		SAFE_THREAD_LOCK(&class->mtx);
+		int threads = 0;
+		int64_t live = poolx_class_live(class, &threads);
+		if ((live != 0) || (threads > 0))
+		{
+			DBG_WN_LN("the class is kept !!! (obj_size: %zd, live: %lld, threads: %d)", class->obj_size - LEN_OF_POOLX_HDR, (long long)live, threads);
+		}
+		else
+		{
+			PoolXMag_t *mag = NULL;
+			while ((mag = poolx_mag_full(class)) != NULL)
+			{
+				SAFE_FREE(mag);
+			}
+			while (class->empty_list)
+			{
+				mag = class->empty_list;
+				class->empty_list = mag->next;
+				SAFE_FREE(mag);
+			}
+			while (class->slab_list)
+			{
+				void *slab = class->slab_list;
+				class->slab_list = *(void **)slab;
+				SAFE_FREE(slab);
+			}
+			class->free_list = NULL;
+			class->depot = 0;
+			class->slab_cur = NULL;
+			class->slab_left = 0;
+			class->slabs = 0;
+			class->live_exited = 0;
+			class->allocs_exited = 0;
+			class->high_water = 0;
+#ifdef UTIL_EX_METRICX
+			metricx_free(class->live_gauge);
+			metricx_free(class->high_water_gauge);
+			class->live_gauge = NULL;
+			class->high_water_gauge = NULL;
+#endif
+		}
+		SAFE_THREAD_UNLOCK(&class->mtx);
+	}
+
+	int64_t live = __atomic_load_n(&poolx_big_live, __ATOMIC_RELAXED);
+	if (live != 0)
+	{
+		DBG_WN_LN("not freed !!! (big, live: %lld)", (long long)live);
+	}
+}
+#endif
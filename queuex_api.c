@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_QUEUEX
 #include "utilx9.h"
 
 #define DBG_TMP_Y(format,args...) //DBG_LN_Y(format, ## args)
@@ -22,7 +23,10 @@ typedef struct QItem_Struct
 {
 	void* next;
 
-	void *data; // queue_api will alloc and free it
+	void *data; // follows the item, one SAFE_POOLX_CALLOC
+#ifdef UTIL_EX_TRACEX
+	unsigned long long t_add; // TRACEX_NOW(), enqueue -> dequeue
+#endif
 } QItem_t;
 #endif
 
@@ -91,6 +95,7 @@ static void queuex_create(QueueX_t *queuex_req)
 	queuex_req->datas = SAFE_CALLOC(queuex_req->queue_size, queuex_req->data_size);
 #endif
 	queuex_req->data_pop = SAFE_CALLOC(1, queuex_req->data_size);
+	queuex_req->max_pop = 1;
 }
 
 void queuex_free(QueueX_t *queuex_req)
@@ -109,8 +114,7 @@ void queuex_free(QueueX_t *queuex_req)
 				{
 					queuex_req->free_cb(qitem->data);
 				}
-				SAFE_FREE(qitem->data);
-				SAFE_FREE(qitem);
+				SAFE_POOLX_FREE(qitem);
 			}
 		}
 		clist_free(queuex_req->qlist);
@@ -130,6 +134,9 @@ void queuex_free(QueueX_t *queuex_req)
 		SAFE_FREE(queuex_req->datas);
 #endif
 		SAFE_FREE(queuex_req->data_pop);
+#ifdef UTIL_EX_METRICX
+		metricx_gauge_set(queuex_req->metric.depth, 0);
+#endif
 
 		queuex_unlock(queuex_req);
 	}
@@ -257,17 +264,48 @@ void queuex_wakeup(QueueX_t *queuex_req)
 	queuex_unlock(queuex_req);
 }
 
-void queuex_add(QueueX_t *queuex_req, void *data_new)
+// pop up to max_batch items per lock, exec_cb is still called one by one
+void queuex_batch(QueueX_t *queuex_req, int max_batch)
 {
 	if (queuex_req==NULL)
 	{
 		return;
 	}
+
+	queuex_lock(queuex_req);
+	queuex_req->max_batch = (max_batch > 1) ? max_batch : 1;
+	queuex_unlock(queuex_req);
+}
+
+#ifdef UTIL_EX_CLIST
+static QItem_t *queuex_item_new(QueueX_t *queuex_req, void *data_new)
+{
+	QItem_t *qitem = (QItem_t*)SAFE_POOLX_CALLOC(1, sizeof(QItem_t) + queuex_req->data_size);
+	if (qitem)
+	{
+		qitem->data = (void*)(qitem + 1);
+		SAFE_MEMCPY(qitem->data, data_new, queuex_req->data_size, queuex_req->data_size);
+#ifdef UTIL_EX_TRACEX
+		qitem->t_add = TRACEX_NOW();
+#endif
+	}
+	return qitem;
+}
+#endif
+
+int queuex_add(QueueX_t *queuex_req, void *data_new)
+{
+	if (queuex_req==NULL)
+	{
+		return -1;
+	}
 	if (queuex_isloop(queuex_req)==0)
 	{
-		return;
+		return -1;
 	}
 
+	int ret = -1;
+
 	queuex_lock(queuex_req);
 	if (queuex_req->dbg_more < DBG_LVL_MAX)
 	{
@@ -277,34 +315,54 @@ void queuex_add(QueueX_t *queuex_req, void *data_new)
 	if ((queuex_isquit(queuex_req)== 0) && (!queuex_isfull(queuex_req)))
 	{
 #ifdef UTIL_EX_CLIST
-		QItem_t *qitem = (QItem_t*)SAFE_CALLOC(1, sizeof(QItem_t));
-		qitem->data = (void*)SAFE_CALLOC(1, queuex_req->data_size);
-		SAFE_MEMCPY(qitem->data, data_new, queuex_req->data_size, queuex_req->data_size);
-		clist_add(queuex_req->qlist, qitem);
+		QItem_t *qitem = queuex_item_new(queuex_req, data_new);
+		if (qitem)
+		{
+			clist_add(queuex_req->qlist, qitem);
+			ret = 0;
+		}
 #else
 		// No support !!!
 #endif
+	}
 
+	if (ret == 0)
+	{
 		DBG_TR_LN("(clist_length: %d)", clist_length(queuex_req->qlist));
+#ifdef UTIL_EX_METRICX
+		metricx_counter_add(queuex_req->metric.adds, 1);
+		metricx_gauge_add(queuex_req->metric.depth, 1);
+#endif
 		if (queuex_req->ishold == 0)
 		{
 			queuex_signal(queuex_req);
 		}
 	}
+#ifdef UTIL_EX_METRICX
+	else
+	{
+		// full, quitting or out of memory
+		metricx_counter_add(queuex_req->metric.drops, 1);
+	}
+#endif
 	queuex_unlock(queuex_req);
+
+	return ret;
 }
 
-void queuex_push(QueueX_t *queuex_req, void *data_new)
+int queuex_push(QueueX_t *queuex_req, void *data_new)
 {
 	if (queuex_req==NULL)
 	{
-		return;
+		return -1;
 	}
 	if (queuex_isloop(queuex_req)==0)
 	{
-		return;
+		return -1;
 	}
 
+	int ret = -1;
+
 	queuex_lock(queuex_req);
 	if (queuex_req->dbg_more < DBG_LVL_MAX)
 	{
@@ -314,10 +372,12 @@ void queuex_push(QueueX_t *queuex_req, void *data_new)
 	if ((queuex_isquit(queuex_req)== 0) && (!queuex_isfull(queuex_req)))
 	{
 #ifdef UTIL_EX_CLIST
-		QItem_t *qitem = (QItem_t*)SAFE_CALLOC(1, sizeof(QItem_t));
-		qitem->data = (void*)SAFE_CALLOC(1, queuex_req->data_size);
-		SAFE_MEMCPY(qitem->data, data_new, queuex_req->data_size, queuex_req->data_size);
-		clist_push(queuex_req->qlist, qitem);
+		QItem_t *qitem = queuex_item_new(queuex_req, data_new);
+		if (qitem)
+		{
+			clist_push(queuex_req->qlist, qitem);
+			ret = 0;
+		}
 #else
 		queuex_req->tail_pos++;
 		queuex_req->tail_pos %= queuex_req->max_data;
@@ -325,14 +385,31 @@ void queuex_push(QueueX_t *queuex_req, void *data_new)
 		void *datas = (void *)queuex_req->datas;
 		SAFE_MEMSET(datas + (queuex_req->tail_pos*queuex_req->data_size), 0, queuex_req->data_size);
 		SAFE_MEMCPY(datas + (queuex_req->tail_pos*queuex_req->data_size), data_new, queuex_req->data_size, queuex_req->data_size);
+		ret = 0;
 #endif
+	}
 
+	if (ret == 0)
+	{
+#ifdef UTIL_EX_METRICX
+		metricx_counter_add(queuex_req->metric.adds, 1);
+		metricx_gauge_add(queuex_req->metric.depth, 1);
+#endif
 		if (queuex_req->ishold == 0)
 		{
 			queuex_signal(queuex_req);
 		}
 	}
+#ifdef UTIL_EX_METRICX
+	else
+	{
+		// full, quitting or out of memory
+		metricx_counter_add(queuex_req->metric.drops, 1);
+	}
+#endif
 	queuex_unlock(queuex_req);
+
+	return ret;
 }
 
 static void queuex_pop(QueueX_t *queuex_req)
@@ -343,8 +420,6 @@ static void queuex_pop(QueueX_t *queuex_req)
 		return;
 	}
 
-	void *data_pop = (void *)queuex_req->data_pop;
-
 	//int old = clist_length(queuex_req->qlist);
 	queuex_lock(queuex_req);
 	if (queuex_req->dbg_more < DBG_LVL_MAX)
@@ -354,14 +429,33 @@ static void queuex_pop(QueueX_t *queuex_req)
 
 	if ((queuex_isquit(queuex_req) == 0) && (queuex_req->ishold == 0) && (queuex_isempty(queuex_req) != 1))
 	{
-		SAFE_MEMSET(data_pop, 0, queuex_req->data_size);
+		int max_batch = (queuex_req->max_batch > 1) ? queuex_req->max_batch : 1;
+		if (max_batch > queuex_req->max_pop)
+		{
+			SAFE_FREE(queuex_req->data_pop);
+			queuex_req->data_pop = SAFE_CALLOC(max_batch, queuex_req->data_size);
+			queuex_req->max_pop = max_batch;
+		}
 
 #ifdef UTIL_EX_CLIST
-		QItem_t *qitem = (QItem_t *)clist_pop(queuex_req->qlist);
-		SAFE_MEMCPY(data_pop, qitem->data, queuex_req->data_size, queuex_req->data_size);
-		SAFE_FREE(qitem->data);
-		SAFE_FREE(qitem);
+		while ((exec < max_batch) && (clist_length(queuex_req->qlist) > 0))
+		{
+			void *data_pop = (void *)queuex_req->data_pop + (exec*queuex_req->data_size);
+			SAFE_MEMSET(data_pop, 0, queuex_req->data_size);
+
+			QItem_t *qitem = (QItem_t *)clist_pop(queuex_req->qlist);
+			SAFE_MEMCPY(data_pop, qitem->data, queuex_req->data_size, queuex_req->data_size);
+#ifdef UTIL_EX_TRACEX
+			TRACEX_ASYNC("queuex", "queuex_wait", qitem, qitem->t_add);
+#endif
+			SAFE_POOLX_FREE(qitem);
+
+			exec++;
+		}
 #else
+		void *data_pop = (void *)queuex_req->data_pop;
+		SAFE_MEMSET(data_pop, 0, queuex_req->data_size);
+
 		void *datas = (void *)queuex_req->datas;
 
 		queuex_req->head_pos++;
@@ -369,9 +463,12 @@ static void queuex_pop(QueueX_t *queuex_req)
 
 		SAFE_MEMCPY(data_pop, datas + (queuex_req->head_pos*queuex_req->data_size), queuex_req->data_size, queuex_req->data_size);
 		SAFE_MEMSET(datas + (queuex_req->head_pos*queuex_req->data_size), 0, queuex_req->data_size);
-#endif
 
 		exec = 1;
+#endif
+#ifdef UTIL_EX_METRICX
+		metricx_gauge_add(queuex_req->metric.depth, -exec);
+#endif
 	}
 	else if (queuex_isquit(queuex_req) == 0)
 	{
@@ -379,11 +476,20 @@ static void queuex_pop(QueueX_t *queuex_req)
 	}
 	queuex_unlock(queuex_req);
 
-	if (exec)
+	int idx = 0;
+	for (idx = 0; idx < exec; idx++)
 	{
+		void *data_pop = (void *)queuex_req->data_pop + (idx*queuex_req->data_size);
 		if (queuex_req->exec_cb)
 		{
+			TRACEX_SPAN("queuex", "queuex_exec");
+#ifdef UTIL_EX_METRICX
+			unsigned long long t_start = metricx_now_us();
+			queuex_req->exec_cb(data_pop);
+			metricx_histogram_add(queuex_req->metric.exec_us, metricx_now_us() - t_start);
+#else
 			queuex_req->exec_cb(data_pop);
+#endif
 		}
 		if (queuex_req->free_cb)
 		{
@@ -417,6 +523,30 @@ static void *queuex_thread_handler(void *user)
 	return NULL;
 }
 
+#ifdef UTIL_EX_METRICX
+static void queuex_metric_open(QueueX_t *queuex_req)
+{
+	char labels[LEN_OF_METRICX_LABELS] = "";
+	SAFE_SPRINTF_EX(labels, "name=\"%s\"", queuex_req->name);
+
+	QueueXMetric_t *metric = &queuex_req->metric;
+	metric->depth = metricx_gauge_new("queuex_depth", "items waiting in the queue", labels);
+	metric->adds = metricx_counter_new("queuex_adds_total", "items queued by queuex_add/queuex_push", labels);
+	metric->drops = metricx_counter_new("queuex_drops_total", "items refused, the queue was full or quitting", labels);
+	metric->exec_us = metricx_histogram_new("queuex_exec_us", "exec_cb duration in microseconds", labels);
+}
+
+static void queuex_metric_close(QueueX_t *queuex_req)
+{
+	QueueXMetric_t *metric = &queuex_req->metric;
+	metricx_free(metric->depth);
+	metricx_free(metric->adds);
+	metricx_free(metric->drops);
+	metricx_free(metric->exec_us);
+	SAFE_MEMSET(metric, 0, sizeof(QueueXMetric_t));
+}
+#endif
+
 void queuex_thread_stop(QueueX_t *queuex_req)
 {
 	if (queuex_req)
@@ -435,6 +565,9 @@ void queuex_thread_close(QueueX_t *queuex_req)
 		ThreadX_t *tidx_req = &queuex_req->tidx;
 		threadx_close(tidx_req);
 
+#ifdef UTIL_EX_METRICX
+		queuex_metric_close(queuex_req);
+#endif
 		SAFE_FREE(queuex_req);
 	}
 }
@@ -454,6 +587,9 @@ QueueX_t *queuex_thread_init(char *name, int queue_size, int data_size, queuex_f
 		queuex_req->exec_cb = exec_cb;
 		queuex_req->free_cb = free_cb;
 		queuex_req->dbg_more = DBG_LVL_MAX;
+#ifdef UTIL_EX_METRICX
+		queuex_metric_open(queuex_req);
+#endif
 
 		{
 			ThreadX_t *tidx_req = &queuex_req->tidx;
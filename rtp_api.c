@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_RTP
 #include "utilx9.h"
 
 #define DBG_TMP_Y(format,args...) //DBG_LN_Y(format, ## args)
@@ -32,149 +33,11 @@ int rtp_port_get(void)
 	return rtp_port_g;
 }
 
-// unsigned char Get_Padding(rtp_hdr *rtp_hdr_msg, char *msg, int sz)
-static unsigned char rtp_padding(rtp_hdr *rtp_hdr_msg, char *msg, int sz)
+static unsigned long long rtp_now_us(void)
 {
-	char padding = 0;
-	unsigned char len_padding = 0;
-
-	/*
-	 * Gestion du padding.
-	 */
-	padding = (rtp_hdr_msg->flags & 0x20) >> 5;
-	if (padding)
-	{
-		memcpy(&len_padding, msg + (sz - 1), 1);
-	}
-	else
-	{
-		len_padding = 0;
-	}
-	return (len_padding);
-}
-
-#ifdef DBG_RTP_INFO
-static void rtp_header_print(rtp_pkt *pkt)
-{
-	if (pkt->RTP_header)
-	{
-		DBG_TR_LN("Version       [%d]", (pkt->RTP_header->flags & 0xd0) >> 6);
-		DBG_TR_LN("Padding       [%d]", (pkt->RTP_header->flags & 0x20) >> 5);
-		DBG_TR_LN("Extension     [%d]", (pkt->RTP_header->flags & 0x10) >> 4);
-		DBG_TR_LN("CSRC Count    [%d]", (pkt->RTP_header->flags & 0x0f));
-		DBG_TR_LN("marker        [%d]", (pkt->RTP_header->mk_pt & 0x10) >> 7);
-		DBG_TR_LN("PayLoad type  [%d]", (pkt->RTP_header->mk_pt & 0x7f));
-		DBG_TR_LN("Sequence      [%d]", pkt->RTP_header->sq_nb);
-		DBG_TR_LN("Timestamp     [%u]", pkt->RTP_header->ts);
-		DBG_TR_LN("Sync Source   [0x%08x]", pkt->RTP_header->ssrc);
-		if (pkt->RTP_header->csrc)
-		{
-			DBG_TR_LN("csrc          [%d]", (pkt->RTP_header->csrc[0]));
-		}
-	}
-	if (pkt->RTP_extension)
-	{
-		DBG_TR_LN("ext->type     [%d]", (pkt->RTP_extension->ext_type));
-		DBG_TR_LN("ext->len      [%d]", (pkt->RTP_extension->ext_len));
-		DBG_TR_LN("ext[0]        [%d]", (pkt->RTP_extension->hd_ext[0]));
-		DBG_TR_LN("ext[1]        [%d]", (pkt->RTP_extension->hd_ext[1]));
-	}
-	DBG_TR_LN("len PayLoad   [%d]", pkt->payload_len);
-	//DBG_TR_LN("PayLoad       [%s]\n", pkt->payload);
-}
-#endif
-
-// rtp_pkt	*Get_RTP_Hdr(char *msg, int  sz)
-static rtp_pkt	*rtp_header_parse(char *msg, int  sz)
-{
-	char cc;
-	char ext;
-	unsigned short hdr_sz = 0;
-	unsigned char len_padding = 0;
-
-	int raw_offset = 0;
-
-	rtp_hdr *rtp_hdr_msg = NULL;
-	rtp_ext *rtp_ext_msg = NULL;
-	rtp_pkt *rtp_pkt_msg = NULL;
-
-	/*
-	 * Recuperation du rtp_header.
-	 */
-	//MEM_SALLOC(rtp_hdr_msg, sizeof(rtp_hdr));
-	rtp_hdr_msg = (rtp_hdr*)SAFE_CALLOC(1, sizeof(rtp_hdr));
-	rtp_hdr_msg->flags = msg[raw_offset++];
-	rtp_hdr_msg->mk_pt = msg[raw_offset++];
-	rtp_hdr_msg->sq_nb = (unsigned short)byte2big_endian(2, (unsigned char*)msg+raw_offset);
-	raw_offset += 2;
-	rtp_hdr_msg->ts = byte2big_endian(4, (unsigned char*)msg+raw_offset);
-	raw_offset += 4;
-	rtp_hdr_msg->ssrc = byte2big_endian(4, (unsigned char*)msg+raw_offset);
-	raw_offset += 4;
-
-	hdr_sz = 12;
-
-	/*
-	 * Recuperation du csrc.
-	 */
-	cc = (rtp_hdr_msg->flags) & 0x0f;
-	if (cc)
-	{
-		//MEM_SALLOC(rtp_hdr_msg->csrc, (cc * 4));
-		rtp_hdr_msg->csrc = (unsigned long*)SAFE_CALLOC(1, (cc * 4));
-		int i = 0;
-		for (i = 0 ; i < cc; i++)
-		{
-			rtp_hdr_msg->csrc[i] = byte2big_endian(4, (unsigned char*)msg+raw_offset);
-			raw_offset += 4;
-		}
-		hdr_sz += (cc * 4);
-	}
-
-	/*
-	 * Recuperation de Ext_type et Ext_len, puis des Ext.
-	 */
-	ext = (rtp_hdr_msg->flags & 0x10) >> 4;
-	if (ext)
-	{
-		//MEM_ALLOC(rtp_ext_msg);
-		rtp_ext_msg = (rtp_ext*)SAFE_CALLOC(1, sizeof(rtp_ext));
-		rtp_ext_msg->ext_type = byte2big_endian(2, (unsigned char*)msg+raw_offset);
-		raw_offset += 2;
-		rtp_ext_msg->ext_len = byte2big_endian(2, (unsigned char*)msg+raw_offset);
-		raw_offset += 2;
-
-		//MEM_SALLOC(rtp_ext_msg->hd_ext, 4 * rtp_ext_msg->ext_len);
-		rtp_ext_msg->hd_ext = (unsigned long *)SAFE_CALLOC(1, 4 * rtp_ext_msg->ext_len);
-		int i = 0;
-		for (i = 0; i < rtp_ext_msg->ext_len; i++)
-		{
-			rtp_ext_msg->hd_ext[i] = byte2big_endian(4, (unsigned char*)msg+raw_offset);
-			raw_offset += 4;
-		}
-
-		hdr_sz += (rtp_ext_msg->ext_len * 4) + 4;
-	}
-
-	/*
-	 * Gestion du padding.
-	 */
-	len_padding = rtp_padding(rtp_hdr_msg, msg, sz);
-
-	/*
-	 * Revoie du packet.
-	 */
-	//MEM_ALLOC(rtp_pkt_msg);
-	rtp_pkt_msg = (rtp_pkt*)SAFE_CALLOC(1, sizeof(rtp_pkt));
-	rtp_pkt_msg->RTP_header = rtp_hdr_msg;
-	rtp_pkt_msg->RTP_extension = rtp_ext_msg;
-	rtp_pkt_msg->payload_len = sz - (hdr_sz + len_padding);
-	//MEM_SALLOC(rtp_pkt_msg->payload, rtp_pkt_msg->payload_len);
-
-	rtp_pkt_msg->payload = (char*)SAFE_CALLOC(1, rtp_pkt_msg->payload_len);
-	memcpy(rtp_pkt_msg->payload, msg + hdr_sz, rtp_pkt_msg->payload_len);
-
-	return (rtp_pkt_msg);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
 }
 
 void rtp_context_print(sess_context_t *sess_req)
@@ -195,7 +58,7 @@ void rtp_context_print(sess_context_t *sess_req)
 	DBG_DB_LN("Padding length                   [%d]", sess_req->padding);
 	DBG_DB_LN("CSRC length                      [%d]", sess_req->CSRClen);
 	DBG_DB_LN("Payload type                     [%d]", sess_req->pt);
-	for (i = 0; i < sess_req->CSRClen; i++)
+	for (i = 0; (sess_req->CSRCList) && (i < sess_req->CSRClen); i++)
 	{
 		DBG_DB_LN("CSRC list[%i]                     [%d]", i, sess_req->CSRCList[i]);
 	}
@@ -217,122 +80,483 @@ void rtp_context_print(sess_context_t *sess_req)
 	}
 }
 
-// void	Put_Pkt_in_Context(rtp_pkt *pkt, char *msg, int cid, int sz)
-static void rtp_context_parse(rtp_pkt *pkt, char *msg, int sz)
+// RFC 3550 A.1
+static void rtp_seq_init(RTPStat_t *stat, unsigned short seq)
 {
-	int i;
+	stat->base_seq = seq;
+	stat->max_seq = seq;
+	stat->bad_seq = RTP_SEQ_MOD + 1;
+	stat->cycles = 0;
+	stat->received = 0;
+	stat->expected = 0;
+	stat->lost = 0;
+}
+
+// 0: drop it, 1: ok, 2: the sender restarted
+static int rtp_seq_update(RTPStat_t *stat, unsigned short seq)
+{
+	int ret = 1;
+	unsigned short udelta = seq - stat->max_seq;
 
-	if (pkt == NULL)
+	if (udelta < RTP_MAX_DROPOUT)
 	{
-		DBG_ER_LN("return, pkt is NULL !!!");
-		return;
+		// in order, with permissible gap
+		if (seq < stat->max_seq)
+		{
+			stat->cycles += RTP_SEQ_MOD;
+		}
+		stat->max_seq = seq;
 	}
+	else if (udelta <= RTP_SEQ_MOD - RTP_MAX_MISORDER)
+	{
+		// the sequence number made a very large jump
+		if (seq == stat->bad_seq)
+		{
+			// two sequential packets, assume that the other side restarted without telling us
+			rtp_seq_init(stat, seq);
+			ret = 2;
+		}
+		else
+		{
+			stat->bad_seq = (seq + 1) & (RTP_SEQ_MOD-1);
+			return 0;
+		}
+	}
+	// else duplicate or reordered packet
 
-	sess_context_t *sess_req = pkt->sess_req;
+	stat->received++;
+	stat->expected = stat->cycles + stat->max_seq - stat->base_seq + 1;
+	stat->lost = (int)(stat->expected - stat->received);
+	return ret;
+}
 
-	/* SSRC number - send/receive */
-	sess_req->my_ssrc = pkt->RTP_header->ssrc;
+// RFC 3550 A.8
+static void rtp_jitter_update(RTPX_t *rtp_req, unsigned int ts, unsigned long long t_arrival)
+{
+	unsigned int arrival = (unsigned int)(t_arrival * rtp_req->clock_rate / 1000000ULL);
+	int transit = (int)(arrival - ts);
+	int d = transit - rtp_req->stat.transit;
 
-	/* Number of packets sent - send/receive */
-	sess_req->sending_pkt_count++;
+	rtp_req->stat.transit = transit;
+	if (rtp_req->stat.received <= 1)
+	{
+		return;
+	}
+	if (d < 0)
+	{
+		d = -d;
+	}
+	rtp_req->jitter_q4 += d - ((rtp_req->jitter_q4 + 8) >> 4);
+	rtp_req->stat.jitter = rtp_req->jitter_q4 >> 4;
+}
 
-	/* Number of bytes sent - send/receive */
-	sess_req->sending_octet_count += sz;
+int rtp_au_write(RTPX_t *rtp_req, unsigned char *buf, size_t count)
+{
+	size_t need = rtp_req->au_len + count;
 
-	/* Version - receive */
-	sess_req->version = (pkt->RTP_header->flags & 0xd0) >> 6;
+	if (need > rtp_req->au_max)
+	{
+		size_t new_max = (rtp_req->au_max > 0) ? rtp_req->au_max * 2 : LEN_OF_BUF_1MB/4;
+		if (new_max < need)
+		{
+			new_max = need;
+		}
 
-	/* Marker flag - receive */
-	sess_req->marker = (pkt->RTP_header->mk_pt & 0x10) >> 7;
+		char *new_buff = SAFE_REALLOC(rtp_req->au_buf, new_max);
+		if (new_buff == NULL)
+		{
+			DBG_ER_LN("SAFE_REALLOC error !!! (au: %zd -> %zd)", rtp_req->au_max, new_max);
+			return -1;
+		}
+		rtp_req->au_buf = new_buff;
+		rtp_req->au_max = new_max;
+	}
 
-	/* Padding length - receive */
-	sess_req->padding = rtp_padding(pkt->RTP_header, msg, sz);
+	SAFE_MEMCPY(rtp_req->au_buf + rtp_req->au_len, buf, count, rtp_req->au_max - rtp_req->au_len);
+	rtp_req->au_len += count;
 
-	/* CSRC length - send/receive */
-	sess_req->CSRClen = (pkt->RTP_header->flags & 0x0f);
+	DBG_TMP_Y("	(count: %zd, au_len: %zd)", count, rtp_req->au_len);
+	return count;
+}
 
-	/* Payload type - send/receive */
-	sess_req->pt = (pkt->RTP_header->mk_pt & 0x7f);
+int rtp_au_startcode(RTPX_t *rtp_req)
+{
+	unsigned char nal_header[4] = {0x00, 0x00, 0x00, 0x01};
+	//unsigned char nal_header[3] = {0x00, 0x00, 0x01};
 
-	/* CSRC list - send/receive */
-	//MEM_SALLOC(sess_req->CSRCList, (sess_req->CSRClen * 4));
-	sess_req->CSRCList = (unsigned int *)SAFE_CALLOC(1, sess_req->CSRClen * 4);
-	memcpy(sess_req->CSRCList, pkt->RTP_header->csrc, (sess_req->CSRClen * 4));
+	return rtp_au_write(rtp_req, nal_header, sizeof(nal_header));
+}
 
-	/* current value of timestamp - receive */
-	sess_req->RTP_timestamp = pkt->RTP_header->ts;
+#ifdef UTIL_EX_SSL
+// the parameter sets of the fmtp (key=base64,base64;) with start codes, to fp if any, otherwise to the access unit of rtp_req
+int rtp_sprop_write(RTPX_t *rtp_req, FILE *fp, char *fmtp, char *key)
+{
+	int count = 0;
+	char sps_str[LEN_OF_VAL512] = "";
+	char *sps = SAFE_STRSTR(fmtp, key);
 
-	/* First value of timestamp - send/receive */
-	if (sess_req->sending_pkt_count == 1)
+	if (sps)
 	{
-		sess_req->init_RTP_timestamp = sess_req->RTP_timestamp;
+		SAFE_SSCANF(sps + strlen(key), "%511[^; \t]", sps_str);
+
+		char *token_sps = NULL;
+		char *saveptr_sps = sps_str;
+		while ((token_sps = SAFE_STRTOK_R(NULL, ",", &saveptr_sps)))
+		{
+			int sps_dec_len = 0;
+			char *sps_dec = sec_base64_dec(token_sps, strlen(token_sps), &sps_dec_len);
+			DBG_TMP_DUMP(sps_dec, sps_dec_len, " ", "(token_sps: %s, sps_dec_len: %d)", token_sps, sps_dec_len);
+			if ((sps_dec) && (sps_dec_len > 0))
+			{
+				if (fp)
+				{
+					unsigned char nal_header[4] = {0x00, 0x00, 0x00, 0x01};
+					SAFE_FWRITE(&nal_header, 1, sizeof(nal_header), fp);
+					SAFE_FWRITE(sps_dec, 1, sps_dec_len, fp);
+					count ++;
+				}
+				else if ((rtp_req) && (rtp_au_startcode(rtp_req) >= 0) && (rtp_au_write(rtp_req, (unsigned char *)sps_dec, sps_dec_len) >= 0))
+				{
+					count ++;
+				}
+			}
+			SAFE_FREE(sps_dec);
+		}
 	}
+	return count;
+}
+#endif
 
-	/* Time elapsed since the beginning - send/receive */
-	if (sess_req->sending_pkt_count == 1)
+static int rtp_au_nal(RTPX_t *rtp_req, unsigned char *nal, int len)
+{
+	if ((rtp_au_startcode(rtp_req) < 0) || (rtp_au_write(rtp_req, nal, len) < 0))
 	{
-		sess_req->time_elapsed = 0;
+		return -1;
 	}
-	else
+	return 0;
+}
+
+// the units of an aggregation packet are written in decoding order
+static int rtp_agg_write(RTPX_t *rtp_req, RTPAggUnit_t *unit_ary, int count, int isdon)
+{
+	int ret = 0;
+	int i = 0;
+	int j = 0;
+
+	if (isdon)
 	{
-		sess_req->time_elapsed = sess_req->RTP_timestamp  - sess_req->init_RTP_timestamp;
+		for (i = 1; i < count; i++)
+		{
+			RTPAggUnit_t unit = unit_ary[i];
+			for (j = i; (j > 0) && ((short)(unit_ary[j-1].don - unit.don) > 0); j--)
+			{
+				unit_ary[j] = unit_ary[j-1];
+			}
+			unit_ary[j] = unit;
+		}
 	}
 
-	/* Current sequence number - send/receive */
-	sess_req->seq_no = pkt->RTP_header->sq_nb; //ntohs(pkt->RTP_header->sq_nb);
-
-	/* First sequence number - send/receive */
-	if (sess_req->sending_pkt_count == 1)
+	for (i = 0; i < count; i++)
 	{
-		sess_req->init_seq_no = sess_req->seq_no;
+		if (rtp_au_nal(rtp_req, unit_ary[i].nal, unit_ary[i].len) != 0)
+		{
+			ret = -1;
+		}
 	}
+	return ret;
+}
 
-	//DBG_TR_LN("(sess_req->pt: %d, sess_req->seq_no: %d, pkt->RTP_extension: %p)", sess_req->pt, sess_req->seq_no, pkt->RTP_extension);
+// RTP Payload Format for H.264 Video
+// https://datatracker.ietf.org/doc/html/rfc6184
+static int rtp_h264(RTPX_t *rtp_req, unsigned char *payload, int payload_len)
+{
+	int ret = -1;
+	int nal_type = (payload[0] & 0x1F);
+
+	DBG_TMP_DUMP(payload, 16, " ", "(len: %d, nal_type: %d)", payload_len, nal_type);
 
-	if (pkt->RTP_extension)
+	if ((nal_type>= NAL_TYPE_SINGLE_NAL_MIN) && (nal_type <= NAL_TYPE_SINGLE_NAL_MAX))
 	{
-		/* Extension header - send/receive */
-		//MEM_ALLOC(sess_req[cid]->hdr_extension);
-		sess_req->hdr_extension = (rtp_ext*)SAFE_CALLOC(1, sizeof(rtp_ext));
-		sess_req->hdr_extension->ext_len = pkt->RTP_extension->ext_len;
-		sess_req->hdr_extension->ext_type = pkt->RTP_extension->ext_type;
+		// 1 ~ 23, 5.6. Single NAL Unit Packet
+		ret = rtp_au_nal(rtp_req, payload, payload_len);
+	}
+	else if ((nal_type >= NAL_TYPE_STAP_A) && (nal_type <= NAL_TYPE_MTAP24))
+	{
+		// 24 ~ 27, 5.7. Aggregation Packets (p22)
+		// STAP-A: [size(16) NALU]...
+		// STAP-B: DON(16) [size(16) NALU]...
+		// MTAP16/24: DONB(16) [size(16) DOND(8) TS offset(16/24) NALU]...
+		RTPAggUnit_t unit_ary[MAX_OF_RTP_AGG];
+		int count = 0;
+		int isdon = (nal_type != NAL_TYPE_STAP_A);
+		int ts_len = (nal_type == NAL_TYPE_MTAP16) ? 2 : ((nal_type == NAL_TYPE_MTAP24) ? 3 : 0);
+		unsigned short don = 0;
+		int nidx = 1;
+
+		if (isdon)
+		{
+			if (payload_len < nidx + 2)
+			{
+				return -1;
+			}
+			don = (payload[nidx] << 8) | payload[nidx + 1];
+			nidx += 2;
+		}
 
-		DBG_TR_LN("(sess_req->hdr_extension->ext_len: %d)", sess_req->hdr_extension->ext_len);
-		DBG_TR_LN("(sess_req->hdr_extension->ext_type: %d)", sess_req->hdr_extension->ext_type);
-		if (sess_req->hdr_extension->ext_len)
+		ret = 0;
+		while ((ret == 0) && (nidx + 2 <= payload_len))
 		{
-			//MEM_SALLOC(sess_req->hdr_extension->hd_ext,  (4 * sess_req->hdr_extension->ext_len));
-			sess_req->hdr_extension->hd_ext = (unsigned long*)SAFE_CALLOC(1, (4 * sess_req->hdr_extension->ext_len));
-			memcpy(sess_req->hdr_extension->hd_ext, pkt->RTP_extension->hd_ext, (4 * sess_req->hdr_extension->ext_len));
-			for (i = 0; i < sess_req->hdr_extension->ext_len; i++)
+			int nalu_size = (payload[nidx] << 8) | payload[nidx + 1];
+			nidx += 2;
+
+			unsigned short unit_don = don + count;
+			if (ts_len)
 			{
-				sess_req->hdr_extension->hd_ext[i] = sess_req->hdr_extension->hd_ext[i];
+				if (nidx + 1 + ts_len > payload_len)
+				{
+					ret = -1;
+					break;
+				}
+				unit_don = don + payload[nidx];
+				nidx += 1 + ts_len;
 			}
+
+			if ((nalu_size == 0) || (nidx + nalu_size > payload_len) || (count >= MAX_OF_RTP_AGG))
+			{
+				DBG_TMP_Y("(nidx: %d, NAL size: %d, count: %d)", nidx, nalu_size, count);
+				ret = -1;
+				break;
+			}
+			unit_ary[count].don = unit_don;
+			unit_ary[count].nal = payload + nidx;
+			unit_ary[count].len = nalu_size;
+			count++;
+			nidx += nalu_size;
+		}
+
+		if (rtp_agg_write(rtp_req, unit_ary, count, isdon) != 0)
+		{
+			ret = -1;
 		}
 	}
+	else if ((nal_type == NAL_TYPE_FU_A) || (nal_type == NAL_TYPE_FU_B))
+	{
+		// 28 ~ 29
+		// 5.8. Fragmentation Units (FUs) (p29)
+		/*
+		 0							 1							 2							 3
+		 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		|  FU indicator | 	FU header 	| 						 DON							|
+		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-|
+		| 																															|
+		| 												 FU payload 													|
+		| 																															|
+		| 															+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		| 															: 	...OPTIONAL RTP padding 		|
+		+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		*/
+		int fu_b = (nal_type == NAL_TYPE_FU_B) ? 4:2;
+		if (payload_len <= fu_b)
+		{
+			return -1;
+		}
+
+		unsigned char h264_key       = (payload[0] & 0xE0);
+		unsigned char h264_type      = (payload[1] & 0x1F);
+		h264_key |= h264_type;
+
+		unsigned char h264_start_bit = (payload[1] & 0x80) >> 7;
+		unsigned char h264_end_bit   = (payload[1] & 0x40) >> 6;
+
+		DBG_TMP_Y("	(S: %d, E: %d, type: 0x%02x, key: 0x%02x)", h264_start_bit, h264_end_bit, h264_type, h264_key);
+		if (h264_start_bit)
+		{
+			/* the NAL header is rebuilt from the FU indicator and the FU header */
+			rtp_req->fu_on = (rtp_au_nal(rtp_req, &h264_key, sizeof(h264_key)) == 0);
+		}
+
+		if ((rtp_req->fu_on) && (rtp_au_write(rtp_req, payload + fu_b, payload_len - fu_b) >= 0))
+		{
+			ret = 0;
+		}
+		// else the head was lost, drop the rest of this NAL unit
+
+		if (h264_end_bit)
+		{
+			rtp_req->fu_on = 0;
+		}
+	}
+
+	return ret;
 }
 
-static int h264_write_nal(RTPX_t *rtp_req)
+// RTP Payload Format for High Efficiency Video Coding (HEVC)
+// https://datatracker.ietf.org/doc/html/rfc7798
+static int rtp_h265(RTPX_t *rtp_req, unsigned char *payload, int payload_len)
 {
-	if (rtp_req)
+	int ret = -1;
+	int donl = (rtp_req->don_present) ? 2 : 0;
+
+	if (payload_len < 3)
 	{
-		FILE *fp = NULL;
-		if ((rtp_req) && (rtp_req->http_req) && (fp = rtp_req->http_req->rtsp_req.fp))
+		return ret;
+	}
+
+	/*
+	+---------------+---------------+
+	|0|1|2|3|4|5|6|7|0|1|2|3|4|5|6|7|
+	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	|F|   Type    |  LayerId  | TID |
+	+-------------+-----------------+
+	*/
+	int nal_type = (payload[0] >> 1) & 0x3F;
+
+	DBG_TMP_DUMP(payload, 16, " ", "(len: %d, nal_type: %d)", payload_len, nal_type);
+
+	if (nal_type <= H265_NAL_TYPE_SINGLE_NAL_MAX)
+	{
+		// 0 ~ 47, 4.4.1. Single NAL Unit Packets - PayloadHdr [DONL] NALU payload
+		if ((payload_len > 2 + donl)
+			&& (rtp_au_nal(rtp_req, payload, 2) == 0)
+			&& (rtp_au_write(rtp_req, payload + 2 + donl, payload_len - 2 - donl) >= 0))
 		{
-			if ((rtp_req->max_size==0) || ((rtp_req->total + 4) <= rtp_req->max_size))
+			ret = 0;
+		}
+	}
+	else if (nal_type == H265_NAL_TYPE_AP)
+	{
+		// 48, 4.4.2. Aggregation Packets - PayloadHdr [DONL] size NALU [DOND size NALU]...
+		RTPAggUnit_t unit_ary[MAX_OF_RTP_AGG];
+		int count = 0;
+		unsigned short don = 0;
+		int nidx = 2;
+
+		ret = 0;
+		while ((ret == 0) && (nidx < payload_len))
+		{
+			if ((donl) && (count == 0))
+			{
+				if (nidx + 2 > payload_len)
+				{
+					ret = -1;
+					break;
+				}
+				don = (payload[nidx] << 8) | payload[nidx + 1];
+				nidx += 2;
+			}
+			else if (donl)
 			{
-				unsigned char nal_header[4] = {0x00, 0x00, 0x00, 0x01};
-				//unsigned char nal_header[3] = {0x00, 0x00, 0x01};
+				don += payload[nidx] + 1;
+				nidx++;
+			}
+
+			if (nidx + 2 > payload_len)
+			{
+				ret = -1;
+				break;
+			}
+			int nalu_size = (payload[nidx] << 8) | payload[nidx + 1];
+			nidx += 2;
 
-				rtp_req->total += sizeof(nal_header);
-				return SAFE_FWRITE(nal_header, 1, sizeof(nal_header), fp);
+			if ((nalu_size < 2) || (nidx + nalu_size > payload_len) || (count >= MAX_OF_RTP_AGG))
+			{
+				ret = -1;
+				break;
 			}
+			unit_ary[count].don = don;
+			unit_ary[count].nal = payload + nidx;
+			unit_ary[count].len = nalu_size;
+			count++;
+			nidx += nalu_size;
+		}
+
+		if (rtp_agg_write(rtp_req, unit_ary, count, donl) != 0)
+		{
+			ret = -1;
 		}
 	}
-	return -1;
+	else if (nal_type == H265_NAL_TYPE_FU)
+	{
+		// 49, 4.4.3. Fragmentation Units - PayloadHdr FU header [DONL] FU payload
+		/*
+		+---------------+
+		|0|1|2|3|4|5|6|7|
+		+-+-+-+-+-+-+-+-+
+		|S|E|  FuType   |
+		+---------------+
+		*/
+		int h265_start_bit = (payload[2] & 0x80) >> 7;
+		int h265_end_bit = (payload[2] & 0x40) >> 6;
+		int fu_type = (payload[2] & 0x3F);
+		int fu_len = 3 + ((h265_start_bit) ? donl : 0);
+
+		if (payload_len <= fu_len)
+		{
+			return -1;
+		}
+
+		DBG_TMP_Y("	(S: %d, E: %d, type: %d)", h265_start_bit, h265_end_bit, fu_type);
+		if (h265_start_bit)
+		{
+			unsigned char nal_header[2] = { (payload[0] & 0x81) | (fu_type << 1), payload[1] };
+			rtp_req->fu_on = (rtp_au_nal(rtp_req, nal_header, sizeof(nal_header)) == 0);
+		}
+
+		if ((rtp_req->fu_on) && (rtp_au_write(rtp_req, payload + fu_len, payload_len - fu_len) >= 0))
+		{
+			ret = 0;
+		}
+
+		if (h265_end_bit)
+		{
+			rtp_req->fu_on = 0;
+		}
+	}
+	else
+	{
+		// 50 PACI and the reserved ones
+		DBG_TMP_Y("%s (nal_type: %d)", DBG_TXT_NO_SUPPORT, nal_type);
+	}
+
+	return ret;
 }
 
-static int h264_write(RTPX_t *rtp_req, char *buf, size_t count)
+static RTPCodec_t rtp_codec_ary[] =
+{
+	{ .name = "H264", .depay_cb = rtp_h264 },
+	{ .name = "H265", .depay_cb = rtp_h265 },
+	{ .name = "", .depay_cb = NULL },
+};
+
+RTPCodec_t *rtp_codec_find(char *name)
+{
+	RTPCodec_t *codec = NULL;
+	if ((name) && (strlen(name) > 0))
+	{
+		for (codec = rtp_codec_ary; (codec->depay_cb) && (SAFE_STRCASECMP(codec->name, name) != 0); codec++)
+		{
+		}
+		if (codec->depay_cb == NULL)
+		{
+			codec = NULL;
+		}
+	}
+	return codec;
+}
+
+void rtp_codec_set(RTPX_t *rtp_req, RTPCodec_t *codec)
+{
+	if (rtp_req)
+	{
+		SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+		rtp_req->codec = codec;
+		rtp_req->fu_on = 0;
+		SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+	}
+}
+
+int dummy_write(RTPX_t *rtp_req, void *buf, size_t count)
 {
 	if (rtp_req)
 	{
@@ -343,7 +567,7 @@ static int h264_write(RTPX_t *rtp_req, char *buf, size_t count)
 			{
 				rtp_req->total += count;
 
-				DBG_TMP_Y("	(count: %zd, total: %zd/%zd)", count, rtp_req->total, rtp_req->max_size);
+				DBG_TMP_Y("	(total: %zd/%zd)", rtp_req->total, rtp_req->max_size);
 
 				return SAFE_FWRITE(buf, 1, count, fp);
 			}
@@ -352,221 +576,500 @@ static int h264_write(RTPX_t *rtp_req, char *buf, size_t count)
 	return -1;
 }
 
-// RTP Payload Format for H.264 Video
-// https://datatracker.ietf.org/doc/html/rfc6184
-static int rtp_h264(RTPX_t *rtp_req, char *payload, long payload_len)
+static int rtp_au_emit(RTPX_t *rtp_req)
 {
-	int ret = -1;
-	if (rtp_req)
+	int ret = 0;
+
+	if (rtp_req->au_len > 0)
 	{
+		RTPAccessUnit_t au = {
+			.ts = rtp_req->au_ts,
+			.pt = rtp_req->pt,
+			.islost = rtp_req->au_lost,
+			.data = rtp_req->au_buf,
+			.len = rtp_req->au_len,
+		};
+
+		rtp_req->stat.au_count++;
+		if (au.islost)
 		{
-			DBG_TMP_DUMP(payload, 16, " ", "(len: %d)", 16);
-
-			int nal_type = (payload[0] & 0x1F);
-#if (0)
-			int nal_forbidden_zero = CHECK_BIT(payload[0], 7);
-			int nal_nri = (payload[0] & 0x60) >> 5;
-			unsigned char *ptr = (unsigned char *)payload;
-			DBG_TMP_Y(">>>>> %ld, 0x%02x.0x%02x.0x%02x.0x%02x (Forbidden zero: %d, NRI: %d, Type: %d)", payload_len, ptr[0], ptr[1], ptr[2], ptr[3], nal_forbidden_zero, nal_nri, nal_type);
-			//SAFE_FWRITE(payload, 1, payload_len, fp);
-#endif
+			rtp_req->stat.au_lost++;
+		}
 
-			if ((nal_type>= NAL_TYPE_SINGLE_NAL_MIN) && (nal_type <= NAL_TYPE_SINGLE_NAL_MAX))
+		FILE *fp = NULL;
+		if ((rtp_req->http_req) && (fp = rtp_req->http_req->rtsp_req.fp))
+		{
+			if ((rtp_req->max_size==0) || ((rtp_req->total + au.len) <= rtp_req->max_size))
 			{
-				// 1 ~ 23
-				/* Write NAL header */
-				ret = h264_write_nal(rtp_req);
-
-				/* Write NAL unit */
-				ret = h264_write(rtp_req, payload, payload_len);
+				// one write per access unit
+				SAFE_FWRITE(au.data, 1, au.len, fp);
 			}
-			else if ((nal_type >= NAL_TYPE_STAP_A) && (nal_type <= NAL_TYPE_MTAP24))
+			else
 			{
-				// 24 ~ 27
-				unsigned char *q;
-				unsigned short nalu_size;
+				ret = -1;
+			}
+		}
+		rtp_req->total += au.len;
 
-				q = (unsigned char *)payload + 1;
-				int nidx = 0;
+		if ((ret == 0) && (rtp_req->au_cb))
+		{
+			ret = rtp_req->au_cb(rtp_req, &au, rtp_req->au_data);
+		}
+	}
 
-				nidx = 0;
-				while (nidx < payload_len - 1)
-				{
-					/* write NAL header */
-					ret = h264_write_nal(rtp_req);
+	rtp_req->au_len = 0;
+	rtp_req->au_lost = 0;
+	return ret;
+}
 
-					/* get NALU size */
-					nalu_size = (q[nidx] << 8) | (q[nidx + 1]);
-					DBG_TMP_Y("(nidx: %d, NAL size: %d)", nidx, nalu_size);
-					nidx += 2;
+static int rtp_pkt_deliver(RTPX_t *rtp_req, RTPPkt_t *pkt)
+{
+	int ret = 0;
 
-					/* write NALU size */
-					ret = h264_write(rtp_req, (char *)&nalu_size, 2);
+	if ((rtp_req->au_len > 0) && (pkt->ts != rtp_req->au_ts))
+	{
+		// the marker of the last one was lost
+		ret = rtp_au_emit(rtp_req);
+		rtp_req->fu_on = 0;
+	}
+	rtp_req->au_ts = pkt->ts;
 
-					if (nalu_size == 0)
-					{
-						nidx++;
-						continue;
-					}
+	RTPCodec_t *codec = (rtp_req->codec) ? rtp_req->codec : &rtp_codec_ary[0];
+	if (codec->depay_cb(rtp_req, (unsigned char *)pkt->buf + pkt->payload_off, pkt->payload_len) == -1)
+	{
+		rtp_req->au_lost = 1;
+	}
 
-					/* write NALU data */
-					ret = h264_write(rtp_req, (char *)q + nidx, nalu_size);
-					nidx += nalu_size;
-				}
-			}
-			else if ((nal_type == NAL_TYPE_FU_A) || (nal_type == NAL_TYPE_FU_B))
-			{
-				// 28 ~ 29
-				// 5.8. Fragmentation Units (FUs) (p29)
-				/*
-				 0							 1							 2							 3
-				 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-				+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-				|  FU indicator | 	FU header 	| 						 DON							|
-				+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-|
-				| 																															|
-				| 												 FU payload 													|
-				| 																															|
-				| 															+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-				| 															: 	...OPTIONAL RTP padding 		|
-				+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-				*/
-				int fu_b = (nal_type == NAL_TYPE_FU_B) ? 4:2;
-				unsigned char *q = (unsigned char *)payload;
-
-				unsigned char h264_key       = (q[0] & 0xE0);
-				unsigned char h264_type      = (q[1] & 0x1F);
-				h264_key |= h264_type;
-
-				unsigned char h264_start_bit = (q[1] & 0x80) >> 7;
-				unsigned char h264_end_bit   = (q[1] & 0x40) >> 6;
-
-
-				DBG_TMP_Y("	(S: %d, E: %d, type: 0x%02x, key: 0x%02x)", h264_start_bit, h264_end_bit, h264_type, h264_key);
-				if (h264_start_bit)
-				{
-					/* write NAL header */
-					ret = h264_write_nal(rtp_req);
+	if ((ret == 0) && (pkt->marker))
+	{
+		ret = rtp_au_emit(rtp_req);
+	}
+	return ret;
+}
 
-					/* write NAL unit code */
-					ret = h264_write(rtp_req, (char *)&h264_key, sizeof(h264_key));
-				}
-				ret = h264_write(rtp_req, (char *)q + fu_b, payload_len - fu_b);
+static int rtp_jitter_drain(RTPX_t *rtp_req)
+{
+	int ret = 0;
+	RTPPkt_t *pkt = NULL;
 
-				if (h264_end_bit)
-				{
-					/* nothing to do... */
-				}
-			}
-			else
+	while ((ret == 0) && ((pkt = &rtp_req->jitter[rtp_req->next_seq & (MAX_OF_RTP_JITTER-1)])->isused))
+	{
+		ret = rtp_pkt_deliver(rtp_req, pkt);
+		pkt->isused = 0;
+		rtp_req->pending--;
+		rtp_req->next_seq++;
+	}
+	return ret;
+}
+
+// gives up the hole in front of the jitter buffer
+static void rtp_jitter_skip(RTPX_t *rtp_req)
+{
+	while ((rtp_req->pending > 0) && (rtp_req->jitter[rtp_req->next_seq & (MAX_OF_RTP_JITTER-1)].isused == 0))
+	{
+		rtp_req->next_seq++;
+		rtp_req->stat.skipped++;
+	}
+	rtp_req->au_lost = 1;
+	rtp_req->fu_on = 0;
+}
+
+static int rtp_jitter_flush(RTPX_t *rtp_req)
+{
+	int ret = 0;
+	while ((ret == 0) && (rtp_req->pending > 0))
+	{
+		rtp_jitter_skip(rtp_req);
+		ret = rtp_jitter_drain(rtp_req);
+	}
+	return ret;
+}
+
+// a hole is held till jitter_depth packets or jitter_ms pass behind it
+static int rtp_jitter_hold(RTPX_t *rtp_req, unsigned long long now)
+{
+	int ret = 0;
+	int depth = (rtp_req->jitter_depth > 0) ? SAFE_MIN(rtp_req->jitter_depth, MAX_OF_RTP_JITTER-1) : MAX_OF_RTP_JITTER/2;
+	unsigned long long hold = ((rtp_req->jitter_ms > 0) ? rtp_req->jitter_ms : MAX_OF_RTP_JITTER_MS) * 1000ULL;
+
+	while ((ret == 0) && (rtp_req->pending > 0))
+	{
+		RTPPkt_t *oldest = NULL;
+		int idx = 0;
+		for (idx = 1; (oldest == NULL) && (idx < MAX_OF_RTP_JITTER); idx++)
+		{
+			RTPPkt_t *pkt = &rtp_req->jitter[(rtp_req->next_seq + idx) & (MAX_OF_RTP_JITTER-1)];
+			if (pkt->isused)
 			{
+				oldest = pkt;
 			}
 		}
+
+		if ((oldest) && (rtp_req->pending < depth) && (now - oldest->t_arrival < hold))
+		{
+			break;
+		}
+		rtp_jitter_skip(rtp_req);
+		ret = rtp_jitter_drain(rtp_req);
 	}
 	return ret;
 }
 
-int dummy_write(RTPX_t *rtp_req, void *buf, size_t count)
+static int rtp_jitter_put(RTPX_t *rtp_req, RTPPkt_t *in)
 {
-	if (rtp_req)
+	RTPPkt_t *slot = &rtp_req->jitter[in->ext_seq & (MAX_OF_RTP_JITTER-1)];
+
+	if (slot->isused)
 	{
-		FILE *fp = NULL;
-		if ((rtp_req) && (rtp_req->http_req) && (fp = rtp_req->http_req->rtsp_req.fp))
+		rtp_req->stat.duplicates++;
+		return 0;
+	}
+
+	if (in->payload_len > slot->buf_max)
+	{
+		char *new_buff = (slot->isheap) ? SAFE_REALLOC(slot->buf, in->payload_len) : SAFE_MALLOC(in->payload_len);
+		if (new_buff == NULL)
 		{
-			if ((rtp_req->max_size==0) || ((rtp_req->total + 4) <= rtp_req->max_size))
-			{
-				rtp_req->total += count;
+			DBG_ER_LN("SAFE_MALLOC error !!! (payload_len: %d)", in->payload_len);
+			return -1;
+		}
+		slot->buf = new_buff;
+		slot->buf_max = in->payload_len;
+		slot->isheap = 1;
+	}
 
-				DBG_TMP_Y("	(total: %zd/%zd)", rtp_req->total, rtp_req->max_size);
+	// only the payload is kept
+	SAFE_MEMCPY(slot->buf, in->buf + in->payload_off, in->payload_len, slot->buf_max);
+	slot->payload_off = 0;
+	slot->payload_len = in->payload_len;
+	slot->ext_seq = in->ext_seq;
+	slot->ts = in->ts;
+	slot->marker = in->marker;
+	slot->pt = in->pt;
+	slot->t_arrival = in->t_arrival;
+	slot->isused = 1;
+	rtp_req->pending++;
+	return 0;
+}
 
-				return SAFE_FWRITE(buf, 1, count, fp);
-			}
-		}
+// au_cb asked to stop, or a packet couldn't be kept
+static void rtp_stop(RTPX_t *rtp_req)
+{
+	rtp_req->isstop = 1;
+
+	HttpX_t *http_req = NULL;
+	if ((http_req = rtp_req->http_req))
+	{
+		http_req->rtsp_req.stop = 1;
 	}
-	return -1;
 }
 
-static void rtp_body_free(rtp_pkt *pkt)
+void rtp_body_parse(RTPX_t *rtp_req, char *buff, int buff_len)
 {
-	if (pkt == NULL)
+	if ((rtp_req == NULL) || (buff == NULL) || (buff_len < 12))
 	{
-		DBG_ER_LN("return, pkt is NULL !!!");
 		return;
 	}
 
-	sess_context_t *sess_req = pkt->sess_req;
-
-	/*
-	 * Free Memoire.
-	 */
-	if ((pkt) && (pkt->RTP_extension))
+	DBG_TMP_DUMP(buff, 32, " ", "(len: %d)", 32);
+
+	// the header is read in place
+	unsigned char *msg = (unsigned char *)buff;
+	int version = (msg[0] & 0xc0) >> 6;
+	int padding = (msg[0] & 0x20) >> 5;
+	int ext = (msg[0] & 0x10) >> 4;
+	int cc = (msg[0] & 0x0f);
+	unsigned short sq_nb = (unsigned short)byte2big_endian(2, msg+2);
+	unsigned int ssrc = byte2big_endian(4, msg+8);
+	RTPPkt_t pkt = {
+		.marker = (msg[1] & 0x80) >> 7,
+		.pt = (msg[1] & 0x7f),
+		.ts = byte2big_endian(4, msg+4),
+		.t_arrival = rtp_now_us(),
+		.buf = buff,
+		.buf_max = buff_len,
+		.payload_off = 12 + cc * 4,
+	};
+	if ((ext) && (pkt.payload_off + 4 <= buff_len))
 	{
-		SAFE_FREE(pkt->RTP_extension->hd_ext);
-		SAFE_FREE(pkt->RTP_extension);
+		pkt.payload_off += 4 + byte2big_endian(2, msg + pkt.payload_off + 2) * 4;
 	}
-	if ((pkt) && (pkt->RTP_header))
+	int len_padding = (padding) ? msg[buff_len - 1] : 0;
+	pkt.payload_len = buff_len - pkt.payload_off - len_padding;
+
+	if ((version != 2) || (pkt.payload_len <= 0))
 	{
-		SAFE_FREE(pkt->RTP_header->csrc);
-		SAFE_FREE(pkt->RTP_header);
+		DBG_ER_LN("bad packet !!! (version: %d, buff_len: %d, payload_len: %d)", version, buff_len, pkt.payload_len);
+		return;
 	}
-	SAFE_FREE(pkt);
 
-	if (sess_req->hdr_extension)
+	int ret = 0;
+	SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+
+	if (rtp_req->pt == 0)
 	{
-		SAFE_FREE(sess_req->hdr_extension->hd_ext);
-		SAFE_FREE(sess_req->hdr_extension);
+		rtp_req->pt = pkt.pt;
 	}
-	SAFE_FREE(sess_req->CSRCList);
-	return;
-}
 
-void rtp_body_parse(RTPX_t *rtp_req, char *buff, int buff_len)
-{
-	if (rtp_req)
+	if (pkt.pt != rtp_req->pt)
+	{
+		DBG_ER_LN("%s (PlayLoad Type: %d)", DBG_TXT_NO_SUPPORT, pkt.pt);
+	}
+	else
 	{
-		DBG_TMP_DUMP(buff, 32, " ", "(len: %d)", 32);
-		rtp_pkt *pkt = rtp_header_parse(buff, buff_len);
+		int seq_ok = 1;
+		if ((rtp_req->sess_data.sending_pkt_count == 0) || (ssrc != rtp_req->stat.ssrc))
+		{
+			// a new source
+			ret = rtp_jitter_flush(rtp_req);
+			rtp_req->stat.ssrc = ssrc;
+			rtp_seq_init(&rtp_req->stat, sq_nb);
+			rtp_req->next_seq = sq_nb;
+		}
+		else if ((seq_ok = rtp_seq_update(&rtp_req->stat, sq_nb)) == 2)
+		{
+			ret = rtp_jitter_flush(rtp_req);
+			rtp_req->next_seq = sq_nb;
+		}
+		if (rtp_req->stat.received == 0)
+		{
+			rtp_seq_update(&rtp_req->stat, sq_nb);
+		}
 
-		if (pkt)
+		if (seq_ok)
 		{
-			pkt->sess_req = &rtp_req->sess_data;
+			sess_context_t *sess_req = &rtp_req->sess_data;
+			sess_req->my_ssrc = ssrc;
+			sess_req->sending_pkt_count++;
+			sess_req->sending_octet_count += buff_len;
+			sess_req->version = version;
+			sess_req->marker = pkt.marker;
+			sess_req->padding = len_padding;
+			sess_req->CSRClen = cc;
+			sess_req->pt = pkt.pt;
+			sess_req->RTP_timestamp = pkt.ts;
+			sess_req->seq_no = sq_nb;
+			if (sess_req->sending_pkt_count == 1)
+			{
+				sess_req->init_RTP_timestamp = pkt.ts;
+				sess_req->init_seq_no = sq_nb;
+			}
+			sess_req->time_elapsed = sess_req->RTP_timestamp - sess_req->init_RTP_timestamp;
 
-			rtp_context_parse(pkt, buff, buff_len);
+			rtp_jitter_update(rtp_req, pkt.ts, pkt.t_arrival);
 
-#ifdef DBG_RTP_INFO
-			if (pkt->sess_req->sending_pkt_count==1)
+			pkt.ext_seq = rtp_req->next_seq + (short)(sq_nb - (unsigned short)rtp_req->next_seq);
+			int delta = (int)(pkt.ext_seq - rtp_req->next_seq);
+			if (delta < 0)
 			{
-				rtp_header_print(pkt);
+				rtp_req->stat.late++;
 			}
-			rtp_context_print(&rtp_req->sess_data);
-#endif
-
-			if (pkt->RTP_header)
+			else if (ret == 0)
 			{
-				int result = 0;
-				switch (pkt->RTP_header->mk_pt & 0x7f)
+				if (delta >= MAX_OF_RTP_JITTER)
 				{
-					case 96:
-						result = rtp_h264(rtp_req, pkt->payload, pkt->payload_len);
-						break;
-					default:
-						DBG_ER_LN("%s (PlayLoad Type: %d)", DBG_TXT_NO_SUPPORT, pkt->RTP_header->mk_pt & 0x7f);
-						//dummy_write(rtp_req, pkt->payload, pkt->payload_len);
-						break;
+					// out of the window, give up the holes in front of it
+					ret = rtp_jitter_flush(rtp_req);
+					rtp_req->stat.skipped += pkt.ext_seq - rtp_req->next_seq;
+					rtp_req->next_seq = pkt.ext_seq;
+					rtp_req->au_lost = 1;
+					rtp_req->fu_on = 0;
 				}
 
-				if (result==-1)
+				if (ret == 0)
 				{
-					HttpX_t *http_req = NULL;
-					if ((http_req = rtp_req->http_req))
+					if ((pkt.ext_seq == rtp_req->next_seq) && (rtp_req->pending == 0))
+					{
+						// in order, straight from the caller's buffer
+						ret = rtp_pkt_deliver(rtp_req, &pkt);
+						rtp_req->next_seq++;
+					}
+					else if (rtp_jitter_put(rtp_req, &pkt) == 0)
 					{
-						http_req->rtsp_req.stop = 1;
+						ret = rtp_jitter_drain(rtp_req);
 					}
 				}
+
+				if (ret == 0)
+				{
+					ret = rtp_jitter_hold(rtp_req, pkt.t_arrival);
+				}
 			}
 		}
+	}
 
-		rtp_body_free(pkt);
+	SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+
+	if (ret != 0)
+	{
+		rtp_stop(rtp_req);
+	}
+}
+
+// rtp_jitter_hold only runs when a packet comes, a stalled stream would keep the frames behind a hole forever
+// the owner calls this every now and then, the holes older than jitter_ms are given up
+void rtp_jitter_poll(RTPX_t *rtp_req)
+{
+	if (rtp_req == NULL)
+	{
+		return;
+	}
+
+	int ret = 0;
+	SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+	if (rtp_req->pending > 0)
+	{
+		ret = rtp_jitter_hold(rtp_req, rtp_now_us());
+	}
+	SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+
+	if (ret != 0)
+	{
+		rtp_stop(rtp_req);
+	}
+}
+
+void rtp_stat(RTPX_t *rtp_req, RTPStat_t *stat)
+{
+	if ((rtp_req) && (stat))
+	{
+		SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+		SAFE_MEMCPY(stat, &rtp_req->stat, sizeof(RTPStat_t), sizeof(RTPStat_t));
+		SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+	}
+}
+
+// RFC 3550 6.4.2 and A.3, a compound RR + SDES CNAME, return the length or -1
+int rtp_rtcp_rr(RTPX_t *rtp_req, unsigned int ssrc, char *cname, unsigned char *buf, int buf_len)
+{
+	if ((rtp_req == NULL) || (buf == NULL))
+	{
+		return -1;
+	}
+
+	int cname_len = (cname) ? SAFE_MIN((int)strlen(cname), 255) : 0;
+	int sdes_len = (4 + 4 + 2 + cname_len + 1 + 3) & ~3; // with END and the padding
+	int rr_len = 8 + 24;
+	if (buf_len < rr_len + sdes_len)
+	{
+		return -1;
+	}
+	SAFE_MEMSET(buf, 0, rr_len + sdes_len);
+
+	SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+	RTPStat_t *stat = &rtp_req->stat;
+	if (stat->received == 0)
+	{
+		// nothing to report yet
+		rr_len = 8;
+		buf[0] = 0x80;
+	}
+	else
+	{
+		unsigned int expected_interval = stat->expected - stat->expected_prior;
+		unsigned int received_interval = stat->received - stat->received_prior;
+		int lost_interval = (int)(expected_interval - received_interval);
+		stat->expected_prior = stat->expected;
+		stat->received_prior = stat->received;
+		stat->fraction = ((expected_interval == 0) || (lost_interval <= 0)) ? 0 : (unsigned char)(((unsigned int)lost_interval << 8) / expected_interval);
+
+		// 24 bits, signed
+		int lost = stat->lost;
+		if (lost > 0x7fffff)
+		{
+			lost = 0x7fffff;
+		}
+		else if (lost < -0x800000)
+		{
+			lost = -0x800000;
+		}
+
+		unsigned int dlsr = 0;
+		if (stat->lsr_us)
+		{
+			// units of 1/65536 seconds
+			dlsr = (unsigned int)((rtp_now_us() - stat->lsr_us) * 65536ULL / 1000000ULL);
+		}
+
+		buf[0] = 0x81;
+		big_endian2byte(4, stat->ssrc, buf + 8);
+		big_endian2byte(4, ((unsigned int)stat->fraction << 24) | ((unsigned int)lost & 0xffffff), buf + 12);
+		big_endian2byte(4, stat->cycles + stat->max_seq, buf + 16);
+		big_endian2byte(4, stat->jitter, buf + 20);
+		big_endian2byte(4, stat->lsr, buf + 24);
+		big_endian2byte(4, dlsr, buf + 28);
+	}
+	SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+
+	buf[1] = 201;
+	big_endian2byte(2, rr_len / 4 - 1, buf + 2);
+	big_endian2byte(4, ssrc, buf + 4);
+
+	unsigned char *sdes = buf + rr_len;
+	sdes[0] = 0x81;
+	sdes[1] = 202;
+	big_endian2byte(2, sdes_len / 4 - 1, sdes + 2);
+	big_endian2byte(4, ssrc, sdes + 4);
+	sdes[8] = 1; // CNAME
+	sdes[9] = cname_len;
+	if (cname_len > 0)
+	{
+		SAFE_MEMCPY(sdes + 10, cname, cname_len, sdes_len - 10);
+	}
+
+	return rr_len + sdes_len;
+}
+
+// keeps LSR of the sender reports, return 1 if BYE
+int rtp_rtcp_parse(RTPX_t *rtp_req, char *buff, int buff_len)
+{
+	int ret = 0;
+
+	if ((rtp_req == NULL) || (buff == NULL))
+	{
+		return ret;
+	}
+
+	unsigned char *msg = (unsigned char *)buff;
+	int off = 0;
+	while (off + 4 <= buff_len)
+	{
+		int version = (msg[off] & 0xc0) >> 6;
+		int pt = msg[off+1];
+		int len = (byte2big_endian(2, msg+off+2) + 1) * 4;
+		if ((version != 2) || (off + len > buff_len))
+		{
+			DBG_ER_LN("bad packet !!! (version: %d, off: %d, len: %d, buff_len: %d)", version, off, len, buff_len);
+			break;
+		}
+
+		if ((pt == 200) && (len >= 28))
+		{
+			// SR, the middle 32 bits of the NTP timestamp
+			SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+			rtp_req->stat.sr_count++;
+			rtp_req->stat.lsr = byte2big_endian(4, msg+off+10);
+			rtp_req->stat.lsr_us = rtp_now_us();
+			SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+		}
+		else if (pt == 203)
+		{
+			ret = 1;
+		}
+		off += len;
+	}
+
+	return ret;
+}
+
+void rtp_au_register(RTPX_t *rtp_req, rtp_au_fn cb, void *userdata)
+{
+	if (rtp_req)
+	{
+		SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+		rtp_req->au_cb = cb;
+		rtp_req->au_data = userdata;
+		SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
 	}
 }
 
@@ -583,10 +1086,38 @@ void rtp_free(RTPX_t *rtp_req)
 {
 	if (rtp_req)
 	{
+		if (rtp_req->chainX_req)
+		{
+			chainX_thread_stop(rtp_req->chainX_req);
+			chainX_thread_close(rtp_req->chainX_req);
+			SAFE_FREE(rtp_req->chainX_req);
+		}
+
+		SAFE_THREAD_LOCK(&rtp_req->in_mtx);
+		if (rtp_jitter_flush(rtp_req) == 0)
 		{
+			rtp_au_emit(rtp_req);
+		}
+
+		int idx = 0;
+		for (idx = 0; idx < MAX_OF_RTP_JITTER; idx++)
+		{
+			if (rtp_req->jitter[idx].isheap)
+			{
+				SAFE_FREE(rtp_req->jitter[idx].buf);
+			}
+		}
+		SAFE_FREE(rtp_req->pool);
+		SAFE_FREE(rtp_req->au_buf);
+		SAFE_THREAD_UNLOCK(&rtp_req->in_mtx);
+
+		{
+			RTPStat_t *stat = &rtp_req->stat;
 			rtp_context_print(&rtp_req->sess_data);
+			DBG_DB_LN("(received: %u, expected: %u, lost: %d, late: %u, duplicates: %u, skipped: %u, jitter: %u, au_count: %u, au_lost: %u)", stat->received, stat->expected, stat->lost, stat->late, stat->duplicates, stat->skipped, stat->jitter, stat->au_count, stat->au_lost);
 		}
 
+		SAFE_MUTEX_DESTROY(&rtp_req->in_mtx);
 		SAFE_FREE(rtp_req);
 	}
 }
@@ -598,13 +1129,30 @@ RTPX_t *rtp_init(int port, int interleaved)
 	if (rtp_req)
 	{
 		rtp_req->total = 0;
+		rtp_req->clock_rate = VAL_OF_RTP_CLOCK_RATE;
+		SAFE_MUTEX_ATTR_RECURSIVE(rtp_req->in_mtx);
+
+		// the packet pool, one slot per seq of the jitter buffer
+		rtp_req->pool = (char*)SAFE_CALLOC(MAX_OF_RTP_JITTER, LEN_OF_RTP_PKT);
+		if (rtp_req->pool == NULL)
+		{
+			SAFE_MUTEX_DESTROY(&rtp_req->in_mtx);
+			SAFE_FREE(rtp_req);
+			return NULL;
+		}
+		int idx = 0;
+		for (idx = 0; idx < MAX_OF_RTP_JITTER; idx++)
+		{
+			rtp_req->jitter[idx].buf = rtp_req->pool + idx * LEN_OF_RTP_PKT;
+			rtp_req->jitter[idx].buf_max = LEN_OF_RTP_PKT;
+		}
 
 		if (interleaved==0)
 		{
 			ChainX_t *chainX_req = (ChainX_t*)SAFE_CALLOC(1, sizeof(ChainX_t));
 			if (chainX_req)
 			{
-				rtp_req->total = 0;
+				rtp_req->chainX_req = chainX_req;
 
 				chainX_req->mode = CHAINX_MODE_ID_UDP_SERVER;
 				chainX_req->sockfd = -1;
@@ -626,7 +1174,8 @@ RTPX_t *rtp_init(int port, int interleaved)
 			}
 			else
 			{
-				SAFE_FREE(rtp_req);
+				rtp_free(rtp_req);
+				rtp_req = NULL;
 			}
 		}
 	}
@@ -0,0 +1,1185 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+
+#define DBG_MOD DBG_MOD_ID_RTP
+#include "utilx9.h"
+
+#define DBG_TMP_Y(format,args...) //DBG_LN_Y(format, ## args)
+#define DBG_TMP_DUMP(ibuf,len,delim,format,args...) //DBG_TR_DUMP(ibuf,len,delim,format,## args)
+
+#define RANGE_OF_RTSP "npt=0.000-"
+#define USERAGENT_OF_RTSP "utilx9"
+#define CNAME_OF_RTSP "utilx9"
+
+#define WAIT_OF_RTSP_EPOLL 100 // ms, the timers of the sessions are checked in between
+
+static unsigned long long rtspx_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void rtspx_wakeup(RTSPX_t *rtspx_req)
+{
+	uint64_t val = 1;
+	if (write(rtspx_req->evfd, &val, sizeof(val)) < 0)
+	{
+		DBG_ER_LN("write error !!! (errno: %d %s)", errno, strerror(errno));
+	}
+}
+
+static int rtspx_send(RTSPSession_t *sess_req, char *buff, int buff_len)
+{
+	int fd = chainX_fd_get(&sess_req->chainX_req);
+	int sent = 0;
+
+	while (sent < buff_len)
+	{
+		ssize_t n = send(fd, buff + sent, buff_len - sent, MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			sent += n;
+		}
+		else if ((n < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		else
+		{
+			DBG_ER_LN("send error !!! (url: %s, errno: %d %s)", sess_req->url, errno, strerror(errno));
+			return -1;
+		}
+	}
+	return sent;
+}
+
+// Name: Value, the value ends before \r\n
+static char *rtspx_header_get(char *hdr, char *key, char *val, int val_len)
+{
+	char pattern[LEN_OF_VAL64] = "";
+	SAFE_SNPRINTF(pattern, sizeof(pattern), "\r\n%s:", key);
+
+	char *found = SAFE_STRCASESTR(hdr, pattern);
+	if (found == NULL)
+	{
+		return NULL;
+	}
+
+	found += strlen(pattern);
+	while ((*found == ' ') || (*found == '\t'))
+	{
+		found++;
+	}
+
+	int idx = 0;
+	while ((found[idx]) && (found[idx] != '\r') && (found[idx] != '\n') && (idx < val_len-1))
+	{
+		val[idx] = found[idx];
+		idx++;
+	}
+	val[idx] = 0;
+	return val;
+}
+
+// key="value"
+static void rtspx_param_get(char *hdr, char *key, char *val, int val_len)
+{
+	char *found = SAFE_STRSTR(hdr, key);
+	if (found)
+	{
+		char fmt[LEN_OF_VAL32] = "";
+		SAFE_SNPRINTF(fmt, sizeof(fmt), "%%%d[^\"]", val_len-1);
+		SAFE_SSCANF(found + strlen(key), fmt, val);
+	}
+}
+
+#ifdef UTIL_EX_SSL
+#include <openssl/evp.h>
+
+static void rtspx_md5_hex(char *in, char *hex, int hex_len)
+{
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+
+	hex[0] = 0;
+	if (EVP_Digest(in, strlen(in), md, &md_len, EVP_md5(), NULL) == 1)
+	{
+		int idx = 0;
+		for (idx = 0; (idx < (int)md_len) && (idx*2+2 < hex_len); idx++)
+		{
+			SAFE_SNPRINTF(hex + idx*2, hex_len - idx*2, "%02x", md[idx]);
+		}
+	}
+}
+
+// RFC 2617, without qop as RTSP cameras do
+static void rtspx_auth_header(RTSPSession_t *sess_req, char *method, char *uri, char *auth, int auth_len)
+{
+	char buff[LEN_OF_BUF1024] = "";
+
+	switch (sess_req->auth)
+	{
+		case RTSP_AUTH_ID_BASIC:
+		{
+			int enc_len = 0;
+			SAFE_SNPRINTF(buff, sizeof(buff), "%s:%s", sess_req->user, sess_req->pass);
+			char *enc = sec_base64_enc(buff, strlen(buff), &enc_len);
+			if (enc)
+			{
+				SAFE_SNPRINTF(auth, auth_len, "Authorization: Basic %s\r\n", enc);
+				SAFE_FREE(enc);
+			}
+		}
+		break;
+		case RTSP_AUTH_ID_DIGEST:
+		{
+			char ha1[LEN_OF_VAL48] = "";
+			char ha2[LEN_OF_VAL48] = "";
+			char response[LEN_OF_VAL48] = "";
+
+			SAFE_SNPRINTF(buff, sizeof(buff), "%s:%s:%s", sess_req->user, sess_req->realm, sess_req->pass);
+			rtspx_md5_hex(buff, ha1, sizeof(ha1));
+			SAFE_SNPRINTF(buff, sizeof(buff), "%s:%s", method, uri);
+			rtspx_md5_hex(buff, ha2, sizeof(ha2));
+			SAFE_SNPRINTF(buff, sizeof(buff), "%s:%s:%s", ha1, sess_req->nonce, ha2);
+			rtspx_md5_hex(buff, response, sizeof(response));
+
+			SAFE_SNPRINTF(auth, auth_len, "Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"%s\", response=\"%s\"\r\n", sess_req->user, sess_req->realm, sess_req->nonce, uri, response);
+		}
+		break;
+		default:
+			break;
+	}
+}
+#endif
+
+static int rtspx_request(RTSPSession_t *sess_req, char *method, char *uri, char *extra)
+{
+	char auth[LEN_OF_BUF1024] = "";
+	char session[LEN_OF_VAL128] = "";
+	char buff[LEN_OF_BUF4096] = "";
+
+#ifdef UTIL_EX_SSL
+	rtspx_auth_header(sess_req, method, uri, auth, sizeof(auth));
+#endif
+	if (strlen(sess_req->session) > 0)
+	{
+		SAFE_SNPRINTF(session, sizeof(session), "Session: %s\r\n", sess_req->session);
+	}
+
+	sess_req->cseq++;
+	int len = SAFE_SNPRINTF(buff, sizeof(buff), "%s %s RTSP/1.0\r\nCSeq: %d\r\nUser-Agent: %s\r\n%s%s%s\r\n", method, uri, sess_req->cseq, USERAGENT_OF_RTSP, session, auth, (extra) ? extra : "");
+	if ((len <= 0) || (len >= (int)sizeof(buff)))
+	{
+		DBG_ER_LN("too long !!! (method: %s, uri: %s)", method, uri);
+		return -1;
+	}
+
+	DBG_DB_LN("(method: %s, uri: %s, CSeq: %d)", method, uri, sess_req->cseq);
+	return rtspx_send(sess_req, buff, len);
+}
+
+// the request of the current state
+static int rtspx_state_send(RTSPSession_t *sess_req)
+{
+	int ret = -1;
+	char extra[LEN_OF_BUF256] = "";
+
+	switch (sess_req->state)
+	{
+		case RTSP_STATE_ID_OPTIONS:
+			ret = rtspx_request(sess_req, "OPTIONS", sess_req->url, NULL);
+			break;
+		case RTSP_STATE_ID_DESCRIBE:
+			ret = rtspx_request(sess_req, "DESCRIBE", sess_req->url, "Accept: application/sdp\r\n");
+			break;
+		case RTSP_STATE_ID_SETUP:
+			SAFE_SNPRINTF(extra, sizeof(extra), "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n", sess_req->ch_rtp, sess_req->ch_rtcp);
+			ret = rtspx_request(sess_req, "SETUP", sess_req->control, extra);
+			break;
+		case RTSP_STATE_ID_PLAY:
+			SAFE_SNPRINTF(extra, sizeof(extra), "Range: %s\r\n", RANGE_OF_RTSP);
+			ret = rtspx_request(sess_req, "PLAY", sess_req->aggregate, extra);
+			break;
+		default:
+			break;
+	}
+
+	sess_req->t_reply = rtspx_now_us() + TIMEOUT_OF_RTSP_REPLY * 1000000ULL;
+	return (ret > 0) ? 0 : -1;
+}
+
+// a=control, absolute or relative to Content-Base
+static void rtspx_control_set(RTSPSession_t *sess_req, char *control, int control_len, char *track)
+{
+	int base_len = strlen(sess_req->base);
+
+	if (strncasecmp(track, "rtsp://", strlen("rtsp://")) == 0)
+	{
+		SAFE_SNPRINTF(control, control_len, "%s", track);
+	}
+	else if ((strlen(track) == 0) || (SAFE_STRCMP(track, "*") == 0))
+	{
+		SAFE_SNPRINTF(control, control_len, "%s", sess_req->base);
+	}
+	else
+	{
+		SAFE_SNPRINTF(control, control_len, "%s%s%s", sess_req->base, ((base_len > 0) && (sess_req->base[base_len-1] == '/')) ? "" : "/", track);
+	}
+}
+
+// the first video stream, fmtp is kept for the parameter sets
+static void rtspx_sdp_parse(RTSPSession_t *sess_req, char *body, char *fmtp, int fmtp_len)
+{
+	char *saveptr = body;
+	char *token = NULL;
+
+	int mtype = -1; // -1: session, 0: the video, 1: others
+	int isfound = 0;
+	while ((token = SAFE_STRTOK_R(NULL, "\r\n", &saveptr)))
+	{
+		if (SAFE_STRNCMP(token, "m=", strlen("m=")) == 0)
+		{
+			mtype = ((isfound == 0) && (SAFE_STRNCMP(token, "m=video", strlen("m=video")) == 0)) ? 0 : 1;
+			isfound |= (mtype == 0);
+		}
+		else if (SAFE_STRNCMP(token, "a=control:", strlen("a=control:")) == 0)
+		{
+			if (mtype == -1)
+			{
+				// the aggregate control
+				rtspx_control_set(sess_req, sess_req->aggregate, sizeof(sess_req->aggregate), token + strlen("a=control:"));
+			}
+			else if (mtype == 0)
+			{
+				rtspx_control_set(sess_req, sess_req->control, sizeof(sess_req->control), token + strlen("a=control:"));
+			}
+		}
+		else if (mtype != 0)
+		{
+			// not the video
+		}
+		else if ((SAFE_STRNCMP(token, "a=rtpmap:", strlen("a=rtpmap:")) == 0) && (strlen(sess_req->encoding) == 0))
+		{
+			// a=rtpmap:96 H265/90000
+			SAFE_SSCANF(token, "a=rtpmap:%d %15[^/]/%d", &sess_req->pt, sess_req->encoding, &sess_req->clock_rate);
+		}
+		else if (SAFE_STRNCMP(token, "a=fmtp:", strlen("a=fmtp:")) == 0)
+		{
+			char *don = SAFE_STRSTR(token, "sprop-max-don-diff=");
+			if (don)
+			{
+				sess_req->don_present = (atoi(don + strlen("sprop-max-don-diff=")) > 0);
+			}
+			SAFE_SNPRINTF(fmtp, fmtp_len, "%s", token);
+		}
+	}
+
+	if (strlen(sess_req->aggregate) == 0)
+	{
+		rtspx_control_set(sess_req, sess_req->aggregate, sizeof(sess_req->aggregate), "*");
+	}
+	if (strlen(sess_req->control) == 0)
+	{
+		rtspx_control_set(sess_req, sess_req->control, sizeof(sess_req->control), "*");
+	}
+	DBG_DB_LN("(aggregate: %s, control: %s, pt: %d, encoding: %s, clock_rate: %d)", sess_req->aggregate, sess_req->control, sess_req->pt, sess_req->encoding, sess_req->clock_rate);
+}
+
+static int rtspx_describe_reply(RTSPSession_t *sess_req, char *hdr, char *body)
+{
+	char fmtp[LEN_OF_BUF1024] = "";
+
+	// from the last connection
+	sess_req->aggregate[0] = 0;
+	sess_req->control[0] = 0;
+	sess_req->encoding[0] = 0;
+	sess_req->pt = 0;
+	sess_req->clock_rate = 0;
+	sess_req->don_present = 0;
+	rtp_free(sess_req->rtp_req);
+	sess_req->rtp_req = NULL;
+
+	if (rtspx_header_get(hdr, "Content-Base", sess_req->base, sizeof(sess_req->base)) == NULL)
+	{
+		SAFE_SNPRINTF(sess_req->base, sizeof(sess_req->base), "%s", sess_req->url);
+	}
+	rtspx_sdp_parse(sess_req, body, fmtp, sizeof(fmtp));
+
+	RTPX_t *rtp_req = rtp_init(0, 1);
+	if (rtp_req == NULL)
+	{
+		return -1;
+	}
+	rtp_req->pt = sess_req->pt;
+	if (sess_req->clock_rate > 0)
+	{
+		rtp_req->clock_rate = sess_req->clock_rate;
+	}
+	rtp_req->don_present = sess_req->don_present;
+	rtp_codec_set(rtp_req, rtp_codec_find(sess_req->encoding));
+	rtp_au_register(rtp_req, sess_req->au_cb, sess_req->au_data);
+#ifdef UTIL_EX_SSL
+	// they come as the first access unit
+	// h264
+	rtp_sprop_write(rtp_req, NULL, fmtp, "sprop-parameter-sets=");
+	// h265
+	rtp_sprop_write(rtp_req, NULL, fmtp, "sprop-vps=");
+	rtp_sprop_write(rtp_req, NULL, fmtp, "sprop-sps=");
+	rtp_sprop_write(rtp_req, NULL, fmtp, "sprop-pps=");
+#endif
+	sess_req->rtp_req = rtp_req;
+	return 0;
+}
+
+static void rtspx_setup_reply(RTSPSession_t *sess_req, char *hdr)
+{
+	char val[LEN_OF_VAL128] = "";
+
+	// Session: 12345678;timeout=60
+	sess_req->timeout = 0;
+	if (rtspx_header_get(hdr, "Session", val, sizeof(val)))
+	{
+		char *timeout = SAFE_STRSTR(val, ";timeout=");
+		if (timeout)
+		{
+			sess_req->timeout = atoi(timeout + strlen(";timeout="));
+			*timeout = 0;
+		}
+		SAFE_SNPRINTF(sess_req->session, sizeof(sess_req->session), "%s", val);
+		str_trim(sess_req->session);
+	}
+	if (sess_req->timeout <= 0)
+	{
+		sess_req->timeout = TIMEOUT_OF_RTSP_SESSION;
+	}
+
+	// the server might pick other channels
+	if (rtspx_header_get(hdr, "Transport", val, sizeof(val)))
+	{
+		char *interleaved = SAFE_STRSTR(val, "interleaved=");
+		if (interleaved)
+		{
+			SAFE_SSCANF(interleaved, "interleaved=%d-%d", &sess_req->ch_rtp, &sess_req->ch_rtcp);
+		}
+	}
+	DBG_DB_LN("(session: %s, timeout: %d, interleaved: %d-%d)", sess_req->session, sess_req->timeout, sess_req->ch_rtp, sess_req->ch_rtcp);
+}
+
+static int rtspx_auth_reply(RTSPSession_t *sess_req, char *hdr)
+{
+	if ((strlen(sess_req->user) == 0) || (sess_req->auth_retry > 0))
+	{
+		DBG_ER_LN("unauthorized !!! (url: %s, user: %s)", sess_req->url, sess_req->user);
+		return -1;
+	}
+	sess_req->auth_retry++;
+
+	char *digest = SAFE_STRCASESTR(hdr, "WWW-Authenticate: Digest");
+	if (digest)
+	{
+		sess_req->auth = RTSP_AUTH_ID_DIGEST;
+		rtspx_param_get(digest, "realm=\"", sess_req->realm, sizeof(sess_req->realm));
+		rtspx_param_get(digest, "nonce=\"", sess_req->nonce, sizeof(sess_req->nonce));
+	}
+	else
+	{
+		sess_req->auth = RTSP_AUTH_ID_BASIC;
+	}
+#ifndef UTIL_EX_SSL
+	DBG_ER_LN("%s (auth: %d)", DBG_TXT_NO_SUPPORT, sess_req->auth);
+	return -1;
+#endif
+
+	return rtspx_state_send(sess_req);
+}
+
+// return -1 to close the session
+static int rtspx_reply(RTSPSession_t *sess_req, char *hdr, char *body)
+{
+	int code = 0;
+	if (SAFE_SSCANF(hdr, "RTSP/%*s %d", &code) != 1)
+	{
+		// a request from the server
+		DBG_TMP_Y("(hdr: %s)", hdr);
+		return 0;
+	}
+
+	if (sess_req->state == RTSP_STATE_ID_PLAYING)
+	{
+		// GET_PARAMETER
+		return 0;
+	}
+
+	if (code == 401)
+	{
+		return rtspx_auth_reply(sess_req, hdr);
+	}
+	else if (code != 200)
+	{
+		DBG_ER_LN("reply error !!! (url: %s, state: %d, code: %d)", sess_req->url, sess_req->state, code);
+		return -1;
+	}
+	sess_req->auth_retry = 0;
+
+	int ret = 0;
+	switch (sess_req->state)
+	{
+		case RTSP_STATE_ID_OPTIONS:
+			sess_req->state = RTSP_STATE_ID_DESCRIBE;
+			ret = rtspx_state_send(sess_req);
+			break;
+		case RTSP_STATE_ID_DESCRIBE:
+			if ((ret = rtspx_describe_reply(sess_req, hdr, body)) == 0)
+			{
+				sess_req->state = RTSP_STATE_ID_SETUP;
+				ret = rtspx_state_send(sess_req);
+			}
+			break;
+		case RTSP_STATE_ID_SETUP:
+			rtspx_setup_reply(sess_req, hdr);
+			sess_req->state = RTSP_STATE_ID_PLAY;
+			ret = rtspx_state_send(sess_req);
+			break;
+		case RTSP_STATE_ID_PLAY:
+		{
+			unsigned long long now = rtspx_now_us();
+			int rr_ms = (sess_req->rtspx_req->rr_ms > 0) ? sess_req->rtspx_req->rr_ms : INTERVAL_OF_RTSP_RR;
+			sess_req->state = RTSP_STATE_ID_PLAYING;
+			sess_req->t_reply = 0;
+			sess_req->t_rr = now + rr_ms * 1000ULL;
+			sess_req->t_keepalive = now + sess_req->timeout * 1000000ULL / 2;
+			sess_req->retry_wait = 0;
+			DBG_IF_LN("playing ... (url: %s)", sess_req->url);
+		}
+		break;
+		default:
+			break;
+	}
+	return ret;
+}
+
+static int rtspx_frame(RTSPSession_t *sess_req, int channel, char *buff, int buff_len)
+{
+	RTPX_t *rtp_req = sess_req->rtp_req;
+
+	if (rtp_req == NULL)
+	{
+		return 0;
+	}
+
+	if (channel == sess_req->ch_rtp)
+	{
+		rtp_body_parse(rtp_req, buff, buff_len);
+		if (rtp_req->isstop)
+		{
+			return -1;
+		}
+	}
+	else if (channel == sess_req->ch_rtcp)
+	{
+		if (rtp_rtcp_parse(rtp_req, buff, buff_len) == 1)
+		{
+			DBG_IF_LN("BYE (url: %s)", sess_req->url);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// $ channel length(2) packet, or a reply, both are parsed inside rbuf
+static int rtspx_session_read(RTSPSession_t *sess_req)
+{
+	char *rbuf = sess_req->rbuf;
+	ssize_t n = recv(chainX_fd_get(&sess_req->chainX_req), rbuf + sess_req->rlen, LEN_OF_RTSP_RBUF - sess_req->rlen, 0);
+	if (n == 0)
+	{
+		DBG_WN_LN("closed by peer !!! (url: %s)", sess_req->url);
+		return -1;
+	}
+	else if (n < 0)
+	{
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : -1;
+	}
+	sess_req->rlen += n;
+
+	int ret = 0;
+	int off = 0;
+	while ((ret == 0) && (off < sess_req->rlen))
+	{
+		int remain = sess_req->rlen - off;
+		if (rbuf[off] == '$')
+		{
+			if (remain < 4)
+			{
+				break;
+			}
+			int len = byte2big_endian(2, (unsigned char *)rbuf + off + 2);
+			if (remain < 4 + len)
+			{
+				break;
+			}
+			ret = rtspx_frame(sess_req, (unsigned char)rbuf[off+1], rbuf + off + 4, len);
+			off += 4 + len;
+		}
+		else
+		{
+			char *hdr = rbuf + off;
+			char *end = SAFE_MEMMEM(hdr, remain, "\r\n\r\n", 4);
+			if (end == NULL)
+			{
+				if (remain >= LEN_OF_BUF4096)
+				{
+					DBG_ER_LN("bad reply !!! (url: %s, remain: %d)", sess_req->url, remain);
+					ret = -1;
+				}
+				break;
+			}
+
+			int hdr_len = end + 4 - hdr;
+			// keeps \r\n of the last header
+			hdr[hdr_len - 2] = 0;
+
+			char val[LEN_OF_VAL16] = "";
+			int body_len = 0;
+			if (rtspx_header_get(hdr, "Content-Length", val, sizeof(val)))
+			{
+				body_len = atoi(val);
+			}
+			if ((body_len < 0) || (hdr_len + body_len > LEN_OF_RTSP_RBUF))
+			{
+				DBG_ER_LN("bad reply !!! (url: %s, body_len: %d)", sess_req->url, body_len);
+				ret = -1;
+				break;
+			}
+			if (remain < hdr_len + body_len)
+			{
+				hdr[hdr_len - 2] = '\r';
+				break;
+			}
+
+			// rbuf has one more byte
+			char *body = hdr + hdr_len;
+			char keep = body[body_len];
+			body[body_len] = 0;
+			ret = rtspx_reply(sess_req, hdr, body);
+			body[body_len] = keep;
+			off += hdr_len + body_len;
+		}
+	}
+
+	if (off > 0)
+	{
+		// only the tail of a frame
+		memmove(rbuf, rbuf + off, sess_req->rlen - off);
+		sess_req->rlen -= off;
+	}
+	return ret;
+}
+
+// isretry: 1, connects again after retry_wait, 0: RTSP_STATE_ID_CLOSED until rtspx_session_del
+static void rtspx_session_close(RTSPSession_t *sess_req, int isretry)
+{
+	RTSPX_t *rtspx_req = sess_req->rtspx_req;
+	ChainX_t *chainX_req = &sess_req->chainX_req;
+
+	if (chainX_fd_get(chainX_req) >= 0)
+	{
+		if (strlen(sess_req->session) > 0)
+		{
+			rtspx_request(sess_req, "TEARDOWN", sess_req->aggregate, NULL);
+		}
+		epoll_ctl(rtspx_req->epfd, EPOLL_CTL_DEL, chainX_fd_get(chainX_req), NULL);
+		chainX_close(chainX_req);
+	}
+	sess_req->session[0] = 0;
+	sess_req->rlen = 0;
+	sess_req->auth_retry = 0;
+	sess_req->ch_rtp = 0;
+	sess_req->ch_rtcp = 1;
+	sess_req->t_reply = 0;
+
+	if ((isretry) && (rtspx_req->retry_ms >= 0) && (threadx_isquit(&rtspx_req->tidx) == 0))
+	{
+		int retry_first = (rtspx_req->retry_ms > 0) ? rtspx_req->retry_ms : INTERVAL_OF_RTSP_RETRY;
+		if (sess_req->retry_wait < retry_first)
+		{
+			sess_req->retry_wait = retry_first;
+		}
+		DBG_WN_LN("reconnect ... (url: %s, state: %d, retry_wait: %d ms)", sess_req->url, sess_req->state, sess_req->retry_wait);
+		sess_req->t_retry = rtspx_now_us() + sess_req->retry_wait * 1000ULL;
+		sess_req->retry_wait *= 2;
+		if (sess_req->retry_wait > MAX_OF_RTSP_RETRY)
+		{
+			sess_req->retry_wait = (retry_first > MAX_OF_RTSP_RETRY) ? retry_first : MAX_OF_RTSP_RETRY;
+		}
+		sess_req->state = RTSP_STATE_ID_CONNECT;
+	}
+	else if (sess_req->state != RTSP_STATE_ID_CLOSED)
+	{
+		DBG_IF_LN("closed (url: %s, state: %d)", sess_req->url, sess_req->state);
+		sess_req->state = RTSP_STATE_ID_CLOSED;
+	}
+}
+
+static void rtspx_session_free(RTSPSession_t *sess_req)
+{
+	rtspx_session_close(sess_req, 0);
+	threadx_mutex_free(&sess_req->chainX_req.tidx);
+	rtp_free(sess_req->rtp_req);
+	SAFE_FREE(sess_req->rbuf);
+	SAFE_FREE(sess_req);
+}
+
+// the socket is writable, connected or failed
+static int rtspx_session_connected(RTSPSession_t *sess_req)
+{
+	ChainX_t *chainX_req = &sess_req->chainX_req;
+
+	if (chainX_connect_check(chainX_req) != 0)
+	{
+		DBG_ER_LN("connect error !!! (url: %s)", sess_req->url);
+		return -1;
+	}
+
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = sess_req,
+	};
+	if (epoll_ctl(sess_req->rtspx_req->epfd, EPOLL_CTL_MOD, chainX_fd_get(chainX_req), &ev) != 0)
+	{
+		DBG_ER_LN("epoll_ctl error !!! (errno: %d %s)", errno, strerror(errno));
+		return -1;
+	}
+
+	sess_req->state = RTSP_STATE_ID_OPTIONS;
+	return rtspx_state_send(sess_req);
+}
+
+// non-blocking, EPOLLOUT tells when the camera answers
+static int rtspx_session_open(RTSPSession_t *sess_req)
+{
+	ChainX_t *chainX_req = &sess_req->chainX_req;
+
+	if (chainX_open(chainX_req) != 0)
+	{
+		DBG_ER_LN("chainX_open error !!! (url: %s)", sess_req->url);
+		return -1;
+	}
+
+	struct epoll_event ev = {
+		.events = EPOLLOUT,
+		.data.ptr = sess_req,
+	};
+	if (epoll_ctl(sess_req->rtspx_req->epfd, EPOLL_CTL_ADD, chainX_fd_get(chainX_req), &ev) != 0)
+	{
+		DBG_ER_LN("epoll_ctl error !!! (errno: %d %s)", errno, strerror(errno));
+		chainX_close(chainX_req);
+		return -1;
+	}
+
+	sess_req->state = RTSP_STATE_ID_CONNECTING;
+	sess_req->t_reply = rtspx_now_us() + TIMEOUT_OF_RTSP_REPLY * 1000000ULL;
+	return 0;
+}
+
+// on the thread of qdns, the session is kept by isresolving
+static int rtspx_dns_exec_cb(void *arg)
+{
+	RTSPDns_t *dns_req = (RTSPDns_t *)arg;
+	RTSPSession_t *sess_req = dns_req->sess_req;
+	RTSPX_t *rtspx_req = sess_req->rtspx_req;
+	char ip[LEN_OF_IP] = "";
+
+	threadx_lock(&rtspx_req->tidx);
+	int isdel = sess_req->isdel;
+	threadx_unlock(&rtspx_req->tidx);
+
+	if ((isdel == 0) && (chainX_nslookup(dns_req->hostname, ip, sizeof(ip)) != 0))
+	{
+		DBG_ER_LN("chainX_nslookup error !!! (hostname: %s)", dns_req->hostname);
+	}
+
+	threadx_lock(&rtspx_req->tidx);
+	chainX_ip_set(&sess_req->chainX_req, ip);
+	sess_req->isresolving = 0;
+	threadx_unlock(&rtspx_req->tidx);
+
+	rtspx_wakeup(rtspx_req);
+	return 0;
+}
+
+static int rtspx_dns_free_cb(void *arg)
+{
+	RTSPDns_t *dns_req = (RTSPDns_t *)arg;
+	RTSPSession_t *sess_req = dns_req->sess_req;
+	RTSPX_t *rtspx_req = sess_req->rtspx_req;
+
+	threadx_lock(&rtspx_req->tidx);
+	sess_req->isresolving = 0;
+	threadx_unlock(&rtspx_req->tidx);
+	return 0;
+}
+
+// an ip is opened at once, a hostname goes to qdns and is opened in RTSP_STATE_ID_RESOLVE
+static int rtspx_session_resolve(RTSPSession_t *sess_req)
+{
+	ChainX_t *chainX_req = &sess_req->chainX_req;
+	char *hostname = chainX_req->netinfo.addr.hostname;
+	struct in_addr addr;
+
+	if (inet_pton(AF_INET, hostname, &addr) == 1)
+	{
+		chainX_ip_set(chainX_req, hostname);
+		return rtspx_session_open(sess_req);
+	}
+
+	RTSPDns_t dns_req = {
+		.sess_req = sess_req,
+	};
+	SAFE_SPRINTF_EX(dns_req.hostname, "%s", hostname);
+	chainX_ip_set(chainX_req, "");
+
+	sess_req->state = RTSP_STATE_ID_RESOLVE;
+	sess_req->isresolving = 1;
+	if (queuex_add(sess_req->rtspx_req->qdns, &dns_req) != 0)
+	{
+		DBG_ER_LN("queuex_add error !!! (url: %s)", sess_req->url);
+		sess_req->isresolving = 0;
+		return -1;
+	}
+	return 0;
+}
+
+static int rtspx_session_rr(RTSPSession_t *sess_req)
+{
+	unsigned char buff[4 + LEN_OF_BUF512];
+
+	int len = rtp_rtcp_rr(sess_req->rtp_req, sess_req->ssrc, CNAME_OF_RTSP, buff + 4, sizeof(buff) - 4);
+	if (len > 0)
+	{
+		buff[0] = '$';
+		buff[1] = sess_req->ch_rtcp;
+		big_endian2byte(2, len, buff + 2);
+		return rtspx_send(sess_req, (char *)buff, 4 + len);
+	}
+	return 0;
+}
+
+// not when rtp_au_fn asked to stop
+static int rtspx_session_isretry(RTSPSession_t *sess_req)
+{
+	return ((sess_req->rtp_req == NULL) || (sess_req->rtp_req->isstop == 0));
+}
+
+static void rtspx_session_tick(RTSPSession_t *sess_req, unsigned long long now)
+{
+	int ret = 0;
+
+	switch (sess_req->state)
+	{
+		case RTSP_STATE_ID_CONNECT:
+			if (now >= sess_req->t_retry)
+			{
+				ret = rtspx_session_resolve(sess_req);
+			}
+			break;
+		case RTSP_STATE_ID_RESOLVE:
+			if (sess_req->isresolving == 0)
+			{
+				ret = rtspx_session_open(sess_req);
+			}
+			break;
+		case RTSP_STATE_ID_CONNECTING:
+		case RTSP_STATE_ID_OPTIONS:
+		case RTSP_STATE_ID_DESCRIBE:
+		case RTSP_STATE_ID_SETUP:
+		case RTSP_STATE_ID_PLAY:
+			if (now > sess_req->t_reply)
+			{
+				DBG_ER_LN("timeout !!! (url: %s, state: %d)", sess_req->url, sess_req->state);
+				ret = -1;
+			}
+			break;
+		case RTSP_STATE_ID_PLAYING:
+			// the frames behind a hole are released even if the camera stalls
+			rtp_jitter_poll(sess_req->rtp_req);
+			if (sess_req->rtp_req->isstop)
+			{
+				ret = -1;
+				break;
+			}
+			if (now >= sess_req->t_rr)
+			{
+				int rr_ms = (sess_req->rtspx_req->rr_ms > 0) ? sess_req->rtspx_req->rr_ms : INTERVAL_OF_RTSP_RR;
+				sess_req->t_rr = now + rr_ms * 1000ULL;
+				rtspx_session_rr(sess_req);
+			}
+			if (now >= sess_req->t_keepalive)
+			{
+				sess_req->t_keepalive = now + sess_req->timeout * 1000000ULL / 2;
+				if (rtspx_request(sess_req, "GET_PARAMETER", sess_req->aggregate, NULL) < 0)
+				{
+					ret = -1;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+
+	if (ret != 0)
+	{
+		rtspx_session_close(sess_req, rtspx_session_isretry(sess_req));
+	}
+}
+
+static void *rtspx_thread_handler(void *user)
+{
+	RTSPX_t *rtspx_req = (RTSPX_t *)user;
+
+	if (rtspx_req)
+	{
+		ThreadX_t *tidx_req = &rtspx_req->tidx;
+		threadx_detach(tidx_req);
+
+		struct epoll_event ev_ary[MAX_OF_RTSP_EVENTS];
+		while (threadx_isquit(tidx_req) == 0)
+		{
+			// the sessions are only freed here, so ev_ary never points to a freed one
+			threadx_lock(tidx_req);
+			unsigned long long now = rtspx_now_us();
+			RTSPSession_t *sess_req = (RTSPSession_t *)clist_head(rtspx_req->session_list);
+			while (sess_req)
+			{
+				RTSPSession_t *sess_next = (RTSPSession_t *)clist_item_next(sess_req);
+				if (sess_req->isdel)
+				{
+					if (sess_req->isresolving == 0)
+					{
+						clist_remove(rtspx_req->session_list, sess_req);
+						rtspx_session_free(sess_req);
+					}
+				}
+				else
+				{
+					rtspx_session_tick(sess_req, now);
+				}
+				sess_req = sess_next;
+			}
+			threadx_unlock(tidx_req);
+
+			int nfds = epoll_wait(rtspx_req->epfd, ev_ary, MAX_OF_RTSP_EVENTS, WAIT_OF_RTSP_EPOLL);
+
+			threadx_lock(tidx_req);
+			int idx = 0;
+			for (idx = 0; idx < nfds; idx++)
+			{
+				sess_req = (RTSPSession_t *)ev_ary[idx].data.ptr;
+				if (sess_req == NULL)
+				{
+					uint64_t val = 0;
+					if (read(rtspx_req->evfd, &val, sizeof(val)) < 0)
+					{
+						DBG_TMP_Y("read error !!! (errno: %d %s)", errno, strerror(errno));
+					}
+				}
+				else if (sess_req->isdel)
+				{
+					// freed in the next round
+				}
+				else if (sess_req->state == RTSP_STATE_ID_CONNECTING)
+				{
+					if (rtspx_session_connected(sess_req) != 0)
+					{
+						rtspx_session_close(sess_req, 1);
+					}
+				}
+				else if ((sess_req->state > RTSP_STATE_ID_CONNECTING) && (sess_req->state < RTSP_STATE_ID_CLOSED))
+				{
+					// one read per session and per round, a busy camera can't starve the others
+					if (rtspx_session_read(sess_req) != 0)
+					{
+						rtspx_session_close(sess_req, rtspx_session_isretry(sess_req));
+					}
+				}
+			}
+			threadx_unlock(tidx_req);
+		}
+
+		// the nslookups in progress are finished, then no one points to the sessions
+		queuex_thread_close(rtspx_req->qdns);
+		rtspx_req->qdns = NULL;
+
+		threadx_lock(tidx_req);
+		RTSPSession_t *sess_req = NULL;
+		while ((sess_req = (RTSPSession_t *)clist_pop(rtspx_req->session_list)) != NULL)
+		{
+			rtspx_session_free(sess_req);
+		}
+		threadx_unlock(tidx_req);
+
+		threadx_leave(tidx_req);
+	}
+
+	return NULL;
+}
+
+RTSP_STATE_ID rtspx_session_state(RTSPSession_t *sess_req)
+{
+	RTSP_STATE_ID state = RTSP_STATE_ID_MAX;
+
+	if ((sess_req) && (sess_req->rtspx_req))
+	{
+		threadx_lock(&sess_req->rtspx_req->tidx);
+		state = sess_req->state;
+		threadx_unlock(&sess_req->rtspx_req->tidx);
+	}
+	return state;
+}
+
+int rtspx_session_stat(RTSPSession_t *sess_req, RTPStat_t *stat)
+{
+	int ret = -1;
+
+	if ((sess_req) && (sess_req->rtspx_req) && (stat))
+	{
+		threadx_lock(&sess_req->rtspx_req->tidx);
+		if (sess_req->rtp_req)
+		{
+			rtp_stat(sess_req->rtp_req, stat);
+			ret = 0;
+		}
+		threadx_unlock(&sess_req->rtspx_req->tidx);
+	}
+	return ret;
+}
+
+// the session is freed by the thread of RTSPX, don't call it inside rtp_au_fn (return non-zero instead)
+void rtspx_session_del(RTSPSession_t *sess_req)
+{
+	if ((sess_req) && (sess_req->rtspx_req))
+	{
+		RTSPX_t *rtspx_req = sess_req->rtspx_req;
+
+		threadx_lock(&rtspx_req->tidx);
+		sess_req->isdel = 1;
+		threadx_unlock(&rtspx_req->tidx);
+
+		rtspx_wakeup(rtspx_req);
+	}
+}
+
+// rtsp://[user:pass@]host[:port]/path, user and pass override the ones of the url
+static int rtspx_url_parse(RTSPSession_t *sess_req, char *url)
+{
+	char *host = SAFE_STRSTR(url, "://");
+	if (host == NULL)
+	{
+		return -1;
+	}
+	host += strlen("://");
+
+	char *path = strchr(host, '/');
+	if (path == NULL)
+	{
+		path = host + strlen(host);
+	}
+
+	char *at = strchr(host, '@');
+	if ((at) && (at < path))
+	{
+		char userinfo[LEN_OF_USER + LEN_OF_VAL64] = "";
+		SAFE_SNPRINTF(userinfo, sizeof(userinfo), "%.*s", (int)(at - host), host);
+
+		char *colon = strchr(userinfo, ':');
+		if (colon)
+		{
+			*colon = 0;
+			SAFE_SNPRINTF(sess_req->pass, sizeof(sess_req->pass), "%s", colon + 1);
+		}
+		SAFE_SNPRINTF(sess_req->user, sizeof(sess_req->user), "%s", userinfo);
+		host = at + 1;
+	}
+
+	char hostport[LEN_OF_VAL128] = "";
+	SAFE_SNPRINTF(hostport, sizeof(hostport), "%.*s", (int)(path - host), host);
+	int port = PORT_OF_RTSP;
+	char *colon = strrchr(hostport, ':');
+	if (colon)
+	{
+		port = atoi(colon + 1);
+		*colon = 0;
+	}
+	if ((strlen(hostport) == 0) || (port <= 0))
+	{
+		return -1;
+	}
+
+	chainX_hostname_set(&sess_req->chainX_req, hostport);
+	chainX_port_set(&sess_req->chainX_req, port);
+	SAFE_SNPRINTF(sess_req->url, sizeof(sess_req->url), "rtsp://%s", host);
+	return 0;
+}
+
+// cb gets the access units of the video on the thread of RTSPX
+RTSPSession_t *rtspx_session_add(RTSPX_t *rtspx_req, char *url, char *user, char *pass, rtp_au_fn cb, void *userdata)
+{
+	if ((rtspx_req == NULL) || (url == NULL))
+	{
+		return NULL;
+	}
+
+	RTSPSession_t *sess_req = (RTSPSession_t *)SAFE_CALLOC(1, sizeof(RTSPSession_t));
+	if (sess_req == NULL)
+	{
+		return NULL;
+	}
+
+	sess_req->rtspx_req = rtspx_req;
+	sess_req->chainX_req.mode = CHAINX_MODE_ID_TCP_CLIENT;
+	sess_req->chainX_req.sockfd = -1;
+	sess_req->chainX_req.noblock = 1;
+	if (rtspx_url_parse(sess_req, url) != 0)
+	{
+		DBG_ER_LN("bad url !!! (url: %s)", url);
+		SAFE_FREE(sess_req);
+		return NULL;
+	}
+	if ((user) && (strlen(user) > 0))
+	{
+		SAFE_SNPRINTF(sess_req->user, sizeof(sess_req->user), "%s", user);
+		SAFE_SNPRINTF(sess_req->pass, sizeof(sess_req->pass), "%s", (pass) ? pass : "");
+	}
+
+	// one byte more, to end a reply in place
+	sess_req->rbuf = (char *)SAFE_CALLOC(1, LEN_OF_RTSP_RBUF + 1);
+	if (sess_req->rbuf == NULL)
+	{
+		SAFE_FREE(sess_req);
+		return NULL;
+	}
+
+	sess_req->ch_rtp = 0;
+	sess_req->ch_rtcp = 1;
+	sess_req->timeout = TIMEOUT_OF_RTSP_SESSION;
+	sess_req->ssrc = (unsigned int)(rtspx_now_us() ^ (uintptr_t)sess_req);
+	sess_req->au_cb = cb;
+	sess_req->au_data = userdata;
+	sess_req->state = RTSP_STATE_ID_CONNECT;
+	// chainX_req has no thread, only the lock
+	threadx_mutex_init(&sess_req->chainX_req.tidx);
+
+	int ret = -1;
+	threadx_lock(&rtspx_req->tidx);
+	if (threadx_isquit(&rtspx_req->tidx) == 0)
+	{
+		clist_push(rtspx_req->session_list, sess_req);
+		ret = 0;
+	}
+	threadx_unlock(&rtspx_req->tidx);
+
+	if (ret != 0)
+	{
+		threadx_mutex_free(&sess_req->chainX_req.tidx);
+		SAFE_FREE(sess_req->rbuf);
+		SAFE_FREE(sess_req);
+		return NULL;
+	}
+
+	rtspx_wakeup(rtspx_req);
+	return sess_req;
+}
+
+void rtspx_stop(RTSPX_t *rtspx_req)
+{
+	if (rtspx_req)
+	{
+		threadx_stop(&rtspx_req->tidx);
+		rtspx_wakeup(rtspx_req);
+	}
+}
+
+// the sessions are torn down and freed
+void rtspx_close(RTSPX_t *rtspx_req)
+{
+	if ((rtspx_req) && (rtspx_req->isfree == 0))
+	{
+		rtspx_req->isfree++;
+
+		rtspx_stop(rtspx_req);
+		threadx_close(&rtspx_req->tidx);
+
+		SAFE_CLOSE(rtspx_req->evfd);
+		SAFE_CLOSE(rtspx_req->epfd);
+		clist_free(rtspx_req->session_list);
+		SAFE_FREE(rtspx_req);
+	}
+}
+
+RTSPX_t *rtspx_init(char *name)
+{
+	RTSPX_t *rtspx_req = (RTSPX_t*)SAFE_CALLOC(1, sizeof(RTSPX_t));
+
+	if (rtspx_req)
+	{
+		SAFE_SPRINTF_EX(rtspx_req->name, "%s", name);
+		CLIST_STRUCT_INIT(rtspx_req, session_list);
+
+		rtspx_req->epfd = epoll_create1(EPOLL_CLOEXEC);
+		rtspx_req->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		struct epoll_event ev = {
+			.events = EPOLLIN,
+			.data.ptr = NULL,
+		};
+		if ((rtspx_req->epfd < 0) || (rtspx_req->evfd < 0)
+			|| (epoll_ctl(rtspx_req->epfd, EPOLL_CTL_ADD, rtspx_req->evfd, &ev) != 0))
+		{
+			DBG_ER_LN("epoll error !!! (errno: %d %s)", errno, strerror(errno));
+			SAFE_CLOSE(rtspx_req->evfd);
+			SAFE_CLOSE(rtspx_req->epfd);
+			SAFE_FREE(rtspx_req);
+			return NULL;
+		}
+
+		rtspx_req->qdns = queuex_thread_init("qdns", MAX_OF_RTSP_DNS, sizeof(RTSPDns_t), rtspx_dns_exec_cb, rtspx_dns_free_cb);
+		if (rtspx_req->qdns == NULL)
+		{
+			DBG_ER_LN("queuex_thread_init error !!!");
+			SAFE_CLOSE(rtspx_req->evfd);
+			SAFE_CLOSE(rtspx_req->epfd);
+			SAFE_FREE(rtspx_req);
+			return NULL;
+		}
+
+		ThreadX_t *tidx_req = &rtspx_req->tidx;
+		tidx_req->thread_cb = rtspx_thread_handler;
+		tidx_req->data = rtspx_req;
+		if (threadx_init(tidx_req, rtspx_req->name) != 0)
+		{
+			DBG_ER_LN("threadx_init error !!!");
+			queuex_thread_close(rtspx_req->qdns);
+			SAFE_CLOSE(rtspx_req->evfd);
+			SAFE_CLOSE(rtspx_req->epfd);
+			SAFE_FREE(rtspx_req);
+			return NULL;
+		}
+	}
+
+	return rtspx_req;
+}
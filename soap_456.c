@@ -0,0 +1,153 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "utilx9.h"
+
+// envelopes per second, mxml (load, set texts, serialize) vs. SoapTmpl_t
+
+#define MAX_OF_BENCH_LOOP 100000
+
+typedef struct BenchSlot_STRUCT
+{
+	char *ns;
+	char *element;
+	char *name; // slot of the template
+	char *value;
+} BenchSlot_t;
+
+static BenchSlot_t getprofiles_slot_ary[] =
+{
+	{ NULL, "Created", "ONVIF_XML_CREATED", "2020-01-01T00:00:00Z" },
+	{ NULL, "Nonce", "ONVIF_XML_NONCE", "p3sU1bxJZ9b4xkUzYwLJVg==" },
+	{ NULL, "Username", "ONVIF_XML_USERNAME", "admin" },
+	{ NULL, "Password", "ONVIF_XML_PASSWORD", "lV0xUsqT2PH/f9uhqEEIYEXmZ0g=" },
+	{ NULL, NULL, NULL, NULL },
+};
+
+static BenchSlot_t probe_slot_ary[] =
+{
+	{ "a", "MessageID", "WSD_XML_MESSAGEID", "2b1e7d3a-5a6f-4c1e-9d3b-0f2a4c6e8b10" },
+	{ NULL, NULL, NULL, NULL },
+};
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_mxml(char *name, char *xmlbuffer, BenchSlot_t *slot_ary)
+{
+	unsigned long total = 0;
+	int count = 0;
+
+	double t_start = bench_now();
+	for (count = 0; count < MAX_OF_BENCH_LOOP; count++)
+	{
+		soap_node_t *request_node = soap_load_string(xmlbuffer);
+		if (request_node == NULL)
+		{
+			break;
+		}
+
+		BenchSlot_t *slot = slot_ary;
+		while (slot->element)
+		{
+			soap_node_t *curr_node = soap_element_fetch(request_node, slot->ns, slot->element, NULL, NULL);
+			soap_element_text_set(curr_node, 0, slot->value);
+			slot++;
+		}
+
+		char *xml = soap_element_2string(request_node);
+		if (xml)
+		{
+			total += strlen(xml);
+		}
+		SAFE_FREE(xml);
+		soap_element_delete(request_node);
+	}
+	double t_spent = bench_now() - t_start;
+
+	DBG_WN_LN("(%-12s mxml, loops: %d, bytes: %lu, %.3f secs, %.0f envelopes/sec)", name, count, total, t_spent, count / t_spent);
+}
+
+static void bench_tmpl(char *name, SoapTmpl_t *tmpl, BenchSlot_t *slot_ary)
+{
+	const char *value_ary[MAX_OF_SOAP_SLOT] = { NULL };
+	unsigned long total = 0;
+	int count = 0;
+
+	BenchSlot_t *slot = slot_ary;
+	while (slot->name)
+	{
+		int idx = soap_tmpl_slot(tmpl, slot->name);
+		if (idx >= 0)
+		{
+			value_ary[idx] = slot->value;
+		}
+		slot++;
+	}
+
+	double t_start = bench_now();
+	for (count = 0; count < MAX_OF_BENCH_LOOP; count++)
+	{
+		int len = 0;
+		if (soap_tmpl_render(tmpl, value_ary, &len) == NULL)
+		{
+			break;
+		}
+		total += len;
+	}
+	double t_spent = bench_now() - t_start;
+
+	DBG_WN_LN("(%-12s tmpl, loops: %d, bytes: %lu, %.3f secs, %.0f envelopes/sec)", name, count, total, t_spent, count / t_spent);
+}
+
+static void bench_run(char *name, char *xmlbuffer, BenchSlot_t *slot_ary)
+{
+	SoapTmpl_t *tmpl = soap_tmpl_compile(xmlbuffer);
+	if (tmpl)
+	{
+		bench_mxml(name, xmlbuffer, slot_ary);
+		bench_tmpl(name, tmpl, slot_ary);
+		soap_tmpl_free(tmpl);
+	}
+	else
+	{
+		DBG_ER_LN("soap_tmpl_compile error !!! (name: %s)", name);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	char *filename = (argc > 1) ? argv[1] : "./xml/GetProfiles-auth.xml";
+
+	soap_node_t *file_node = soap_load_file(filename);
+	if (file_node)
+	{
+		char *xmlbuffer = soap_element_2string(file_node);
+		bench_run("GetProfiles", xmlbuffer, getprofiles_slot_ary);
+		SAFE_FREE(xmlbuffer);
+		soap_element_delete(file_node);
+	}
+	else
+	{
+		DBG_ER_LN("soap_load_file error !!! (filename: %s)", filename);
+	}
+
+	bench_run("Probe", WSD_XML_PROBE_NETWORKVIDEOTRANSMITTER, probe_slot_ary);
+
+	exit(0);
+}
@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_ONVIF
 #include "utilx9.h"
 
 #define MAX_OF_WRAP 8192
@@ -261,3 +262,319 @@ SoapX_t *soap_create(char *xmlbuffer)
 	return soap;
 }
 
+
+//** template, compiled once and rendered without mxml **
+static int soap_tmpl_slot_add(SoapTmpl_t *tmpl, const char *name, int name_len)
+{
+	int idx = 0;
+	for (idx = 0; idx < tmpl->slot_count; idx++)
+	{
+		if (((int)strlen(tmpl->slot_ary[idx]) == name_len) && (SAFE_STRNCMP(tmpl->slot_ary[idx], (char *)name, name_len) == 0))
+		{
+			return idx;
+		}
+	}
+
+	if (tmpl->slot_count >= MAX_OF_SOAP_SLOT)
+	{
+		return -1;
+	}
+	SAFE_MEMCPY(tmpl->slot_ary[idx], (char *)name, name_len, LEN_OF_NAME32-1);
+	tmpl->slot_count++;
+	return idx;
+}
+
+static int soap_tmpl_seg_add(SoapTmpl_t *tmpl, int off, int len, int slot, SOAP_SLOT_ID slot_id)
+{
+	if (tmpl->seg_count >= MAX_OF_SOAP_SEG)
+	{
+		return -1;
+	}
+
+	SoapSeg_t *seg = &tmpl->seg_ary[tmpl->seg_count++];
+	seg->off = off;
+	seg->len = len;
+	seg->slot = slot;
+	seg->slot_id = slot_id;
+	return 0;
+}
+
+// {NAME}: A-Z, 0-9 and _, others are kept as they are
+static int soap_tmpl_name_len(const char *ptr, const char *end)
+{
+	const char *name = ptr + 1;
+	while ((name < end) && (((*name >= 'A') && (*name <= 'Z')) || ((*name >= '0') && (*name <= '9')) || (*name == '_')))
+	{
+		name++;
+	}
+
+	int name_len = name - (ptr + 1);
+	if ((name < end) && (*name == '}') && (name_len > 0) && (name_len < LEN_OF_NAME32))
+	{
+		return name_len;
+	}
+	return 0;
+}
+
+static SoapTmpl_t *soap_tmpl_compile_ex(const char *xmlbuffer, int xml_len)
+{
+	SoapTmpl_t *tmpl = (SoapTmpl_t*)SAFE_CALLOC(1, sizeof(SoapTmpl_t));
+	if (tmpl == NULL)
+	{
+		return NULL;
+	}
+
+	tmpl->xml = (char*)SAFE_MALLOC(xml_len + 1);
+	if (tmpl->xml == NULL)
+	{
+		SAFE_FREE(tmpl);
+		return NULL;
+	}
+
+	const char *ptr = xmlbuffer;
+	const char *end = xmlbuffer + xml_len;
+	int out = 0;
+	int lit_off = 0;
+	int isintag = 0;
+	int istagend = 0; // the last byte of the literal is '>'
+	char quote = 0;
+	while (ptr < end)
+	{
+		char ch = *ptr;
+
+		int name_len = (ch == '{') ? soap_tmpl_name_len(ptr, end) : 0;
+		if (name_len > 0)
+		{
+			int slot = soap_tmpl_slot_add(tmpl, ptr + 1, name_len);
+			if ((slot < 0) || (soap_tmpl_seg_add(tmpl, lit_off, out - lit_off, slot, (quote) ? SOAP_SLOT_ID_ATTR : SOAP_SLOT_ID_TEXT) != 0))
+			{
+				DBG_ER_LN("too many slots !!! (%s)", xmlbuffer);
+				soap_tmpl_free(tmpl);
+				return NULL;
+			}
+			lit_off = out;
+			istagend = 0;
+			ptr += name_len + 2;
+			continue;
+		}
+
+		if (quote)
+		{
+			if (ch == quote)
+			{
+				quote = 0;
+			}
+		}
+		else if (isintag)
+		{
+			if ((ch == '"') || (ch == '\''))
+			{
+				quote = ch;
+			}
+			else if (ch == '>')
+			{
+				isintag = 0;
+			}
+		}
+		else if (ch == '<')
+		{
+			isintag = 1;
+		}
+		else if ((istagend) && (isspace((unsigned char)ch)))
+		{
+			// the indents of the files under xml/
+			const char *next = ptr;
+			while ((next < end) && (isspace((unsigned char)*next)))
+			{
+				next++;
+			}
+			if ((next == end) || (*next == '<'))
+			{
+				ptr = next;
+				continue;
+			}
+		}
+
+		tmpl->xml[out++] = ch;
+		istagend = ((isintag == 0) && (quote == 0) && (ch == '>'));
+		ptr++;
+	}
+	tmpl->xml[out] = 0;
+	tmpl->xml_len = out;
+
+	if (soap_tmpl_seg_add(tmpl, lit_off, out - lit_off, -1, SOAP_SLOT_ID_TEXT) != 0)
+	{
+		DBG_ER_LN("too many slots !!! (%s)", xmlbuffer);
+		soap_tmpl_free(tmpl);
+		return NULL;
+	}
+
+	return tmpl;
+}
+
+static const char *soap_tmpl_entity(char ch, SOAP_SLOT_ID slot_id)
+{
+	switch (ch)
+	{
+		case '&':
+			return "&amp;";
+		case '<':
+			return "&lt;";
+		case '>':
+			return "&gt;";
+		case '"':
+			return (slot_id == SOAP_SLOT_ID_ATTR) ? "&quot;" : NULL;
+		case '\'':
+			return (slot_id == SOAP_SLOT_ID_ATTR) ? "&apos;" : NULL;
+		default:
+			return NULL;
+	}
+}
+
+static size_t soap_tmpl_len(SoapTmpl_t *tmpl, const char **value_ary)
+{
+	size_t total = 0;
+	int idx = 0;
+	for (idx = 0; idx < tmpl->seg_count; idx++)
+	{
+		SoapSeg_t *seg = &tmpl->seg_ary[idx];
+		total += seg->len;
+
+		const char *value = (seg->slot >= 0) ? value_ary[seg->slot] : NULL;
+		while ((value) && (*value))
+		{
+			const char *entity = soap_tmpl_entity(*value, seg->slot_id);
+			total += (entity) ? strlen(entity) : 1;
+			value++;
+		}
+	}
+	return total;
+}
+
+// dst has soap_tmpl_len() + 1 bytes
+static void soap_tmpl_write(SoapTmpl_t *tmpl, const char **value_ary, char *dst)
+{
+	int idx = 0;
+	for (idx = 0; idx < tmpl->seg_count; idx++)
+	{
+		SoapSeg_t *seg = &tmpl->seg_ary[idx];
+		memcpy(dst, tmpl->xml + seg->off, seg->len);
+		dst += seg->len;
+
+		const char *value = (seg->slot >= 0) ? value_ary[seg->slot] : NULL;
+		while ((value) && (*value))
+		{
+			const char *entity = soap_tmpl_entity(*value, seg->slot_id);
+			if (entity)
+			{
+				size_t entity_len = strlen(entity);
+				memcpy(dst, entity, entity_len);
+				dst += entity_len;
+			}
+			else
+			{
+				*dst++ = *value;
+			}
+			value++;
+		}
+	}
+	*dst = 0;
+}
+
+// return the index of value_ary, -1: not found
+int soap_tmpl_slot(SoapTmpl_t *tmpl, const char *name)
+{
+	int idx = 0;
+	for (idx = 0; (tmpl) && (name) && (idx < tmpl->slot_count); idx++)
+	{
+		if (SAFE_STRCMP(tmpl->slot_ary[idx], (char *)name) == 0)
+		{
+			return idx;
+		}
+	}
+	return -1;
+}
+
+// value_ary[slot_count], NULL is empty
+// the buffer belongs to tmpl and is overwritten by the next call, please lock tmpl between threads
+char *soap_tmpl_render(SoapTmpl_t *tmpl, const char **value_ary, int *len)
+{
+	if ((tmpl == NULL) || ((value_ary == NULL) && (tmpl->slot_count > 0)))
+	{
+		return NULL;
+	}
+
+	size_t total = soap_tmpl_len(tmpl, value_ary);
+	if (total + 1 > tmpl->buf_max)
+	{
+		size_t buf_max = SAFE_MAX(tmpl->buf_max * 2, total + 1);
+		char *buf = (char*)SAFE_REALLOC(tmpl->buf, buf_max);
+		if (buf == NULL)
+		{
+			return NULL;
+		}
+		tmpl->buf = buf;
+		tmpl->buf_max = buf_max;
+	}
+
+	soap_tmpl_write(tmpl, value_ary, tmpl->buf);
+	if (len)
+	{
+		*len = (int)total;
+	}
+	return tmpl->buf;
+}
+
+// the same as soap_tmpl_render, but the caller owns the buffer, e.g. soap_req.request
+char *soap_tmpl_render_alloc(SoapTmpl_t *tmpl, const char **value_ary, int *len)
+{
+	if ((tmpl == NULL) || ((value_ary == NULL) && (tmpl->slot_count > 0)))
+	{
+		return NULL;
+	}
+
+	size_t total = soap_tmpl_len(tmpl, value_ary);
+	char *buf = (char*)SAFE_MALLOC(total + 1);
+	if (buf)
+	{
+		soap_tmpl_write(tmpl, value_ary, buf);
+		if (len)
+		{
+			*len = (int)total;
+		}
+	}
+	return buf;
+}
+
+void soap_tmpl_free(SoapTmpl_t *tmpl)
+{
+	if (tmpl)
+	{
+		SAFE_FREE(tmpl->xml);
+		SAFE_FREE(tmpl->buf);
+		SAFE_FREE(tmpl);
+	}
+}
+
+SoapTmpl_t *soap_tmpl_load(char *filename)
+{
+	SoapTmpl_t *tmpl = NULL;
+	int xml_len = 0;
+	char *xmlbuffer = file_reader(filename, &xml_len);
+	if (xmlbuffer)
+	{
+		tmpl = soap_tmpl_compile_ex(xmlbuffer, xml_len);
+		SAFE_FREE(xmlbuffer);
+	}
+	return tmpl;
+}
+
+// e.g. <Username>{ONVIF_XML_USERNAME}</Username>
+SoapTmpl_t *soap_tmpl_compile(const char *xmlbuffer)
+{
+	if (xmlbuffer)
+	{
+		return soap_tmpl_compile_ex(xmlbuffer, strlen(xmlbuffer));
+	}
+	return NULL;
+}
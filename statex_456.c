@@ -0,0 +1,108 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <sched.h>
+
+#include "utilx9.h"
+
+// events per second vs. the size of fn_links
+
+#define MAX_OF_BENCH_EVENT 200000
+#define MAX_OF_BENCH_INFLIGHT 16
+
+static unsigned long enter_count = 0;
+
+static void bench_enter_cb(StateXFn_t *fn_link, void *data)
+{
+	enter_count++;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_run(int max_fn, int iscoalesce)
+{
+	StateXFn_t *fn_links = (StateXFn_t*)SAFE_CALLOC(max_fn+1, sizeof(StateXFn_t));
+	if (fn_links == NULL)
+	{
+		return;
+	}
+
+	int idx = 0;
+	for (idx = 0; idx < max_fn; idx++)
+	{
+		fn_links[idx].id = idx;
+		fn_links[idx].subitem = -1;
+		fn_links[idx].action = ACTION_ID_OFF;
+		fn_links[idx].enter_cb = bench_enter_cb;
+	}
+	// fn_links[max_fn] is the terminator
+
+	StateX_t statex_bench =
+	{
+		.fn_last = NULL,
+		.fn_links = fn_links,
+
+		.dbg_more = DBG_LVL_MAX,
+		.iscoalesce = iscoalesce,
+	};
+
+	if (statex_open(&statex_bench, "bench") == 0)
+	{
+		enter_count = 0;
+		srand(max_fn);
+
+		double t_start = bench_now();
+		unsigned long sent = 0;
+		for (sent = 0; sent < MAX_OF_BENCH_EVENT; sent++)
+		{
+			// only MAX_OF_QSTATEX pucks can be in the queue
+			while ((iscoalesce==0) && (sent - statex_bench.nevent >= MAX_OF_BENCH_INFLIGHT))
+			{
+				sched_yield();
+			}
+
+			idx = rand() % max_fn;
+			statex_push(&statex_bench, idx, SUBITEM_ID_NONE, (sent & 1) ? ACTION_ID_OFF : ACTION_ID_ON, ACTION_RUN_ID_NORMAL);
+		}
+		while (statex_bench.nevent < sent)
+		{
+			sched_yield();
+		}
+		double t_spent = bench_now() - t_start;
+
+		DBG_WN_LN("(max_fn: %4d, iscoalesce: %d, events: %lu, enter: %lu, %.3f secs, %.0f events/sec)", max_fn, iscoalesce, sent, enter_count, t_spent, sent / t_spent);
+	}
+	statex_close(&statex_bench);
+
+	SAFE_FREE(fn_links);
+}
+
+int main(int argc, char* argv[])
+{
+	int max_ary[] = { 8, 64, 512, MAX_OF_STATEX_FN };
+
+	int i = 0;
+	for (i = 0; i < (int)(sizeof(max_ary)/sizeof(int)); i++)
+	{
+		bench_run(max_ary[i], 0);
+		bench_run(max_ary[i], 1);
+	}
+
+	exit(0);
+}
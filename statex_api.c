@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_STATEX
 #include "utilx9.h"
 
 #define MAX_OF_QSTATEX     30
@@ -21,6 +22,34 @@ StateXFn_t *statex_fn_last(StateX_t *statex_req)
 	return statex_req->fn_last;
 }
 
+static void statex_map_set(StateXMap_t *map_req, int idx)
+{
+	int word = idx >> 6;
+	map_req->map[word] |= (1ULL << (idx & 63));
+	map_req->sum |= (1ULL << word);
+}
+
+static void statex_map_clear(StateXMap_t *map_req, int idx)
+{
+	int word = idx >> 6;
+	map_req->map[word] &= ~(1ULL << (idx & 63));
+	if (map_req->map[word] == 0)
+	{
+		map_req->sum &= ~(1ULL << word);
+	}
+}
+
+// find-first-set, -1: empty
+static int statex_map_first(StateXMap_t *map_req)
+{
+	if (map_req->sum == 0)
+	{
+		return -1;
+	}
+	int word = __builtin_ctzll(map_req->sum);
+	return (word << 6) + __builtin_ctzll(map_req->map[word]);
+}
+
 static void statex_free(StateX_t *statex_req, StateXFn_t *fn_curr)
 {
 	if (fn_curr->init_count)
@@ -54,64 +83,61 @@ static int statex_rotate(StateX_t *statex_req, int run)
 {
 	int ret = 0;
 	StateXFn_t *fn_last = statex_req->fn_last;
-	StateXFn_t *fn_links = statex_req->fn_links;
 	StateXFn_t *fn_curr = NULL;
 
-	int idx = 0;
-	int change = 0;
-	while ((fn_curr = &fn_links[idx]) && (fn_curr->enter_cb))
+	// the first ACTION_ID_ON
+	int idx = statex_map_first(&statex_req->active);
+	if (idx < 0)
 	{
-		if (fn_curr->action == ACTION_ID_ON)
+		goto exit_rotate;
+	}
+
+	fn_curr = &statex_req->fn_links[idx];
+	if (fn_last != fn_curr)
+	{
+		statex_req->fn_last = fn_curr;
+
+		// leave
+		if (fn_last)
 		{
-			if (statex_req->fn_last != fn_curr)
-			{
-				statex_req->fn_last = fn_curr;
-				change = 1;
-			}
-			else
+			if (fn_last->leave_cb)
 			{
-				// again
-				// enter
-				//DBG_ER_LN(">>>>>>>>>>>>>> (run: 0x%02X)", run);
-				if ((run & ACTION_RUN_ID_AGAIN) == ACTION_RUN_ID_AGAIN)
-				{
-					if (fn_curr->enter_cb)
-					{
-						fn_curr->enter_cb(fn_curr, statex_req->data);
-					}
-				}
+				unsigned long long t_start = TRACEX_NOW();
+				fn_last->leave_cb(fn_last, statex_req->data);
+				TRACEX_COMPLETE("statex", "statex_leave", t_start, fn_last->id);
 			}
+		}
 
-			if (change == 1)
+		// enter
+		if (fn_curr->enter_cb)
+		{
+			unsigned long long t_start = TRACEX_NOW();
+			fn_curr->enter_cb(fn_curr, statex_req->data);
+			TRACEX_COMPLETE("statex", "statex_enter", t_start, fn_curr->id);
+		}
+	}
+	else
+	{
+		// again
+		// enter
+		if ((run & ACTION_RUN_ID_AGAIN) == ACTION_RUN_ID_AGAIN)
+		{
+			if (fn_curr->enter_cb)
 			{
-				// leave
-				if (fn_last)
-				{
-					if (fn_last->leave_cb)
-					{
-						fn_last->leave_cb(fn_last, statex_req->data);
-					}
-				}
-
-				// enter
-				if (fn_curr->enter_cb)
-				{
-					fn_curr->enter_cb(fn_curr, statex_req->data);
-				}
+				unsigned long long t_start = TRACEX_NOW();
+				fn_curr->enter_cb(fn_curr, statex_req->data);
+				TRACEX_COMPLETE("statex", "statex_enter", t_start, fn_curr->id);
 			}
-			goto exit_rotate;
 		}
-		idx++;
 	}
 
 exit_rotate:
 	return ret;
 }
 
-static void statex_switch(StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
+static void statex_set(StateX_t *statex_req, int idx, int subitem, ACTION_ID action)
 {
-	StateXFn_t *fn_links = statex_req->fn_links;
-	StateXFn_t *fn_curr = &fn_links[idx];
+	StateXFn_t *fn_curr = &statex_req->fn_links[idx];
 
 	if (action == ACTION_ID_ON)
 	{
@@ -124,9 +150,21 @@ static void statex_switch(StateX_t *statex_req, int idx, int subitem, ACTION_ID
 			}
 			fn_curr->init_count ++;
 		}
+		statex_map_set(&statex_req->active, idx);
+	}
+	else
+	{
+		statex_map_clear(&statex_req->active, idx);
 	}
 	fn_curr->action = action;
 	fn_curr->subitem = subitem;
+}
+
+static void statex_switch(StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
+{
+	StateXFn_t *fn_curr = &statex_req->fn_links[idx];
+
+	statex_set(statex_req, idx, subitem, action);
 
 	statex_rotate(statex_req, run);
 
@@ -137,6 +175,65 @@ static void statex_switch(StateX_t *statex_req, int idx, int subitem, ACTION_ID
 	}
 }
 
+// iscoalesce, handle all the waiting pend_ary[] with one rotation
+static void statex_drain(StateX_t *statex_req)
+{
+	QueueX_t *statex_q = statex_req->statex_q;
+	StateXMap_t snap;
+
+	while (1)
+	{
+		queuex_lock(statex_q);
+		if (statex_req->pending.sum == 0)
+		{
+			statex_req->ispending = 0;
+			queuex_unlock(statex_q);
+			break;
+		}
+		SAFE_MEMCPY(&snap, &statex_req->pending, sizeof(StateXMap_t), sizeof(StateXMap_t));
+		SAFE_MEMSET(&statex_req->pending, 0, sizeof(StateXMap_t));
+
+		int idx = 0;
+		StateXMap_t walk = snap;
+		while ((idx = statex_map_first(&walk)) >= 0)
+		{
+			statex_req->pend_run[idx] = statex_req->pend_ary[idx];
+			SAFE_MEMSET(&statex_req->pend_ary[idx], 0, sizeof(StateXPend_t));
+			statex_map_clear(&walk, idx);
+		}
+		queuex_unlock(statex_q);
+
+		int run = 0;
+		StateXMap_t walk_set = snap;
+		while ((idx = statex_map_first(&walk_set)) >= 0)
+		{
+			StateXPend_t *pend = &statex_req->pend_run[idx];
+			if (statex_req->dbg_more < DBG_LVL_MAX)
+			{
+				DBG_IF_LN("(name: %s, idx: %d, subitem: %d, action: %d, run : %d, count: %d)", statex_q->name, idx, pend->subitem, pend->action, pend->run, pend->count);
+			}
+			statex_set(statex_req, idx, pend->subitem, pend->action);
+			run |= pend->run;
+			statex_req->nevent += pend->count;
+			statex_map_clear(&walk_set, idx);
+		}
+
+		statex_rotate(statex_req, run);
+
+		StateXMap_t walk_free = snap;
+		while ((idx = statex_map_first(&walk_free)) >= 0)
+		{
+			StateXFn_t *fn_curr = &statex_req->fn_links[idx];
+			if (fn_curr->action == ACTION_ID_OFF)
+			{
+				// free
+				statex_free(statex_req, fn_curr);
+			}
+			statex_map_clear(&walk_free, idx);
+		}
+	}
+}
+
 static void statex_new(StateXPuck_t *puck_new, StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
 {
 	puck_new->idx = idx;
@@ -146,33 +243,95 @@ static void statex_new(StateXPuck_t *puck_new, StateX_t *statex_req, int idx, in
 	puck_new->statex_req = statex_req;
 }
 
+// iscoalesce, 1: a puck is needed
+static int statex_merge(StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
+{
+	int ret = 0;
+	QueueX_t *statex_q = statex_req->statex_q;
+
+	queuex_lock(statex_q);
+	StateXPend_t *pend = &statex_req->pend_ary[idx];
+	pend->subitem = subitem;
+	pend->action = action;
+	pend->run |= run;
+	pend->count ++;
+	statex_map_set(&statex_req->pending, idx);
+	if (statex_req->ispending == 0)
+	{
+		statex_req->ispending = 1;
+		ret = 1;
+	}
+	queuex_unlock(statex_q);
+
+	return ret;
+}
+
+// the puck from statex_merge was dropped, let the next statex_add try again
+static void statex_unmerge(StateX_t *statex_req)
+{
+	QueueX_t *statex_q = statex_req->statex_q;
+
+	queuex_lock(statex_q);
+	statex_req->ispending = 0;
+	queuex_unlock(statex_q);
+}
+
+static int statex_check(StateX_t *statex_req, int idx)
+{
+	if ((statex_req == NULL) || (statex_req->statex_q == NULL))
+	{
+		return -1;
+	}
+	if ((idx < 0) || (idx >= statex_req->max_fn))
+	{
+		return -1;
+	}
+	return 0;
+}
+
 void statex_add(StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
 {
-	if ((statex_req) && (statex_req->statex_q))
+	if (statex_check(statex_req, idx) == 0)
 	{
 		StateXPuck_t puck_new;
 
+		if ((statex_req->iscoalesce) && (statex_merge(statex_req, idx, subitem, action, run) == 0))
+		{
+			return;
+		}
+
 		statex_new(&puck_new, statex_req, idx, subitem, action, run);
-		queuex_add(statex_req->statex_q, (void*)&puck_new);
+		if ((queuex_add(statex_req->statex_q, (void*)&puck_new) != 0) && (statex_req->iscoalesce))
+		{
+			statex_unmerge(statex_req);
+		}
 	}
 	else
 	{
-		DBG_ER_LN("statex_add error !!!");
+		DBG_ER_LN("statex_add error !!! (idx: %d)", idx);
 	}
 }
 
 void statex_push(StateX_t *statex_req, int idx, int subitem, ACTION_ID action, int run)
 {
-	if ((statex_req) && (statex_req->statex_q))
+	if (statex_check(statex_req, idx) == 0)
 	{
 		StateXPuck_t puck_new;
 
+		if ((statex_req->iscoalesce) && (statex_merge(statex_req, idx, subitem, action, run) == 0))
+		{
+			return;
+		}
+
 		statex_new(&puck_new, statex_req, idx, subitem, action, run);
-		queuex_push(statex_req->statex_q, (void*)&puck_new);
+		if ((queuex_push(statex_req->statex_q, (void*)&puck_new) != 0) && (statex_req->iscoalesce))
+		{
+			statex_unmerge(statex_req);
+		}
 	}
 	else
 	{
-		DBG_ER_LN("statex_push error !!!");
+		DBG_ER_LN("statex_push error !!! (idx: %d)", idx);
 	}
 }
 
@@ -196,6 +355,12 @@ static int statex_q_exec_cb(void *arg)
 		StateX_t *statex_req = data_pop->statex_req;
 		QueueX_t *statex_q = statex_req->statex_q;
 
+		if (statex_req->iscoalesce)
+		{
+			statex_drain(statex_req);
+			return 0;
+		}
+
 		char *name = statex_q->name;
 		int idx = data_pop->idx;
 		int subitem = data_pop->subitem;
@@ -207,6 +372,7 @@ static int statex_q_exec_cb(void *arg)
 			DBG_IF_LN("(name: %s, idx: %d, subitem: %d, action: %d, run : %d)", name, idx, subitem, action, run);
 		}
 		statex_switch(statex_req, idx, subitem, action, run);
+		statex_req->nevent ++;
 	}
 
 	return 0;
@@ -215,6 +381,41 @@ static int statex_q_exec_cb(void *arg)
 int statex_open(StateX_t *statex_req, char *name)
 {
 	int ret = 0;
+
+	{
+		StateXFn_t *fn_links = statex_req->fn_links;
+		StateXFn_t *fn_curr = NULL;
+
+		int idx = 0;
+		while ((fn_curr = &fn_links[idx]) && (fn_curr->enter_cb))
+		{
+			if (idx >= MAX_OF_STATEX_FN)
+			{
+				DBG_ER_LN("fn_links is too large !!! (name: %s, max: %d)", name, MAX_OF_STATEX_FN);
+				return -1;
+			}
+			idx++;
+		}
+		statex_req->max_fn = idx;
+
+		SAFE_MEMSET(&statex_req->active, 0, sizeof(StateXMap_t));
+		SAFE_MEMSET(&statex_req->pending, 0, sizeof(StateXMap_t));
+		for (idx = 0; idx < statex_req->max_fn; idx++)
+		{
+			if (fn_links[idx].action == ACTION_ID_ON)
+			{
+				statex_map_set(&statex_req->active, idx);
+			}
+		}
+		statex_req->ispending = 0;
+		statex_req->nevent = 0;
+		if (statex_req->max_fn > 0)
+		{
+			statex_req->pend_ary = (StateXPend_t*)SAFE_CALLOC(statex_req->max_fn, sizeof(StateXPend_t));
+			statex_req->pend_run = (StateXPend_t*)SAFE_CALLOC(statex_req->max_fn, sizeof(StateXPend_t));
+		}
+	}
+
 	statex_req->statex_q = queuex_thread_init(name, MAX_OF_QSTATEX, sizeof(StateXPuck_t), statex_q_exec_cb, statex_q_free_cb);
 	if (statex_req->statex_q)
 	{
@@ -246,4 +447,8 @@ void statex_close(StateX_t *statex_req)
 			idx++;
 		}
 	}
+	SAFE_MEMSET(&statex_req->active, 0, sizeof(StateXMap_t));
+	SAFE_MEMSET(&statex_req->pending, 0, sizeof(StateXMap_t));
+	SAFE_FREE(statex_req->pend_ary);
+	SAFE_FREE(statex_req->pend_run);
 }
@@ -197,6 +197,12 @@ void threadx_leave(ThreadX_t *tidx_req)
 
 int threadx_detach(ThreadX_t *tidx_req)
 {
+#ifdef UTIL_EX_TRACEX
+	if (tidx_req)
+	{
+		tracex_thread_name(tidx_req->name);
+	}
+#endif
 	//return SAFE_THREAD_DETACH_EX(tidx_req);
 	return SAFE_THREAD_DETACH_CHECK(tidx_req);
 }
@@ -0,0 +1,175 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <signal.h>
+#include <getopt.h>
+
+#include "utilx9.h"
+
+#define TAG "timerx_123"
+
+TimerX_t *timerx_req = NULL;
+
+TimerXNode_t *tick_node = NULL;
+TimerXNode_t *once_node = NULL;
+TimerXNode_t *long_node = NULL;
+
+LedRequest_t *ledreq_1 = NULL;
+
+LedOn_t ledon_blink[MAX_OF_LEDON]=
+{
+	{LED_ID_1, LED_ACTION_ID_ON, 200},
+	{LED_ID_1, LED_ACTION_ID_OFF, 300},
+};
+
+static int tick_count = 0;
+static int long_done = 0;
+
+static void tick_cb(TimerXNode_t *node, void *usr_data)
+{
+	tick_count++;
+	DBG_IF_LN("(%s, tick_count: %d)", (char*)usr_data, tick_count);
+}
+
+static void once_cb(TimerXNode_t *node, void *usr_data)
+{
+	DBG_IF_LN("(%s)", (char*)usr_data);
+}
+
+static void long_cb(TimerXNode_t *node, void *usr_data)
+{
+	// more than TIMERX_WHEEL_SIZE ticks, cascaded from level 1
+	DBG_IF_LN("(%s, count: %d)", (char*)usr_data, timerx_count(timerx_req));
+	long_done = 1;
+}
+
+static void led_turn_on_cb(void *usr_data)
+{
+	LedOn_t *ledon = (LedOn_t *)usr_data;
+
+	DBG_IF_LN("(id: %d, action: %d, duration: %d)", ledon->id, ledon->action, ledon->duration);
+}
+
+// ** app **
+static int is_quit = 0;
+
+static int app_quit(void)
+{
+	return is_quit;
+}
+
+static void app_set_quit(int mode)
+{
+	is_quit = mode;
+}
+
+static void app_stop(void)
+{
+	if (app_quit()==0)
+	{
+		app_set_quit(1);
+	}
+}
+
+static void app_loop(void)
+{
+	timerx_req = timerx_thread_init("timerx", TIMERX_TICK_MS);
+	if (timerx_req == NULL)
+	{
+		return;
+	}
+
+	tick_node = timerx_add(timerx_req, 100, 100, tick_cb, "tick");
+	once_node = timerx_add(timerx_req, 250, 0, once_cb, "once");
+	long_node = timerx_add(timerx_req, 3000, 0, long_cb, "long");
+
+	ledreq_1 = led_timer_init(timerx_req, "led1", 2, (LedOn_t*)&ledon_blink, led_turn_on_cb);
+
+	while ((app_quit()==0) && (long_done==0))
+	{
+		sleep(1);
+	}
+
+	DBG_IF_LN("(tick_count: %d, fires: %lu, drops: %lu)", tick_count, timerx_req->fires, timerx_req->drops);
+
+	SAFE_LED_CLOSE(ledreq_1);
+
+	timerx_del(timerx_req, tick_node);
+	timerx_del(timerx_req, once_node);
+	timerx_del(timerx_req, long_node);
+	SAFE_TIMERX_CLOSE(timerx_req);
+}
+
+static int app_init(void)
+{
+	int ret = 0;
+
+	return ret;
+}
+
+static void app_exit(void)
+{
+	app_stop();
+}
+
+static void app_signal_handler(int signum)
+{
+	DBG_ER_LN("(signum: %d)", signum);
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			app_stop();
+			break;
+		case SIGPIPE:
+			break;
+
+		case SIGUSR1:
+			break;
+
+		case SIGUSR2:
+			dbg_lvl_round();
+			DBG_ER_LN("dbg_lvl_get(): %d", dbg_lvl_get());
+			DBG_ER_LN("(Version: %s)", version_show());
+			break;
+	}
+}
+
+static void app_signal_register(void)
+{
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGUSR1, app_signal_handler);
+	signal(SIGUSR2, app_signal_handler);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int main(int argc, char* argv[])
+{
+	app_signal_register();
+	atexit(app_exit);
+
+	if ( app_init() == -1 )
+	{
+		return -1;
+	}
+
+	app_loop();
+
+	DBG_WN_LN(DBG_TXT_BYE_BYE);
+	return 0;
+}
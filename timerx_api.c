@@ -0,0 +1,544 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_TIMERX
+#include "utilx9.h"
+
+// hashed and hierarchical timer wheel (similar to linux kernel/timer.c)
+// one timerfd thread moves the wheel, and the expired timers are dispatched into timerx_q.
+// level 0 holds the timers which expire within TIMERX_WHEEL_SIZE ticks, level N holds
+// the timers which expire within TIMERX_WHEEL_SIZE^(N+1) ticks, and they are cascaded
+// down when the lower level wraps around.
+
+#define TIMERX_LEVEL_SHIFT(level) (TIMERX_WHEEL_BITS * (level))
+#define TIMERX_MAX_TICKS ((1ULL << TIMERX_LEVEL_SHIFT(TIMERX_WHEEL_LEVELS)) - 1)
+
+void timerx_lock(TimerX_t *timerx_req)
+{
+	if (timerx_req)
+	{
+		ThreadX_t *tidx_req = &timerx_req->tidx;
+		threadx_lock(tidx_req);
+	}
+}
+
+void timerx_unlock(TimerX_t *timerx_req)
+{
+	if (timerx_req)
+	{
+		ThreadX_t *tidx_req = &timerx_req->tidx;
+		threadx_unlock(tidx_req);
+	}
+}
+
+void timerx_debug(TimerX_t *timerx_req, int dbg_more)
+{
+	if (timerx_req)
+	{
+		timerx_req->dbg_more = dbg_more;
+	}
+}
+
+int timerx_count(TimerX_t *timerx_req)
+{
+	int ret = 0;
+	if (timerx_req)
+	{
+		timerx_lock(timerx_req);
+		ret = timerx_req->count;
+		timerx_unlock(timerx_req);
+	}
+	return ret;
+}
+
+static uint64_t timerx_ms2tick(TimerX_t *timerx_req, int ms)
+{
+	if (ms <= 0)
+	{
+		return 0;
+	}
+	return (ms + timerx_req->tick_ms - 1) / timerx_req->tick_ms;
+}
+
+static void timerx_arm(TimerX_t *timerx_req, int on)
+{
+	struct itimerspec its;
+	SAFE_MEMSET(&its, 0, sizeof(its));
+	if (on)
+	{
+		its.it_value.tv_sec = timerx_req->tick_ms / 1000;
+		its.it_value.tv_nsec = (timerx_req->tick_ms % 1000) * 1000000;
+		its.it_interval = its.it_value;
+	}
+	if (timerfd_settime(timerx_req->timerfd, 0, &its, NULL) == -1)
+	{
+		DBG_ER_LN("timerfd_settime error !!! (errno: %d %s)", errno, strerror(errno));
+	}
+}
+
+static void timerx_unlink(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	if (node->islinked)
+	{
+		node->prev->next = node->next;
+		node->next->prev = node->prev;
+		node->prev = NULL;
+		node->next = NULL;
+		node->islinked = 0;
+		timerx_req->count--;
+	}
+}
+
+static void timerx_link(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	uint64_t expire = node->expire;
+	int64_t delta = (int64_t)(expire - timerx_req->jiffies);
+	TimerXNode_t *head = NULL;
+
+	if (delta < 0)
+	{
+		// already expired, run it at the next tick
+		head = &timerx_req->wheel[0][timerx_req->jiffies & TIMERX_WHEEL_MASK];
+	}
+	else
+	{
+		int level = 0;
+		if ((uint64_t)delta > TIMERX_MAX_TICKS)
+		{
+			// out of range, park it at the top and it will be re-linked while cascading
+			expire = timerx_req->jiffies + TIMERX_MAX_TICKS;
+			level = TIMERX_WHEEL_LEVELS - 1;
+		}
+		else
+		{
+			while ((level < TIMERX_WHEEL_LEVELS - 1) && ((uint64_t)delta >= (1ULL << TIMERX_LEVEL_SHIFT(level+1))))
+			{
+				level++;
+			}
+		}
+		head = &timerx_req->wheel[level][(expire >> TIMERX_LEVEL_SHIFT(level)) & TIMERX_WHEEL_MASK];
+	}
+
+	node->next = head;
+	node->prev = head->prev;
+	head->prev->next = node;
+	head->prev = node;
+	node->islinked = 1;
+	timerx_req->count++;
+}
+
+// detach the whole slot, the caller walks the list with node->next until NULL
+static TimerXNode_t *timerx_slot_detach(TimerX_t *timerx_req, int level, int idx)
+{
+	TimerXNode_t *head = &timerx_req->wheel[level][idx];
+	TimerXNode_t *first = NULL;
+
+	if (head->next != head)
+	{
+		first = head->next;
+		head->prev->next = NULL;
+		head->next = head;
+		head->prev = head;
+	}
+	return first;
+}
+
+static void timerx_cascade(TimerX_t *timerx_req, int level, int idx)
+{
+	TimerXNode_t *node = timerx_slot_detach(timerx_req, level, idx);
+	while (node)
+	{
+		TimerXNode_t *next = node->next;
+		node->islinked = 0;
+		timerx_req->count--;
+		timerx_link(timerx_req, node);
+		node = next;
+	}
+}
+
+static void timerx_dispatch(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	if ((node->ispending) || (threadx_isquit(&timerx_req->tidx)))
+	{
+		// coalesced, timer_cb will be called once
+		return;
+	}
+
+	TimerXPuck_t puck = { .timerx_req = timerx_req, .node = node };
+	node->ispending = 1;
+	if (queuex_add(timerx_req->timerx_q, (void*)&puck) != 0)
+	{
+		// full or quitting, timer_cb won't be called
+		node->ispending = 0;
+		timerx_req->drops++;
+	}
+}
+
+static void timerx_fire(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	if (node->interval_ms > 0)
+	{
+		// keep the period, don't drift with the dispatching
+		uint64_t ticks = timerx_ms2tick(timerx_req, node->interval_ms);
+		node->expire += (ticks > 0) ? ticks : 1;
+		timerx_link(timerx_req, node);
+	}
+
+	timerx_req->fires++;
+	node->isfire = 1;
+	timerx_dispatch(timerx_req, node);
+}
+
+static void timerx_run_tick(TimerX_t *timerx_req)
+{
+	int idx = timerx_req->jiffies & TIMERX_WHEEL_MASK;
+
+	if (idx == 0)
+	{
+		int level = 0;
+		for (level = 1; level < TIMERX_WHEEL_LEVELS; level++)
+		{
+			int sub = (timerx_req->jiffies >> TIMERX_LEVEL_SHIFT(level)) & TIMERX_WHEEL_MASK;
+			timerx_cascade(timerx_req, level, sub);
+			if (sub != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	timerx_req->jiffies++;
+
+	TimerXNode_t *node = timerx_slot_detach(timerx_req, 0, idx);
+	while (node)
+	{
+		TimerXNode_t *next = node->next;
+		node->islinked = 0;
+		timerx_req->count--;
+		timerx_fire(timerx_req, node);
+		node = next;
+	}
+}
+
+static int timerx_q_exec_cb(void *arg)
+{
+	TimerXPuck_t *puck = (TimerXPuck_t *)arg;
+
+	if ((puck) && (puck->timerx_req) && (puck->node))
+	{
+		TimerX_t *timerx_req = puck->timerx_req;
+		TimerXNode_t *node = puck->node;
+
+		SAFE_THREAD_LOCK(&timerx_req->in_run);
+
+		timerx_lock(timerx_req);
+		int isfire = ((node->isdel == 0) && (node->isfire));
+		node->isfire = 0;
+		timerx_unlock(timerx_req);
+
+		if ((isfire) && (node->timer_cb))
+		{
+			node->timer_cb(node, node->usr_data);
+		}
+
+		SAFE_THREAD_UNLOCK(&timerx_req->in_run);
+	}
+
+	return 0;
+}
+
+static int timerx_q_free_cb(void *arg)
+{
+	TimerXPuck_t *puck = (TimerXPuck_t *)arg;
+
+	if ((puck) && (puck->timerx_req) && (puck->node))
+	{
+		TimerX_t *timerx_req = puck->timerx_req;
+		TimerXNode_t *node = puck->node;
+		int isfree = 0;
+
+		timerx_lock(timerx_req);
+		node->ispending = 0;
+		if (node->isdel)
+		{
+			isfree = 1;
+		}
+		else if (node->isfire)
+		{
+			// expired again while timer_cb was running
+			timerx_dispatch(timerx_req, node);
+		}
+		timerx_unlock(timerx_req);
+
+		if (isfree)
+		{
+			SAFE_FREE(node);
+		}
+	}
+
+	return 0;
+}
+
+TimerXNode_t *timerx_add(TimerX_t *timerx_req, int expire_ms, int interval_ms, timerx_fn timer_cb, void *usr_data)
+{
+	if ((timerx_req == NULL) || (timer_cb == NULL))
+	{
+		return NULL;
+	}
+
+	TimerXNode_t *node = (TimerXNode_t*)SAFE_CALLOC(1, sizeof(TimerXNode_t));
+	if (node)
+	{
+		node->interval_ms = interval_ms;
+		node->timer_cb = timer_cb;
+		node->usr_data = usr_data;
+		node->timerx_req = timerx_req;
+
+		timerx_lock(timerx_req);
+		node->expire = timerx_req->jiffies + timerx_ms2tick(timerx_req, expire_ms);
+		timerx_link(timerx_req, node);
+		if (timerx_req->count == 1)
+		{
+			threadx_wakeup(&timerx_req->tidx);
+		}
+		if (timerx_req->dbg_more < DBG_LVL_MAX)
+		{
+			DBG_IF_LN("(name: %s, expire_ms: %d, interval_ms: %d, count: %d)", timerx_req->name, expire_ms, interval_ms, timerx_req->count);
+		}
+		timerx_unlock(timerx_req);
+	}
+
+	return node;
+}
+
+// restart the timer, 0: ok, -1: error
+int timerx_mod(TimerX_t *timerx_req, TimerXNode_t *node, int expire_ms)
+{
+	int ret = -1;
+	if ((timerx_req == NULL) || (node == NULL))
+	{
+		return ret;
+	}
+
+	timerx_lock(timerx_req);
+	if (node->isdel == 0)
+	{
+		timerx_unlink(timerx_req, node);
+		node->isfire = 0;
+		node->expire = timerx_req->jiffies + timerx_ms2tick(timerx_req, expire_ms);
+		timerx_link(timerx_req, node);
+		if (timerx_req->count == 1)
+		{
+			threadx_wakeup(&timerx_req->tidx);
+		}
+		ret = 0;
+	}
+	timerx_unlock(timerx_req);
+
+	return ret;
+}
+
+// 1: the timer was in the wheel, 0: not
+int timerx_cancel(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	int ret = 0;
+	if ((timerx_req == NULL) || (node == NULL))
+	{
+		return ret;
+	}
+
+	timerx_lock(timerx_req);
+	ret = node->islinked;
+	timerx_unlink(timerx_req, node);
+	node->isfire = 0;
+	timerx_unlock(timerx_req);
+
+	return ret;
+}
+
+// the node can't be used after timerx_del, and timer_cb isn't running when it returns (except when called inside timer_cb)
+void timerx_del(TimerX_t *timerx_req, TimerXNode_t *node)
+{
+	if ((timerx_req == NULL) || (node == NULL))
+	{
+		return;
+	}
+
+	int isfree = 0;
+
+	timerx_lock(timerx_req);
+	timerx_unlink(timerx_req, node);
+	node->isfire = 0;
+	node->isdel = 1;
+	isfree = (node->ispending == 0);
+	timerx_unlock(timerx_req);
+
+	if (isfree)
+	{
+		SAFE_FREE(node);
+	}
+	else
+	{
+		// wait for the running timer_cb, timerx_q_free_cb will free the node
+		SAFE_THREAD_LOCK(&timerx_req->in_run);
+		SAFE_THREAD_UNLOCK(&timerx_req->in_run);
+	}
+}
+
+static void *timerx_thread_handler(void *user)
+{
+	TimerX_t *timerx_req = (TimerX_t*)user;
+	ThreadX_t *tidx_req = &timerx_req->tidx;
+
+	threadx_detach(tidx_req);
+
+	int isarmed = 0;
+	while (threadx_isquit(tidx_req)==0)
+	{
+		timerx_lock(timerx_req);
+		if (timerx_req->count == 0)
+		{
+			// nothing to do, stop the timerfd and sleep until timerx_add
+			if (isarmed)
+			{
+				timerx_arm(timerx_req, 0);
+				isarmed = 0;
+			}
+			threadx_wait(tidx_req);
+			timerx_unlock(timerx_req);
+			continue;
+		}
+		if (isarmed == 0)
+		{
+			timerx_arm(timerx_req, 1);
+			isarmed = 1;
+		}
+		timerx_unlock(timerx_req);
+
+		uint64_t expirations = 0;
+		ssize_t len = read(timerx_req->timerfd, &expirations, sizeof(expirations));
+		if (len == sizeof(expirations))
+		{
+			timerx_lock(timerx_req);
+			// catch up the lost ticks
+			while ((expirations > 0) && (timerx_req->count > 0))
+			{
+				timerx_run_tick(timerx_req);
+				expirations--;
+			}
+			timerx_unlock(timerx_req);
+		}
+		else if ((len == -1) && (errno != EINTR) && (errno != EAGAIN))
+		{
+			DBG_ER_LN("read error !!! (errno: %d %s)", errno, strerror(errno));
+			break;
+		}
+	}
+
+	threadx_leave(tidx_req);
+
+	return NULL;
+}
+
+void timerx_thread_stop(TimerX_t *timerx_req)
+{
+	if (timerx_req)
+	{
+		ThreadX_t *tidx_req = &timerx_req->tidx;
+		threadx_stop(tidx_req);
+	}
+}
+
+void timerx_thread_close(TimerX_t *timerx_req)
+{
+	if ((timerx_req) && (timerx_req->isfree == 0))
+	{
+		timerx_req->isfree ++;
+
+		ThreadX_t *tidx_req = &timerx_req->tidx;
+		// the wheel stops first, timerx_q_free_cb still needs the lock
+		threadx_stop(tidx_req);
+		threadx_join(tidx_req);
+
+		queuex_thread_stop(timerx_req->timerx_q);
+		queuex_thread_close(timerx_req->timerx_q);
+		timerx_req->timerx_q = NULL;
+
+		int level = 0;
+		for (level = 0; level < TIMERX_WHEEL_LEVELS; level++)
+		{
+			int idx = 0;
+			for (idx = 0; idx < TIMERX_WHEEL_SIZE; idx++)
+			{
+				TimerXNode_t *node = timerx_slot_detach(timerx_req, level, idx);
+				while (node)
+				{
+					TimerXNode_t *next = node->next;
+					SAFE_FREE(node);
+					node = next;
+				}
+			}
+		}
+
+		threadx_close(tidx_req);
+
+		SAFE_CLOSE(timerx_req->timerfd);
+		SAFE_MUTEX_DESTROY(&timerx_req->in_run);
+		SAFE_FREE(timerx_req);
+	}
+}
+
+TimerX_t *timerx_thread_init(char *name, int tick_ms)
+{
+	TimerX_t *timerx_req = (TimerX_t*)SAFE_CALLOC(1, sizeof(TimerX_t));
+
+	if (timerx_req)
+	{
+		SAFE_SPRINTF_EX(timerx_req->name, "%s", name);
+		timerx_req->tick_ms = (tick_ms > 0) ? tick_ms : TIMERX_TICK_MS;
+		timerx_req->dbg_more = DBG_LVL_MAX;
+
+		int level = 0;
+		for (level = 0; level < TIMERX_WHEEL_LEVELS; level++)
+		{
+			int idx = 0;
+			for (idx = 0; idx < TIMERX_WHEEL_SIZE; idx++)
+			{
+				TimerXNode_t *head = &timerx_req->wheel[level][idx];
+				head->next = head;
+				head->prev = head;
+			}
+		}
+
+		timerx_req->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (timerx_req->timerfd == -1)
+		{
+			DBG_ER_LN("timerfd_create error !!! (errno: %d %s)", errno, strerror(errno));
+			SAFE_FREE(timerx_req);
+			return NULL;
+		}
+		SAFE_MUTEX_ATTR_RECURSIVE(timerx_req->in_run);
+
+		timerx_req->timerx_q = queuex_thread_init(timerx_req->name, MAX_OF_QTIMERX, sizeof(TimerXPuck_t), timerx_q_exec_cb, timerx_q_free_cb);
+		queuex_isready(timerx_req->timerx_q, 10);
+
+		{
+			ThreadX_t *tidx_req = &timerx_req->tidx;
+			tidx_req->thread_cb = timerx_thread_handler;
+			tidx_req->data = timerx_req;
+			threadx_init(tidx_req, timerx_req->name);
+		}
+	}
+	return timerx_req;
+}
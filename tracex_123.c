@@ -0,0 +1,220 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <signal.h>
+#include <getopt.h>
+
+#include "utilx9.h"
+
+#define TAG "tracex_123"
+
+#define MAX_OF_QTEST 64
+
+typedef struct TestX_Struct
+{
+	int idx;
+} TestX_t;
+
+static QueueX_t *test_q = NULL;
+
+static char tracex_filename[LEN_OF_FULLNAME] = "/tmp/tracex.json";
+static int tracex_secs = 0; // 0: forever
+static int tracex_isdump = 0;
+
+static int test_q_exec_cb(void *arg)
+{
+	TestX_t *data_pop = (TestX_t *)arg;
+
+	if (data_pop)
+	{
+		// 1 ~ 1024 us
+		TRACEX_SPAN("tracex_123", "test_q_exec_cb");
+		TRACEX_SPAN_ARG(data_pop->idx);
+		usleep(1 + (data_pop->idx % 1024));
+	}
+
+	return 0;
+}
+
+// ** app **
+static int is_quit = 0;
+
+static int app_quit(void)
+{
+	return is_quit;
+}
+
+static void app_set_quit(int mode)
+{
+	is_quit = mode;
+}
+
+static void app_stop(void)
+{
+	if (app_quit()==0)
+	{
+		app_set_quit(1);
+	}
+}
+
+static void app_loop(void)
+{
+	tracex_start(0);
+	test_q = queuex_thread_init("tracex_123", MAX_OF_QTEST, sizeof(TestX_t), test_q_exec_cb, NULL);
+	queuex_isready(test_q, 5);
+
+	DBG_WN_LN("kill -USR1 %d, then open %s with ui.perfetto.dev", getpid(), tracex_filename);
+
+	int idx = 0;
+	time_t t_end = time(NULL) + tracex_secs;
+	while ((app_quit() == 0) && ((tracex_secs == 0) || (time(NULL) < t_end)))
+	{
+		{
+			TRACEX_SPAN("tracex_123", "app_loop");
+			TestX_t data_new = { .idx = idx++ };
+			queuex_push(test_q, (void*)&data_new);
+			if ((idx % 1000) == 0)
+			{
+				TRACEX_INSTANT("tracex_123", "app_loop_1000", idx);
+			}
+		}
+		usleep(500);
+
+		if (tracex_isdump)
+		{
+			tracex_isdump = 0;
+			tracex_dump(tracex_filename);
+		}
+	}
+
+	queuex_thread_stop(test_q);
+	queuex_thread_close(test_q);
+
+	tracex_dump(tracex_filename);
+	tracex_close();
+}
+
+static int app_init(void)
+{
+	int ret = 0;
+
+	return ret;
+}
+
+static void app_exit(void)
+{
+	app_stop();
+}
+
+static void app_signal_handler(int signum)
+{
+	DBG_ER_LN("(signum: %d)", signum);
+	switch (signum)
+	{
+		case SIGINT:
+		case SIGTERM:
+		case SIGHUP:
+			app_stop();
+			break;
+		case SIGPIPE:
+			break;
+
+		case SIGUSR1:
+			tracex_isdump = 1;
+			break;
+
+		case SIGUSR2:
+			dbg_lvl_round();
+			DBG_ER_LN("dbg_lvl_get(): %d", dbg_lvl_get());
+			DBG_ER_LN("(Version: %s)", version_show());
+			break;
+	}
+}
+
+static void app_signal_register(void)
+{
+	signal(SIGINT, app_signal_handler);
+	signal(SIGTERM, app_signal_handler);
+	signal(SIGHUP, app_signal_handler);
+	signal(SIGUSR1, app_signal_handler);
+	signal(SIGUSR2, app_signal_handler);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int option_index = 0;
+const char* short_options = "f:s:h";
+static struct option long_options[] =
+{
+	{ "file",        required_argument,   NULL,    'f'  },
+	{ "secs",        required_argument,   NULL,    's'  },
+	{ "help",        no_argument,         NULL,    'h'  },
+	{ 0,             0,                      0,    0    }
+};
+
+static void app_showusage(int exit_code)
+{
+	printf("Usage: %s\n"
+		"  -f, --file        the trace file, dumped on SIGUSR1 and at the end\n"
+		"  -s, --secs        seconds to run, 0: until Ctrl+C\n"
+		"  -h, --help\n", TAG);
+	printf("Version: %s\n", version_show());
+	printf("Example:\n"
+		"  %s -f /tmp/tracex.json -s 10\n", TAG);
+	exit(exit_code);
+}
+
+static void app_ParseArguments(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				if (optarg)
+				{
+					SAFE_SPRINTF_EX(tracex_filename, "%s", optarg);
+				}
+				break;
+			case 's':
+				if (optarg)
+				{
+					tracex_secs = atoi(optarg);
+				}
+				break;
+			default:
+				app_showusage(-1);
+				break;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	app_ParseArguments(argc, argv);
+	app_signal_register();
+	atexit(app_exit);
+
+	if ( app_init() == -1 )
+	{
+		return -1;
+	}
+
+	app_loop();
+
+	DBG_WN_LN(DBG_TXT_BYE_BYE);
+	return 0;
+}
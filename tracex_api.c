@@ -0,0 +1,303 @@
+/***************************************************************************
+ * Copyright (C) 2017 - 2020, Lanka Hsu, <lankahsu@gmail.com>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include <ctype.h>
+
+#include "utilx9.h"
+
+#ifdef UTIL_EX_TRACEX
+// every thread writes its events into its own ring, the oldest are overwritten.
+// tracex_dump copies the rings while they are written, the slots which might
+// have been overwritten during the copy are skipped.
+// when tracex is off, TRACEX_* only read tracex_enable.
+
+typedef struct TraceXRing_STRUCT
+{
+	struct TraceXRing_STRUCT *next;
+
+	unsigned int tid;
+	int isexit; // the thread is gone, freed by tracex_dump or tracex_close
+	char name[LEN_OF_NAME32];
+
+	uint32_t size;
+	uint64_t head; // the owner
+	uint64_t base; // tracex_close, the events before it are dropped
+
+	TraceXEvent_t *event_ary;
+} TraceXRing_t;
+
+int tracex_enable = 0;
+
+static int tracex_ring_size = TRACEX_RING_SIZE;
+static pthread_mutex_t tracex_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static TraceXRing_t *tracex_ring_list = NULL;
+static pthread_once_t tracex_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tracex_key;
+
+static __thread TraceXRing_t *tracex_ring = NULL;
+static __thread char tracex_name[LEN_OF_NAME32] = "";
+
+unsigned long long tracex_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void tracex_ring_exit(void *arg)
+{
+	TraceXRing_t *ring = (TraceXRing_t *)arg;
+	tracex_ring = NULL;
+	__atomic_store_n(&ring->isexit, 1, __ATOMIC_RELEASE);
+}
+
+static void tracex_once_init(void)
+{
+	pthread_key_create(&tracex_key, tracex_ring_exit);
+}
+
+static TraceXRing_t *tracex_ring_get(void)
+{
+	if (tracex_ring == NULL)
+	{
+		pthread_once(&tracex_once, tracex_once_init);
+
+		TraceXRing_t *ring = (TraceXRing_t *)SAFE_CALLOC(1, sizeof(TraceXRing_t));
+		if (ring)
+		{
+			ring->size = tracex_ring_size;
+			ring->event_ary = (TraceXEvent_t *)SAFE_CALLOC(ring->size, sizeof(TraceXEvent_t));
+			if (ring->event_ary == NULL)
+			{
+				SAFE_FREE(ring);
+				return NULL;
+			}
+
+			ring->tid = (unsigned int)gettidv1_ex();
+			SAFE_SPRINTF_EX(ring->name, "%s", tracex_name);
+			pthread_setspecific(tracex_key, ring);
+
+			SAFE_THREAD_LOCK(&tracex_mtx);
+			ring->next = tracex_ring_list;
+			tracex_ring_list = ring;
+			SAFE_THREAD_UNLOCK(&tracex_mtx);
+
+			tracex_ring = ring;
+		}
+	}
+	return tracex_ring;
+}
+
+void tracex_event(char ph, const char *cat, const char *name, unsigned long long ts, unsigned long long dur, unsigned long long id, long long arg)
+{
+	TraceXRing_t *ring = tracex_ring_get();
+	if (ring)
+	{
+		uint64_t head = ring->head;
+		TraceXEvent_t *event = &ring->event_ary[head & (ring->size - 1)];
+		event->ts = ts;
+		event->dur = dur;
+		event->id = id;
+		event->arg = arg;
+		event->cat = cat;
+		event->name = name;
+		event->ph = ph;
+		__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	}
+}
+
+void tracex_span_end(TraceXSpan_t *span)
+{
+	if ((span) && (span->ts))
+	{
+		tracex_event('X', span->cat, span->name, span->ts, tracex_now() - span->ts, 0, span->arg);
+	}
+}
+
+// ThreadX_t calls this with its name
+void tracex_thread_name(const char *name)
+{
+	if (name)
+	{
+		SAFE_SPRINTF_EX(tracex_name, "%s", name);
+		if (tracex_ring)
+		{
+			SAFE_THREAD_LOCK(&tracex_mtx);
+			SAFE_SPRINTF_EX(tracex_ring->name, "%s", name);
+			SAFE_THREAD_UNLOCK(&tracex_mtx);
+		}
+	}
+}
+
+void tracex_start(int ring_size)
+{
+	if (ring_size > 0)
+	{
+		// power of 2
+		int size = 1;
+		while (size < ring_size)
+		{
+			size <<= 1;
+		}
+		tracex_ring_size = size;
+	}
+	__atomic_store_n(&tracex_enable, 1, __ATOMIC_RELAXED);
+	DBG_IF_LN("(ring_size: %d)", tracex_ring_size);
+}
+
+void tracex_stop(void)
+{
+	__atomic_store_n(&tracex_enable, 0, __ATOMIC_RELAXED);
+}
+
+static void tracex_json_name(FILE *fp, const char *name)
+{
+	// only [A-Za-z0-9_-. :/] are kept, it is a json string
+	const char *cur = (name) ? name : "";
+	for (; *cur; cur++)
+	{
+		fputc( ((isalnum((unsigned char)*cur)) || (strchr("_-. :/", *cur))) ? *cur : '_', fp);
+	}
+}
+
+static int tracex_ring_dump(FILE *fp, TraceXRing_t *ring, TraceXEvent_t *copy_ary, int pid, int *isfirst)
+{
+	int count = 0;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t start = (head > ring->size) ? head - ring->size : 0;
+	uint64_t idx = 0;
+
+	for (idx = start; idx < head; idx++)
+	{
+		copy_ary[idx - start] = ring->event_ary[idx & (ring->size - 1)];
+	}
+
+	// the owner might be writing the slot of (head_now - size)
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	uint64_t head_now = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	uint64_t valid = (head_now + 1 > ring->size) ? head_now + 1 - ring->size : 0;
+	uint64_t base = __atomic_load_n(&ring->base, __ATOMIC_RELAXED);
+	if (valid < base)
+	{
+		valid = base;
+	}
+
+	fprintf(fp, "%s\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"", (*isfirst) ? "" : ",", pid, ring->tid);
+	tracex_json_name(fp, (ring->name[0]) ? ring->name : "thread");
+	fprintf(fp, "\"}}");
+	*isfirst = 0;
+
+	for (idx = start; idx < head; idx++)
+	{
+		if (idx < valid)
+		{
+			continue;
+		}
+
+		TraceXEvent_t *event = &copy_ary[idx - start];
+		fprintf(fp, ",\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%u,\"cat\":\"%s\",\"name\":\"%s\",\"ts\":%llu.%03llu", event->ph, pid, ring->tid, event->cat, event->name, event->ts / 1000, event->ts % 1000);
+		switch (event->ph)
+		{
+			case 'X':
+				fprintf(fp, ",\"dur\":%llu.%03llu,\"args\":{\"arg\":%lld}}", event->dur / 1000, event->dur % 1000, event->arg);
+				break;
+			case 'i':
+				fprintf(fp, ",\"s\":\"t\",\"args\":{\"arg\":%lld}}", event->arg);
+				break;
+			case 'b':
+			case 'e':
+				fprintf(fp, ",\"id\":\"0x%llx\"}", event->id);
+				break;
+			default:
+				fprintf(fp, "}");
+				break;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+// the rings of the exited threads are freed after they are written
+static void tracex_ring_sweep(void)
+{
+	TraceXRing_t **prev = &tracex_ring_list;
+	while (*prev)
+	{
+		TraceXRing_t *ring = *prev;
+		if (__atomic_load_n(&ring->isexit, __ATOMIC_ACQUIRE))
+		{
+			*prev = ring->next;
+			SAFE_FREE(ring->event_ary);
+			SAFE_FREE(ring);
+		}
+		else
+		{
+			prev = &ring->next;
+		}
+	}
+}
+
+int tracex_dump(char *filename)
+{
+	int count = 0;
+	int isfirst = 1;
+	int pid = (int)getpid();
+
+	FILE *fp = SAFE_FOPEN(filename, "w");
+	if (fp == NULL)
+	{
+		DBG_ER_LN("SAFE_FOPEN error !!! (filename: %s)", filename);
+		return -1;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	SAFE_THREAD_LOCK(&tracex_mtx);
+	TraceXRing_t *ring = NULL;
+	for (ring = tracex_ring_list; ring != NULL; ring = ring->next)
+	{
+		TraceXEvent_t *copy_ary = (TraceXEvent_t *)SAFE_CALLOC(ring->size, sizeof(TraceXEvent_t));
+		if (copy_ary)
+		{
+			count += tracex_ring_dump(fp, ring, copy_ary, pid, &isfirst);
+			SAFE_FREE(copy_ary);
+		}
+	}
+	tracex_ring_sweep();
+	SAFE_THREAD_UNLOCK(&tracex_mtx);
+
+	fprintf(fp, "\n]}\n");
+	SAFE_FCLOSE(fp);
+
+	DBG_IF_LN("(filename: %s, count: %d)", filename, count);
+	return count;
+}
+
+// the rings of the living threads are kept (their owners still point to them), only emptied
+void tracex_close(void)
+{
+	tracex_stop();
+
+	SAFE_THREAD_LOCK(&tracex_mtx);
+	tracex_ring_sweep();
+	TraceXRing_t *ring = NULL;
+	for (ring = tracex_ring_list; ring != NULL; ring = ring->next)
+	{
+		__atomic_store_n(&ring->base, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+	}
+	SAFE_THREAD_UNLOCK(&tracex_mtx);
+}
+#endif
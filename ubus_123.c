@@ -32,6 +32,12 @@ static int is_list = 0;
 static int is_service = 0;
 static int is_notify = 0;
 static int is_event = 0;
+static int is_burst = 0;
+static int is_remove = 0;
+static int async_count = 0;
+
+static int async_done = 0;
+static int async_error = 0;
 
 char msg[LEN_OF_BUF256]="";
 
@@ -100,6 +106,28 @@ void ubus_invoke_echo_cb(struct ubus_request *req, int type, struct blob_attr *m
 	SAFE_FREE(cMsg);
 }
 
+static void ubus_invoke_async_cb(struct ubus_request *req, int ret)
+{
+	if (ret == UBUS_STATUS_OK)
+	{
+		async_done ++;
+	}
+	else
+	{
+		async_error ++;
+	}
+
+	if (async_done + async_error >= async_count)
+	{
+		uloop_end();
+	}
+}
+
+static void ubus_remove_timeout_cb(struct uloop_timeout *t)
+{
+	uloop_end();
+}
+
 static int ubus_srv_handler_echo(struct ubus_context *ubus_req, struct ubus_object *obj, struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
 	struct blob_attr *tb[UBUS_P_ECHO_ID_MAX];
@@ -205,14 +233,106 @@ static void ubus_cli_event_cb(struct ubus_context *ctx, struct ubus_event_handle
 }
 #endif
 
+// 100 updates, the subscribers get one notify and one event with the last b_count
+void ubus_srv_burst(void)
+{
+	static int b_count = 0;
+	int i = 0;
+
+	for (i = 0; i < 100; i++)
+	{
+		b_count++;
+
+		char tmpbuf[LEN_OF_VAL32] = "";
+		SAFE_SPRINTF_EX(tmpbuf, "b_count: %d", b_count);
+#ifdef USE_UBUS_NOTIFY
+		ubus_srv_notify_coalesce(UBUS_M_ECHO, &ubus_srv_m_obj, UBUS_P_ECHO_MSG, tmpbuf);
+#endif
+#ifdef USE_UBUS_EVENT
+		ubus_srv_send_event_coalesce(UBUS_B_O_ECHO, UBUS_P_ECHO_MSG, tmpbuf);
+#endif
+	}
+}
+
+#if defined(USE_UBUS_UNICAST) && defined(USE_UBUS_NOTIFY)
+// one process against ubusd
+//  1. async_count calls of ubus_cli_invoke_async to itself, timeout 0 (TIMEOUT_OF_UBUS_REPLY)
+//  2. 100 ubus_srv_notify_coalesce on a calloc'd object, which is removed and freed inside the window
+//  3. the coalesce window fires, valgrind / ASan would catch a touch of the freed object
+static void ubus_remove_scenario(struct ubus_context *ubus_req)
+{
+	struct ubus_object *obj = (struct ubus_object *)SAFE_CALLOC(1, sizeof(struct ubus_object));
+	if (obj == NULL)
+	{
+		return;
+	}
+	obj->name = UBUS_M_O_ECHO;
+	obj->type = &ubus_m_t_echo;
+
+	ubus_srv_add_object_ex(ubus_req, &ubus_srv_u_obj);
+	ubus_srv_object_subscribe(ubus_req, obj, ubus_srv_subscribe_cb);
+
+	uloop_init();
+	ubus_add_uloop_ex(ubus_req);
+
+	if (async_count <= 0)
+	{
+		async_count = 100;
+	}
+
+	struct blob_buf bbuf = {};
+	blob_buf_init(&bbuf, 0);
+	blobmsg_add_string(&bbuf, UBUS_P_ECHO_MSG, (SAFE_STRLEN(msg) > 0) ? msg : TAG);
+	int i = 0;
+	for (i = 0; i < async_count; i++)
+	{
+		if (ubus_cli_invoke_async(UBUS_U_O_ECHO, UBUS_M_ECHO, &bbuf, NULL, ubus_invoke_async_cb, NULL, 0) == -1)
+		{
+			async_error ++;
+		}
+	}
+	blob_buf_free(&bbuf);
+
+	// the timer is armed even with timeout 0, so uloop_run always returns
+	if (async_done + async_error < async_count)
+	{
+		uloop_run();
+	}
+
+	char tmpbuf[LEN_OF_VAL32] = "";
+	for (i = 0; i < 100; i++)
+	{
+		SAFE_SPRINTF_EX(tmpbuf, "r_count: %d", i);
+		ubus_srv_notify_coalesce(UBUS_M_ECHO, obj, UBUS_P_ECHO_MSG, tmpbuf);
+	}
+	ubus_srv_remove_object_ex(ubus_req, obj);
+	SAFE_FREE(obj);
+
+	struct uloop_timeout remove_timer = { .cb = ubus_remove_timeout_cb };
+	uloop_timeout_set_ex();
+	uloop_timeout_set(&remove_timer, TIMEOUT_OF_EVENT_200MSEC * 3);
+	uloop_run();
+
+	DBG_IF_LN("%s (async_count: %d, async_done: %d, async_error: %d, ubus_cli_invoke_pending: %d)", ((async_done == async_count) && (ubus_cli_invoke_pending() == 0)) ? "pass" : "fail", async_count, async_done, async_error, ubus_cli_invoke_pending());
+	uloop_done();
+}
+#endif
+
 void timer_3sec_loop(struct uloop_timeout *t)
 {
+	if (is_burst)
+	{
+		ubus_srv_burst();
+	}
+	else
+	{
 #ifdef USE_UBUS_NOTIFY
-	ubus_srv_publish();
+		ubus_srv_publish();
 #endif
 #ifdef USE_UBUS_EVENT
-	ubus_srv_event();
+		ubus_srv_event();
 #endif
+	}
 	uloop_timeout_set(t, 3 * 1000);
 }
 
@@ -223,7 +343,19 @@ static int app_quit(void)
 
 static void app_loop(void)
 {
-	if (is_list)
+	if (is_remove)
+	{
+#if defined(USE_UBUS_UNICAST) && defined(USE_UBUS_NOTIFY)
+		struct ubus_context *ubus_req = NULL;
+		if ((ubus_req = ubus_srv_init()))
+		{
+			ubus_remove_scenario(ubus_req);
+		}
+#else
+		DBG_ER_LN("%s", DBG_TXT_NO_SUPPORT);
+#endif
+	}
+	else if (is_list)
 	{
 		if (ubus_conn_init())
 		{
@@ -341,7 +473,33 @@ static void app_loop(void)
 			struct blob_buf bbuf = {};
 			blob_buf_init(&bbuf, 0);
 			blobmsg_add_string(&bbuf, UBUS_P_ECHO_MSG, msg);
-			ubus_cli_invoke_ex(UBUS_U_O_ECHO, UBUS_M_ECHO, &bbuf, ubus_invoke_echo_cb, TIMEOUT_OF_UBUS_REPLY);
+			if (async_count > 0)
+			{
+				// all the calls are sent before the first reply
+				uloop_init();
+				ubus_add_uloop_ex(ubus_req);
+
+				unsigned long long start = metricx_now_us();
+				int i = 0;
+				for (i = 0; i < async_count; i++)
+				{
+					if (ubus_cli_invoke_async(UBUS_U_O_ECHO, UBUS_M_ECHO, &bbuf, NULL, ubus_invoke_async_cb, NULL, TIMEOUT_OF_UBUS_REPLY) == -1)
+					{
+						async_error ++;
+					}
+				}
+
+				if (async_done + async_error < async_count)
+				{
+					uloop_run();
+				}
+				DBG_IF_LN("(async_count: %d, async_done: %d, async_error: %d, elapsed: %llu us)", async_count, async_done, async_error, metricx_now_us() - start);
+				uloop_done();
+			}
+			else
+			{
+				ubus_cli_invoke_ex(UBUS_U_O_ECHO, UBUS_M_ECHO, &bbuf, ubus_invoke_echo_cb, TIMEOUT_OF_UBUS_REPLY);
+			}
 			blob_buf_free(&bbuf);
 		}
 #else
@@ -423,7 +581,7 @@ static void app_signal_register(void)
 }
 
 int option_index = 0;
-const char* short_options = "d:m:slneh";
+const char* short_options = "d:m:slnebra:h";
 static struct option long_options[] =
 {
 	{ "debug",       required_argument,   NULL,    'd'  },
@@ -432,6 +590,9 @@ static struct option long_options[] =
 	{ "list",        no_argument,         NULL,    'l'  },
 	{ "notify",      no_argument,         NULL,    'n'  },
 	{ "event",       no_argument,         NULL,    'e'  },
+	{ "burst",       no_argument,         NULL,    'b'  },
+	{ "remove",      no_argument,         NULL,    'r'  },
+	{ "async",       required_argument,   NULL,    'a'  },
 	{ "help",        no_argument,         NULL,    'h'  },
 	{ 0,             0,                      0,    0    }
 };
@@ -445,10 +606,15 @@ static void app_showusage(int exit_code)
 		"  -l, --list\n"
 		"  -n, --notify\n"
 		"  -e, --event\n"
+		"  -b, --burst       service, 100 updates every 3 seconds by ubus_srv_notify_coalesce\n"
+		"  -r, --remove      one process, ubus_cli_invoke_async to itself, then an object is removed inside the coalesce window\n"
+		"  -a, --async       count of the pipelined ubus_cli_invoke_async, with -m or -r\n"
 		"  -h, --help\n", TAG);
 	printf("Version: %s\n", version_show());
 	printf("Example:\n"
-		"  %s -d 4 -s\n", TAG);
+		"  %s -d 4 -s\n"
+		"  %s -m lanka -a 1000\n"
+		"  %s -d 4 -r -a 1000\n", TAG, TAG, TAG);
 	exit(exit_code);
 }
 
@@ -484,6 +650,18 @@ static void app_ParseArguments(int argc, char **argv)
 			case 'e':
 				is_event = 1;
 				break;
+			case 'b':
+				is_burst = 1;
+				break;
+			case 'r':
+				is_remove = 1;
+				break;
+			case 'a':
+				if (optarg)
+				{
+					async_count = atoi(optarg);
+				}
+				break;
 			default:
 				app_showusage(-1);
 				break;
@@ -495,6 +673,7 @@ static void app_ParseArguments(int argc, char **argv)
 // valgrind --tool=memcheck --leak-check=full --show-reachable=yes --track-origins=yes ./ubus_123 -s
 // valgrind --tool=memcheck --leak-check=full --show-reachable=yes --track-origins=yes ./ubus_123 -d 3 -e
 // valgrind --tool=memcheck --leak-check=full --show-reachable=yes --track-origins=yes ./ubus_123 -d 3 -n
+// valgrind --tool=memcheck --leak-check=full --show-reachable=yes --track-origins=yes ./ubus_123 -d 4 -r
 // ./ubus_123 -l
 int main(int argc, char *argv[])
 {
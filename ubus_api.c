@@ -72,6 +72,54 @@ typedef struct UEventQueue_STRUCT
 
 CLIST(ubus_event_queue);
 
+typedef struct UObjId_STRUCT
+{
+	void* next;
+
+	char *obj_name;
+	uint32_t obj_id;
+} UObjId_t;
+
+CLIST(ubus_objid_list);
+
+// list_head of libubox, a clist would be walked on every add and remove
+typedef struct UInvoke_STRUCT
+{
+	struct list_head list;
+
+	char *obj_name;
+	struct ubus_request req;
+	struct uloop_timeout timeout;
+
+	ubus_complete_handler_t complete_cb;
+} UInvoke_t;
+
+static LIST_HEAD(ubus_invoke_list);
+static int ubus_invoke_count = 0;
+
+typedef struct UCoalesceKV_STRUCT
+{
+	void* next;
+
+	char *key;
+	char *val;
+} UCoalesceKV_t;
+
+typedef struct UCoalesce_STRUCT
+{
+	void* next;
+
+	struct ubus_object *obj; // NULL: ubus_send_event
+	char *name; // method of ubus_notify or id of ubus_send_event
+	int count;
+
+	CLIST_STRUCT(kv_list);
+} UCoalesce_t;
+
+CLIST(ubus_coalesce_list);
+static pthread_mutex_t ubus_coalesce_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int ubus_coalesce_msecs = TIMEOUT_OF_EVENT_200MSEC;
+
 void uloop_timeout_set_ex(void)
 {
 	UTimerList_t *cur = NULL;
@@ -273,6 +321,150 @@ int ubus_cli_invoke_ex(char *obj_name, const char *method, struct blob_buf *bbuf
 	return ubus_invoke(ubus_conn_get(), obj_id, method, bbuf->head, cb, 0, timeout);
 }
 
+// the ids are kept, so the pipelined calls don't wait for ubus_lookup_id
+static int ubus_cli_lookup_cache(char *obj_name, uint32_t *obj_id)
+{
+	UObjId_t *cur = NULL;
+
+	for (cur = clist_head(ubus_objid_list); cur != NULL; cur = clist_item_next(cur))
+	{
+		if (SAFE_STRCMP(cur->obj_name, obj_name) == 0)
+		{
+			*obj_id = cur->obj_id;
+			return 0;
+		}
+	}
+
+	int ret = ubus_lookup_id(ubus_conn_get(), obj_name, obj_id);
+	if (ret)
+	{
+		DBG_ER_LN("ubus_lookup_id error !!! (obj_name: %s, ret: %d %s)", obj_name, ret, ubus_strerror(ret));
+		return ret;
+	}
+
+	UObjId_t *objid = (UObjId_t *)SAFE_CALLOC(1, sizeof(UObjId_t));
+	if (objid)
+	{
+		SAFE_ASPRINTF(objid->obj_name, "%s", obj_name);
+		objid->obj_id = *obj_id;
+		clist_add(ubus_objid_list, objid);
+	}
+
+	return 0;
+}
+
+// the object was removed or registered again
+static void ubus_cli_lookup_drop(char *obj_name)
+{
+	UObjId_t *cur = NULL;
+
+	for (cur = clist_head(ubus_objid_list); cur != NULL; cur = clist_item_next(cur))
+	{
+		if (SAFE_STRCMP(cur->obj_name, obj_name) == 0)
+		{
+			clist_remove(ubus_objid_list, cur);
+			SAFE_FREE(cur->obj_name);
+			SAFE_FREE(cur);
+			break;
+		}
+	}
+}
+
+static void ubus_cli_invoke_free(UInvoke_t *invoke)
+{
+	uloop_timeout_cancel(&invoke->timeout);
+	list_del(&invoke->list);
+	ubus_invoke_count --;
+	SAFE_FREE(invoke->obj_name);
+	SAFE_FREE(invoke);
+}
+
+static void ubus_cli_invoke_complete_cb(struct ubus_request *req, int ret)
+{
+	UInvoke_t *invoke = container_of(req, UInvoke_t, req);
+
+	if (ret == UBUS_STATUS_NOT_FOUND)
+	{
+		ubus_cli_lookup_drop(invoke->obj_name);
+	}
+
+	if (invoke->complete_cb)
+	{
+		invoke->complete_cb(req, ret);
+	}
+
+	ubus_cli_invoke_free(invoke);
+}
+
+// ubus_abort_request doesn't call complete_cb
+static void ubus_cli_invoke_timeout_cb(struct uloop_timeout *t)
+{
+	UInvoke_t *invoke = container_of(t, UInvoke_t, timeout);
+
+	DBG_WN_LN("timeout !!! (obj_name: %s)", invoke->obj_name);
+	ubus_abort_request(ubus_conn_get(), &invoke->req);
+	ubus_cli_invoke_complete_cb(&invoke->req, UBUS_STATUS_TIMEOUT);
+}
+
+// returns at once, data_cb gets the replies and complete_cb the status (UBUS_STATUS_TIMEOUT after timeout ms, TIMEOUT_OF_UBUS_REPLY if timeout <= 0).
+// req->priv is priv. many calls can be in flight, please call it on the thread of uloop.
+int ubus_cli_invoke_async(char *obj_name, const char *method, struct blob_buf *bbuf, ubus_data_handler_t data_cb, ubus_complete_handler_t complete_cb, void *priv, int timeout)
+{
+	if (ubus_quit() == QUIT_ID_NOW)
+	{
+		return -1;
+	}
+	uint32_t obj_id;
+
+	if (ubus_cli_lookup_cache(obj_name, &obj_id))
+	{
+		return -1;
+	}
+
+	UInvoke_t *invoke = (UInvoke_t *)SAFE_CALLOC(1, sizeof(UInvoke_t));
+	if (invoke == NULL)
+	{
+		DBG_ER_LN("SAFE_CALLOC error - invoke !!! (obj_name: %s)", obj_name);
+		return -1;
+	}
+
+	int ret = ubus_invoke_async(ubus_conn_get(), obj_id, method, bbuf->head, &invoke->req);
+	if (ret)
+	{
+		DBG_ER_LN("ubus_invoke_async error !!! (obj_name: %s, ret: %d %s)", obj_name, ret, ubus_strerror(ret));
+		if (ret == UBUS_STATUS_NOT_FOUND)
+		{
+			ubus_cli_lookup_drop(obj_name);
+		}
+		SAFE_FREE(invoke);
+		return -1;
+	}
+
+	SAFE_ASPRINTF(invoke->obj_name, "%s", obj_name);
+	invoke->complete_cb = complete_cb;
+	invoke->req.data_cb = data_cb;
+	invoke->req.complete_cb = ubus_cli_invoke_complete_cb;
+	invoke->req.priv = priv;
+	if (timeout <= 0)
+	{
+		// without the timer a lost reply would keep the call forever
+		timeout = TIMEOUT_OF_UBUS_REPLY;
+	}
+	invoke->timeout.cb = ubus_cli_invoke_timeout_cb;
+	uloop_timeout_set(&invoke->timeout, timeout);
+	list_add_tail(&invoke->list, &ubus_invoke_list);
+	ubus_invoke_count ++;
+
+	ubus_complete_request_async(ubus_conn_get(), &invoke->req);
+
+	return 0;
+}
+
+int ubus_cli_invoke_pending(void)
+{
+	return ubus_invoke_count;
+}
+
 static int ubus_srv_notify_ex(struct ubus_object *obj, const char *type, struct blob_buf *bbuf)
 {
 	return ubus_notify(ubus_conn_get(), obj, type, bbuf->head, -1);
@@ -337,6 +529,193 @@ int ubus_srv_send_event_simple(const char *obj_name, char *key, char *val)
 	return ret;
 }
 
+static void ubus_srv_coalesce_kv_free(void *item)
+{
+	UCoalesceKV_t *kv = (UCoalesceKV_t *)item;
+
+	if (kv)
+	{
+		SAFE_FREE(kv->key);
+		SAFE_FREE(kv->val);
+	}
+}
+
+static void ubus_srv_coalesce_item_free(void *item)
+{
+	UCoalesce_t *coalesce = (UCoalesce_t *)item;
+
+	if (coalesce)
+	{
+		clist_free_ex(coalesce->kv_list, ubus_srv_coalesce_kv_free);
+		SAFE_FREE(coalesce->name);
+	}
+}
+
+// the same key in the same window, only the last val is sent
+static int ubus_srv_coalesce_add(struct ubus_object *obj, const char *name, char *key, char *val)
+{
+	int ret = -1;
+
+	if (ubus_quit() == QUIT_ID_NOW)
+	{
+		return -1;
+	}
+
+	SAFE_THREAD_LOCK(&ubus_coalesce_mtx);
+	UCoalesce_t *coalesce = NULL;
+	for (coalesce = clist_head(ubus_coalesce_list); coalesce != NULL; coalesce = clist_item_next(coalesce))
+	{
+		if ((coalesce->obj == obj) && (SAFE_STRCMP(coalesce->name, (char *)name) == 0))
+		{
+			break;
+		}
+	}
+
+	if (coalesce == NULL)
+	{
+		coalesce = (UCoalesce_t *)SAFE_CALLOC(1, sizeof(UCoalesce_t));
+		if (coalesce == NULL)
+		{
+			DBG_ER_LN("SAFE_CALLOC error - coalesce !!! (name: %s)", name);
+			goto exit_coalesce;
+		}
+		CLIST_STRUCT_INIT(coalesce, kv_list);
+		coalesce->obj = obj;
+		SAFE_ASPRINTF(coalesce->name, "%s", name);
+		clist_push(ubus_coalesce_list, coalesce);
+	}
+
+	UCoalesceKV_t *kv = NULL;
+	for (kv = clist_head(coalesce->kv_list); kv != NULL; kv = clist_item_next(kv))
+	{
+		if (SAFE_STRCMP(kv->key, key) == 0)
+		{
+			break;
+		}
+	}
+
+	if (kv == NULL)
+	{
+		kv = (UCoalesceKV_t *)SAFE_CALLOC(1, sizeof(UCoalesceKV_t));
+		if (kv == NULL)
+		{
+			DBG_ER_LN("SAFE_CALLOC error - kv !!! (name: %s, key: %s)", name, key);
+			goto exit_coalesce;
+		}
+		SAFE_ASPRINTF(kv->key, "%s", key);
+		clist_push(coalesce->kv_list, kv);
+	}
+	SAFE_FREE(kv->val);
+	SAFE_ASPRINTF(kv->val, "%s", val);
+	coalesce->count ++;
+	ret = 0;
+
+exit_coalesce:
+	SAFE_THREAD_UNLOCK(&ubus_coalesce_mtx);
+
+	return ret;
+}
+
+// sent by ubus_srv_coalesce_loop, one message per obj and method within the window
+int ubus_srv_notify_coalesce(const char *method, struct ubus_object *obj, char *key, char *val)
+{
+	if (obj == NULL)
+	{
+		return -1;
+	}
+	return ubus_srv_coalesce_add(obj, method, key, val);
+}
+
+int ubus_srv_send_event_coalesce(const char *obj_name, char *key, char *val)
+{
+	return ubus_srv_coalesce_add(NULL, obj_name, key, val);
+}
+
+// before ubus_conn_init
+void ubus_srv_coalesce_window_set(int msecs)
+{
+	if (msecs > 0)
+	{
+		ubus_coalesce_msecs = msecs;
+	}
+}
+
+static void ubus_srv_coalesce_send(UCoalesce_t *coalesce)
+{
+	int ret = 0;
+
+	// nobody listens
+	if ((coalesce->obj) && (coalesce->obj->has_subscribers == 0))
+	{
+		return;
+	}
+
+	struct blob_buf bbuf = {};
+	blob_buf_init(&bbuf, 0);
+	UCoalesceKV_t *kv = NULL;
+	for (kv = clist_head(coalesce->kv_list); kv != NULL; kv = clist_item_next(kv))
+	{
+		blobmsg_add_string(&bbuf, kv->key, kv->val);
+	}
+
+	if (coalesce->obj)
+	{
+		ret = ubus_srv_notify_ex(coalesce->obj, coalesce->name, &bbuf);
+	}
+	else
+	{
+		// not ubus_srv_send_event_ex, the last window goes out from ubus_conn_free after QUIT_ID_NOW
+		ret = ubus_send_event(ubus_conn_get(), coalesce->name, bbuf.head);
+	}
+	DBG_DB_LN("(name: %s, count: %d, ret: %d)", coalesce->name, coalesce->count, ret);
+	blob_buf_free(&bbuf);
+}
+
+static void ubus_srv_coalesce_flush(void)
+{
+	// take the whole window, the others can add into the next one
+	SAFE_THREAD_LOCK(&ubus_coalesce_mtx);
+	UCoalesce_t *coalesce = clist_head(ubus_coalesce_list);
+	clist_init(ubus_coalesce_list);
+	SAFE_THREAD_UNLOCK(&ubus_coalesce_mtx);
+
+	while (coalesce)
+	{
+		UCoalesce_t *next = clist_item_next(coalesce);
+		ubus_srv_coalesce_send(coalesce);
+		ubus_srv_coalesce_item_free(coalesce);
+		SAFE_FREE(coalesce);
+		coalesce = next;
+	}
+}
+
+static void ubus_srv_coalesce_loop(struct uloop_timeout *t)
+{
+	ubus_srv_coalesce_flush();
+
+	uloop_timeout_set(t, ubus_coalesce_msecs);
+}
+
+// the pending notifies of obj are dropped, obj might be freed after ubus_remove_object
+static void ubus_srv_coalesce_drop(struct ubus_object *obj)
+{
+	SAFE_THREAD_LOCK(&ubus_coalesce_mtx);
+	UCoalesce_t *coalesce = clist_head(ubus_coalesce_list);
+	while (coalesce)
+	{
+		UCoalesce_t *next = clist_item_next(coalesce);
+		if (coalesce->obj == obj)
+		{
+			DBG_DB_LN("(name: %s, count: %d)", coalesce->name, coalesce->count);
+			clist_remove(ubus_coalesce_list, coalesce);
+			ubus_srv_coalesce_item_free(coalesce);
+			SAFE_FREE(coalesce);
+		}
+		coalesce = next;
+	}
+	SAFE_THREAD_UNLOCK(&ubus_coalesce_mtx);
+}
+
 static void ubus_srv_add_object_show(struct ubus_object *srv_obj)
 {
 	const char *o_name = srv_obj->name;
@@ -386,6 +765,13 @@ int ubus_srv_object_subscribe(struct ubus_context *ctx, struct ubus_object *obj,
 	return ubus_srv_add_object_ex(ctx, obj);
 }
 
+// please use it instead of ubus_remove_object, when ubus_srv_notify_coalesce is called with obj (on the thread of uloop)
+int ubus_srv_remove_object_ex(struct ubus_context *ctx, struct ubus_object *obj)
+{
+	ubus_srv_coalesce_drop(obj);
+	return ubus_remove_object(ctx, obj);
+}
+
 static const char *json_format_type(void *priv, struct blob_attr *attr)
 {
 	static const char * const attr_types[] =
@@ -496,6 +882,42 @@ static void ubus_srv_equeue_free(void)
 	clist_free_ex(ubus_event_queue, ubus_srv_equeue_item_free);
 }
 
+// the last window (notifies and events) is sent before the connection is gone, also after ubus_thread_stop
+static void ubus_srv_coalesce_free(void)
+{
+	ubus_srv_coalesce_flush();
+
+	SAFE_THREAD_LOCK(&ubus_coalesce_mtx);
+	clist_free_ex(ubus_coalesce_list, ubus_srv_coalesce_item_free);
+	SAFE_THREAD_UNLOCK(&ubus_coalesce_mtx);
+}
+
+// the calls in flight are dropped without complete_cb
+static void ubus_cli_invoke_list_free(void)
+{
+	while (!list_empty(&ubus_invoke_list))
+	{
+		UInvoke_t *invoke = list_first_entry(&ubus_invoke_list, UInvoke_t, list);
+		ubus_abort_request(ubus_conn_get(), &invoke->req);
+		ubus_cli_invoke_free(invoke);
+	}
+}
+
+static void ubus_cli_objid_item_free(void *item)
+{
+	UObjId_t *objid = (UObjId_t *)item;
+
+	if (objid)
+	{
+		SAFE_FREE(objid->obj_name);
+	}
+}
+
+static void ubus_cli_objid_list_free(void)
+{
+	clist_free_ex(ubus_objid_list, ubus_cli_objid_item_free);
+}
+
 static void ubus_srv_conn_lost(struct ubus_context *ctx)
 {
 	struct ubus_context *ubus_req = ubus_conn_get();
@@ -543,6 +965,9 @@ void ubus_conn_free(void)
 		uloop_timerlist_free();
 
 		ubus_srv_equeue_free();
+		ubus_srv_coalesce_free();
+		ubus_cli_invoke_list_free();
+		ubus_cli_objid_list_free();
 		ubus_cli_subscriber_list_free();
 		ubus_cli_event_list_free();
 
@@ -571,11 +996,14 @@ struct ubus_context *ubus_conn_init(void)
 	clist_init(ubus_subscriber_list);
 	clist_init(ubus_timer_list);
 	clist_init(ubus_event_queue);
+	clist_init(ubus_objid_list);
+	clist_init(ubus_coalesce_list);
 
 #ifdef SEND_EVENT_DIRECTLY
 #else
 	uloop_timerlist_add(timer_200msec_loop, TIMEOUT_OF_EVENT_200MSEC);
 #endif
+	uloop_timerlist_add(ubus_srv_coalesce_loop, ubus_coalesce_msecs);
 
 	return ubus_conn;
 }
@@ -45,12 +45,19 @@ void uloop_end_ex(void);
 int ubus_cli_register_event(const char *pattern, ubus_event_handler_t cb);
 int ubus_cli_subscribe(char *obj_name, ubus_handler_t cb, ubus_remove_handler_t remove_cb);
 int ubus_cli_invoke_ex(char *obj_name, const char *method, struct blob_buf *bbuf, ubus_data_handler_t cb, int timeout);
+int ubus_cli_invoke_async(char *obj_name, const char *method, struct blob_buf *bbuf, ubus_data_handler_t data_cb, ubus_complete_handler_t complete_cb, void *priv, int timeout);
+int ubus_cli_invoke_pending(void);
 int ubus_srv_notify_simple(const char *method, struct ubus_object *obj, char *key, char *val);
 int ubus_srv_send_event_ex(const char *obj_name, struct blob_buf *bbuf);
 int ubus_srv_send_event_simple(const char *obj_name, char *key, char *val);
 
+int ubus_srv_notify_coalesce(const char *method, struct ubus_object *obj, char *key, char *val);
+int ubus_srv_send_event_coalesce(const char *obj_name, char *key, char *val);
+void ubus_srv_coalesce_window_set(int msecs);
+
 int ubus_srv_add_object_ex(struct ubus_context *ctx, struct ubus_object *obj);
 int ubus_srv_object_subscribe(struct ubus_context *ctx, struct ubus_object *obj, ubus_state_handler_t subscribe_cb);
+int ubus_srv_remove_object_ex(struct ubus_context *ctx, struct ubus_object *obj);
 
 void ubus_cli_list_register(const char *path, ubus_lookup_handler_t cb);
 
@@ -24,18 +24,57 @@
 #ifdef UTIL_EX_DBG
 int dbg_more = DBG_LVL_INFO;//DBG_LVL_INFO;
 
+int dbg_mod_ary[DBG_MOD_ID_MAX] = { [0 ... DBG_MOD_ID_MAX-1] = DBG_LVL_INFO };
+static int dbg_mod_own[DBG_MOD_ID_MAX] = { [0 ... DBG_MOD_ID_MAX-1] = -1 }; // -1: dbg_more
+static pthread_mutex_t dbg_mod_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *dbg_mod_name_ary[DBG_MOD_ID_MAX] =
+{
+	"none",
+	"chainx",
+	"queuex",
+	"statex",
+	"timerx",
+	"curl",
+	"mqtt",
+	"lws",
+	"onvif",
+	"rtp",
+	"dbus",
+	"uv",
+};
+
+// only the writers are locked, DBG_LVL_ON reads dbg_mod_ary without it
+static void dbg_mod_refresh(void)
+{
+	int mod_id = 0;
+	for (mod_id = 0; mod_id < DBG_MOD_ID_MAX; mod_id++)
+	{
+		int lvl = (dbg_mod_own[mod_id] >= 0) ? dbg_mod_own[mod_id] : dbg_more;
+		__atomic_store_n(&dbg_mod_ary[mod_id], lvl, __ATOMIC_RELAXED);
+	}
+}
+
 int dbg_lvl_round(void)
 {
+	SAFE_THREAD_LOCK(&dbg_mod_mtx);
 	dbg_more++;
 	dbg_more %= DBG_LVL_MAX;
-	return dbg_more;
+	dbg_mod_refresh();
+	int lvl = dbg_more;
+	SAFE_THREAD_UNLOCK(&dbg_mod_mtx);
+	return lvl;
 }
 
 int dbg_lvl_set(int lvl)
 {
+	SAFE_THREAD_LOCK(&dbg_mod_mtx);
 	dbg_more = lvl;
 	dbg_more %= DBG_LVL_MAX;
-	return dbg_more;
+	dbg_mod_refresh();
+	lvl = dbg_more;
+	SAFE_THREAD_UNLOCK(&dbg_mod_mtx);
+	return lvl;
 }
 
 int dbg_lvl_get(void)
@@ -43,6 +82,82 @@ int dbg_lvl_get(void)
 	return dbg_more;
 }
 
+const char *dbg_mod_name(DBG_MOD_ID mod_id)
+{
+	if ((mod_id >= 0) && (mod_id < DBG_MOD_ID_MAX))
+	{
+		return dbg_mod_name_ary[mod_id];
+	}
+	return NULL;
+}
+
+DBG_MOD_ID dbg_mod_find(const char *name)
+{
+	int mod_id = 0;
+	for (mod_id = 0; mod_id < DBG_MOD_ID_MAX; mod_id++)
+	{
+		if (SAFE_STRCASECMP((char *)name, (char *)dbg_mod_name_ary[mod_id]) == 0)
+		{
+			return mod_id;
+		}
+	}
+	return DBG_MOD_ID_MAX;
+}
+
+int dbg_mod_set(DBG_MOD_ID mod_id, int lvl)
+{
+	if ((mod_id <= DBG_MOD_ID_NONE) || (mod_id >= DBG_MOD_ID_MAX))
+	{
+		return -1;
+	}
+
+	SAFE_THREAD_LOCK(&dbg_mod_mtx);
+	dbg_mod_own[mod_id] = (lvl >= 0) ? (lvl % DBG_LVL_MAX) : -1;
+	dbg_mod_refresh();
+	lvl = dbg_mod_ary[mod_id];
+	SAFE_THREAD_UNLOCK(&dbg_mod_mtx);
+	return lvl;
+}
+
+int dbg_mod_get(DBG_MOD_ID mod_id)
+{
+	if ((mod_id >= 0) && (mod_id < DBG_MOD_ID_MAX))
+	{
+		return __atomic_load_n(&dbg_mod_ary[mod_id], __ATOMIC_RELAXED);
+	}
+	return dbg_more;
+}
+
+// "chainx:4,mqtt:3", "curl:-1" goes back to dbg_more
+int dbg_mod_parse(char *mods)
+{
+	int count = 0;
+	char buf[LEN_OF_BUF512] = "";
+	char *saveptr = NULL;
+
+	SAFE_SPRINTF_EX(buf, "%s", mods);
+	char *token = SAFE_STRTOK_R(buf, ",", &saveptr);
+	while (token)
+	{
+		char *lvl_s = strchr(token, ':');
+		if (lvl_s)
+		{
+			*lvl_s++ = '\0';
+			DBG_MOD_ID mod_id = dbg_mod_find(token);
+			if (dbg_mod_set(mod_id, atoi(lvl_s)) >= 0)
+			{
+				count++;
+			}
+			else
+			{
+				DBG_ER_LN("dbg_mod_set error !!! (token: %s)", token);
+			}
+		}
+		token = SAFE_STRTOK_R(NULL, ",", &saveptr);
+	}
+	return count;
+}
+
 #else
 int dbg_lvl_get(void)
 {
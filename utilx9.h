@@ -48,10 +48,17 @@ extern "C" {
 //******************************************************************************
 //** Linux **
 #define UTIL_EX_DBG
+#ifdef UTIL_EX_DBG
+#define UTIL_EX_DBG_ASYNC
+#endif
 #define UTIL_EX_SAFE
+// -DUTIL_EX_MEMX: SAFE_MALLOC / SAFE_CALLOC / SAFE_REALLOC / SAFE_ASPRINTF / SAFE_FREE are tracked by callsite
 #define UTIL_EX_BASIC
 
 #define UTIL_EX_CLIST
+#define UTIL_EX_METRICX
+#define UTIL_EX_TRACEX
+#define UTIL_EX_POOLX
 #define UTIL_EX_SYSTEMINFO
 #define UTIL_EX_LED
 
@@ -62,6 +69,7 @@ extern "C" {
 #define UTIL_EX_PROC_TABLE
 #define UTIL_EX_QUEUEX
 #define UTIL_EX_STATEX
+#define UTIL_EX_TIMERX
 
 #define UTIL_EX_SSL
 
@@ -102,40 +110,72 @@ extern "C" {
 #ifdef UTIL_EX_DBG
 extern int dbg_more;
 
-#define DBG_ER_DUMP(ibuf,ilen,delim,format,args...) if (dbg_more>=DBG_LVL_ERROR) DBG_DUMP_COLOR(COLORX_RED, ibuf, ilen, delim, format, ## args)
-#define DBG_WN_DUMP(ibuf,ilen,delim,format,args...) if (dbg_more>=DBG_LVL_WARN) DBG_DUMP_COLOR(COLORX_PURPLE, ibuf, ilen, delim, format, ## args)
-#define DBG_IF_DUMP(ibuf,ilen,delim,format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_DUMP_COLOR(COLORX_YELLOW, ibuf, ilen, delim, format, ## args)
-#define DBG_DB_DUMP(ibuf,ilen,delim,format,args...) if (dbg_more>=DBG_LVL_DEBUG) DBG_DUMP_COLOR(COLORX_WHITE, ibuf, ilen, delim, format, ## args)
-#define DBG_TR_DUMP(ibuf,ilen,delim,format,args...) if (dbg_more>=DBG_LVL_TRACE) DBG_DUMP_COLOR(COLORX_LIGHT_GRAY, ibuf, ilen, delim, format, ## args)
-
-#define DBG_ER(format,args...) if (dbg_more>=DBG_LVL_ERROR) DBG_R(format, ## args)
-#define DBG_ER_0(format,args...) if (dbg_more>=DBG_LVL_ERROR) DBG_R_0(format, ## args)
-#define DBG_WN(format,args...) if (dbg_more>=DBG_LVL_WARN) DBG_P(format, ## args)
-#define DBG_WN_0(format,args...) if (dbg_more>=DBG_LVL_WARN) DBG_P_0(format, ## args)
-#define DBG_IF(format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_Y(format, ## args)
-#define DBG_IF_0(format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_Y_0(format, ## args)
-#define DBG_DB(format,args...) if (dbg_more>=DBG_LVL_DEBUG) DBG_W(format, ## args)
-#define DBG_DB_0(format,args...) if (dbg_more>=DBG_LVL_DEBUG) DBG_W_0(format, ## args)
-#define DBG_TR(format,args...) if (dbg_more>=DBG_LVL_TRACE) DBG_LGR(format, ## args)
-#define DBG_TR_0(format,args...) if (dbg_more>=DBG_LVL_TRACE) DBG_LGR_0(format, ## args)
-
-#define DBG_ER_LN(format,args...) if (dbg_more>=DBG_LVL_ERROR) DBG_LN_R(format, ## args)
-#define DBG_ER_LN_0(format,args...) if (dbg_more>=DBG_LVL_ERROR) DBG_LN_R_0(format, ## args)
-#define DBG_WN_LN(format,args...) if (dbg_more>=DBG_LVL_WARN) DBG_LN_P(format, ## args)
-#define DBG_WN_LN_0(format,args...) if (dbg_more>=DBG_LVL_WARN) DBG_LN_P_0(format, ## args)
-#define DBG_IF_LN(format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_LN_Y(format, ## args)
-#define DBG_IF_LN_0(format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_LN_Y_0(format, ## args)
-#define DBG_IF_LN_G(format,args...) if (dbg_more>=DBG_LVL_INFO) DBG_LN_LG(format, ## args)
-#define DBG_DB_LN(format,args...) if (dbg_more>=DBG_LVL_DEBUG) DBG_LN_W(format, ## args)
-#define DBG_DB_LN_0(format,args...) if (dbg_more>=DBG_LVL_DEBUG) DBG_LN_W_0(format, ## args)
-#define DBG_TR_LN(format,args...) if (dbg_more>=DBG_LVL_TRACE) DBG_LN_LGR(format, ## args)
-#define DBG_TR_LN_0(format,args...) if (dbg_more>=DBG_LVL_TRACE) DBG_LN_LGR_0(format, ## args)
-
-#define ARGC_AND_ARGV_ER_DUMP(s1,s2) if (dbg_more>=DBG_LVL_ERROR) ARGC_AND_ARGV_DUMP_COLOR(COLORX_RED,s1,s2)
-#define ARGC_AND_ARGV_WN_DUMP(s1,s2) if (dbg_more>=DBG_LVL_WARN) ARGC_AND_ARGV_DUMP_COLOR(COLORX_PURPLE,s1,s2)
-#define ARGC_AND_ARGV_IF_DUMP(s1,s2) if (dbg_more>=DBG_LVL_INFO) ARGC_AND_ARGV_DUMP_COLOR(COLORX_YELLOW,s1,s2)
-#define ARGC_AND_ARGV_DB_DUMP(s1,s2) if (dbg_more>=DBG_LVL_DEBUG) ARGC_AND_ARGV_DUMP_COLOR(COLORX_WHITE,s1,s2)
-#define ARGC_AND_ARGV_TR_DUMP(s1,s2) if (dbg_more>=DBG_LVL_TRACE) ARGC_AND_ARGV_DUMP_COLOR(COLORX_LIGHT_GRAY,s1,s2)
+// DBG_* above this level compile to nothing, e.g. -DUTIL_EX_DBG_MIN_LEVEL=DBG_LVL_INFO drops DBG_DB_* and DBG_TR_*
+#ifndef UTIL_EX_DBG_MIN_LEVEL
+#define UTIL_EX_DBG_MIN_LEVEL DBG_LVL_TRACE
+#endif
+
+typedef enum
+{
+	DBG_MOD_ID_NONE, // dbg_more
+	DBG_MOD_ID_CHAINX,
+	DBG_MOD_ID_QUEUEX,
+	DBG_MOD_ID_STATEX,
+	DBG_MOD_ID_TIMERX,
+	DBG_MOD_ID_CURL,
+	DBG_MOD_ID_MQTT,
+	DBG_MOD_ID_LWS,
+	DBG_MOD_ID_ONVIF, // onvif, soap and wsdiscovery
+	DBG_MOD_ID_RTP, // rtp and rtsp
+	DBG_MOD_ID_DBUS,
+	DBG_MOD_ID_UV,
+	DBG_MOD_ID_MAX,
+} DBG_MOD_ID;
+
+// a module puts #define DBG_MOD DBG_MOD_ID_XXX in front of #include "utilx9.h"
+#ifndef DBG_MOD
+#define DBG_MOD DBG_MOD_ID_NONE
+#endif
+
+// the level in effect of each module, the same as dbg_more until dbg_mod_set
+extern int dbg_mod_ary[DBG_MOD_ID_MAX];
+
+#define DBG_LVL_ON(lvl) (((lvl) <= UTIL_EX_DBG_MIN_LEVEL) && (__atomic_load_n(&dbg_mod_ary[DBG_MOD], __ATOMIC_RELAXED) >= (lvl)))
+
+#define DBG_ER_DUMP(ibuf,ilen,delim,format,args...) if (DBG_LVL_ON(DBG_LVL_ERROR)) DBG_DUMP_COLOR(COLORX_RED, ibuf, ilen, delim, format, ## args)
+#define DBG_WN_DUMP(ibuf,ilen,delim,format,args...) if (DBG_LVL_ON(DBG_LVL_WARN)) DBG_DUMP_COLOR(COLORX_PURPLE, ibuf, ilen, delim, format, ## args)
+#define DBG_IF_DUMP(ibuf,ilen,delim,format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_DUMP_COLOR(COLORX_YELLOW, ibuf, ilen, delim, format, ## args)
+#define DBG_DB_DUMP(ibuf,ilen,delim,format,args...) if (DBG_LVL_ON(DBG_LVL_DEBUG)) DBG_DUMP_COLOR(COLORX_WHITE, ibuf, ilen, delim, format, ## args)
+#define DBG_TR_DUMP(ibuf,ilen,delim,format,args...) if (DBG_LVL_ON(DBG_LVL_TRACE)) DBG_DUMP_COLOR(COLORX_LIGHT_GRAY, ibuf, ilen, delim, format, ## args)
+
+#define DBG_ER(format,args...) if (DBG_LVL_ON(DBG_LVL_ERROR)) DBG_R(format, ## args)
+#define DBG_ER_0(format,args...) if (DBG_LVL_ON(DBG_LVL_ERROR)) DBG_R_0(format, ## args)
+#define DBG_WN(format,args...) if (DBG_LVL_ON(DBG_LVL_WARN)) DBG_P(format, ## args)
+#define DBG_WN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_WARN)) DBG_P_0(format, ## args)
+#define DBG_IF(format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_Y(format, ## args)
+#define DBG_IF_0(format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_Y_0(format, ## args)
+#define DBG_DB(format,args...) if (DBG_LVL_ON(DBG_LVL_DEBUG)) DBG_W(format, ## args)
+#define DBG_DB_0(format,args...) if (DBG_LVL_ON(DBG_LVL_DEBUG)) DBG_W_0(format, ## args)
+#define DBG_TR(format,args...) if (DBG_LVL_ON(DBG_LVL_TRACE)) DBG_LGR(format, ## args)
+#define DBG_TR_0(format,args...) if (DBG_LVL_ON(DBG_LVL_TRACE)) DBG_LGR_0(format, ## args)
+
+#define DBG_ER_LN(format,args...) if (DBG_LVL_ON(DBG_LVL_ERROR)) DBG_LN_R(format, ## args)
+#define DBG_ER_LN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_ERROR)) DBG_LN_R_0(format, ## args)
+#define DBG_WN_LN(format,args...) if (DBG_LVL_ON(DBG_LVL_WARN)) DBG_LN_P(format, ## args)
+#define DBG_WN_LN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_WARN)) DBG_LN_P_0(format, ## args)
+#define DBG_IF_LN(format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_LN_Y(format, ## args)
+#define DBG_IF_LN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_LN_Y_0(format, ## args)
+#define DBG_IF_LN_G(format,args...) if (DBG_LVL_ON(DBG_LVL_INFO)) DBG_LN_LG(format, ## args)
+#define DBG_DB_LN(format,args...) if (DBG_LVL_ON(DBG_LVL_DEBUG)) DBG_LN_W(format, ## args)
+#define DBG_DB_LN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_DEBUG)) DBG_LN_W_0(format, ## args)
+#define DBG_TR_LN(format,args...) if (DBG_LVL_ON(DBG_LVL_TRACE)) DBG_LN_LGR(format, ## args)
+#define DBG_TR_LN_0(format,args...) if (DBG_LVL_ON(DBG_LVL_TRACE)) DBG_LN_LGR_0(format, ## args)
+
+#define ARGC_AND_ARGV_ER_DUMP(s1,s2) if (DBG_LVL_ON(DBG_LVL_ERROR)) ARGC_AND_ARGV_DUMP_COLOR(COLORX_RED,s1,s2)
+#define ARGC_AND_ARGV_WN_DUMP(s1,s2) if (DBG_LVL_ON(DBG_LVL_WARN)) ARGC_AND_ARGV_DUMP_COLOR(COLORX_PURPLE,s1,s2)
+#define ARGC_AND_ARGV_IF_DUMP(s1,s2) if (DBG_LVL_ON(DBG_LVL_INFO)) ARGC_AND_ARGV_DUMP_COLOR(COLORX_YELLOW,s1,s2)
+#define ARGC_AND_ARGV_DB_DUMP(s1,s2) if (DBG_LVL_ON(DBG_LVL_DEBUG)) ARGC_AND_ARGV_DUMP_COLOR(COLORX_WHITE,s1,s2)
+#define ARGC_AND_ARGV_TR_DUMP(s1,s2) if (DBG_LVL_ON(DBG_LVL_TRACE)) ARGC_AND_ARGV_DUMP_COLOR(COLORX_LIGHT_GRAY,s1,s2)
 
 #define DBG_IF_LLADDR(format, addr, args...) \
 		DBG_IF_LN(format, ## args); \
@@ -180,6 +220,112 @@ extern int dbg_more;
 int dbg_lvl_round(void);
 int dbg_lvl_set(int lvl);
 int dbg_lvl_get(void);
+
+const char *dbg_mod_name(DBG_MOD_ID mod_id);
+DBG_MOD_ID dbg_mod_find(const char *name);
+int dbg_mod_set(DBG_MOD_ID mod_id, int lvl); // -1: back to dbg_more
+int dbg_mod_get(DBG_MOD_ID mod_id);
+int dbg_mod_parse(char *mods); // e.g. "chainx:4,mqtt:3"
+
+#ifdef UTIL_EX_DBG_ASYNC
+// DBG_* are formatted on the caller into a ring of its own, one writer thread prints them after dbgx_open
+#define DBGX_RING_SIZE (64*1024) // bytes per thread, power of 2
+#define LEN_OF_DBGX_TEXT LEN_OF_BUF1024 // a longer one is printed by the caller
+#define DBGX_FLUSH_MS 20
+
+#define DBGX_FLAG_PREFIX 0x01 // [pid/tid] func:line -
+#define DBGX_FLAG_LN 0x02
+
+typedef enum
+{
+	DBGX_SINK_ID_STDOUT,
+	DBGX_SINK_ID_FILE,
+	DBGX_SINK_ID_SYSLOG,
+	DBGX_SINK_ID_MAX,
+} DBGX_SINK_ID;
+
+typedef enum
+{
+	DBGX_OVERFLOW_ID_DROP, // counted, the writer reports it
+	DBGX_OVERFLOW_ID_BLOCK, // wait for the writer
+	DBGX_OVERFLOW_ID_SYNC, // printed by the caller
+	DBGX_OVERFLOW_ID_MAX,
+} DBGX_OVERFLOW_ID;
+
+typedef struct DbgX_STRUCT
+{
+	DBGX_SINK_ID sink;
+	char filename[LEN_OF_FULLNAME]; // DBGX_SINK_ID_FILE, appended
+	char ident[LEN_OF_NAME32]; // DBGX_SINK_ID_SYSLOG
+
+	DBGX_OVERFLOW_ID overflow;
+	int ring_size; // 0: DBGX_RING_SIZE
+
+	int iscolor;
+	int istime; // hh:mm:ss.usec in front
+} DbgX_t;
+
+void dbgx_printf(const char *color, const char *func, int line, int flags, const char *format, ...) __attribute__((format(printf, 5, 6)));
+unsigned long dbgx_drops(void);
+void dbgx_flush(void);
+void dbgx_close(void);
+int dbgx_open(DbgX_t *dbgx_req);
+
+// the signatures of DBG_* are kept, only the backend is changed
+#undef DBG_COLOR
+#undef DBG_COLOR_0
+#undef DBG_LN_COLOR
+#undef DBG_LN_COLOR_0
+#define DBG_COLOR(color, format, args...) dbgx_printf(color, __FUNCTION__, __LINE__, DBGX_FLAG_PREFIX, format, ## args)
+#define DBG_COLOR_0(color, format, args...) dbgx_printf(color, __FUNCTION__, __LINE__, 0, format, ## args)
+#define DBG_LN_COLOR(color, format, args...) dbgx_printf(color, __FUNCTION__, __LINE__, DBGX_FLAG_PREFIX|DBGX_FLAG_LN, format, ## args)
+#define DBG_LN_COLOR_0(color, format, args...) dbgx_printf(color, __FUNCTION__, __LINE__, DBGX_FLAG_LN, format, ## args)
+#endif
+#endif
+
+
+//******************************************************************************
+//** UTIL_EX_MEMX **
+//******************************************************************************
+#ifdef UTIL_EX_MEMX
+#define MAX_OF_MEMX_SHARD 64 // power of 2, the pointers are spread over the shards
+#define MAX_OF_MEMX_LEAK 16 // pointers of every callsite in the leak dump
+
+// one of every SAFE_MALLOC / SAFE_CALLOC / SAFE_REALLOC / SAFE_ASPRINTF, a static of the callsite
+typedef struct MemXSite_Struct
+{
+	struct MemXSite_Struct *next;
+
+	const char *file;
+	const char *func;
+	int line;
+	int isjoin;
+
+	int64_t live_bytes;
+	int64_t live_count;
+	uint64_t allocs;
+	uint64_t allocs_last; // memx_dump, allocs/sec since the last one
+	int leaks; // memx_dump
+} MemXSite_t;
+
+#define MEMX_SITE() \
+	({ static MemXSite_t __memx_site = { NULL, __FILE__, __FUNCTION__, __LINE__, 0, 0, 0, 0, 0, 0 }; &__memx_site; })
+
+void *memx_malloc(MemXSite_t *site, size_t size);
+void *memx_calloc(MemXSite_t *site, size_t nitems, size_t size);
+void *memx_realloc(MemXSite_t *site, void *ptr, size_t size);
+// ptr is allocated by someone else (asprintf), it is freed by memx_free
+void memx_track(MemXSite_t *site, void *ptr, size_t size);
+// the pointers not from memx_* are only freed
+void memx_free(void *ptr);
+
+// filename: NULL, stderr. the callsites ordered by live bytes, isleak: and the live pointers
+int memx_dump(char *filename, int isleak);
+// async-signal-safe, for the signal handlers, the thread of memx_open writes the dump
+void memx_dump_async(void);
+// filename: NULL, stderr. the leak dump is written at exit
+void memx_open(char *filename);
+void memx_close(void);
 #endif
 
 
@@ -208,6 +354,14 @@ void* pcheck(void* a);
 
 #define SAFE_ARRAY_SIZE(array) (sizeof(array) / sizeof *(array))
 
+#ifdef UTIL_EX_MEMX
+#define SAFE_FREE(X) \
+	do { if ( (X) != NULL ) {memx_free(X); X=NULL;} } while(0)
+
+#define SAFE_CALLOC(nitems, size) memx_calloc(MEMX_SITE(), nitems, size)
+#define SAFE_MALLOC(size) memx_malloc(MEMX_SITE(), size)
+#define SAFE_REALLOC(ptr, size) memx_realloc(MEMX_SITE(), ptr, size)
+#else
 #define SAFE_FREE(X) \
 	do { if ( (X) != NULL ) {free(X); X=NULL;} } while(0)
 
@@ -233,6 +387,7 @@ void* pcheck(void* a);
 		} while(0); \
 		__ret; \
 	})
+#endif
 
 #define SAFE_MEMCPY(dst, src, count, maxcount) \
 	({ void *__ret = NULL; do { if ( (pcheck(dst)) && (pcheck(src)) ) { __ret = memcpy(dst, src, SAFE_MIN((SIZE_X)count, (SIZE_X)maxcount)); } } while(0); __ret; })
@@ -259,6 +414,16 @@ void* pcheck(void* a);
 #define SAFE_SNPRINTF(X, Y, FMT, args...) \
 	({ int __ret =0; do { if ((pcheck(X)) && (Y>0)) __ret = snprintf(X, Y, FMT, ## args); else DBG_ER_LN("%s is NULL or Y (%zd <= 0) !!!", #X, (size_t)Y); } while(0); __ret; })
 
+#ifdef UTIL_EX_MEMX
+#define SAFE_ASPRINTF(X, FMT, args...) \
+	({ int __ret =0; \
+		do { \
+			__ret = asprintf(&X, FMT, ## args); \
+			if (__ret >= 0) memx_track(MEMX_SITE(), X, __ret + 1); \
+		} while(0); \
+		__ret; \
+	})
+#else
 #define SAFE_ASPRINTF(X, FMT, args...) \
 	({ int __ret =0; \
 		do { \
@@ -266,6 +431,7 @@ void* pcheck(void* a);
 		} while(0); \
 		__ret; \
 	})
+#endif
 
 #define SAFE_STRCAT(str1, str2) \
 	({ char *__ret = NULL; do { if ( (pcheck(str1)) && (pcheck(str2)) ) { __ret = strcat(str1, str2); } } while(0); __ret; })
@@ -1053,6 +1219,189 @@ void clist_free(clist_t list);
 #endif
 
 
+//******************************************************************************
+//** UTIL_EX_METRICX **
+//******************************************************************************
+#ifdef UTIL_EX_METRICX
+#define MAX_OF_METRICX_SHARD 16 // power of 2, threads are spread over the shards
+#define MAX_OF_METRICX_BUCKET 496 // 8 + 61*8, 3 significant bits of uint64_t
+#define LEN_OF_METRICX_CACHELINE 64
+#define LEN_OF_METRICX_LABELS LEN_OF_BUF256
+
+typedef enum
+{
+	METRICX_TYPE_ID_COUNTER = 0,
+	METRICX_TYPE_ID_GAUGE,
+	METRICX_TYPE_ID_HISTOGRAM,
+	METRICX_TYPE_ID_MAX,
+} METRICX_TYPE_ID;
+
+typedef struct MetricXShard_Struct
+{
+	uint64_t count;
+	uint64_t sum; // METRICX_TYPE_ID_HISTOGRAM
+} __attribute__((aligned(LEN_OF_METRICX_CACHELINE))) MetricXShard_t;
+
+typedef struct MetricX_Struct
+{
+	void *next;
+
+	char name[LEN_OF_NAME64];
+	char help[LEN_OF_NAME128];
+	char labels[LEN_OF_METRICX_LABELS]; // name="q1",mode="sync"
+	METRICX_TYPE_ID type;
+
+	MetricXShard_t *shard_ary; // MAX_OF_METRICX_SHARD, counter and histogram
+	int64_t gauge;
+	uint64_t *bucket_ary; // MAX_OF_METRICX_SHARD * MAX_OF_METRICX_BUCKET, histogram
+} MetricX_t;
+
+// everything is allocated by *_new(), *_add() and *_set() are lock-free and NULL-safe
+MetricX_t *metricx_counter_new(char *name, char *help, char *labels);
+MetricX_t *metricx_gauge_new(char *name, char *help, char *labels);
+MetricX_t *metricx_histogram_new(char *name, char *help, char *labels);
+void metricx_free(MetricX_t *metricx_req);
+
+void metricx_counter_add(MetricX_t *metricx_req, uint64_t val);
+void metricx_gauge_set(MetricX_t *metricx_req, int64_t val);
+void metricx_gauge_add(MetricX_t *metricx_req, int64_t val);
+void metricx_histogram_add(MetricX_t *metricx_req, uint64_t val);
+
+uint64_t metricx_counter_get(MetricX_t *metricx_req);
+int64_t metricx_gauge_get(MetricX_t *metricx_req);
+uint64_t metricx_histogram_count(MetricX_t *metricx_req);
+uint64_t metricx_histogram_sum(MetricX_t *metricx_req);
+// q: 0.5, 0.99, 0.999 ..., the upper bound of the bucket (max. 12.5% above)
+uint64_t metricx_histogram_quantile(MetricX_t *metricx_req, double q);
+
+int metricx_bucket_idx(uint64_t val);
+uint64_t metricx_bucket_upper(int idx);
+unsigned long long metricx_now_us(void);
+
+// Prometheus text format (version 0.0.4) of the whole registry
+size_t metricx_prometheus(QBUF_t *qbuf);
+
+// addr: "/tmp/metricx.sock" or "@metricx" (abstract) for AF_UNIX, "9100" for 127.0.0.1:9100
+// GET /metrics is Prometheus text, GET /metrics.json is metricx_json() (UTIL_EX_JSON)
+void metricx_server_close(void);
+int metricx_server_open(char *addr);
+#endif
+
+
+//******************************************************************************
+//** UTIL_EX_TRACEX **
+//******************************************************************************
+#ifdef UTIL_EX_TRACEX
+#define TRACEX_RING_SIZE 8192 // events per thread, power of 2, the oldest are overwritten
+
+typedef struct TraceXEvent_Struct
+{
+	unsigned long long ts; // ns, CLOCK_MONOTONIC
+	unsigned long long dur; // ns, 'X'
+	unsigned long long id; // 'b' and 'e'
+	long long arg;
+	const char *cat; // string literals, only the pointers are kept
+	const char *name;
+	char ph; // 'X': complete, 'i': instant, 'b'/'e': async begin/end
+} TraceXEvent_t;
+
+typedef struct TraceXSpan_Struct
+{
+	const char *cat;
+	const char *name;
+	unsigned long long ts; // 0: tracex was off at the beginning
+	long long arg;
+} TraceXSpan_t;
+
+extern int tracex_enable;
+
+#define TRACEX_ISON() __builtin_expect(__atomic_load_n(&tracex_enable, __ATOMIC_RELAXED), 0)
+#define TRACEX_NOW() (TRACEX_ISON() ? tracex_now() : 0)
+
+// the span ends when the scope is left
+#define TRACEX_SPAN(cat, name) \
+	TraceXSpan_t __tracex_span __attribute__((cleanup(tracex_span_leave))) = { cat, name, TRACEX_NOW(), 0 }
+#define TRACEX_SPAN_ARG(val) __tracex_span.arg = (val)
+
+// ts_start: from TRACEX_NOW()
+#define TRACEX_COMPLETE(cat, name, ts_start, val) \
+	do { unsigned long long __ts = (ts_start); if (__ts) tracex_event('X', cat, name, __ts, tracex_now() - __ts, 0, val); } while(0)
+#define TRACEX_INSTANT(cat, name, val) \
+	do { if (TRACEX_ISON()) tracex_event('i', cat, name, tracex_now(), 0, 0, val); } while(0)
+// from ts_start (another thread) to now, drawn on its own track
+#define TRACEX_ASYNC(cat, name, uid, ts_start) \
+	do { unsigned long long __ts = (ts_start); if (__ts) { tracex_event('b', cat, name, __ts, 0, (unsigned long long)(uid), 0); tracex_event('e', cat, name, tracex_now(), 0, (unsigned long long)(uid), 0); } } while(0)
+
+unsigned long long tracex_now(void);
+void tracex_event(char ph, const char *cat, const char *name, unsigned long long ts, unsigned long long dur, unsigned long long id, long long arg);
+void tracex_span_end(TraceXSpan_t *span);
+static inline void tracex_span_leave(TraceXSpan_t *span)
+{
+	if (__builtin_expect(span->ts != 0, 0))
+	{
+		tracex_span_end(span);
+	}
+}
+void tracex_thread_name(const char *name);
+
+// ring_size: 0: TRACEX_RING_SIZE, used by the rings created after this
+void tracex_start(int ring_size);
+void tracex_stop(void);
+// Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev), the rings are kept
+int tracex_dump(char *filename);
+void tracex_close(void);
+#else
+#define TRACEX_ISON() 0
+#define TRACEX_NOW() 0
+#define TRACEX_SPAN(cat, name)
+#define TRACEX_SPAN_ARG(val)
+#define TRACEX_COMPLETE(cat, name, ts_start, val) do { (void)(ts_start); } while(0)
+#define TRACEX_INSTANT(cat, name, val)
+#define TRACEX_ASYNC(cat, name, uid, ts_start)
+#endif
+
+
+//******************************************************************************
+//** UTIL_EX_POOLX **
+//******************************************************************************
+#ifdef UTIL_EX_POOLX
+#define MAX_OF_POOLX_CLASS 21 // 32 ~ 4096 bytes, the header included
+#define MAX_OF_POOLX_ROUNDS 32 // objects per magazine
+#define LEN_OF_POOLX_HDR 16
+#define LEN_OF_POOLX_SLAB (64*1024)
+
+typedef struct PoolXStat_Struct
+{
+	size_t obj_size; // usable bytes, 0: the objects above the classes (calloc)
+	int64_t live; // allocated and not freed yet
+	int64_t high_water; // max. of live, sampled when the depot is visited
+	uint64_t allocs; // total
+	uint64_t slabs; // LEN_OF_POOLX_SLAB each
+	uint64_t depot; // free objects kept by the depot, not by the threads
+	int threads; // the threads with a cache of this class
+} PoolXStat_t;
+
+// like calloc / free, the objects are kept in size classes.
+// every thread has its own magazines of every class, only the depot (one of every class) is locked.
+// the memory of the classes is kept until poolx_close, a pointer must come back to poolx_free.
+void *poolx_calloc(size_t nitems, size_t size);
+void poolx_free(void *ptr);
+
+// idx: 0 ~ MAX_OF_POOLX_CLASS (the last one is the objects above the classes)
+int poolx_stat(int idx, PoolXStat_t *stat);
+void poolx_print(void);
+// after the other threads are gone, the classes with live objects are reported and kept
+void poolx_close(void);
+
+#define SAFE_POOLX_CALLOC(nitems, size) poolx_calloc(nitems, size)
+#define SAFE_POOLX_FREE(X) \
+	do { if ( (X) != NULL ) {poolx_free(X); X=NULL;} } while(0)
+#else
+#define SAFE_POOLX_CALLOC(nitems, size) SAFE_CALLOC(nitems, size)
+#define SAFE_POOLX_FREE(X) SAFE_FREE(X)
+#endif
+
+
 //******************************************************************************
 //** UTIL_EX_SYSTEMINFO **
 //******************************************************************************
@@ -1272,6 +1621,11 @@ typedef struct LedRequest_Struct
 	LedOn_t *ledon_ary;
 
 	led_on_fn led_on_cb;
+
+	// UTIL_EX_TIMERX, led_timer_init
+	void *timerx_req;
+	void *timer_node;
+	int idx;
 } LedRequest_t;
 
 void led_gosleep(LedRequest_t *ledreq);
@@ -1290,7 +1644,7 @@ LedRequest_t *led_thread_init(char *name, int infinite, LedOn_t *ledon_ary, led_
 #ifdef UTIL_EX_CURL
 #include <curl/curl.h>
 
-#define VAL_OF_CURLOPT_VERBOSE (dbg_more/DBG_LVL_TRACE)
+#define VAL_OF_CURLOPT_VERBOSE (dbg_mod_get(DBG_MOD_ID_CURL)/DBG_LVL_TRACE)
 
 #define MAX_OF_CURL_CONNECTTIMEOUT 20L
 #define MAX_OF_CURL_TIMEOUT 300L
@@ -1396,35 +1750,60 @@ typedef struct FileRequest_STRUCT
 
 typedef enum
 {
-	MJPEG_STATE_ID_BOUNDARY,
-	MJPEG_STATE_ID_TYPE,
-	MJPEG_STATE_ID_TYPE_0D0A,
-	MJPEG_STATE_ID_LENGTH,
-	MJPEG_STATE_ID_LENGTH_0D0A,
-	MJPEG_STATE_ID_STUPID_0D0A,
+	MJPEG_STATE_ID_BOUNDARY, // looking for --boundary, then the part headers till \r\n\r\n
 	MJPEG_STATE_ID_BODY,
 	MJPEG_STATE_ID_MAX,
 } MJPEG_STATE_ID;
 
+#define MAX_OF_MJPEG_POOL 4
+
+typedef struct MJPEGFrame_STRUCT
+{
+	int num;
+	char ftype[LEN_OF_VAL32];
+
+	char *data;
+	size_t len;
+	int iscopy; // 0: a view of the curl chunk, 1: a buffer of the pool
+} MJPEGFrame_t;
+
+struct HttpX_STRUCT;
+// the frame is only valid inside the callback, except a copied one which lasts till pool_size-1 more frames
+// return 0 to continue, others to abort the transfer
+typedef int (*mjpeg_frame_fn)(struct HttpX_STRUCT *http_req, MJPEGFrame_t *frame, void *userdata);
+
 typedef struct MJPEGRequest_STRUCT
 {
 	size_t max_size;
-	char filename[LEN_OF_FULLNAME];
+	char filename[LEN_OF_FULLNAME]; // disk sink, frame 0
 	FILE *fp;
 
-	char prefixname[LEN_OF_DIRNAME];
+	char prefixname[LEN_OF_DIRNAME]; // disk sink, frame n - prefixname_%02d.jpg
 	int maxfiles;
 
 	int num;
 
-	QBUF_t qbuf;
+	mjpeg_frame_fn frame_cb; // NULL: disk sink only
+	void *frame_data;
+	int pool_size; // 0: 1, up to MAX_OF_MJPEG_POOL
+
 	char boundary[LEN_OF_VAL32];
 	char ctype[LEN_OF_VAL32];
 	int clength;
 
 	char ftype[LEN_OF_VAL32];
-	int flength;
+	int flength; // 0: unknown, scan for the next boundary
 	MJPEG_STATE_ID state;
+
+	char delim[LEN_OF_VAL48]; // \r\n--boundary
+	int delim_len;
+	char hdr[LEN_OF_BUF1024]; // the boundary line and the part headers
+	int hdr_len;
+
+	char *pool_buf[MAX_OF_MJPEG_POOL];
+	size_t pool_max[MAX_OF_MJPEG_POOL];
+	int pool_idx;
+	size_t frame_len; // bytes collected into pool_buf[pool_idx]
 } MJPEGRequest_t;
 
 #define MAX_OF_RTSP_TRACK 2
@@ -1444,16 +1823,45 @@ typedef struct RTSPRequest_STRUCT
 	int no_of_track;
 	char track[MAX_OF_RTSP_TRACK][LEN_OF_VAL32];
 	char session[LEN_OF_VAL32];
+	char encoding[LEN_OF_VAL16]; // a=rtpmap of the video
+	int pt;
+	int clock_rate;
+	int don_present; // H265, sprop-max-don-diff > 0
 	QBUF_t qoption;
 	QBUF_t qdescribe;
 
 	void *rtp_req;
 } RTSPRequest_t;
 
+typedef enum
+{
+	HTTP_SINK_ID_BUFFER, // response, grows geometrically, pre-sized by Content-Length (up to MAX_OF_HTTP_PRESIZE)
+	HTTP_SINK_ID_FD, // written to fd, response is not kept
+	HTTP_SINK_ID_STREAM, // handed to sink_cb chunk by chunk, response is not kept
+	HTTP_SINK_ID_MAX,
+} HTTP_SINK_ID;
+
+#define MAX_OF_HTTP_PRESIZE LEN_OF_BUF_4MB // a larger Content-Length isn't trusted, the buffer grows with the body
+
+// return len to continue, others to abort the transfer
+typedef size_t (*http_sink_fn)(struct HttpX_STRUCT *http_req, char *ptr, size_t len, void *userdata);
+
+typedef struct HttpSink_STRUCT
+{
+	HTTP_SINK_ID sink_id;
+
+	size_t res_max; // HTTP_SINK_ID_BUFFER, allocated size of response
+	int fd; // HTTP_SINK_ID_FD
+	http_sink_fn sink_cb; // HTTP_SINK_ID_STREAM
+	void *sink_data;
+} HttpSink_t;
+
 typedef struct HttpX_STRUCT
 {
 	HTTP_MODE_ID mode;
 	CURL *curl;
+	struct HttpXPool_STRUCT *pool; // NULL: a new easy handle per request
+	HttpSink_t sink; // for the response of SIMPLE, SOAP and UPLOADFILE, res_size still counts the bytes
 	char url[LEN_OF_URL];
 	int port;
 	char *user;
@@ -1476,6 +1884,44 @@ typedef struct HttpX_STRUCT
 
 typedef void (*http_response_fn)(HttpX_t *http_req, void *userdata);
 
+#define MAX_OF_HTTPX_POOL 8 // idle easy handles kept by the pool
+#define MAX_OF_HTTPX_HOST_CONNECTIONS 8 // async mode
+
+// the easy handles share DNS, TLS sessions and connections
+typedef struct HttpXPool_STRUCT
+{
+	char name[LEN_OF_NAME32];
+
+	ThreadX_t tidx; // async mode, drives multi
+
+	int isfree;
+	int dbg_more;
+
+	CURLSH *share;
+	pthread_mutex_t share_mtx[CURL_LOCK_DATA_LAST];
+
+	pthread_mutex_t easy_mtx;
+	CURL *easy_ary[MAX_OF_HTTPX_POOL];
+	int easy_count;
+
+	CURLM *multi;
+	CLIST_STRUCT(async_list); // waiting to be added into multi
+	CLIST_STRUCT(running_list); // inside multi, only the thread of the pool touches it
+	int running;
+} HttpXPool_t;
+
+typedef struct HttpXAsync_STRUCT
+{
+	void* next;
+
+	HttpX_t *http_req;
+	http_response_fn done_cb;
+	void *userdata;
+#ifdef UTIL_EX_TRACEX
+	unsigned long long t_add; // TRACEX_NOW(), http_request_async -> done_cb
+#endif
+} HttpXAsync_t;
+
 void http_connect_timeout_set(HttpX_t *http_req, int timeout);
 void http_timeout_set(HttpX_t *http_req, int timeout);
 void http_request_stop(HttpX_t *http_req);
@@ -1487,6 +1933,14 @@ int http_upload(const char *url, const char *filename);
 int http_upload_with_response(const char *url, const char *filename, void *userdata, http_response_fn cb);
 
 int http_simple(const char *url, HTTP_METHOD_ID method, struct curl_slist *http_simple, size_t req_size, char *request, void *userdata, http_response_fn cb);
+int http_simple_ex(const char *url, HTTP_METHOD_ID method, struct curl_slist *headers, size_t req_size, char *request, HttpSink_t *sink, void *userdata, http_response_fn cb);
+
+CURL *http_pool_get(HttpXPool_t *pool);
+void http_pool_put(HttpXPool_t *pool, CURL *curl);
+int http_request_async(HttpX_t *http_req, void *userdata, http_response_fn cb);
+void http_pool_stop(HttpXPool_t *pool);
+void http_pool_close(HttpXPool_t *pool);
+HttpXPool_t *http_pool_init(char *name, int isasync);
 
 #endif
 
@@ -1507,9 +1961,9 @@ int http_simple(const char *url, HTTP_METHOD_ID method, struct curl_slist *http_
 #define ONVIF_XML_GETSNAPSHOTURI "<?xml version='1.0' encoding='utf-8'?><SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\"><SOAP-ENV:Body><trt:GetSnapshotUri><trt:ProfileToken>Profile00Token</trt:ProfileToken></trt:GetSnapshotUri></SOAP-ENV:Body></SOAP-ENV:Envelope>"
 #define ONVIF_XML_GETSTREAMURI "<?xml version='1.0' encoding='UTF-8'?><SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:tt=\"http://www.onvif.org/ver10/schema\" xmlns:trt=\"http://www.onvif.org/ver10/media/wsdl\"><SOAP-ENV:Body><trt:GetStreamUri><trt:StreamSetup><tt:Stream>RTP-Unicast</tt:Stream><tt:Transport><tt:Protocol>RTSP</tt:Protocol></tt:Transport></trt:StreamSetup><trt:ProfileToken>profile1</trt:ProfileToken></trt:GetStreamUri></SOAP-ENV:Body></SOAP-ENV:Envelope>"
 
-#define WSD_XML_PROBE_DEVICE "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:bd77953d-2069-40b2-82ee-b81a4b007277</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/device/wsdl\">dp0:Device</d:Types></Probe></s:Body></s:Envelope>"
-#define WSD_XML_PROBE_NETWORKVIDEOTRANSMITTER "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:1b897826-55b9-464d-9b34-d36f0a776cb3</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/network/wsdl\">dp0:NetworkVideoTransmitter</d:Types></Probe></s:Body></s:Envelope>"
-#define WSD_XML_PROBE_NETWORKVIDEODISPLAY "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:501fbe60-d3f2-4978-9b41-e8a3bc2acb4f</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/network/wsdl\">dp0:NetworkVideoDisplay</d:Types></Probe></s:Body></s:Envelope>"
+#define WSD_XML_PROBE_DEVICE "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:{WSD_XML_MESSAGEID}</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/device/wsdl\">dp0:Device</d:Types></Probe></s:Body></s:Envelope>"
+#define WSD_XML_PROBE_NETWORKVIDEOTRANSMITTER "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:{WSD_XML_MESSAGEID}</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/network/wsdl\">dp0:NetworkVideoTransmitter</d:Types></Probe></s:Body></s:Envelope>"
+#define WSD_XML_PROBE_NETWORKVIDEODISPLAY "<?xml version='1.0' encoding='utf-8'?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\" xmlns:a=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\"><s:Header><a:Action s:mustUnderstand=\"1\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</a:Action><a:MessageID>uuid:{WSD_XML_MESSAGEID}</a:MessageID><a:ReplyTo><a:Address>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</a:Address></a:ReplyTo><a:To s:mustUnderstand=\"1\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</a:To></s:Header><s:Body><Probe xmlns=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\"><d:Types xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\" xmlns:dp0=\"http://www.onvif.org/ver10/network/wsdl\">dp0:NetworkVideoDisplay</d:Types></Probe></s:Body></s:Envelope>"
 
 #define soap_node_t mxml_node_t
 
@@ -1573,6 +2027,46 @@ void soap_load_request(SoapX_t *soap, char *action);
 void soap_http_access(SoapX_t *soap, HttpX_t *http_req);
 void soap_free(SoapX_t *soap);
 SoapX_t *soap_create(char *xmlbuffer);
+
+#define MAX_OF_SOAP_SLOT 8 // different {NAME}
+#define MAX_OF_SOAP_SEG 16 // literal + {NAME} pairs
+
+typedef enum
+{
+	SOAP_SLOT_ID_TEXT, // &, < and > are escaped
+	SOAP_SLOT_ID_ATTR, // and the quotes
+	SOAP_SLOT_ID_MAX,
+} SOAP_SLOT_ID;
+
+typedef struct SoapSeg_STRUCT
+{
+	int off; // literal inside SoapTmpl_t.xml
+	int len;
+	int slot; // value_ary[slot] follows the literal, -1: the last literal
+	SOAP_SLOT_ID slot_id;
+} SoapSeg_t;
+
+// an envelope with {NAME} slots, parsed once, then rendered without mxml
+typedef struct SoapTmpl_STRUCT
+{
+	char *xml; // the literals, whitespace between tags is dropped
+	int xml_len;
+
+	SoapSeg_t seg_ary[MAX_OF_SOAP_SEG];
+	int seg_count;
+	char slot_ary[MAX_OF_SOAP_SLOT][LEN_OF_NAME32];
+	int slot_count;
+
+	char *buf; // soap_tmpl_render, reused and grows geometrically
+	size_t buf_max;
+} SoapTmpl_t;
+
+int soap_tmpl_slot(SoapTmpl_t *tmpl, const char *name);
+char *soap_tmpl_render(SoapTmpl_t *tmpl, const char **value_ary, int *len);
+char *soap_tmpl_render_alloc(SoapTmpl_t *tmpl, const char **value_ary, int *len);
+void soap_tmpl_free(SoapTmpl_t *tmpl);
+SoapTmpl_t *soap_tmpl_load(char *filename);
+SoapTmpl_t *soap_tmpl_compile(const char *xmlbuffer);
 #endif
 
 
@@ -1889,9 +2383,22 @@ void chainX_netlink_register(ChainX_t *chainX_req, chainX_netlink_fn cb);
 void chainX_thread_stop(ChainX_t *chainX_req);
 void chainX_thread_close(ChainX_t *chainX_req);
 int chainX_thread_init(ChainX_t *chainX_req);
+int chainX_connect_check(ChainX_t *chainX_req);
+int chainX_open(ChainX_t *chainX_req);
 
 int chainX_ping(ChainX_t *chainX_req);
 
+#ifdef UTIL_EX_METRICX
+// chainx_bytes_total and chainx_packets_total, dir="rx" or "tx"
+void chainX_metric_rx(int len);
+void chainX_metric_tx(int len);
+#define SOCKETX_METRIC_RX(len) chainX_metric_rx(len)
+#define SOCKETX_METRIC_TX(len) chainX_metric_tx(len)
+#else
+#define SOCKETX_METRIC_RX(len)
+#define SOCKETX_METRIC_TX(len)
+#endif
+
 #ifdef UTIL_EX_SOCKET_OPENSSL
 #define SOCKETX_READ(req, wbuff, wlen) \
 	({ int __ret = 0; \
@@ -1900,6 +2407,7 @@ int chainX_ping(ChainX_t *chainX_req);
 				if (chainX_security_get(req) == 1 ) __ret = SSL_read(chainXssl_sslfd_get(req), wbuff, wlen); else __ret = read(chainX_fd_get(req), wbuff, wlen); \
 			else \
 				__ret = 0; \
+			SOCKETX_METRIC_RX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1911,6 +2419,7 @@ int chainX_ping(ChainX_t *chainX_req);
 				if (chainX_security_get(req) == 1 ) __ret = SSL_write(chainXssl_sslfd_get(req), wbuff, wlen); else __ret = write(chainX_fd_get(req), wbuff, wlen); \
 			else \
 				__ret = 0; \
+			SOCKETX_METRIC_TX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1924,6 +2433,7 @@ int chainX_ping(ChainX_t *chainX_req);
 				if (chainX_security_get(req) == 1 ) __ret = mbedtls_ssl_read(chainXssl_sslfd_get(req), (unsigned char *)wbuff, wlen); else	 __ret = read(chainX_fd_get(req), wbuff, wlen); \
 			else \
 				__ret = 0; \
+			SOCKETX_METRIC_RX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1935,6 +2445,7 @@ int chainX_ping(ChainX_t *chainX_req);
 				if (chainX_security_get(req) == 1 ) __ret = mbedtls_ssl_write(chainXssl_sslfd_get(req), (const unsigned char *)wbuff, wlen); else __ret = write(chainX_fd_get(req), wbuff, wlen); \
 			else \
 				__ret = 0; \
+			SOCKETX_METRIC_TX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1947,6 +2458,7 @@ int chainX_ping(ChainX_t *chainX_req);
 			if (pcheck(wbuff)) \
 				__ret = read(chainX_fd_get(req), wbuff, wlen); \
 			else __ret = 0; \
+			SOCKETX_METRIC_RX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1957,6 +2469,7 @@ int chainX_ping(ChainX_t *chainX_req);
 			if (pcheck(wbuff)) \
 				__ret = write(chainX_fd_get(req), wbuff, wlen); \
 			else __ret = 0; \
+			SOCKETX_METRIC_TX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1970,6 +2483,7 @@ int chainX_ping(ChainX_t *chainX_req);
 			if (pcheck(wbuff)) \
 				__ret = sendto(chainX_fd_get(req), wbuff, wlen, 0, (struct sockaddr*)chainX_addr_to_get(req), addr_len); \
 			else __ret = 0; \
+			SOCKETX_METRIC_TX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -1979,6 +2493,7 @@ int chainX_ping(ChainX_t *chainX_req);
 		do { \
 			int addr_len=sizeof(struct sockaddr_in); \
 			__ret = recvfrom(chainX_fd_get(req), wbuff, wlen, 0, (struct sockaddr*)chainX_addr_from_get(req), (socklen_t *)&addr_len); \
+			SOCKETX_METRIC_RX(__ret); \
 		} while(0); \
 		__ret; \
 	})
@@ -2087,15 +2602,14 @@ typedef enum
 	NAL_TYPE_FU_B = 29,
 } NAL_TYPE;
 
-typedef struct
+/* H.265 NAL unit types of RFC 7798 */
+typedef enum
 {
-	unsigned char flags; /* Version(2),Padding(1), Ext(1), Cc(4) */
-	unsigned char mk_pt; /* Marker(1), PlayLoad Type(7) */
-	unsigned short sq_nb; /* Sequence Number */
-	unsigned long ts; /* Timestamp */
-	unsigned long ssrc; /* SSRC */
-	unsigned long *csrc; /* CSRC's table */
-} rtp_hdr;
+	H265_NAL_TYPE_SINGLE_NAL_MAX = 47,
+	H265_NAL_TYPE_AP = 48,
+	H265_NAL_TYPE_FU = 49,
+	H265_NAL_TYPE_PACI = 50,
+} H265_NAL_TYPE;
 
 /**
  ** RTP header extension
@@ -2132,35 +2646,264 @@ typedef struct
 	void *conx_data; /* Network data */
 } sess_context_t;
 
-/**
- ** RTP Packet
- **/
-typedef struct
+#define MAX_OF_RTP_JITTER 64 // slots of the jitter buffer, a power of 2
+#define LEN_OF_RTP_PKT 1600 // preallocated per slot, a bigger packet grows its slot
+#define MAX_OF_RTP_JITTER_MS 200
+#define VAL_OF_RTP_CLOCK_RATE 90000
+
+// RFC 3550 A.1
+#define RTP_SEQ_MOD (1<<16)
+#define RTP_MAX_DROPOUT 3000
+#define RTP_MAX_MISORDER 100
+
+typedef struct RTPPkt_STRUCT
 {
-	rtp_hdr *RTP_header; /* Header RTP */
-	rtp_ext *RTP_extension; /* extension of the header if exist */
+	int isused;
+	unsigned int ext_seq; // cycles + sq_nb
+	unsigned int ts;
+	int marker;
+	int pt;
+	unsigned long long t_arrival; // us
+
+	char *buf; // the whole packet, a slot of the pool or from the caller
+	int buf_max;
+	int isheap; // buf outgrew its slot
+	int payload_off;
+	int payload_len;
+} RTPPkt_t;
 
-	char *payload; /* payload portion of RTP packet */
-	unsigned int payload_len; /* The length of the payload */
+// RFC 3550 A.1, A.3 and A.8
+typedef struct RTPStat_STRUCT
+{
+	unsigned int ssrc;
+	unsigned short max_seq;
+	unsigned int cycles;
+	unsigned int base_seq;
+	unsigned int bad_seq;
+	unsigned int received;
+	unsigned int expected;
+	int lost; // cumulative
+	int transit;
+	unsigned int jitter; // timestamp units
+
+	unsigned int late; // behind the jitter buffer
+	unsigned int duplicates;
+	unsigned int skipped; // holes given up by the jitter buffer
+
+	unsigned int au_count;
+	unsigned int au_lost; // delivered with islost
+
+	// RFC 3550 6.4, kept by rtp_rtcp_rr and rtp_rtcp_parse
+	unsigned int expected_prior;
+	unsigned int received_prior;
+	unsigned char fraction; // of the last receiver report
+	unsigned int sr_count;
+	unsigned int lsr; // the middle 32 bits of the NTP timestamp of the last SR
+	unsigned long long lsr_us; // when the last SR arrived
+} RTPStat_t;
+
+typedef struct RTPAccessUnit_STRUCT
+{
+	unsigned int ts;
+	int pt;
+	int islost; // with a hole, the decoder might skip it
+	char *data; // Annex-B
+	size_t len;
+} RTPAccessUnit_t;
+
+struct RTPX_STRUCT;
+// au->data is only valid inside the callback, return 0 to continue, others to stop the stream
+typedef int (*rtp_au_fn)(struct RTPX_STRUCT *rtp_req, RTPAccessUnit_t *au, void *userdata);
+// appends the NAL units of one payload with rtp_au_startcode and rtp_au_write, return -1 if something is missing
+typedef int (*rtp_depay_fn)(struct RTPX_STRUCT *rtp_req, unsigned char *payload, int payload_len);
+
+typedef struct RTPCodec_STRUCT
+{
+	char name[LEN_OF_VAL16]; // encoding name of a=rtpmap
+	rtp_depay_fn depay_cb;
+} RTPCodec_t;
 
-	sess_context_t *sess_req;
-} rtp_pkt;
+#define MAX_OF_RTP_AGG 32 // NAL units in one aggregation packet
+
+typedef struct RTPAggUnit_STRUCT
+{
+	unsigned short don;
+	unsigned char *nal;
+	int len;
+} RTPAggUnit_t;
 
 typedef struct RTPX_STRUCT
 {
 	size_t max_size;
 	size_t total;
-	HttpX_t *http_req;
+	HttpX_t *http_req; // file sink - http_req->rtsp_req.fp
 
 	sess_context_t sess_data;
+
+	ChainX_t *chainX_req; // udp
+	pthread_mutex_t in_mtx;
+
+	int clock_rate; // VAL_OF_RTP_CLOCK_RATE
+	int pt; // 0: the first one
+	RTPCodec_t *codec; // NULL: H264
+	int don_present; // H265, sprop-max-don-diff > 0
+	int jitter_depth; // packets held behind a hole, 0: MAX_OF_RTP_JITTER/2
+	int jitter_ms; // 0: MAX_OF_RTP_JITTER_MS
+
+	char *pool; // MAX_OF_RTP_JITTER * LEN_OF_RTP_PKT
+	RTPPkt_t jitter[MAX_OF_RTP_JITTER]; // by ext_seq
+	unsigned int next_seq;
+	int pending;
+
+	char *au_buf; // reused by every access unit
+	size_t au_len;
+	size_t au_max;
+	unsigned int au_ts;
+	int au_lost;
+	int fu_on; // inside a fragmented NAL unit
+
+	rtp_au_fn au_cb;
+	void *au_data;
+	int isstop; // rtp_au_fn asked to stop
+
+	RTPStat_t stat;
+	unsigned int jitter_q4; // RFC 3550 A.8, jitter << 4
 } RTPX_t;
 
 int rtp_port_get(void);
 void rtp_context_print(sess_context_t *sess_req);
 int dummy_write(RTPX_t *rtp_req, void *buf, size_t count);
 void rtp_body_parse(RTPX_t *rtp_req, char *buff, int buff_len);
+void rtp_jitter_poll(RTPX_t *rtp_req);
+int rtp_au_write(RTPX_t *rtp_req, unsigned char *buf, size_t count);
+int rtp_au_startcode(RTPX_t *rtp_req);
+#ifdef UTIL_EX_SSL
+int rtp_sprop_write(RTPX_t *rtp_req, FILE *fp, char *fmtp, char *key);
+#endif
+RTPCodec_t *rtp_codec_find(char *name);
+void rtp_codec_set(RTPX_t *rtp_req, RTPCodec_t *codec);
+void rtp_stat(RTPX_t *rtp_req, RTPStat_t *stat);
+int rtp_rtcp_rr(RTPX_t *rtp_req, unsigned int ssrc, char *cname, unsigned char *buf, int buf_len);
+int rtp_rtcp_parse(RTPX_t *rtp_req, char *buff, int buff_len);
+void rtp_au_register(RTPX_t *rtp_req, rtp_au_fn cb, void *userdata);
 void rtp_free(RTPX_t *rtp_req);
 RTPX_t *rtp_init(int port, int interleaved);
+
+// RTSP over TCP (interleaved), the sessions of the cameras share one thread and one epoll
+#include <sys/epoll.h>
+
+#define LEN_OF_RTSP_RBUF (64*1024+LEN_OF_BUF4096) // the biggest interleaved frame and a reply
+#define MAX_OF_RTSP_EVENTS 32
+#define PORT_OF_RTSP 554
+#define TIMEOUT_OF_RTSP_REPLY 10 // seconds
+#define TIMEOUT_OF_RTSP_SESSION 60 // seconds, when Session has no timeout=
+#define INTERVAL_OF_RTSP_RR 5000 // ms, RFC 3550 6.2
+#define INTERVAL_OF_RTSP_RETRY 1000 // ms, the first reconnect, then doubled
+#define MAX_OF_RTSP_RETRY 60000 // ms, the longest between reconnects
+#define MAX_OF_RTSP_DNS 64 // nslookups waiting for the thread of the dns
+
+typedef enum
+{
+	RTSP_STATE_ID_CONNECT, // waiting for t_retry
+	RTSP_STATE_ID_RESOLVE, // nslookup on the thread of the dns
+	RTSP_STATE_ID_CONNECTING, // non-blocking connect, waiting for EPOLLOUT
+	RTSP_STATE_ID_OPTIONS,
+	RTSP_STATE_ID_DESCRIBE,
+	RTSP_STATE_ID_SETUP,
+	RTSP_STATE_ID_PLAY,
+	RTSP_STATE_ID_PLAYING,
+	RTSP_STATE_ID_CLOSED, // stopped by rtp_au_fn or retry_ms < 0, until rtspx_session_del
+	RTSP_STATE_ID_MAX,
+} RTSP_STATE_ID;
+
+typedef enum
+{
+	RTSP_AUTH_ID_NONE,
+	RTSP_AUTH_ID_BASIC,
+	RTSP_AUTH_ID_DIGEST,
+	RTSP_AUTH_ID_MAX,
+} RTSP_AUTH_ID;
+
+struct RTSPX_STRUCT;
+struct QueueX_Struct;
+
+typedef struct RTSPSession_STRUCT
+{
+	void* next;
+	struct RTSPX_STRUCT *rtspx_req;
+
+	ChainX_t chainX_req; // tcp client without its thread, polled by RTSPX
+	int isdel;
+	int isresolving; // queued to qdns, not freed until it is back
+
+	char url[LEN_OF_URL]; // without user:pass
+	char user[LEN_OF_USER];
+	char pass[LEN_OF_VAL64];
+	char base[LEN_OF_URL]; // Content-Base
+	char aggregate[LEN_OF_URL]; // a=control of the session, for PLAY, GET_PARAMETER and TEARDOWN
+	char control[LEN_OF_URL]; // of the video, for SETUP
+	char session[LEN_OF_VAL64];
+	int timeout; // seconds
+	int cseq;
+	RTSP_STATE_ID state;
+
+	RTSP_AUTH_ID auth;
+	char realm[LEN_OF_VAL128];
+	char nonce[LEN_OF_VAL128];
+	int auth_retry;
+
+	char *rbuf; // LEN_OF_RTSP_RBUF, the frames are parsed in place
+	int rlen;
+	int ch_rtp;
+	int ch_rtcp;
+
+	char encoding[LEN_OF_VAL16]; // a=rtpmap of the video
+	int pt;
+	int clock_rate;
+	int don_present;
+	RTPX_t *rtp_req;
+	unsigned int ssrc; // ours, of the receiver reports
+
+	unsigned long long t_reply; // us, waiting for the reply until
+	unsigned long long t_rr; // the next receiver report
+	unsigned long long t_keepalive; // the next GET_PARAMETER
+	unsigned long long t_retry; // the next connect
+	int retry_wait; // ms, until the next reconnect
+
+	rtp_au_fn au_cb;
+	void *au_data;
+} RTSPSession_t;
+
+typedef struct RTSPDns_STRUCT
+{
+	RTSPSession_t *sess_req;
+	char hostname[LEN_OF_HOSTNAME32];
+} RTSPDns_t;
+
+typedef struct RTSPX_STRUCT
+{
+	char name[LEN_OF_NAME32];
+
+	ThreadX_t tidx;
+
+	int isfree;
+	int epfd;
+	int evfd; // wakes up epoll_wait
+	int rr_ms; // 0: INTERVAL_OF_RTSP_RR
+	int retry_ms; // the first reconnect, doubled until MAX_OF_RTSP_RETRY, 0: INTERVAL_OF_RTSP_RETRY, < 0: never
+
+	struct QueueX_Struct *qdns; // the nslookups of the sessions, off the thread of epoll
+
+	CLIST_STRUCT(session_list);
+} RTSPX_t;
+
+RTSP_STATE_ID rtspx_session_state(RTSPSession_t *sess_req);
+int rtspx_session_stat(RTSPSession_t *sess_req, RTPStat_t *stat);
+void rtspx_session_del(RTSPSession_t *sess_req);
+RTSPSession_t *rtspx_session_add(RTSPX_t *rtspx_req, char *url, char *user, char *pass, rtp_au_fn cb, void *userdata);
+void rtspx_stop(RTSPX_t *rtspx_req);
+void rtspx_close(RTSPX_t *rtspx_req);
+RTSPX_t *rtspx_init(char *name);
 #endif
 
 
@@ -2298,6 +3041,70 @@ typedef struct OnvifX_STRUCT
 
 typedef void (*onvif_resuest_fn)(SoapX_t *soap, OnvifX_t *onvif_req);
 
+#define MAX_OF_ONVIF_INFLIGHT 32 // requests inside the HttpXPool at the same time
+#define MAX_OF_ONVIF_PROFILES 8
+
+typedef enum
+{
+	ONVIF_DEV_STATE_ID_NONE, // the services are unknown
+	ONVIF_DEV_STATE_ID_CAPABILITIES,
+	ONVIF_DEV_STATE_ID_PROFILES,
+	ONVIF_DEV_STATE_ID_READY,
+	ONVIF_DEV_STATE_ID_MAX,
+} ONVIF_DEV_STATE_ID;
+
+typedef struct OnvifDev_STRUCT
+{
+	void* next;
+
+	struct OnvifPool_STRUCT *onvif_pool;
+
+	NetworkInfo_t netinfo; // url of the device service
+	int http_auth;
+
+	ONVIF_DEV_STATE_ID state;
+	OnvifServices_t service; // GetCapabilities and GetProfiles, only once
+	char profile_ary[MAX_OF_ONVIF_PROFILES][LEN_OF_VAL32];
+	int profile_count;
+
+	CLIST_STRUCT(parked_list); // waiting for the services
+} OnvifDev_t;
+
+// response_node is NULL when failed, and it is deleted after the callback
+typedef void (*onvif_response_fn)(OnvifDev_t *dev, SOAP_ACTION_ID act_id, soap_node_t *response_node, void *userdata);
+
+typedef struct OnvifJob_STRUCT
+{
+	void* next;
+
+	OnvifDev_t *dev;
+	SOAP_ACTION_ID act_id;
+	char token[LEN_OF_VAL32]; // ProfileToken, "": the 1st profile
+	int isboot; // GetCapabilities and GetProfiles of the services
+
+	onvif_response_fn done_cb;
+	void *userdata;
+
+	HttpX_t http_req;
+} OnvifJob_t;
+
+typedef struct OnvifPool_STRUCT
+{
+	char name[LEN_OF_NAME32];
+
+	int isfree;
+
+	HttpXPool_t *http_pool;
+
+	pthread_mutex_t in_mtx;
+	int max_inflight;
+	int inflight;
+	CLIST_STRUCT(job_list); // waiting for a slot
+	CLIST_STRUCT(dev_list);
+
+	SoapTmpl_t *tmpl_ary[SOAP_ACTION_ID_MAX]; // serialized by mxml once, shared by the devices
+} OnvifPool_t;
+
 char *onvif_pass_sha1(char *nonce, int nonce_len, char *created, int create_len, char *password, int password_len);
 void onvif_auth(OnvifX_t *onvif_req, SoapX_t *soap);
 soap_node_t *onvif_open(OnvifX_t *onvif_req, onvif_resuest_fn request_cb);
@@ -2309,6 +3116,11 @@ soap_node_t *onvif_GetCommon(OnvifX_t *onvif_req);
 
 int onvif_GetVideoClip(OnvifX_t *onvif_req, char *videoclip_uri, char *filename, int duration);
 int onvif_GetSnapshot(OnvifX_t *onvif_req, char *snapshot_uri, char *prefixname);
+
+OnvifDev_t *onvif_dev_add(OnvifPool_t *onvif_pool, char *url, char *user, char *pass, int http_auth);
+int onvif_request_async(OnvifDev_t *dev, SOAP_ACTION_ID act_id, char *token, onvif_response_fn cb, void *userdata);
+void onvif_pool_close(OnvifPool_t *onvif_pool);
+OnvifPool_t *onvif_pool_init(char *name, int max_inflight);
 #endif
 
 
@@ -2347,6 +3159,16 @@ void proc_table_close(void);
 #ifdef UTIL_EX_QUEUEX
 typedef int (*queuex_fn)(void *arg);
 
+#ifdef UTIL_EX_METRICX
+typedef struct QueueXMetric_Struct
+{
+	MetricX_t *depth;
+	MetricX_t *adds;
+	MetricX_t *drops; // full or quit
+	MetricX_t *exec_us; // exec_cb
+} QueueXMetric_t;
+#endif
+
 typedef struct QueueX_Struct
 {
 	char name[LEN_OF_NAME32];
@@ -2373,8 +3195,15 @@ typedef struct QueueX_Struct
 	int max_data;
 #endif
 
+	int max_batch; // items per pop, 0 or 1: one by one
+	int max_pop; // slots of data_pop
+
 	queuex_fn exec_cb;
 	queuex_fn free_cb; // for un-processed data
+
+#ifdef UTIL_EX_METRICX
+	QueueXMetric_t metric; // labels: name="queuex_req->name"
+#endif
 } QueueX_t;
 
 void queuex_lock(QueueX_t *queuex_req);
@@ -2392,8 +3221,9 @@ int queuex_isready(QueueX_t *queuex_req, int retry);
 
 void queuex_gosleep(QueueX_t *queuex_req);
 void queuex_wakeup(QueueX_t *queuex_req);
-void queuex_add(QueueX_t *queuex_req, void *data_new);
-void queuex_push(QueueX_t *queuex_req, void *data_new);
+void queuex_batch(QueueX_t *queuex_req, int max_batch);
+int queuex_add(QueueX_t *queuex_req, void *data_new);
+int queuex_push(QueueX_t *queuex_req, void *data_new);
 
 void queuex_thread_stop(QueueX_t *queuex_req);
 void queuex_thread_close(QueueX_t *queuex_req);
@@ -2472,6 +3302,24 @@ typedef struct StateXPuck_Struct
 	int run;
 } StateXPuck_t;
 
+// fn_links[idx], the smaller idx has the higher priority
+#define MAX_OF_STATEX_FN 4096 // 64 * 64
+#define STATEX_MAP_WORDS (MAX_OF_STATEX_FN / 64)
+
+typedef struct StateXMap_Struct
+{
+	uint64_t sum; // bit n: map[n] != 0
+	uint64_t map[STATEX_MAP_WORDS];
+} StateXMap_t;
+
+typedef struct StateXPend_Struct
+{
+	int subitem;
+	ACTION_ID action;
+	int run;
+	int count; // merged events
+} StateXPend_t;
+
 typedef struct StateX_STRUCT
 {
 	QueueX_t *statex_q;
@@ -2481,6 +3329,17 @@ typedef struct StateX_STRUCT
 
 	int dbg_more;
 	void *data;
+
+	int iscoalesce; // 1: the events are merged per fn_links[idx] and handled with one rotation
+	int ispending; // iscoalesce, a puck is in statex_q
+
+	int max_fn;
+	StateXMap_t active; // fn_links[idx].action == ACTION_ID_ON
+	StateXMap_t pending; // iscoalesce, pend_ary[idx] is waiting
+	StateXPend_t *pend_ary;
+	StateXPend_t *pend_run;
+
+	unsigned long nevent; // handled events, including the merged ones
 } StateX_t;
 
 StateXFn_t *statex_fn_last(StateX_t *statex_req);
@@ -2495,6 +3354,102 @@ void statex_close(StateX_t *statex_req);
 #endif
 
 
+//******************************************************************************
+//** UTIL_EX_TIMERX **
+//******************************************************************************
+#ifdef UTIL_EX_TIMERX
+#include <sys/timerfd.h>
+
+#define TIMERX_TICK_MS 10 // 10 m-seconds
+
+// 4 levels x 64 slots, 64^4 ticks (about 1942 days with 10ms tick)
+#define TIMERX_WHEEL_BITS 6
+#define TIMERX_WHEEL_SIZE (1 << TIMERX_WHEEL_BITS)
+#define TIMERX_WHEEL_MASK (TIMERX_WHEEL_SIZE - 1)
+#define TIMERX_WHEEL_LEVELS 4
+
+#define MAX_OF_QTIMERX 100
+
+#define SAFE_TIMERX_CLOSE(x) \
+	do { \
+		timerx_thread_close(x); \
+		x = NULL; \
+	} while(0)
+
+typedef struct TimerXNode_Struct TimerXNode_t;
+typedef struct TimerX_Struct TimerX_t;
+
+typedef void (*timerx_fn)(TimerXNode_t *node, void *usr_data);
+
+typedef struct TimerXNode_Struct
+{
+	TimerXNode_t *prev;
+	TimerXNode_t *next;
+
+	uint64_t expire; // ticks
+	int interval_ms; // 0: one-shot
+
+	int islinked; // in the wheel
+	int isfire; // expired, waiting for timer_cb
+	int ispending; // in timerx_q
+	int isdel; // timerx_del, released by the owner
+
+	timerx_fn timer_cb;
+	void *usr_data;
+
+	TimerX_t *timerx_req;
+} TimerXNode_t;
+
+typedef struct TimerXPuck_Struct
+{
+	TimerX_t *timerx_req;
+	TimerXNode_t *node;
+} TimerXPuck_t;
+
+typedef struct TimerX_Struct
+{
+	char name[LEN_OF_NAME32];
+
+	ThreadX_t tidx;
+
+	int isfree;
+	int dbg_more;
+
+	int tick_ms;
+	int timerfd;
+
+	uint64_t jiffies; // the next tick to process
+	TimerXNode_t wheel[TIMERX_WHEEL_LEVELS][TIMERX_WHEEL_SIZE]; // sentinel heads
+	int count;
+
+	unsigned long fires;
+	unsigned long drops; // timerx_q is full
+
+	pthread_mutex_t in_run; // held while a callback is running
+	QueueX_t *timerx_q;
+} TimerX_t;
+
+void timerx_lock(TimerX_t *timerx_req);
+void timerx_unlock(TimerX_t *timerx_req);
+
+void timerx_debug(TimerX_t *timerx_req, int dbg_more);
+int timerx_count(TimerX_t *timerx_req);
+
+TimerXNode_t *timerx_add(TimerX_t *timerx_req, int expire_ms, int interval_ms, timerx_fn timer_cb, void *usr_data);
+int timerx_mod(TimerX_t *timerx_req, TimerXNode_t *node, int expire_ms);
+int timerx_cancel(TimerX_t *timerx_req, TimerXNode_t *node);
+void timerx_del(TimerX_t *timerx_req, TimerXNode_t *node);
+
+void timerx_thread_stop(TimerX_t *timerx_req);
+void timerx_thread_close(TimerX_t *timerx_req);
+TimerX_t *timerx_thread_init(char *name, int tick_ms);
+
+#ifdef UTIL_EX_LED
+LedRequest_t *led_timer_init(TimerX_t *timerx_req, char *name, int infinite, LedOn_t *ledon_ary, led_on_fn led_on_cb);
+#endif
+#endif
+
+
 //******************************************************************************
 //** UTIL_EX_JSON **
 //******************************************************************************
@@ -2913,6 +3868,11 @@ json_t *json_ary_find_key_val(json_t *jparent, const char *key, json_t *jval, in
 json_t *json_object_find_with_keys(json_t *jparent, const char *keys);
 json_t *json_object_lookup(json_t *jparent, const char *key, json_t *jval, int deepth, char *topic_parent, json_t *jfound_ary);
 
+#ifdef UTIL_EX_METRICX
+// [ { "name": "queuex_depth", "type": "gauge", "labels": "name=\"q1\"", "value": 0 }, ... ]
+json_t *metricx_json(void);
+#endif
+
 #endif
 
 
@@ -3518,6 +4478,12 @@ void uv_event_open_ex(UvEvent_t *event_req);
 
 typedef int dbusx_match_fn(DBusConnection *dbus_listen, DBusError *err, void *usr_data);
 typedef DBusHandlerResult dbusx_filter_fn(DBusConnection *connection, DBusMessage *message, void *usr_data);
+// dbus_msg_res is NULL or DBUS_MESSAGE_TYPE_ERROR when retStr is NULL
+typedef void dbusx_reply_fn(DBusMessage *dbus_msg_res, char *retStr, void *usr_data);
+
+#ifdef UTIL_EX_UV
+typedef struct DbusXUv_Struct DbusXUv_t;
+#endif
 
 typedef struct DbusX_Struct
 {
@@ -3528,11 +4494,18 @@ typedef struct DbusX_Struct
 	int isfree;
 	int isinit;
 	int isgdbus; // DbusX & gdbus run at the same time.
+	int issession; // DBUS_BUS_SESSION instead of DBUS_BUS_SYSTEM
 
 	char path[LEN_OF_NAME64];
 	DBusConnection *dbus_conn;
 	DBusConnection *dbus_conn_listen;
 
+#ifdef UTIL_EX_UV
+	uv_loop_t *loop; // dbusx_uv_init
+	DbusXUv_t *uv_conn;
+	DbusXUv_t *uv_listen;
+#endif
+
 	dbusx_match_fn *add_match_cb;
 	dbusx_filter_fn *filter_user_cb;
 
@@ -3557,6 +4530,9 @@ char *dbusx_method_simple_str2int(DbusX_t *dbusx_req, const char *dest, const ch
 void dbusx_method_simple_path_str2null(DbusX_t *dbusx_req, char *dbus_path, const char *dest, const char *ifac, char *cmd, char *arg, int timeout);
 void dbusx_method_simple_str2null(DbusX_t *dbusx_req, const char *dest, const char *ifac, char *cmd, char *arg, int timeout);
 
+int dbusx_method_helper_async(DBusConnection *dbus_conn, char *dbus_path, const char *dest, const char *ifac, char *cmd, int itype, void *arg, int timeout, dbusx_reply_fn *reply_cb, void *usr_data);
+int dbusx_method_simple_str2async(DbusX_t *dbusx_req, const char *dest, const char *ifac, char *cmd, char *arg, int timeout, dbusx_reply_fn *reply_cb, void *usr_data);
+
 void dbusx_shutdown(void);
 void dbusx_conn_free(DbusX_t *dbusx_req);
 int dbusx_client_init(DbusX_t *dbusx_req);
@@ -3582,6 +4558,11 @@ int dbusx_thread_init(dbusx_match_fn *match_cb, dbusx_filter_fn *filter_cb, Dbus
 void dbusx_thread_stop(DbusX_t *dbusx_req);
 void dbusx_thread_close(DbusX_t *dbusx_req);
 
+#ifdef UTIL_EX_UV
+int dbusx_uv_init(dbusx_match_fn *match_cb, dbusx_filter_fn *filter_cb, DbusX_t *dbusx_req, uv_loop_t *loop);
+void dbusx_uv_close(DbusX_t *dbusx_req);
+#endif
+
 #endif
 
 
@@ -3917,7 +4898,7 @@ yuarel_param_t *query_parser(char *query, QueryParam_t *q_params_req);
 
 #define LEN_OF_WEBSOCKET LEN_OF_BUF_2MB
 #define LEN_OF_LWS (LWS_SEND_BUFFER_PRE_PADDING + LEN_OF_WEBSOCKET + LWS_SEND_BUFFER_POST_PADDING)
-#define MAX_OF_RING 8
+#define MAX_OF_RING 8 // queued messages of a session
 #define MAX_OF_SESSION 8
 
 #define LWS_SUB_PROTOCOL_HTTP "http"
@@ -3937,14 +4918,49 @@ typedef enum
 	LWS_WSI_ID_MAX,
 } LWS_WSI_ID;
 
+// what to do when the ring of a session is full
+typedef enum
+{
+	LWS_SLOW_ID_DROP_OLDEST,
+	LWS_SLOW_ID_COALESCE, // the newest queued message is replaced
+	LWS_SLOW_ID_DISCONNECT,
+	LWS_SLOW_ID_MAX,
+} LWS_SLOW_ID;
+
+// refcounted message, shared by all the sessions of a broadcast
 typedef struct LWSMsg_Struct
 {
-	void* next;
+	int ref;
 
-	char *payload;
+	char *payload; // LWS_SEND_BUFFER_PRE_PADDING + payload_len + 1
 	int payload_len;
+	int wp; // LWS_WRITE_TEXT or LWS_WRITE_BINARY
+
+	char data[];
 } LWSMsg_t;
 
+typedef struct LWSQStat_Struct
+{
+	int depth;
+	int max_depth;
+	unsigned long pushes;
+	unsigned long drops;
+	unsigned long coalesces;
+	unsigned long writes; // calls of lws_write
+	unsigned long merges; // messages sent inside another one's frame
+} LWSQStat_t;
+
+#ifdef UTIL_EX_METRICX
+typedef struct LWSMetric_Struct
+{
+	MetricX_t *sessions;
+	MetricX_t *pushes;
+	MetricX_t *drops;
+	MetricX_t *coalesces;
+	MetricX_t *writes;
+} LWSMetric_t;
+#endif
+
 typedef struct LWSSession_Struct
 {
 	void* next;
@@ -3952,7 +4968,17 @@ typedef struct LWSSession_Struct
 	int use_foreign_loops;
 	struct lws *wsi;
 	//pthread_mutex_t in_mtx;
-	CLIST_STRUCT(msg_list);
+
+	LWSMsg_t **ring;
+	int ring_size;
+	int ring_head;
+	int isclose; // LWS_SLOW_ID_DISCONNECT
+	int iswake; // lws_callback_on_writable was called and not served yet
+
+	LWSMsg_t *frag_msg; // the message being sent in fragments
+	int frag_pos;
+
+	LWSQStat_t q_stat;
 } LWSSession_t;
 
 typedef struct LWSX_Struct
@@ -3981,11 +5007,19 @@ typedef struct LWSX_Struct
 	lws_callback_function *callback;
 
 	CLIST_STRUCT(session_list);
+	int max_ring; // 0: MAX_OF_RING
+	LWS_SLOW_ID slow_id;
+	int coalesce_size; // 0: off, queued text messages are joined with '\n' up to coalesce_size bytes
+	int max_frame; // 0: off, larger payloads are sent with LWS_WRITE_CONTINUATION
 
 	char tx[LEN_OF_LWS];
 	int tx_size;
 	char rx[LEN_OF_LWS];
 	int rx_size;
+
+#ifdef UTIL_EX_METRICX
+	LWSMetric_t metric; // labels: name="lws_req->name", the sum of q_stat of the sessions
+#endif
 } LWSX_t;
 
 #define SAFE_LWS_MEMCPY(dst, src, count, maxcount) \
@@ -4020,9 +5054,18 @@ void lws2_session_lock(LWSSession_t *session);
 void lws2_session_unlock(LWSSession_t *session);
 void lws2_session_pop(LWSX_t *lws_req, LWSSession_t *session);
 
-void lws2_session_write(LWSSession_t *session);
+LWSMsg_t *lws2_msg_new(char *payload, int payload_len);
+LWSMsg_t *lws2_msg_new_ex(char *payload, int payload_len, int wp);
+LWSMsg_t *lws2_msg_ref(LWSMsg_t *msg);
+void lws2_msg_unref(LWSMsg_t *msg);
+
+int lws2_session_write(LWSSession_t *session);
+void lws2_session_write_q_msg(LWSSession_t *session, LWSMsg_t *msg);
 void lws2_session_write_q_push(LWSSession_t *session, char *payload, int payload_len);
+void lws2_session_write_q_push_ex(LWSSession_t *session, char *payload, int payload_len, int wp);
 void lws2_session_write_q_broadcast(LWSX_t *lws_req, char *payload, int payload_len);
+void lws2_session_write_q_broadcast_ex(LWSX_t *lws_req, char *payload, int payload_len, int wp);
+void lws2_session_stat(LWSSession_t *session, LWSQStat_t *q_stat);
 int lws2_session_count(LWSX_t *lws_req);
 
 void lws2_lock(LWSX_t *lws_req);
@@ -4050,6 +5093,11 @@ void lws2_thread_init(LWSX_t *lws_req);
 #define LEN_OF_CLIENT_ID LEN_OF_VAL32
 #define MAX_OF_QPUB     30
 #define MAX_OF_QSUB     30
+#define MAX_OF_QPUB_BATCH 10 // items per pop of qpub
+#define MAX_OF_INFLIGHT 20 // QoS1/2 messages waiting for the ack
+#define MAX_OF_EARLY_ACK 8 // acks which came back before mosquitto_publish returned the mid
+#define TIMEOUT_OF_INFLIGHT 5000 // ms, how long a message waits for a free slot of the window before it is dropped
+#define MQTT_ACK_HIST_BUCKETS 24 // log2(us), [0]: < 1us, [n]: < 2^n us, the last: others
 
 // methodid/c_macid/c_uuid/c_nodeid/epid/issue
 #define MQTT_TOPIC_SUB_ROOT_MASK "%s%s+/#"
@@ -4077,8 +5125,70 @@ typedef struct MQTTSub_Struct
 
 	char topic[LEN_OF_TOPIC];
 	mqtt_message_fn *message_cb;
+
+	struct MQTTSub_Struct *trie_next; // MQTTTrie_t->sub_head
 } MQTTSub_t;
 
+// topic trie, one node per level of the subscriptions
+#define MQTT_TRIE_HASH_SIZE 8 // initial buckets of the children
+
+typedef struct MQTTTrie_Struct
+{
+	struct MQTTTrie_Struct *sibling; // the same bucket of the parent
+
+	char *level;
+	int level_len;
+	unsigned int hash;
+
+	struct MQTTTrie_Struct **child_ary; // hash buckets
+	int child_size;
+	int child_count;
+
+	struct MQTTTrie_Struct *plus; // "+"
+	struct MQTTTrie_Struct *sharp; // "#"
+
+	MQTTSub_t *sub_head; // subscriptions which end here
+} MQTTTrie_t;
+
+typedef struct MQTTEarlyAck_Struct
+{
+	int mid;
+	unsigned long send_seq; // the last mosquitto_publish which had started
+} MQTTEarlyAck_t;
+
+typedef struct MQTTInflight_Struct
+{
+	int mid; // 0: not accepted by mosquitto, publish again after reconnect
+	int issending; // mosquitto_publish is running without the lock
+	unsigned long send_seq; // the early acks recorded before this send can't be its ack
+	struct MQTTMsg_Struct *mqtt_msg; // keeps one reference until the ack
+	unsigned long long t_send; // us
+} MQTTInflight_t;
+
+typedef struct MQTTPubStat_Struct
+{
+	int inflight;
+	int max_inflight;
+	unsigned long pub_count; // handed to mosquitto
+	unsigned long ack_count;
+	unsigned long retry_count;
+	unsigned long drops; // qpub is full, the window stayed full, publish failed or never acked
+	unsigned long ack_hist[MQTT_ACK_HIST_BUCKETS];
+} MQTTPubStat_t;
+
+#ifdef UTIL_EX_METRICX
+typedef struct MQTTMetric_Struct
+{
+	MetricX_t *pubs;
+	MetricX_t *acks;
+	MetricX_t *retries;
+	MetricX_t *drops;
+	MetricX_t *recvs;
+	MetricX_t *inflight;
+	MetricX_t *ack_us;
+} MQTTMetric_t;
+#endif
+
 typedef struct MQTTSession_Struct
 {
 	void *mqtt_req;
@@ -4108,7 +5218,19 @@ typedef struct MQTTSession_Struct
 	QueueX_t *qpub;
 	QueueX_t *qsub;
 
+	int max_inflight; // 0: MAX_OF_INFLIGHT
+	int inflight_wait; // ms, 0: TIMEOUT_OF_INFLIGHT
+	MQTTEarlyAck_t early_ack[MAX_OF_EARLY_ACK]; // ring, protected by the lock of qpub
+	int early_idx;
+	unsigned long send_seq; // protected by the lock of qpub
+	MQTTInflight_t *inflight_ary; // protected by the lock of qpub
+	MQTTPubStat_t pub_stat;
+#ifdef UTIL_EX_METRICX
+	MQTTMetric_t metric; // labels: broker="hostname:port",client="clientid"
+#endif
+
 	CLIST_STRUCT(sub_list);
+	MQTTTrie_t *sub_trie;
 
 	mqtt_log_fn *log_cb;
 	mqtt_connect_fn *connect_cb;
@@ -4124,12 +5246,31 @@ typedef struct MQTTSession_Struct
 
 typedef void mqtt_topic_fn(MQTTSession_t *session, char *topic, char *msg);
 
+// refcounted message, topic and payload are kept in the same allocation
+typedef struct MQTTMsg_Struct
+{
+	int ref;
+
+	char *topic;
+	void *payload; // payload[payloadlen] is always '\0'
+	int payloadlen;
+	int qos;
+	int retain;
+
+	char data[];
+} MQTTMsg_t;
+
+typedef void mqtt_msg_fn(MQTTSession_t *session, MQTTMsg_t *mqtt_msg);
+
 typedef struct MQTTTopic_Struct
 {
 	MQTTSession_t *session;
-	char *topic;
-	char *msg;
+	char *topic; // mqtt_msg->topic
+	char *msg; // mqtt_msg->payload
 	mqtt_topic_fn *topic_cb;
+
+	MQTTMsg_t *mqtt_msg; // the queue keeps one reference
+	mqtt_msg_fn *msg_cb;
 } MQTTTopic_t;
 
 typedef struct MQTTX_Struct
@@ -4148,13 +5289,22 @@ typedef struct MQTTX_Struct
 int mqtt_session_isconnect(MQTTX_t *mqtt_req);
 MQTTSession_t *mqtt_session_get(MQTTX_t *mqtt_req);
 
+MQTTMsg_t *mqtt_msg_new(char *topic, void *payload, int payloadlen, int qos, int retain);
+MQTTMsg_t *mqtt_msg_ref(MQTTMsg_t *mqtt_msg);
+void mqtt_msg_unref(MQTTMsg_t *mqtt_msg);
+
 int mqtt_publish(MQTTSession_t *session, char *topic, char *msg);
+int mqtt_publish_ex(MQTTSession_t *session, char *topic, void *payload, int payloadlen, int qos, int retain);
+int mqtt_publish_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg);
 
 void mqtt_subscribe_add(MQTTSession_t *session, char *topic, mqtt_message_fn *message_cb);
 
 void mqtt_qsub_add(MQTTSession_t *session, char *topic, char *msg, mqtt_topic_fn *topic_cb);
 void mqtt_qpub_add(MQTTSession_t *session, char *topic, char *msg, mqtt_topic_fn *topic_cb);
+void mqtt_qsub_add_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg, mqtt_msg_fn *msg_cb);
+void mqtt_qpub_add_msg(MQTTSession_t *session, MQTTMsg_t *mqtt_msg);
 void mqtt_queue_wakeup(MQTTSession_t *session);
+void mqtt_pub_stat(MQTTSession_t *session, MQTTPubStat_t *pub_stat);
 void mqtt_queue_gosleep(MQTTSession_t *session);
 
 void mqtt_srv_subscribe(MQTTSession_t *session);
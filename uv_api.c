@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_UV
 #include "utilx9.h"
 
 void on_uv_close(uv_handle_t *handle)
@@ -121,10 +122,9 @@ static void uv_spawn_pipe_stdout_cb(uv_stream_t *stream, ssize_t nread, const uv
 	}
 
 	// OK to free buffer as write_data copies it.
-	if (buf->base)
-	{
-		free(buf->base);
-	}
+	// SAFE_MALLOC in uv_alloc_ex_cb
+	char *base = buf->base;
+	SAFE_FREE(base);
 }
 
 void uv_spawn_close_ex(SpawnX_t *spawn_req)
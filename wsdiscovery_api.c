@@ -12,6 +12,7 @@
  * KIND, either express or implied.
  *
  ***************************************************************************/
+#define DBG_MOD DBG_MOD_ID_ONVIF
 #include "utilx9.h"
 
 #define DBG_TMP_Y(format,args...) //DBG_LN_Y(format, ## args)
@@ -294,48 +295,79 @@ static char *wsdiscovery_xml(SOAP_ACTION_ID act_id)
 	}
 }
 
-static void wsdiscovery_uuid_gen(ChainX_t *chainX_req, soap_node_t *request_node)
+static void wsdiscovery_uuid_gen(ChainX_t *chainX_req)
 {
-	//ChainX_t *chainX_req = wsd_req->chainX_req;
-	//SoapX_t *soap = wsd_req->soap;
+	if (chainX_req)
+	{
+		os_random_uuid(chainX_req->session, sizeof(chainX_req->session));
+		DBG_TR_LN("(messageid: uuid:%s)", chainX_req->session);
+	}
+}
+
+// the Probe envelopes are compiled once, only MessageID is rendered per message
+static SoapTmpl_t *wsd_tmpl_ary[SOAP_ACTION_ID_MAX];
+static pthread_mutex_t wsd_tmpl_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+// please lock wsd_tmpl_mtx, isalloc: 0: the buffer is kept until the next call, 1: please free
+static char *wsdiscovery_render(ChainX_t *chainX_req, SOAP_ACTION_ID act_id, int *buffer_len, int isalloc)
+{
+	char *buffer = NULL;
+
+	if ((act_id < 0) || (act_id >= SOAP_ACTION_ID_MAX))
+	{
+		return NULL;
+	}
+	if (wsd_tmpl_ary[act_id] == NULL)
+	{
+		wsd_tmpl_ary[act_id] = soap_tmpl_compile(wsdiscovery_xml(act_id));
+	}
 
-	if ((chainX_req) && (request_node))
+	SoapTmpl_t *tmpl = wsd_tmpl_ary[act_id];
+	if ((tmpl) && (tmpl->xml_len > 0))
 	{
-		soap_node_t *MessageID_node = soap_element_fetch(request_node, NULL, "MessageID", NULL, NULL);
-		if (MessageID_node)
+		const char *value_ary[MAX_OF_SOAP_SLOT] = { NULL };
+		int slot = soap_tmpl_slot(tmpl, "WSD_XML_MESSAGEID");
+		if (slot >= 0)
 		{
-			os_random_uuid(chainX_req->session, sizeof(chainX_req->session));
-			char *messageid = NULL;
-			SAFE_ASPRINTF(messageid, "uuid:%s", chainX_req->session);
-			if (messageid)
-			{
-				DBG_TR_LN("(messageid: %s)", messageid);
-				soap_element_text_set(MessageID_node, 0, messageid);
-				SAFE_FREE(messageid);
-			}
+			wsdiscovery_uuid_gen(chainX_req);
+			value_ary[slot] = chainX_req->session;
+		}
+		if (isalloc)
+		{
+			buffer = soap_tmpl_render_alloc(tmpl, value_ary, buffer_len);
+		}
+		else
+		{
+			buffer = soap_tmpl_render(tmpl, value_ary, buffer_len);
 		}
 	}
+	return buffer;
+}
+
+static void wsdiscovery_tmpl_free(void)
+{
+	SAFE_THREAD_LOCK(&wsd_tmpl_mtx);
+	int idx = 0;
+	for (idx = 0; idx < SOAP_ACTION_ID_MAX; idx++)
+	{
+		soap_tmpl_free(wsd_tmpl_ary[idx]);
+		wsd_tmpl_ary[idx] = NULL;
+	}
+	SAFE_THREAD_UNLOCK(&wsd_tmpl_mtx);
 }
 
 void wsdiscovery_sender(WSDiscoveryX_t *wsd_req, SOAP_ACTION_ID act_id)
 {
 	if (wsd_req)
 	{
-		soap_node_t *request_node = soap_load_string(wsdiscovery_xml(act_id));
-		if (request_node)
+		SAFE_THREAD_LOCK(&wsd_tmpl_mtx);
+		int buffer_len = 0;
+		char *buffer = wsdiscovery_render(wsd_req->chainX_req, act_id, &buffer_len, 0);
+		if ((buffer) && (buffer_len > 0))
 		{
-			wsdiscovery_uuid_gen(wsd_req->chainX_req, request_node);
-
-			int buffer_len = 0;
-			char *buffer = soap_element_2string(request_node);
-			if ((buffer) && (buffer_len = strlen(buffer)))
-			{
-				chainX_multi_sender(wsd_req->chainX_req, buffer, buffer_len);
-				SAFE_FREE(buffer);
-			}
-
-			soap_element_delete(request_node);
+			chainX_multi_sender(wsd_req->chainX_req, buffer, buffer_len);
 		}
+		SAFE_THREAD_UNLOCK(&wsd_tmpl_mtx);
 	}
 }
 
@@ -363,22 +395,18 @@ void wsdiscovery_probe(chainX_post_fn cb)
 		chainX_port_set(&chainXms, WS_DISCOVERY_PORT);
 		chainX_post_register(&chainXms, cb);
 
-		soap_node_t *request_node = soap_load_string(wsdiscovery_xml(SOAP_ACTION_ID_PROBE_DEVICE));
-		if (request_node)
+		// chainX_multi_sender_and_post waits for the replies, so the envelope is not kept inside the template
+		int buffer_len = 0;
+		SAFE_THREAD_LOCK(&wsd_tmpl_mtx);
+		char *buffer = wsdiscovery_render(&chainXms, SOAP_ACTION_ID_PROBE_DEVICE, &buffer_len, 1);
+		SAFE_THREAD_UNLOCK(&wsd_tmpl_mtx);
+
+		if ((buffer) && (buffer_len > 0))
 		{
-			{
-				wsdiscovery_uuid_gen(&chainXms, request_node);
-			}
-			int buffer_len = 0;
-			char *buffer = soap_element_2string(request_node);
-			if ((buffer) && (buffer_len = strlen(buffer)))
-			{
-				DBG_TMP_Y("%s", buffer);
-				chainX_multi_sender_and_post(&chainXms, buffer, buffer_len);
-				SAFE_FREE(buffer);
-			}
-			soap_element_delete(request_node);
+			DBG_TMP_Y("%s", buffer);
+			chainX_multi_sender_and_post(&chainXms, buffer, buffer_len);
 		}
+		SAFE_FREE(buffer);
 	}
 }
 
@@ -414,6 +442,7 @@ void wsdiscovery_close(void)
 		wsdiscovery_free(wsd_req);
 		wsd_info = NULL;
 	}
+	wsdiscovery_tmpl_free();
 }
 
 static WSDiscoveryX_t *wsdiscovery_init(void)